@@ -0,0 +1,79 @@
+#pragma once
+#include "element.h"
+#include "framework.h"
+#include "platform.h"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace lvt {
+
+// Raw attributes of one window, as returned by GetClassName, GetWindowText,
+// GetWindowRect, GetWindowLong(GWL_STYLE) and IsWindowVisible/Enabled.
+struct WindowInfo {
+    Symbol className;
+    std::string text;
+    Bounds rect;
+    uint32_t style = 0;
+    bool visible = false;
+    bool enabled = false;
+};
+
+// One item read back from a common control (list view row, tree view root,
+// toolbar button, status bar part or tab).
+struct ComCtlItem {
+    enum State : uint32_t {
+        kSelected = 1,
+        kExpanded = 2,
+        kHasChildren = 4,
+        kChecked = 8,
+        kDisabled = 16,
+        kSeparator = 32,
+    };
+
+    std::string text;
+    int32_t commandId = 0;  // toolbar buttons only
+    uint32_t state = 0;     // State bits
+};
+
+// A common control's replies to the messages ComCtlProvider sends it. Which
+// fields are meaningful depends on the control's window class.
+struct ComCtlReply {
+    int32_t count = 0;                   // items, buttons, parts or tabs
+    uint32_t viewMode = 0;               // list view LV_VIEW_*
+    std::optional<int32_t> columnCount;  // list view header columns, if it has a header
+    int32_t selected = -1;               // tab control TCM_GETCURSEL
+    std::vector<ComCtlItem> items;       // empty if the control's process could not be read
+};
+
+// Everything the providers read from outside lvt. build_tree() asks a source
+// for raw inputs and does all tree construction, grafting and labeling itself,
+// so the same pipeline runs against a live desktop (LiveSource), while
+// capturing one (RecordingSource) or from a recording (ReplayProvider).
+class CaptureSource {
+public:
+    virtual ~CaptureSource() = default;
+
+    // Attributes of `hwnd`.
+    virtual WindowInfo window(HWND hwnd) = 0;
+
+    // Direct children of `hwnd`, in z-order.
+    virtual std::vector<HWND> children(HWND hwnd) = 0;
+
+    // Replies of the common control `hwnd` (of window class `className`).
+    // Returns false if the control could not be queried.
+    virtual bool comctl(HWND hwnd, Symbol className, ComCtlReply& reply) = 0;
+
+    // JSON tree collected by the TAP DLL (Xaml, WinUI3) or the WPF walker for
+    // the UI hosted by `host` in process `pid`. Empty if nothing was collected.
+    virtual std::string tap_payload(Framework framework, HWND host, DWORD pid) = 0;
+
+    // JSON returned by the enrich() of the plugin that detected `name`, for
+    // the part of the window below `scope` (the whole window if nullptr).
+    // Empty if the plugin is not loaded or returned nothing.
+    virtual std::string plugin_payload(const std::string& name, HWND hwnd, DWORD pid,
+                                       HWND scope) = 0;
+};
+
+} // namespace lvt
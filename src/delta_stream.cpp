@@ -0,0 +1,39 @@
+#include "delta_stream.h"
+#include "json_serializer.h"
+#include "tree_diff.h"
+#include <string>
+
+namespace lvt {
+
+void DeltaStream::begin_line(const char* member) {
+    m_out.write("{\"seq\":");
+    m_out.write(std::to_string(m_seq));
+    m_out.write(",\"");
+    m_out.write(member);
+    m_out.write("\":");
+}
+
+bool DeltaStream::push(TreeDocument doc) {
+    if (m_seq == 0) {
+        begin_line("tree");
+        write_json(m_out, doc.tree, doc.tree.root(), doc.hwnd, doc.pid, doc.processName, doc.frameworks,
+                   false, true);
+        m_out.write("}\n");
+    } else {
+        TreeDiff diff = diff_trees(m_current.tree, doc.tree);
+        if (diff.empty() && doc.hwnd == m_current.hwnd && doc.pid == m_current.pid &&
+            doc.processName == m_current.processName && doc.frameworks == m_current.frameworks) {
+            m_current = std::move(doc);
+            return false;
+        }
+        begin_line("patch");
+        write_json_patch(m_out, m_current, doc, diff, true);
+        m_out.write("}\n");
+    }
+    m_out.flush();
+    m_current = std::move(doc);
+    m_seq++;
+    return true;
+}
+
+} // namespace lvt
@@ -0,0 +1,38 @@
+#pragma once
+#include "json_reader.h"
+#include "output_sink.h"
+#include <cstdint>
+
+namespace lvt {
+
+// Successive captures of one target as NDJSON, for --watch. The first
+// capture is written in full, each later one as a JSON Patch against the one
+// before, and one that did not change not at all:
+//   {"seq":0,"tree":{"frameworks":[...],"root":{...},"target":{...}}}
+//   {"seq":1,"patch":[{"op":"replace","path":"/root/children/3/text",...}]}
+// "tree" is write_json's document without whitespace; applying every patch
+// in order to it gives write_json's document for the latest capture. Lines
+// are flushed as they are written.
+class DeltaStream {
+public:
+    explicit DeltaStream(OutputSink& out) : m_out(out) {}
+
+    // Write what changed since the last capture. Needs subtree hashes (see
+    // diff_trees). Returns whether a line was written.
+    bool push(TreeDocument doc);
+
+    // The last capture pushed, e.g. to carry its IDs over to the next one.
+    const TreeDocument& current() const { return m_current; }
+
+    // Lines written so far.
+    uint64_t lines() const { return m_seq; }
+
+private:
+    void begin_line(const char* member);
+
+    OutputSink& m_out;
+    TreeDocument m_current;
+    uint64_t m_seq = 0;
+};
+
+} // namespace lvt
@@ -0,0 +1,276 @@
+#include "element.h"
+#include "element_index.h"
+#include "hash.h"
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <utility>
+#include <variant>
+
+namespace lvt {
+
+ElementTree::~ElementTree() {
+    clear();
+}
+
+ElementTree::ElementTree(const ElementTree& other) {
+    *this = other;
+}
+
+ElementTree& ElementTree::operator=(const ElementTree& other) {
+    if (this == &other) return *this;
+    clear();
+    for (size_t i = 0; i < other.m_count; i++) {
+        NodeId n = allocate(Element(other[static_cast<NodeId>(i)]));
+        links(n) = other.links(n);
+    }
+    return *this;
+}
+
+ElementTree::ElementTree(ElementTree&& other) noexcept
+    : m_blocks(std::move(other.m_blocks))
+    , m_count(std::exchange(other.m_count, 0)) {
+    other.m_blocks.clear();
+}
+
+ElementTree& ElementTree::operator=(ElementTree&& other) noexcept {
+    if (this == &other) return *this;
+    clear();
+    m_blocks = std::move(other.m_blocks);
+    m_count = std::exchange(other.m_count, 0);
+    other.m_blocks.clear();
+    return *this;
+}
+
+void ElementTree::clear() {
+    for (size_t i = 0; i < m_count; i++) {
+        element_at(static_cast<NodeId>(i)).~Element();
+    }
+    m_blocks.clear();
+    m_count = 0;
+}
+
+NodeId ElementTree::allocate(Element&& el) {
+    size_t slot = m_count & kBlockMask;
+    if (slot == 0) {
+        // Default-init leaves element storage raw; Links are set by their initializers.
+        m_blocks.push_back(std::unique_ptr<Block>(new Block));
+    }
+    auto* base = reinterpret_cast<Element*>(m_blocks.back()->storage);
+    new (base + slot) Element(std::move(el));
+    return static_cast<NodeId>(m_count++);
+}
+
+NodeId ElementTree::add_root(Element el) {
+    if (m_count) return kNoNode;
+    return allocate(std::move(el));
+}
+
+NodeId ElementTree::append_child(NodeId parent, Element el) {
+    NodeId node = allocate(std::move(el));
+    auto& pl = links(parent);
+    links(node).parent = parent;
+    if (pl.lastChild == kNoNode) {
+        pl.firstChild = node;
+    } else {
+        links(pl.lastChild).nextSibling = node;
+    }
+    pl.lastChild = node;
+    pl.childCount++;
+    return node;
+}
+
+NodeId ElementTree::append_subtree(NodeId parent, const ElementTree& src, NodeId srcNode) {
+    NodeId top = (parent == kNoNode) ? add_root(src[srcNode]) : append_child(parent, src[srcNode]);
+    if (top == kNoNode) return kNoNode;
+
+    std::vector<std::pair<NodeId, NodeId>> stack{{srcNode, top}};
+    while (!stack.empty()) {
+        auto [from, to] = stack.back();
+        stack.pop_back();
+        for (NodeId c : src.children(from)) {
+            stack.push_back({c, append_child(to, src[c])});
+        }
+    }
+    return top;
+}
+
+void ElementTree::clear_children(NodeId node) {
+    auto& l = links(node);
+    l.firstChild = kNoNode;
+    l.lastChild = kNoNode;
+    l.childCount = 0;
+}
+
+NodeId ElementTree::child_at(NodeId node, size_t index) const {
+    NodeId c = first_child(node);
+    while (c != kNoNode && index--) c = next_sibling(c);
+    return c;
+}
+
+namespace {
+
+// Subtree hashes, built in one depth-first walk: a node's own fields are
+// hashed on the way down, and on the way up its finished hash is folded into
+// its parent's, so children go in in order. Symbols repeat across most of a
+// tree, so each distinct one is hashed once.
+class SubtreeHasher {
+public:
+    template <class Enter>
+    void walk(ElementTree& tree, Enter&& enter) {
+        NodeId root = tree.root();
+        if (root == kNoNode) return;
+        NodeId n = root;
+        for (;;) {
+            enter(n);
+            tree[n].hash = own(tree[n]);
+            if (tree.has_children(n)) {
+                n = tree.first_child(n);
+                continue;
+            }
+            for (;;) {
+                Element& el = tree[n];
+                el.hash = hash::avalanche(el.hash);
+                if (n == root) return;
+                Element& parent = tree[tree.parent(n)];
+                parent.hash = hash::fold(parent.hash ^ hash::kSecret[2], el.hash ^ hash::kSecret[3]);
+                NodeId sibling = tree.next_sibling(n);
+                if (sibling != kNoNode) {
+                    n = sibling;
+                    break;
+                }
+                n = tree.parent(n);
+            }
+        }
+    }
+
+private:
+    uint64_t symbol(Symbol s) {
+        if (s.id() >= m_symbols.size()) m_symbols.resize(s.id() + 1);
+        uint64_t& slot = m_symbols[s.id()];
+        if (!slot) slot = hash::bytes(s.view()) | 1;
+        return slot;
+    }
+
+    static uint64_t value(const PropertyValue& v) {
+        return std::visit([](const auto& x) -> uint64_t {
+            using T = std::decay_t<decltype(x)>;
+            if constexpr (std::is_same_v<T, std::string>) {
+                return hash::bytes(x);
+            } else if constexpr (std::is_same_v<T, Bounds>) {
+                int32_t r[4] = {x.x, x.y, x.width, x.height};
+                return hash::bytes(r, sizeof(r));
+            } else if constexpr (std::is_same_v<T, HandleValue>) {
+                return x.value;
+            } else if constexpr (std::is_same_v<T, double>) {
+                return std::bit_cast<uint64_t>(x);
+            } else {
+                return static_cast<uint64_t>(x);
+            }
+        }, v.storage()) + v.storage().index() * hash::kPrime1;
+    }
+
+    uint64_t own(const Element& el) {
+        using hash::fold;
+        using hash::kSecret;
+        auto pack = [](int a, int b) {
+            return uint64_t{static_cast<uint32_t>(a)} | (uint64_t{static_cast<uint32_t>(b)} << 32);
+        };
+        uint64_t h = fold(symbol(el.type) ^ kSecret[0], symbol(el.framework) ^ kSecret[1]);
+        h = fold(h ^ symbol(el.className), hash::bytes(el.text) ^ kSecret[4]);
+        h = fold(h ^ pack(el.bounds.x, el.bounds.y), pack(el.bounds.width, el.bounds.height) ^ kSecret[5]);
+        h = fold(h ^ el.nativeHandle, el.properties.size() ^ kSecret[6]);
+        for (auto& [k, v] : el.properties) h = fold(h ^ symbol(k), value(v) ^ kSecret[7]);
+        return h;
+    }
+
+    std::vector<uint64_t> m_symbols;
+};
+
+} // namespace
+
+void hash_subtrees(ElementTree& tree) {
+    SubtreeHasher().walk(tree, [](NodeId) {});
+}
+
+void assign_element_ids(ElementTree& tree, ElementIndex* index, uintptr_t target) {
+    // A segment's prefix is "e" for the target's and "w<handle>." for any
+    // other window's; `next` numbers the rest of the segment.
+    struct Segment {
+        std::string prefix;
+        uint64_t next;
+    };
+    std::vector<Segment> segments;
+    std::vector<uint32_t> segmentOf(tree.size());
+
+    NodeId root = tree.root();
+    SubtreeHasher().walk(tree, [&](NodeId n) {
+        Element& el = tree[n];
+        if (n == root && (!target || !el.nativeHandle || el.nativeHandle == target)) {
+            segments.push_back({"e", 1});
+            segmentOf[n] = 0;
+            el.id = "e0";
+        } else if (el.nativeHandle) {
+            char buf[24];
+            auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), uint64_t{el.nativeHandle}, 16);
+            std::string prefix = "w";
+            for (const char* c = buf; c != end; c++) prefix += static_cast<char>(toupper(*c));
+            el.id = prefix;
+            prefix += '.';
+            segmentOf[n] = static_cast<uint32_t>(segments.size());
+            segments.push_back({std::move(prefix), 1});
+        } else {
+            Segment& seg = segments[segmentOf[tree.parent(n)]];
+            segmentOf[n] = segmentOf[tree.parent(n)];
+            el.id = seg.prefix + std::to_string(seg.next++);
+        }
+    });
+    if (index) {
+        index->sync(tree);
+        index->reindex_ids(tree);
+    }
+}
+
+bool parse_element_id(std::string_view id, ElementIdAnchor& out) {
+    auto number = [](std::string_view text, int base, uint64_t& value) {
+        auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+        return !text.empty() && ec == std::errc() && end == text.data() + text.size();
+    };
+    uint64_t value = 0;
+    if (id.starts_with('e')) {
+        if (!number(id.substr(1), 10, value)) return false;
+        out = {0, value == 0};
+        return true;
+    }
+    if (!id.starts_with('w')) return false;
+    std::string_view handle = id.substr(1, id.find('.') - 1);
+    uint64_t window = 0;
+    if (handle.find_first_of("abcdef") != std::string_view::npos) return false;
+    if (!number(handle, 16, window) || window == 0) return false;
+    if (handle.size() + 1 < id.size() && !number(id.substr(handle.size() + 2), 10, value))
+        return false;
+    out = {static_cast<uintptr_t>(window), handle.size() + 1 == id.size()};
+    return true;
+}
+
+void trim_to_depth(ElementTree& tree, NodeId node, int maxDepth) {
+    if (maxDepth < 0 || node == kNoNode) return;
+    std::vector<std::pair<NodeId, int>> stack{{node, 0}};
+    bool cut = false;
+    while (!stack.empty()) {
+        auto [n, depth] = stack.back();
+        stack.pop_back();
+        if (depth >= maxDepth) {
+            cut |= tree.has_children(n);
+            tree.clear_children(n);
+            continue;
+        }
+        for (NodeId c : tree.children(n)) {
+            stack.push_back({c, depth + 1});
+        }
+    }
+    // The hashes above the cut covered what it removed.
+    if (cut) hash_subtrees(tree);
+}
+
+} // namespace lvt
@@ -1,30 +1,204 @@
 #pragma once
+#include "property_list.h"
+#include "symbol.h"
 #include <string>
+#include <string_view>
 #include <vector>
-#include <map>
+#include <memory>
 #include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <new>
 
 namespace lvt {
 
-struct Bounds {
-    int x = 0;
-    int y = 0;
-    int width = 0;
-    int height = 0;
-};
+// Index of a node within an ElementTree.
+using NodeId = uint32_t;
+inline constexpr NodeId kNoNode = UINT32_MAX;
 
+// Per-node payload. Structure (parent/children) lives in the owning ElementTree.
 struct Element {
     std::string id;
-    std::string type;
-    std::string framework;
-    std::string className;
+    // Interned: these repeat across most of the tree.
+    Symbol type;
+    Symbol framework;
+    Symbol className;
     std::string text;
     Bounds bounds;
-    std::map<std::string, std::string> properties;
-    std::vector<Element> children;
+    PropertyList properties;
 
     // Opaque handle for provider use (e.g. HWND value)
     uintptr_t nativeHandle = 0;
+
+    // Merkle hash of this element's subtree, set by assign_element_ids and
+    // hash_subtrees: every field but `id`, then each child's hash in order.
+    // Equal hashes mean equal subtrees wherever they sit in the tree.
+    uint64_t hash = 0;
+};
+
+// Flat element tree. Nodes are allocated from fixed-size arena blocks, so
+// Element references and NodeIds stay valid while the tree grows; structure is
+// stored as parent / first-child / next-sibling indices rather than nested vectors.
+class ElementTree {
+public:
+    class ChildIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = NodeId;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const NodeId*;
+        using reference = NodeId;
+
+        ChildIterator() = default;
+        ChildIterator(const ElementTree* tree, NodeId node) : m_tree(tree), m_node(node) {}
+        NodeId operator*() const { return m_node; }
+        ChildIterator& operator++() { m_node = m_tree->next_sibling(m_node); return *this; }
+        ChildIterator operator++(int) { auto old = *this; ++*this; return old; }
+        bool operator==(const ChildIterator& o) const { return m_node == o.m_node; }
+
+    private:
+        const ElementTree* m_tree = nullptr;
+        NodeId m_node = kNoNode;
+    };
+
+    struct ChildRange {
+        ChildIterator first;
+        ChildIterator last;
+        ChildIterator begin() const { return first; }
+        ChildIterator end() const { return last; }
+    };
+
+    ElementTree() = default;
+    ~ElementTree();
+    ElementTree(const ElementTree& other);
+    ElementTree& operator=(const ElementTree& other);
+    ElementTree(ElementTree&& other) noexcept;
+    ElementTree& operator=(ElementTree&& other) noexcept;
+
+    // Number of allocated nodes (including any detached by clear_children).
+    size_t size() const { return m_count; }
+    bool empty() const { return m_count == 0; }
+
+    // The root is always the first node allocated.
+    NodeId root() const { return m_count ? 0 : kNoNode; }
+
+    // Create the root node. The tree must be empty.
+    NodeId add_root(Element el = {});
+
+    // Append a new last child under `parent` and return its id.
+    NodeId append_child(NodeId parent, Element el = {});
+
+    // Deep-copy the subtree at `srcNode` of `src` as the last child of `parent`
+    // (or as the root when `parent` is kNoNode and this tree is empty).
+    NodeId append_subtree(NodeId parent, const ElementTree& src, NodeId srcNode);
+
+    // Detach all children of `node`. Detached nodes stay allocated but are no
+    // longer reachable from the root.
+    void clear_children(NodeId node);
+
+    void clear();
+
+    Element& operator[](NodeId node) { return element_at(node); }
+    const Element& operator[](NodeId node) const { return const_cast<ElementTree*>(this)->element_at(node); }
+
+    NodeId parent(NodeId node) const { return links(node).parent; }
+    NodeId first_child(NodeId node) const { return links(node).firstChild; }
+    NodeId last_child(NodeId node) const { return links(node).lastChild; }
+    NodeId next_sibling(NodeId node) const { return links(node).nextSibling; }
+    size_t child_count(NodeId node) const { return links(node).childCount; }
+    bool has_children(NodeId node) const { return links(node).firstChild != kNoNode; }
+
+    ChildRange children(NodeId node) const {
+        return {ChildIterator(this, first_child(node)), ChildIterator(this, kNoNode)};
+    }
+
+    // True if `node` is `scope` or one of its descendants. Linear in depth.
+    bool in_subtree(NodeId node, NodeId scope) const {
+        for (; node != kNoNode; node = parent(node)) {
+            if (node == scope) return true;
+        }
+        return false;
+    }
+
+    // The index-th child of `node`, or kNoNode. Linear in `index`.
+    NodeId child_at(NodeId node, size_t index) const;
+
+    // Next node in depth-first pre-order within the subtree rooted at `scope`,
+    // or kNoNode once the subtree is exhausted.
+    NodeId next_preorder(NodeId node, NodeId scope) const {
+        if (first_child(node) != kNoNode) return first_child(node);
+        while (node != scope) {
+            if (next_sibling(node) != kNoNode) return next_sibling(node);
+            node = parent(node);
+        }
+        return kNoNode;
+    }
+
+private:
+    struct Links {
+        NodeId parent = kNoNode;
+        NodeId firstChild = kNoNode;
+        NodeId lastChild = kNoNode;
+        NodeId nextSibling = kNoNode;
+        uint32_t childCount = 0;
+    };
+
+    static constexpr unsigned kBlockShift = 8;
+    static constexpr size_t kBlockSize = size_t{1} << kBlockShift;
+    static constexpr size_t kBlockMask = kBlockSize - 1;
+
+    // Elements are constructed in place on allocation; links are plain data.
+    struct Block {
+        alignas(Element) unsigned char storage[kBlockSize * sizeof(Element)];
+        Links links[kBlockSize];
+    };
+
+    Element& element_at(NodeId node) {
+        auto* base = std::launder(reinterpret_cast<Element*>(m_blocks[node >> kBlockShift]->storage));
+        return base[node & kBlockMask];
+    }
+    Links& links(NodeId node) { return m_blocks[node >> kBlockShift]->links[node & kBlockMask]; }
+    const Links& links(NodeId node) const { return m_blocks[node >> kBlockShift]->links[node & kBlockMask]; }
+
+    NodeId allocate(Element&& el);
+
+    std::vector<std::unique_ptr<Block>> m_blocks;
+    size_t m_count = 0;
+};
+
+class ElementIndex;
+
+// Assign deterministic element IDs that do not depend on how much of the tree
+// was built. Every window (element with a nativeHandle) starts a segment: the
+// window and the elements below it, down to but not including the next
+// windows. The segment of the target window, `target` (the root when
+// `target` is 0), is numbered e0, e1, ... in depth-first order. Any other
+// window is "w" and its handle in upper-case hex ("w1A2B"), and the rest of its segment
+// "w1A2B.1", "w1A2B.2", .... So an element keeps its ID in any build that
+// includes its window and everything grafted into that window, however
+// little else was built. Subtree hashes are computed in the same walk. When
+// `index` is given it is synced and its ID table rebuilt.
+void assign_element_ids(ElementTree& tree, ElementIndex* index = nullptr, uintptr_t target = 0);
+
+// Recompute Element::hash for every node reachable from the root, for trees
+// that did not come through assign_element_ids (which does this in the same
+// pass) or that changed since.
+void hash_subtrees(ElementTree& tree);
+
+// Where an element ID from assign_element_ids puts its element: in the
+// segment of `window` (0 for the target window's "e" segment), and whether
+// it is that window itself.
+struct ElementIdAnchor {
+    uintptr_t window = 0;
+    bool isWindow = false;
 };
 
+// Parse an element ID. Returns false if `id` is not of the forms above; a
+// handle in lower-case hex is rejected, as no element would match it.
+bool parse_element_id(std::string_view id, ElementIdAnchor& out);
+
+// Trim the subtree at `node` to a maximum depth (0 = node only, 1 = node + children, etc.)
+// Subtree hashes are recomputed when anything is cut.
+void trim_to_depth(ElementTree& tree, NodeId node, int maxDepth);
+
 } // namespace lvt
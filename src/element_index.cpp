@@ -0,0 +1,78 @@
+#include "element_index.h"
+#include <variant>
+
+namespace lvt {
+
+std::optional<uint64_t> ElementIndex::parse_handle(std::string_view text) {
+    if (text.size() >= 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X'))
+        text.remove_prefix(2);
+    if (text.empty() || text.size() > 16) return std::nullopt;
+    uint64_t v = 0;
+    for (char c : text) {
+        unsigned d;
+        if (c >= '0' && c <= '9') d = c - '0';
+        else if (c >= 'a' && c <= 'f') d = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') d = c - 'A' + 10;
+        else return std::nullopt;
+        v = (v << 4) | d;
+    }
+    return v;
+}
+
+void ElementIndex::index_handles(const ElementTree& tree, NodeId node) {
+    const Element& el = tree[node];
+    if (el.nativeHandle) m_handles.emplace(static_cast<uint64_t>(el.nativeHandle), node);
+
+    const PropertyValue* hwnd = el.properties.find(prop::kHwnd);
+    if (!hwnd) return;
+    const auto& v = hwnd->storage();
+    if (auto* h = std::get_if<HandleValue>(&v)) {
+        m_handles.emplace(h->value, node);
+    } else if (auto* s = std::get_if<std::string>(&v)) {
+        if (auto parsed = parse_handle(*s)) m_handles.emplace(*parsed, node);
+        else m_unparsedHwnds.emplace(*s, node);
+    }
+}
+
+void ElementIndex::sync(const ElementTree& tree) {
+    for (size_t i = m_synced; i < tree.size(); i++) {
+        NodeId n = static_cast<NodeId>(i);
+        if (!tree[n].id.empty()) m_ids.emplace(tree[n].id, n);
+        index_handles(tree, n);
+    }
+    m_synced = tree.size();
+}
+
+void ElementIndex::reindex_ids(const ElementTree& tree) {
+    m_ids.clear();
+    m_ids.reserve(tree.size());
+    for (size_t i = 0; i < m_synced && i < tree.size(); i++) {
+        NodeId n = static_cast<NodeId>(i);
+        if (!tree[n].id.empty()) m_ids.emplace(tree[n].id, n);
+    }
+}
+
+void ElementIndex::clear() {
+    m_synced = 0;
+    m_ids.clear();
+    m_handles.clear();
+    m_unparsedHwnds.clear();
+}
+
+NodeId ElementIndex::find_by_id(std::string_view id) const {
+    auto it = m_ids.find(id);
+    return it != m_ids.end() ? it->second : kNoNode;
+}
+
+NodeId ElementIndex::find_by_handle(uint64_t handle) const {
+    auto it = m_handles.find(handle);
+    return it != m_handles.end() ? it->second : kNoNode;
+}
+
+NodeId ElementIndex::find_by_hwnd(std::string_view hwnd) const {
+    if (auto parsed = parse_handle(hwnd)) return find_by_handle(*parsed);
+    auto it = m_unparsedHwnds.find(std::string(hwnd));
+    return it != m_unparsedHwnds.end() ? it->second : kNoNode;
+}
+
+} // namespace lvt
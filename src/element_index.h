@@ -0,0 +1,57 @@
+#pragma once
+#include "element.h"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace lvt {
+
+// Lookup tables over an ElementTree: element ID -> node and native handle
+// (nativeHandle or the "hwnd" property) -> node. Parent links come from the
+// tree itself.
+//
+// The index follows the tree's allocation order, so keeping it current after
+// appending nodes (e.g. grafting a plugin subtree) is a call to sync(), which
+// only visits the new nodes. When several nodes share a handle the earliest
+// allocated one wins. Nodes detached by clear_children stay indexed.
+class ElementIndex {
+public:
+    ElementIndex() = default;
+    explicit ElementIndex(const ElementTree& tree) { sync(tree); }
+
+    // Index nodes appended to `tree` since the previous sync (all of them on
+    // the first call). Calling it with a different tree is not supported.
+    void sync(const ElementTree& tree);
+
+    // Rebuild the ID table after IDs were (re)assigned; see assign_element_ids.
+    void reindex_ids(const ElementTree& tree);
+
+    void clear();
+
+    NodeId find_by_id(std::string_view id) const;
+    NodeId find_by_handle(uint64_t handle) const;
+
+    // Look up by the text form of an HWND ("0x0000000000123ABC", "0x123abc").
+    // Text that does not parse as hex is matched verbatim against "hwnd"
+    // properties that did not parse either.
+    NodeId find_by_hwnd(std::string_view hwnd) const;
+
+    size_t indexed_count() const { return m_synced; }
+
+    // Parse "0x"-prefixed (or bare) hex. Returns nullopt unless the whole
+    // string is hex digits.
+    static std::optional<uint64_t> parse_handle(std::string_view text);
+
+private:
+    void index_handles(const ElementTree& tree, NodeId node);
+
+    size_t m_synced = 0;
+    // Keys view Element::id strings owned by the tree; see reindex_ids.
+    std::unordered_map<std::string_view, NodeId> m_ids;
+    std::unordered_map<uint64_t, NodeId> m_handles;
+    std::unordered_map<std::string, NodeId> m_unparsedHwnds;
+};
+
+} // namespace lvt
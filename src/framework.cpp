@@ -0,0 +1,33 @@
+#include "framework.h"
+
+namespace lvt {
+
+std::string framework_to_string(Framework f) {
+    switch (f) {
+    case Framework::Win32:  return "win32";
+    case Framework::ComCtl: return "comctl";
+    case Framework::Xaml:   return "xaml";
+    case Framework::WinUI3: return "winui3";
+    case Framework::Wpf:    return "wpf";
+    case Framework::Plugin: return "plugin";
+    }
+    return "unknown";
+}
+
+bool framework_from_string(std::string_view s, Framework& f) {
+    for (Framework candidate : {Framework::Win32, Framework::ComCtl, Framework::Xaml,
+                                Framework::WinUI3, Framework::Wpf, Framework::Plugin}) {
+        if (s == framework_to_string(candidate)) {
+            f = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string framework_display_name(const FrameworkInfo& fi) {
+    if (!fi.name.empty()) return fi.name;
+    return framework_to_string(fi.type);
+}
+
+} // namespace lvt
@@ -0,0 +1,30 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+namespace lvt {
+
+enum class Framework {
+    Win32,
+    ComCtl,
+    Xaml,
+    WinUI3,
+    Wpf,
+    Plugin,  // Plugin-provided framework (name in FrameworkInfo::name)
+};
+
+struct FrameworkInfo {
+    Framework type;
+    std::string version; // e.g. "3.1.7.2602" for WinUI3, "6.10" for comctl
+    std::string name;    // Plugin-provided name (empty for built-in frameworks)
+};
+
+std::string framework_to_string(Framework f);
+
+// Inverse of framework_to_string. Returns false for unknown names.
+bool framework_from_string(std::string_view s, Framework& f);
+
+// Returns the display name for a FrameworkInfo (uses name field if set).
+std::string framework_display_name(const FrameworkInfo& fi);
+
+} // namespace lvt
@@ -1,35 +1,15 @@
 #include "framework_detector.h"
-#include "plugin_loader.h"
-#include <wil/resource.h>
-#include <Psapi.h>
-
-#pragma comment(lib, "version.lib")
+#include <string>
+#include <string_view>
 
 namespace lvt {
 
-std::string framework_to_string(Framework f) {
-    switch (f) {
-    case Framework::Win32:  return "win32";
-    case Framework::ComCtl: return "comctl";
-    case Framework::Xaml:   return "xaml";
-    case Framework::WinUI3: return "winui3";
-    case Framework::Wpf:    return "wpf";
-    case Framework::Plugin: return "plugin";
-    }
-    return "unknown";
-}
-
-std::string framework_display_name(const FrameworkInfo& fi) {
-    if (!fi.name.empty()) return fi.name;
-    return framework_to_string(fi.type);
-}
-
-static const wchar_t* comctl_classes[] = {
-    L"SysListView32", L"SysTreeView32", L"SysTabControl32",
-    L"msctls_statusbar32", L"ToolbarWindow32", L"msctls_trackbar32",
-    L"SysHeader32", L"msctls_progress32", L"SysAnimate32",
-    L"SysDateTimePick32", L"SysMonthCal32", L"ReBarWindow32",
-    L"tooltips_class32", L"SysPager", L"SysLink",
+static constexpr std::string_view comctl_classes[] = {
+    "SysListView32", "SysTreeView32", "SysTabControl32",
+    "msctls_statusbar32", "ToolbarWindow32", "msctls_trackbar32",
+    "SysHeader32", "msctls_progress32", "SysAnimate32",
+    "SysDateTimePick32", "SysMonthCal32", "ReBarWindow32",
+    "tooltips_class32", "SysPager", "SysLink",
 };
 
 struct DetectData {
@@ -39,81 +19,27 @@ struct DetectData {
     bool hasWpf = false;
 };
 
-static BOOL CALLBACK detect_child_proc(HWND hwnd, LPARAM lParam) {
-    auto* data = reinterpret_cast<DetectData*>(lParam);
-    wchar_t cls[256]{};
-    GetClassNameW(hwnd, cls, 256);
-
-    for (auto* cc : comctl_classes) {
-        if (_wcsicmp(cls, cc) == 0) {
-            data->hasComCtl = true;
+static void detect_child(std::string_view cls, DetectData& data) {
+    for (auto cc : comctl_classes) {
+        if (iequals(cls, cc)) {
+            data.hasComCtl = true;
             break;
         }
     }
 
-    if (wcsstr(cls, L"Microsoft.UI.Content.DesktopChildSiteBridge") ||
-        wcsstr(cls, L"Microsoft.UI.") ||
-        _wcsicmp(cls, L"WinUIDesktopWin32WindowClass") == 0 ||
-        _wcsicmp(cls, L"InputNonClientPointerSource") == 0) {
-        data->hasWinUI3 = true;
+    if (cls.find("Microsoft.UI.") != std::string_view::npos ||
+        iequals(cls, "WinUIDesktopWin32WindowClass") ||
+        iequals(cls, "InputNonClientPointerSource")) {
+        data.hasWinUI3 = true;
     }
 
-    if (_wcsicmp(cls, L"Windows.UI.Core.CoreWindow") == 0) {
-        data->hasXaml = true;
+    if (iequals(cls, "Windows.UI.Core.CoreWindow")) {
+        data.hasXaml = true;
     }
 
-    if (wcsstr(cls, L"HwndWrapper[")) {
-        data->hasWpf = true;
-    }
-
-    return TRUE;
-}
-
-// Get the full path of a module loaded in a remote process.
-static std::wstring get_module_path(HANDLE proc, const wchar_t* moduleName) {
-    HMODULE modules[1024];
-    DWORD needed = 0;
-    if (!EnumProcessModulesEx(proc, modules, sizeof(modules), &needed, LIST_MODULES_ALL))
-        return {};
-
-    for (DWORD i = 0; i < needed / sizeof(HMODULE); i++) {
-        wchar_t name[MAX_PATH]{};
-        if (GetModuleBaseNameW(proc, modules[i], name, MAX_PATH)) {
-            if (_wcsicmp(name, moduleName) == 0) {
-                wchar_t fullPath[MAX_PATH]{};
-                if (GetModuleFileNameExW(proc, modules[i], fullPath, MAX_PATH))
-                    return fullPath;
-                return {};
-            }
-        }
+    if (cls.find("HwndWrapper[") != std::string_view::npos) {
+        data.hasWpf = true;
     }
-    return {};
-}
-
-// Extract version string from a DLL path.
-// useFileVersion=true reads dwFileVersion (e.g. "6.10" for comctl32),
-// useFileVersion=false reads dwProductVersion (e.g. "10.0.26568.5001" for system DLLs).
-static std::string get_file_version(const std::wstring& path, bool useFileVersion = false) {
-    if (path.empty()) return {};
-    DWORD verHandle = 0;
-    DWORD verSize = GetFileVersionInfoSizeW(path.c_str(), &verHandle);
-    if (verSize == 0) return {};
-
-    std::vector<BYTE> verData(verSize);
-    if (!GetFileVersionInfoW(path.c_str(), verHandle, verSize, verData.data()))
-        return {};
-
-    VS_FIXEDFILEINFO* fileInfo = nullptr;
-    UINT len = 0;
-    if (!VerQueryValueW(verData.data(), L"\\", reinterpret_cast<void**>(&fileInfo), &len))
-        return {};
-
-    DWORD ms = useFileVersion ? fileInfo->dwFileVersionMS : fileInfo->dwProductVersionMS;
-    DWORD ls = useFileVersion ? fileInfo->dwFileVersionLS : fileInfo->dwProductVersionLS;
-    char buf[64];
-    snprintf(buf, sizeof(buf), "%d.%d.%d.%d",
-             HIWORD(ms), LOWORD(ms), HIWORD(ls), LOWORD(ls));
-    return buf;
 }
 
 struct ModuleDetection {
@@ -121,34 +47,31 @@ struct ModuleDetection {
     std::string version;
 };
 
-static ModuleDetection detect_module(DWORD pid, const wchar_t* moduleName, bool useFileVersion = false) {
-    wil::unique_handle proc(OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, pid));
-    if (!proc) return {};
-
-    auto path = get_module_path(proc.get(), moduleName);
-    if (path.empty()) return {};
-
-    return {true, get_file_version(path, useFileVersion)};
+static ModuleDetection detect_module(IWindowSystem& ws, DWORD pid, std::string_view moduleName,
+                                     bool useFileVersion = false) {
+    ModuleDetection det;
+    det.found = ws.module_version(pid, moduleName, useFileVersion, det.version);
+    return det;
 }
 
-std::vector<FrameworkInfo> detect_frameworks(HWND hwnd, DWORD pid) {
+std::vector<FrameworkInfo> detect_frameworks(IWindowSystem& ws, HWND hwnd, DWORD pid) {
     std::vector<FrameworkInfo> result;
     result.push_back({Framework::Win32, {}});
 
     DetectData data;
     if (hwnd) {
         // Check the top-level window class too (WPF apps use HwndWrapper as the main window)
-        wchar_t topCls[256]{};
-        GetClassNameW(hwnd, topCls, 256);
-        if (wcsstr(topCls, L"HwndWrapper[")) {
+        if (ws.class_name(hwnd).view().find("HwndWrapper[") != std::string_view::npos) {
             data.hasWpf = true;
         }
 
-        EnumChildWindows(hwnd, detect_child_proc, reinterpret_cast<LPARAM>(&data));
+        for (HWND child : ws.descendants(hwnd)) {
+            detect_child(ws.class_name(child).view(), data);
+        }
         if (data.hasComCtl) {
             std::string comctlVer;
             if (pid) {
-                auto det = detect_module(pid, L"comctl32.dll", true);
+                auto det = detect_module(ws, pid, "comctl32.dll", true);
                 if (det.found) {
                     // Truncate to major.minor (e.g. "6.10")
                     auto& v = det.version;
@@ -169,21 +92,21 @@ std::vector<FrameworkInfo> detect_frameworks(HWND hwnd, DWORD pid) {
     bool detectedXaml = false;
     bool detectedWpf = false;
     if (pid) {
-        auto winui = detect_module(pid, L"Microsoft.UI.Xaml.dll");
+        auto winui = detect_module(ws, pid, "Microsoft.UI.Xaml.dll");
         if (winui.found) {
             result.push_back({Framework::WinUI3, winui.version});
             detectedWinUI3 = true;
         }
-        auto xaml = detect_module(pid, L"Windows.UI.Xaml.dll");
+        auto xaml = detect_module(ws, pid, "Windows.UI.Xaml.dll");
         if (xaml.found) {
             result.push_back({Framework::Xaml, xaml.version});
             detectedXaml = true;
         }
-        auto wpf = detect_module(pid, L"PresentationFramework.dll");
+        auto wpf = detect_module(ws, pid, "PresentationFramework.dll");
         if (!wpf.found)
-            wpf = detect_module(pid, L"wpfgfx_cor3.dll");
+            wpf = detect_module(ws, pid, "wpfgfx_cor3.dll");
         if (!wpf.found)
-            wpf = detect_module(pid, L"wpfgfx_v0400.dll");
+            wpf = detect_module(ws, pid, "wpfgfx_v0400.dll");
         if (wpf.found) {
             result.push_back({Framework::Wpf, wpf.version});
             detectedWpf = true;
@@ -198,12 +121,6 @@ std::vector<FrameworkInfo> detect_frameworks(HWND hwnd, DWORD pid) {
     if (!detectedWpf && data.hasWpf)
         result.push_back({Framework::Wpf, {}});
 
-    // Plugin-provided framework detection
-    auto pluginFws = detect_plugin_frameworks(hwnd, pid);
-    for (auto& pf : pluginFws) {
-        result.push_back({Framework::Plugin, pf.version, pf.name});
-    }
-
     return result;
 }
 
@@ -0,0 +1,113 @@
+#pragma once
+// 64-bit hashing in the style of XXH3: inputs are folded 16 bytes at a time
+// through a 64x64->128-bit multiply (low half xor high half) against fixed
+// secrets, with branch-light special cases for short inputs, which is what
+// element fields mostly are. Each stripe's multiply is independent of the
+// others until the final sum, so long strings keep several in flight.
+// Header-only, like text_scan.h. Results are the same on every platform and
+// in every process, so they can be stored in snapshots and compared later.
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace lvt::hash {
+
+static_assert(std::endian::native == std::endian::little, "hash reads little-endian words");
+
+inline constexpr uint64_t kSecret[8] = {
+    0xBE4BA423396CFEB8ull, 0x1CAD21F72C81017Cull, 0xDB979083E96DD4DEull, 0x1F67B3B7A4A44072ull,
+    0x78E5C0CC4EE679CBull, 0x2172FFCC7DD05A82ull, 0x8E2443F7744608B8ull, 0x4C263A81E69035E0ull,
+};
+inline constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+inline constexpr uint64_t kPrime2 = 0x165667919E3779F9ull;
+
+inline uint64_t read64(const unsigned char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t read32(const unsigned char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Low and high halves of a * b, xored.
+inline uint64_t fold(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 r = static_cast<unsigned __int128>(a) * b;
+    return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    uint64_t hi;
+    uint64_t lo = _umul128(a, b, &hi);
+    return lo ^ hi;
+#elif defined(_MSC_VER) && defined(_M_ARM64)
+    return (a * b) ^ __umulh(a, b);
+#else
+    uint64_t aLo = a & 0xFFFFFFFF, aHi = a >> 32, bLo = b & 0xFFFFFFFF, bHi = b >> 32;
+    uint64_t ll = aLo * bLo, lh = aLo * bHi, hl = aHi * bLo, hh = aHi * bHi;
+    uint64_t mid = (ll >> 32) + (lh & 0xFFFFFFFF) + hl;
+    uint64_t lo = (mid << 32) | (ll & 0xFFFFFFFF);
+    uint64_t hi = hh + (lh >> 32) + (mid >> 32);
+    return lo ^ hi;
+#endif
+}
+
+inline uint64_t avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= kPrime2;
+    return h ^ (h >> 32);
+}
+
+// Combine two 64-bit values, order-sensitively.
+inline uint64_t combine(uint64_t a, uint64_t b) {
+    return fold(a ^ kSecret[0], b ^ kSecret[1]);
+}
+
+inline uint64_t bytes(const void* data, size_t len, uint64_t seed = 0) {
+    auto* p = static_cast<const unsigned char*>(data);
+    uint64_t acc = seed ^ (len * kPrime1);
+    if (len <= 16) {
+        if (len > 8) {
+            uint64_t lo = read64(p) ^ (kSecret[2] + seed);
+            uint64_t hi = read64(p + len - 8) ^ (kSecret[3] - seed);
+            return avalanche(acc + fold(lo, hi));
+        }
+        if (len >= 4) {
+            uint64_t v = read32(p) | (uint64_t{read32(p + len - 4)} << 32);
+            return avalanche(acc + fold(v ^ kSecret[4], acc ^ kSecret[5]));
+        }
+        if (len > 0) {
+            uint64_t v = (uint64_t{p[0]} << 16) | (uint64_t{p[len >> 1]} << 8) | p[len - 1];
+            return avalanche(acc + fold(v ^ kSecret[6], acc ^ kSecret[7]));
+        }
+        return avalanche(acc ^ kSecret[0]);
+    }
+    // Full stripes cycle through the four secret pairs, offset by position so
+    // that reordering blocks changes the result. The last 16 bytes are folded
+    // again (possibly overlapping) so every length is covered.
+    uint64_t lanes[4] = {acc, 0, 0, 0};
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        for (int s = 0; s < 4; s++) {
+            const unsigned char* q = p + i + 16 * s;
+            lanes[s] += fold(read64(q) ^ (kSecret[2 * s] + seed + i), read64(q + 8) ^ (kSecret[2 * s + 1] - seed));
+        }
+    }
+    for (int s = 0; i + 16 <= len; i += 16, s++)
+        lanes[s] += fold(read64(p + i) ^ (kSecret[2 * s] + seed + i), read64(p + i + 8) ^ (kSecret[2 * s + 1] - seed));
+    lanes[3] += fold(read64(p + len - 16) ^ (kSecret[6] - seed), read64(p + len - 8) ^ (kSecret[7] + seed));
+    return avalanche(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+}
+
+inline uint64_t bytes(std::string_view s, uint64_t seed = 0) { return bytes(s.data(), s.size(), seed); }
+
+} // namespace lvt::hash
@@ -0,0 +1,397 @@
+#include "image.h"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+namespace lvt {
+
+// ---- Annotation ----
+
+namespace {
+
+// 5x7 glyphs, one byte per row, bit 4 leftmost. Covers what element IDs are
+// made of, window handles in upper-case hex included; anything else draws as
+// an empty box.
+struct Glyph {
+    char c;
+    uint8_t rows[7];
+};
+
+constexpr Glyph kGlyphs[] = {
+    {'0', {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}}, {'1', {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E}},
+    {'2', {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F}}, {'3', {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E}},
+    {'4', {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}}, {'5', {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E}},
+    {'6', {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E}}, {'7', {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}},
+    {'8', {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E}}, {'9', {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C}},
+    {'A', {0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}}, {'B', {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E}},
+    {'C', {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E}}, {'D', {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C}},
+    {'E', {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F}}, {'F', {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10}},
+    {'a', {0x00, 0x00, 0x0E, 0x01, 0x0F, 0x11, 0x0F}}, {'b', {0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1E}},
+    {'c', {0x00, 0x00, 0x0E, 0x10, 0x10, 0x11, 0x0E}}, {'d', {0x01, 0x01, 0x0D, 0x13, 0x11, 0x11, 0x0F}},
+    {'e', {0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E}}, {'f', {0x06, 0x09, 0x08, 0x1C, 0x08, 0x08, 0x08}},
+    {'g', {0x00, 0x0F, 0x11, 0x11, 0x0F, 0x01, 0x0E}}, {'h', {0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11}},
+    {'i', {0x04, 0x00, 0x0C, 0x04, 0x04, 0x04, 0x0E}}, {'j', {0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0C}},
+    {'k', {0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12}}, {'l', {0x0C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E}},
+    {'m', {0x00, 0x00, 0x1A, 0x15, 0x15, 0x11, 0x11}}, {'n', {0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11}},
+    {'o', {0x00, 0x00, 0x0E, 0x11, 0x11, 0x11, 0x0E}}, {'p', {0x00, 0x00, 0x1E, 0x11, 0x1E, 0x10, 0x10}},
+    {'q', {0x00, 0x00, 0x0D, 0x13, 0x0F, 0x01, 0x01}}, {'r', {0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10}},
+    {'s', {0x00, 0x00, 0x0E, 0x10, 0x0E, 0x01, 0x1E}}, {'t', {0x08, 0x08, 0x1C, 0x08, 0x08, 0x09, 0x06}},
+    {'u', {0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0D}}, {'v', {0x00, 0x00, 0x11, 0x11, 0x11, 0x0A, 0x04}},
+    {'w', {0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0A}}, {'x', {0x00, 0x00, 0x11, 0x0A, 0x04, 0x0A, 0x11}},
+    {'y', {0x00, 0x00, 0x11, 0x11, 0x0F, 0x01, 0x0E}}, {'z', {0x00, 0x00, 0x1F, 0x02, 0x04, 0x08, 0x1F}},
+    {'-', {0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00}}, {'_', {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F}},
+    {'.', {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C}}, {':', {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00}},
+    {'/', {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00}},
+};
+constexpr uint8_t kUnknownGlyph[7] = {0x1F, 0x11, 0x11, 0x11, 0x11, 0x11, 0x1F};
+constexpr int kGlyphWidth = 5;
+constexpr int kGlyphHeight = 7;
+constexpr int kGlyphAdvance = 6;
+constexpr int kLabelPadding = 2;
+
+const uint8_t* glyph_rows(char c) {
+    for (const Glyph& g : kGlyphs)
+        if (g.c == c) return g.rows;
+    return kUnknownGlyph;
+}
+
+void put(uint8_t* p, uint32_t bgra) {
+    p[0] = static_cast<uint8_t>(bgra);
+    p[1] = static_cast<uint8_t>(bgra >> 8);
+    p[2] = static_cast<uint8_t>(bgra >> 16);
+    p[3] = static_cast<uint8_t>(bgra >> 24);
+}
+
+// Fill [x0, x1) x [y0, y1), clipped to the image.
+void fill(Image& image, int x0, int y0, int x1, int y1, uint32_t bgra) {
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, image.width);
+    y1 = std::min(y1, image.height);
+    for (int y = y0; y < y1; y++)
+        for (int x = x0; x < x1; x++) put(image.pixel(x, y), bgra);
+}
+
+void draw_label(Image& image, int x, int y, std::string_view text) {
+    int w = static_cast<int>(text.size()) * kGlyphAdvance - 1 + 2 * kLabelPadding;
+    int h = kGlyphHeight + 2 * kLabelPadding;
+    int top = y - h;
+    if (top < 0) top = y;
+    fill(image, x, top, x + w, top + h, kLabelBackground);
+
+    int gx = x + kLabelPadding;
+    int gy = top + kLabelPadding;
+    for (char c : text) {
+        const uint8_t* rows = glyph_rows(c);
+        for (int r = 0; r < kGlyphHeight; r++) {
+            for (int col = 0; col < kGlyphWidth; col++) {
+                if (rows[r] & (0x10 >> col))
+                    fill(image, gx + col, gy + r, gx + col + 1, gy + r + 1, kAnnotationColor);
+            }
+        }
+        gx += kGlyphAdvance;
+    }
+}
+
+} // namespace
+
+void annotate_image(Image& image, const ElementTree& tree) {
+    if (image.empty()) return;
+    for (NodeId n = tree.root(); n != kNoNode; n = tree.next_preorder(n, tree.root())) {
+        const Element& el = tree[n];
+        if (el.bounds.width <= 0 || el.bounds.height <= 0) continue;
+        int x = el.bounds.x - image.originX;
+        int y = el.bounds.y - image.originY;
+        int w = el.bounds.width;
+        int h = el.bounds.height;
+        if (x + w <= 0 || y + h <= 0 || x >= image.width || y >= image.height) continue;
+
+        fill(image, x, y, x + w, y + 2, kAnnotationColor);
+        fill(image, x, y + h - 2, x + w, y + h, kAnnotationColor);
+        fill(image, x, y, x + 2, y + h, kAnnotationColor);
+        fill(image, x + w - 2, y, x + w, y + h, kAnnotationColor);
+        if (!el.id.empty()) draw_label(image, x, y, el.id);
+    }
+
+    // Captured frames may carry transparent pixels; the overlay and the
+    // encoded PNG should not.
+    for (size_t i = 3; i < image.pixels.size(); i += 4) image.pixels[i] = 255;
+}
+
+bool image_crop_rect(const Image& image, const Bounds& bounds, Bounds& out) {
+    int x0 = std::max(bounds.x - image.originX, 0);
+    int y0 = std::max(bounds.y - image.originY, 0);
+    int x1 = std::min(bounds.x - image.originX + bounds.width, image.width);
+    int y1 = std::min(bounds.y - image.originY + bounds.height, image.height);
+    if (x1 <= x0 || y1 <= y0) return false;
+    out = {x0, y0, x1 - x0, y1 - y0};
+    return true;
+}
+
+// ---- PNG encoding ----
+
+namespace {
+
+const std::array<uint32_t, 256>& crc_table() {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+    return table;
+}
+
+uint32_t crc32(uint32_t crc, std::string_view data) {
+    const auto& table = crc_table();
+    crc = ~crc;
+    for (unsigned char c : data) crc = table[(crc ^ c) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t adler32(std::string_view data) {
+    uint32_t a = 1, b = 0;
+    size_t i = 0;
+    while (i < data.size()) {
+        // 5552 is the most bytes that cannot overflow b before the modulo.
+        size_t end = std::min(data.size(), i + 5552);
+        for (; i < end; i++) {
+            a += static_cast<unsigned char>(data[i]);
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+void put_be32(std::string& out, uint32_t v) {
+    out.push_back(static_cast<char>(v >> 24));
+    out.push_back(static_cast<char>(v >> 16));
+    out.push_back(static_cast<char>(v >> 8));
+    out.push_back(static_cast<char>(v));
+}
+
+void write_chunk(OutputSink& out, const char type[4], std::string_view data) {
+    std::string header;
+    put_be32(header, static_cast<uint32_t>(data.size()));
+    header.append(type, 4);
+    out.write(header);
+    out.write(data);
+    std::string crc;
+    put_be32(crc, crc32(crc32(0, std::string_view(type, 4)), data));
+    out.write(crc);
+}
+
+// Deflate bit stream: fields are packed from the least significant bit.
+class BitWriter {
+public:
+    explicit BitWriter(std::string& out) : m_out(out) {}
+
+    void bits(uint32_t value, int count) {
+        m_acc |= static_cast<uint64_t>(value) << m_count;
+        m_count += count;
+        while (m_count >= 8) {
+            m_out.push_back(static_cast<char>(m_acc & 0xFF));
+            m_acc >>= 8;
+            m_count -= 8;
+        }
+    }
+
+    // Huffman codes are defined most significant bit first.
+    void code(uint32_t code, int length) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < length; i++) reversed |= ((code >> i) & 1) << (length - 1 - i);
+        bits(reversed, length);
+    }
+
+    void finish() {
+        if (m_count > 0) m_out.push_back(static_cast<char>(m_acc & 0xFF));
+        m_acc = 0;
+        m_count = 0;
+    }
+
+private:
+    std::string& m_out;
+    uint64_t m_acc = 0;
+    int m_count = 0;
+};
+
+// RFC 1951 3.2.6: the fixed literal/length code.
+void put_literal(BitWriter& w, uint32_t sym) {
+    if (sym < 144)
+        w.code(0x30 + sym, 8);
+    else if (sym < 256)
+        w.code(0x190 + sym - 144, 9);
+    else if (sym < 280)
+        w.code(sym - 256, 7);
+    else
+        w.code(0xC0 + sym - 280, 8);
+}
+
+constexpr uint16_t kLengthBase[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                      31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr uint8_t kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                      2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr uint16_t kDistBase[30] = {1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+                                    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+                                    1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+constexpr uint8_t kDistExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                    6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+void put_match(BitWriter& w, int length, int distance) {
+    int lc = static_cast<int>(std::upper_bound(std::begin(kLengthBase), std::end(kLengthBase), length) -
+                              std::begin(kLengthBase)) - 1;
+    put_literal(w, 257 + lc);
+    w.bits(length - kLengthBase[lc], kLengthExtra[lc]);
+    int dc = static_cast<int>(std::upper_bound(std::begin(kDistBase), std::end(kDistBase), distance) -
+                              std::begin(kDistBase)) - 1;
+    w.code(dc, 5);
+    w.bits(distance - kDistBase[dc], kDistExtra[dc]);
+}
+
+// One fixed-Huffman block with greedy LZ77 over a 32 KiB window. Screenshots
+// are dominated by flat runs and repeated rows, which this catches; a
+// dynamic-Huffman encoder would only shave off a little more.
+void deflate(std::string_view data, std::string& out) {
+    constexpr int kWindow = 1 << 15;
+    constexpr int kHashBits = 15;
+    constexpr int kMinMatch = 3;
+    constexpr int kMaxMatch = 258;
+    constexpr int kMaxChain = 16;
+
+    BitWriter w(out);
+    w.bits(1, 1);  // BFINAL
+    w.bits(1, 2);  // BTYPE = fixed Huffman
+
+    const auto* p = reinterpret_cast<const unsigned char*>(data.data());
+    const int n = static_cast<int>(data.size());
+    std::vector<int> head(size_t{1} << kHashBits, -1);
+    std::vector<int> prev(kWindow, -1);
+    auto hash = [p](int i) {
+        uint32_t v = p[i] | (p[i + 1] << 8) | (p[i + 2] << 16);
+        return (v * 2654435761u) >> (32 - kHashBits);
+    };
+    auto insert = [&](int i) {
+        uint32_t h = hash(i);
+        prev[i & (kWindow - 1)] = head[h];
+        head[h] = i;
+    };
+
+    int i = 0;
+    while (i < n) {
+        int bestLen = 0, bestDist = 0;
+        if (i + kMinMatch <= n) {
+            int limit = std::min(kMaxMatch, n - i);
+            int chain = kMaxChain;
+            for (int c = head[hash(i)]; c >= 0 && i - c <= kWindow && chain-- > 0;
+                 c = prev[c & (kWindow - 1)]) {
+                int len = 0;
+                while (len < limit && p[c + len] == p[i + len]) len++;
+                if (len > bestLen) {
+                    bestLen = len;
+                    bestDist = i - c;
+                    if (len == limit) break;
+                }
+            }
+        }
+        if (bestLen >= kMinMatch) {
+            put_match(w, bestLen, bestDist);
+            for (int k = 0; k < bestLen; k++, i++)
+                if (i + kMinMatch <= n) insert(i);
+        } else {
+            put_literal(w, p[i]);
+            if (i + kMinMatch <= n) insert(i);
+            i++;
+        }
+    }
+    put_literal(w, 256);  // end of block
+    w.finish();
+}
+
+// Sum of filtered bytes read as signed: the usual PNG filter heuristic.
+size_t filter_cost(const uint8_t* row, size_t size) {
+    size_t cost = 0;
+    for (size_t i = 0; i < size; i++) cost += static_cast<size_t>(std::abs(static_cast<int8_t>(row[i])));
+    return cost;
+}
+
+} // namespace
+
+void write_png(OutputSink& out, const Image& image, const Bounds* crop) {
+    Bounds r = crop ? *crop : Bounds{0, 0, image.width, image.height};
+    const size_t stride = static_cast<size_t>(r.width) * 4;
+
+    // Scanlines as RGBA, each with the cheapest of the None, Sub and Up filters.
+    std::string raw;
+    raw.reserve((stride + 1) * r.height);
+    std::vector<uint8_t> cur(stride), above(stride, 0), sub(stride), up(stride);
+    for (int y = 0; y < r.height; y++) {
+        const uint8_t* src = image.pixel(r.x, r.y + y);
+        for (size_t i = 0; i < stride; i += 4) {
+            cur[i] = src[i + 2];
+            cur[i + 1] = src[i + 1];
+            cur[i + 2] = src[i];
+            cur[i + 3] = src[i + 3];
+        }
+        for (size_t i = 0; i < stride; i++) {
+            sub[i] = static_cast<uint8_t>(cur[i] - (i >= 4 ? cur[i - 4] : 0));
+            up[i] = static_cast<uint8_t>(cur[i] - above[i]);
+        }
+        const uint8_t* best = cur.data();
+        char filter = 0;
+        size_t bestCost = filter_cost(cur.data(), stride);
+        if (size_t c = filter_cost(sub.data(), stride); c < bestCost) {
+            best = sub.data();
+            filter = 1;
+            bestCost = c;
+        }
+        if (size_t c = filter_cost(up.data(), stride); c < bestCost) {
+            best = up.data();
+            filter = 2;
+        }
+        raw.push_back(filter);
+        raw.append(reinterpret_cast<const char*>(best), stride);
+        std::swap(above, cur);
+    }
+
+    std::string idat;
+    idat.push_back(0x78);  // zlib: deflate, 32 KiB window
+    idat.push_back(0x01);  // no preset dictionary, fastest-level hint
+    deflate(raw, idat);
+    put_be32(idat, adler32(raw));
+
+    std::string ihdr;
+    put_be32(ihdr, static_cast<uint32_t>(r.width));
+    put_be32(ihdr, static_cast<uint32_t>(r.height));
+    ihdr += std::string_view("\x08\x06\x00\x00\x00", 5);  // 8-bit RGBA, deflate, adaptive, no interlace
+
+    out.write(std::string_view("\x89PNG\r\n\x1a\n", 8));
+    write_chunk(out, "IHDR", ihdr);
+    write_chunk(out, "IDAT", idat);
+    write_chunk(out, "IEND", {});
+}
+
+bool write_screenshot(OutputSink& out, Image frame, const ElementTree* tree, NodeId cropNode) {
+    if (frame.empty()) return false;
+    if (tree) annotate_image(frame, *tree);
+
+    Bounds crop;
+    const Bounds* cropPtr = nullptr;
+    if (tree && cropNode != kNoNode) {
+        const Bounds& b = (*tree)[cropNode].bounds;
+        if (b.width > 0 && b.height > 0) {
+            if (!image_crop_rect(frame, b, crop)) return false;
+            cropPtr = &crop;
+        }
+    }
+    write_png(out, frame, cropPtr);
+    return true;
+}
+
+} // namespace lvt
@@ -0,0 +1,50 @@
+#pragma once
+#include "element.h"
+#include "output_sink.h"
+#include <cstdint>
+#include <vector>
+
+namespace lvt {
+
+// A captured window frame: 32-bit BGRA pixels, top-down, rows packed with no
+// padding. `originX`/`originY` are the screen coordinates of the top-left
+// pixel (the window's visible frame when it was captured), which is how
+// element bounds map onto the image.
+struct Image {
+    int width = 0;
+    int height = 0;
+    int originX = 0;
+    int originY = 0;
+    std::vector<uint8_t> pixels;
+
+    bool empty() const { return width <= 0 || height <= 0; }
+    uint8_t* pixel(int x, int y) { return pixels.data() + (static_cast<size_t>(y) * width + x) * 4; }
+    const uint8_t* pixel(int x, int y) const {
+        return pixels.data() + (static_cast<size_t>(y) * width + x) * 4;
+    }
+};
+
+// Overlay colors, as BGRA.
+inline constexpr uint32_t kAnnotationColor = 0xFFFF3232;  // RGB(255, 50, 50)
+inline constexpr uint32_t kLabelBackground = 0xFFFFFFDC;  // RGB(255, 255, 220)
+
+// Draw a 2px box around every element of `tree` with a size, and its ID in a
+// label above the box (inside it when there is no room above). Elements
+// outside the image are skipped. Leaves every pixel fully opaque.
+void annotate_image(Image& image, const ElementTree& tree);
+
+// The part of `image` covered by `bounds` (screen coordinates), clipped to the
+// image, in image coordinates. Returns false if nothing of it is visible.
+bool image_crop_rect(const Image& image, const Bounds& bounds, Bounds& out);
+
+// Encode `image`, or the `crop` rectangle of it (image coordinates, already
+// clipped), as an 8-bit RGBA PNG.
+void write_png(OutputSink& out, const Image& image, const Bounds* crop = nullptr);
+
+// The screenshot pipeline after the frame is captured: annotate with `tree`
+// (if given), crop to `cropNode` (if a node of `tree`), encode as PNG.
+// Returns false if the crop leaves nothing to write.
+bool write_screenshot(OutputSink& out, Image frame, const ElementTree* tree,
+                      NodeId cropNode = kNoNode);
+
+} // namespace lvt
@@ -0,0 +1,320 @@
+#include "ipc.h"
+#include <algorithm>
+#include <atomic>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <sddl.h>
+#include <vector>
+#else
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace lvt {
+
+static bool fail(std::string* error, std::string message) {
+    if (error) *error = std::move(message);
+    return false;
+}
+
+bool IpcConnection::read_line(std::string& line) {
+    static constexpr size_t kChunk = 64 * 1024;
+    for (;;) {
+        size_t nl = m_buffer.find('\n', m_scanned);
+        if (nl != std::string::npos) {
+            size_t end = nl > m_start && m_buffer[nl - 1] == '\r' ? nl - 1 : nl;
+            line.assign(m_buffer, m_start, end - m_start);
+            m_start = m_scanned = nl + 1;
+            return true;
+        }
+        if (m_start) {
+            m_buffer.erase(0, m_start);
+            m_start = 0;
+        }
+        m_scanned = m_buffer.size();
+        m_buffer.resize(m_scanned + kChunk);
+        ptrdiff_t n = read_some(m_buffer.data() + m_scanned, kChunk);
+        m_buffer.resize(m_scanned + (n > 0 ? static_cast<size_t>(n) : 0));
+        if (n <= 0) return false;  // a last line without a newline is incomplete
+    }
+}
+
+#ifdef _WIN32
+
+namespace {
+
+std::wstring widen(const std::string& s) {
+    int n = MultiByteToWideChar(CP_UTF8, 0, s.data(), static_cast<int>(s.size()), nullptr, 0);
+    std::wstring w(n, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, s.data(), static_cast<int>(s.size()), w.data(), n);
+    return w;
+}
+
+class PipeConnection final : public IpcConnection {
+public:
+    PipeConnection(HANDLE pipe, bool server) : m_pipe(pipe), m_server(server) {}
+    ~PipeConnection() override {
+        if (m_server) DisconnectNamedPipe(m_pipe);
+        CloseHandle(m_pipe);
+    }
+
+    bool write(std::string_view data) override {
+        while (!data.empty()) {
+            DWORD written = 0;
+            DWORD size = static_cast<DWORD>(std::min<size_t>(data.size(), 1u << 20));
+            if (m_closed || !WriteFile(m_pipe, data.data(), size, &written, nullptr)) return false;
+            data.remove_prefix(written);
+        }
+        return true;
+    }
+
+    void close() override {
+        m_closed = true;
+        CancelIoEx(m_pipe, nullptr);
+    }
+
+protected:
+    ptrdiff_t read_some(char* data, size_t size) override {
+        DWORD read = 0;
+        if (m_closed || !ReadFile(m_pipe, data, static_cast<DWORD>(size), &read, nullptr))
+            return GetLastError() == ERROR_BROKEN_PIPE ? 0 : -1;
+        return read;
+    }
+
+private:
+    HANDLE m_pipe;
+    bool m_server;
+    std::atomic<bool> m_closed{false};
+};
+
+// A DACL that lets only this process's user open the pipe, as the socket's
+// 0600 does on other platforms. Free with LocalFree; null on failure.
+PSECURITY_DESCRIPTOR owner_only_descriptor() {
+    HANDLE token = nullptr;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token)) return nullptr;
+    DWORD size = 0;
+    GetTokenInformation(token, TokenUser, nullptr, 0, &size);
+    std::vector<BYTE> user(size);
+    bool ok = size && GetTokenInformation(token, TokenUser, user.data(), size, &size);
+    CloseHandle(token);
+    LPWSTR sid = nullptr;
+    if (!ok || !ConvertSidToStringSidW(reinterpret_cast<TOKEN_USER*>(user.data())->User.Sid, &sid)) return nullptr;
+    std::wstring sddl = L"D:P(A;;GA;;;" + std::wstring(sid) + L")";
+    LocalFree(sid);
+    PSECURITY_DESCRIPTOR sd = nullptr;
+    ConvertStringSecurityDescriptorToSecurityDescriptorW(sddl.c_str(), SDDL_REVISION_1, &sd, nullptr);
+    return sd;
+}
+
+HANDLE create_pipe(const std::wstring& name, bool first) {
+    SECURITY_ATTRIBUTES sa = {sizeof(sa), owner_only_descriptor(), FALSE};
+    if (!sa.lpSecurityDescriptor) return INVALID_HANDLE_VALUE;  // never fall back to the default DACL
+    HANDLE pipe = CreateNamedPipeW(name.c_str(), PIPE_ACCESS_DUPLEX | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+                                   PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                                   PIPE_UNLIMITED_INSTANCES, 64 * 1024, 64 * 1024, 0, &sa);
+    LocalFree(sa.lpSecurityDescriptor);
+    return pipe;
+}
+
+// Keeps one unconnected pipe instance waiting, so a client never finds the
+// name missing between two accepts.
+class PipeListener final : public IpcListener {
+public:
+    PipeListener(std::wstring name, HANDLE first) : m_name(std::move(name)), m_pending(first) {}
+    ~PipeListener() override {
+        if (m_pending != INVALID_HANDLE_VALUE) CloseHandle(m_pending);
+    }
+
+    std::unique_ptr<IpcConnection> accept() override {
+        if (m_closed || m_pending == INVALID_HANDLE_VALUE) return nullptr;
+        HANDLE pipe = m_pending;
+        bool connected = ConnectNamedPipe(pipe, nullptr) || GetLastError() == ERROR_PIPE_CONNECTED;
+        m_pending = m_closed ? INVALID_HANDLE_VALUE : create_pipe(m_name, false);
+        if (!connected || m_closed) {
+            CloseHandle(pipe);
+            return nullptr;
+        }
+        return std::make_unique<PipeConnection>(pipe, true);
+    }
+
+    void close() override {
+        if (m_closed.exchange(true)) return;
+        // ConnectNamedPipe only returns for a client: be one.
+        HANDLE wake = CreateFileW(m_name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0,
+                                  nullptr);
+        if (wake != INVALID_HANDLE_VALUE) CloseHandle(wake);
+    }
+
+private:
+    std::wstring m_name;
+    HANDLE m_pending;
+    std::atomic<bool> m_closed{false};
+};
+
+} // namespace
+
+std::string ipc_endpoint(const std::string& name) { return "\\\\.\\pipe\\" + name; }
+
+std::unique_ptr<IpcListener> ipc_listen(const std::string& name, std::string* error) {
+    std::wstring path = widen(ipc_endpoint(name));
+    HANDLE first = create_pipe(path, true);
+    if (first == INVALID_HANDLE_VALUE) {
+        fail(error, GetLastError() == ERROR_ACCESS_DENIED ? "another server is listening on " + ipc_endpoint(name)
+                                                          : "cannot create pipe " + ipc_endpoint(name));
+        return nullptr;
+    }
+    return std::make_unique<PipeListener>(std::move(path), first);
+}
+
+std::unique_ptr<IpcConnection> ipc_connect(const std::string& name, std::string* error) {
+    std::wstring path = widen(ipc_endpoint(name));
+    for (;;) {
+        HANDLE pipe = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+        if (pipe != INVALID_HANDLE_VALUE) return std::make_unique<PipeConnection>(pipe, false);
+        // Every instance busy: wait for the server's next accept.
+        if (GetLastError() != ERROR_PIPE_BUSY || !WaitNamedPipeW(path.c_str(), 5000)) {
+            fail(error, "no server is listening on " + ipc_endpoint(name));
+            return nullptr;
+        }
+    }
+}
+
+#else
+
+namespace {
+
+class SocketConnection final : public IpcConnection {
+public:
+    explicit SocketConnection(int fd) : m_fd(fd) {}
+    ~SocketConnection() override { ::close(m_fd); }
+
+    bool write(std::string_view data) override {
+        while (!data.empty()) {
+            ssize_t n = send(m_fd, data.data(), data.size(), MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            data.remove_prefix(static_cast<size_t>(n));
+        }
+        return true;
+    }
+
+    void close() override { shutdown(m_fd, SHUT_RDWR); }
+
+protected:
+    ptrdiff_t read_some(char* data, size_t size) override {
+        for (;;) {
+            ssize_t n = recv(m_fd, data, size, 0);
+            if (n >= 0 || errno != EINTR) return n;
+        }
+    }
+
+private:
+    int m_fd;
+};
+
+class SocketListener final : public IpcListener {
+public:
+    SocketListener(int fd, std::string path) : m_fd(fd), m_path(std::move(path)) {}
+    ~SocketListener() override {
+        ::close(m_fd);
+        unlink(m_path.c_str());
+    }
+
+    std::unique_ptr<IpcConnection> accept() override {
+        for (;;) {
+            if (m_closed) return nullptr;
+            int fd = ::accept4(m_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd >= 0 && !m_closed) return std::make_unique<SocketConnection>(fd);
+            if (fd >= 0) ::close(fd);
+            if (fd < 0 && errno != EINTR && errno != ECONNABORTED) return nullptr;
+        }
+    }
+
+    // shutdown() wakes a blocked accept() on Linux; close() would not.
+    void close() override {
+        m_closed = true;
+        shutdown(m_fd, SHUT_RDWR);
+    }
+
+private:
+    int m_fd;
+    std::string m_path;
+    std::atomic<bool> m_closed{false};
+};
+
+bool socket_address(const std::string& path, sockaddr_un& addr, std::string* error) {
+    addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) return fail(error, "socket path too long: " + path);
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+int connect_socket(const sockaddr_un& addr) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+} // namespace
+
+std::string ipc_endpoint(const std::string& name) {
+    if (name.find('/') != std::string::npos) return name;
+    const char* dir = getenv("XDG_RUNTIME_DIR");
+    std::string path = dir && *dir ? dir : "/tmp";
+    return path + "/" + name + "-" + std::to_string(getuid()) + ".sock";
+}
+
+std::unique_ptr<IpcListener> ipc_listen(const std::string& name, std::string* error) {
+    std::string path = ipc_endpoint(name);
+    sockaddr_un addr;
+    if (!socket_address(path, addr, error)) return nullptr;
+    // A socket file nobody answers on is left over from a server that died.
+    if (int live = connect_socket(addr); live >= 0) {
+        ::close(live);
+        fail(error, "another server is listening on " + path);
+        return nullptr;
+    }
+    unlink(path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    // Create the socket file 0600 rather than chmod it after bind: in /tmp
+    // another user could connect in between.
+    bool bound = false;
+    if (fd >= 0) {
+        mode_t mask = umask(0177);
+        bound = bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+        umask(mask);
+    }
+    if (!bound || listen(fd, 16) != 0) {
+        fail(error, "cannot listen on " + path + ": " + strerror(errno));
+        if (fd >= 0) ::close(fd);
+        return nullptr;
+    }
+    return std::make_unique<SocketListener>(fd, std::move(path));
+}
+
+std::unique_ptr<IpcConnection> ipc_connect(const std::string& name, std::string* error) {
+    std::string path = ipc_endpoint(name);
+    sockaddr_un addr;
+    if (!socket_address(path, addr, error)) return nullptr;
+    int fd = connect_socket(addr);
+    if (fd < 0) {
+        fail(error, "no server is listening on " + path);
+        return nullptr;
+    }
+    return std::make_unique<SocketConnection>(fd);
+}
+
+#endif
+
+} // namespace lvt
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace lvt {
+
+// One end of a local byte-stream connection: a named pipe on Windows, a Unix
+// domain socket elsewhere. The server protocol is line-based, so reads come
+// a line at a time.
+class IpcConnection {
+public:
+    virtual ~IpcConnection() = default;
+
+    // The next '\n'-terminated line, without the newline (or a "\r\n").
+    // False at the end of the stream or on error.
+    bool read_line(std::string& line);
+
+    // Write all of `data`. False if the other end went away.
+    virtual bool write(std::string_view data) = 0;
+
+    // End the connection; a blocked read_line() on another thread returns.
+    virtual void close() = 0;
+
+protected:
+    // Up to `size` bytes; 0 at the end of the stream, negative on error.
+    virtual ptrdiff_t read_some(char* data, size_t size) = 0;
+
+private:
+    std::string m_buffer;
+    size_t m_start = 0;    // unread bytes begin here
+    size_t m_scanned = 0;  // no newline before here
+};
+
+class IpcListener {
+public:
+    virtual ~IpcListener() = default;
+
+    // Wait for the next client. Null once close() was called, or on error.
+    virtual std::unique_ptr<IpcConnection> accept() = 0;
+
+    // Stop listening and wake a blocked accept(). Safe from any thread.
+    virtual void close() = 0;
+};
+
+// The endpoint for `name`: "\\.\pipe\<name>" on Windows; elsewhere `name`
+// itself if it contains a '/', or else "<name>-<uid>.sock" in
+// $XDG_RUNTIME_DIR (or /tmp).
+std::string ipc_endpoint(const std::string& name);
+
+// Listen on, or connect to, ipc_endpoint(name). A Unix socket is created
+// owner-only and replaces a stale socket file of the same name. On failure
+// returns null and describes the problem in `error`.
+std::unique_ptr<IpcListener> ipc_listen(const std::string& name, std::string* error = nullptr);
+std::unique_ptr<IpcConnection> ipc_connect(const std::string& name, std::string* error = nullptr);
+
+} // namespace lvt
@@ -0,0 +1,161 @@
+#include "json_reader.h"
+#include <nlohmann/json.hpp>
+#include <cstdlib>
+
+using json = nlohmann::json;
+
+namespace lvt {
+
+namespace {
+
+// SAX handler for the write_json layout. Each open object or array pushes a
+// frame saying what it is; members of anything unexpected are skipped.
+class DocumentReader {
+public:
+    explicit DocumentReader(TreeDocument& doc) : m_doc(doc) {}
+
+    const std::string& error() const { return m_error; }
+
+    bool null() {
+        if (top() == Frame::Document && m_key == "root") m_sawRoot = true;
+        return true;
+    }
+    bool boolean(bool) { return true; }
+    bool number_integer(json::number_integer_t v) { return number(static_cast<double>(v)); }
+    bool number_unsigned(json::number_unsigned_t v) { return number(static_cast<double>(v)); }
+    bool number_float(json::number_float_t v, const std::string&) { return number(v); }
+    bool binary(json::binary_t&) { return true; }
+
+    bool string(std::string& s) {
+        switch (top()) {
+        case Frame::Frameworks:
+            m_doc.frameworks.push_back(std::move(s));
+            break;
+        case Frame::Target:
+            if (m_key == "hwnd")
+                m_doc.hwnd = reinterpret_cast<HWND>(static_cast<uintptr_t>(std::strtoull(s.c_str(), nullptr, 16)));
+            else if (m_key == "processName")
+                m_doc.processName = std::move(s);
+            break;
+        case Frame::Element: {
+            Element& el = m_doc.tree[m_nodes.back()];
+            if (m_key == "id") el.id = std::move(s);
+            else if (m_key == "type") el.type = s;
+            else if (m_key == "framework") el.framework = s;
+            else if (m_key == "className") el.className = s;
+            else if (m_key == "text") el.text = std::move(s);
+            break;
+        }
+        case Frame::Properties:
+            m_doc.tree[m_nodes.back()].properties.set(Symbol(m_key), std::move(s));
+            break;
+        default:
+            break;
+        }
+        return true;
+    }
+
+    bool key(std::string& k) {
+        m_key = std::move(k);
+        return true;
+    }
+
+    bool start_object(std::size_t) {
+        Frame parent = top();
+        Frame frame = Frame::Skip;
+        if (m_frames.empty()) {
+            frame = Frame::Document;
+        } else if (parent == Frame::Document && m_key == "root") {
+            // A repeated "root" member is valid JSON but not a tree we wrote.
+            NodeId root = m_sawRoot ? kNoNode : m_doc.tree.add_root();
+            if (root == kNoNode) {
+                m_error = "not an lvt tree document";
+                return false;
+            }
+            m_nodes.push_back(root);
+            m_sawRoot = true;
+            frame = Frame::Element;
+        } else if (parent == Frame::Document && m_key == "target") {
+            frame = Frame::Target;
+        } else if (parent == Frame::Children) {
+            m_nodes.push_back(m_doc.tree.append_child(m_nodes.back()));
+            frame = Frame::Element;
+        } else if (parent == Frame::Element && m_key == "bounds") {
+            frame = Frame::Bounds;
+        } else if (parent == Frame::Element && m_key == "properties") {
+            frame = Frame::Properties;
+        }
+        m_frames.push_back(frame);
+        return true;
+    }
+
+    bool end_object() {
+        if (top() == Frame::Element) m_nodes.pop_back();
+        m_frames.pop_back();
+        return true;
+    }
+
+    bool start_array(std::size_t) {
+        Frame parent = top();
+        Frame frame = Frame::Skip;
+        if (parent == Frame::Document && m_key == "frameworks") frame = Frame::Frameworks;
+        else if (parent == Frame::Element && m_key == "children") frame = Frame::Children;
+        m_frames.push_back(frame);
+        return true;
+    }
+
+    bool end_array() {
+        m_frames.pop_back();
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& e) {
+        m_error = e.what();
+        return false;
+    }
+
+    // A document has to be an object with a "root" member.
+    bool complete() const { return m_sawRoot; }
+
+private:
+    enum class Frame { Document, Frameworks, Target, Element, Bounds, Properties, Children, Skip };
+
+    Frame top() const { return m_frames.empty() ? Frame::Skip : m_frames.back(); }
+
+    bool number(double v) {
+        if (top() == Frame::Target && m_key == "pid") {
+            m_doc.pid = static_cast<DWORD>(v);
+        } else if (top() == Frame::Bounds) {
+            Bounds& b = m_doc.tree[m_nodes.back()].bounds;
+            int i = static_cast<int>(v);
+            if (m_key == "x") b.x = i;
+            else if (m_key == "y") b.y = i;
+            else if (m_key == "width") b.width = i;
+            else if (m_key == "height") b.height = i;
+        }
+        return true;
+    }
+
+    TreeDocument& m_doc;
+    std::vector<Frame> m_frames;
+    std::vector<NodeId> m_nodes;  // open elements
+    std::string m_key;
+    std::string m_error;
+    bool m_sawRoot = false;
+};
+
+} // namespace
+
+bool read_json_document(std::string_view text, TreeDocument& doc, std::string* error) {
+    doc = {};
+    DocumentReader reader(doc);
+    bool ok = json::sax_parse(text.begin(), text.end(), &reader);
+    if (!ok || !reader.complete()) {
+        if (error) *error = ok ? "not an lvt tree document" : reader.error();
+        doc = {};
+        return false;
+    }
+    return true;
+}
+
+} // namespace lvt
@@ -0,0 +1,27 @@
+#pragma once
+#include "element.h"
+#include "platform.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lvt {
+
+// A captured tree with the target it came from: what write_json and
+// write_snapshot write and what `lvt diff` compares.
+struct TreeDocument {
+    ElementTree tree;
+    HWND hwnd = nullptr;
+    DWORD pid = 0;
+    std::string processName;
+    std::vector<std::string> frameworks;
+};
+
+// Read lvt's own JSON output (write_json) back into a document. The parse is
+// streamed straight into the tree, with no intermediate DOM. Property values
+// come back as the strings they were written as; element hashes are not read
+// (call hash_subtrees). On failure returns false and describes the problem
+// in `error`.
+bool read_json_document(std::string_view json, TreeDocument& doc, std::string* error = nullptr);
+
+} // namespace lvt
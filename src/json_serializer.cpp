@@ -1,163 +1,565 @@
 #include "json_serializer.h"
-#include <nlohmann/json.hpp>
-#include <sstream>
-#include <iomanip>
+#include "text_scan.h"
+#include <charconv>
+#include <cstdio>
+#include <cctype>
+#include <optional>
 
 namespace lvt {
 
-using json = nlohmann::json;
+// Derived text (sanitized or escaped) for interned strings, computed once per
+// distinct symbol per document instead of once per element.
+class SymbolTextCache {
+public:
+    explicit SymbolTextCache(std::string (*derive)(const std::string&)) : m_derive(derive) {}
 
-static json bounds_to_json(const Bounds& b) {
-    return json{{"x", b.x}, {"y", b.y}, {"width", b.width}, {"height", b.height}};
+    const std::string& get(Symbol s) {
+        if (s.id() >= m_slots.size()) m_slots.resize(s.id() + 1);
+        auto& slot = m_slots[s.id()];
+        if (!slot) slot = m_derive(s.str());
+        return *slot;
+    }
+
+private:
+    std::string (*m_derive)(const std::string&);
+    std::vector<std::optional<std::string>> m_slots;
+};
+
+// --- JSON serialization ---
+//
+// A forward-only writer that reproduces nlohmann::json::dump(2) byte for
+// byte: object keys in sorted order, two-space indent, the same escapes. The
+// tree is walked iteratively and written straight to the sink.
+
+namespace {
+
+// Length of the valid UTF-8 sequence at p, or 0 if it is malformed
+// (overlong, surrogate, above U+10FFFF or truncated).
+size_t utf8_sequence_length(const unsigned char* p, size_t avail) {
+    unsigned char b = p[0];
+    auto cont = [&](size_t i, unsigned char lo = 0x80, unsigned char hi = 0xBF) {
+        return i < avail && p[i] >= lo && p[i] <= hi;
+    };
+    if (b >= 0xC2 && b <= 0xDF) return cont(1) ? 2 : 0;
+    if (b == 0xE0) return cont(1, 0xA0) && cont(2) ? 3 : 0;
+    if ((b >= 0xE1 && b <= 0xEC) || b == 0xEE || b == 0xEF) return cont(1) && cont(2) ? 3 : 0;
+    if (b == 0xED) return cont(1, 0x80, 0x9F) && cont(2) ? 3 : 0;
+    if (b == 0xF0) return cont(1, 0x90) && cont(2) && cont(3) ? 4 : 0;
+    if (b >= 0xF1 && b <= 0xF3) return cont(1) && cont(2) && cont(3) ? 4 : 0;
+    if (b == 0xF4) return cont(1, 0x80, 0x8F) && cont(2) && cont(3) ? 4 : 0;
+    return 0;
 }
 
-static json element_to_json(const Element& el) {
-    json j;
-    // Strip control characters from strings (XAML runtime can include them in type names)
-    auto sanitize = [](const std::string& s) {
-        std::string r;
-        r.reserve(s.size());
-        for (char c : s) {
-            if (static_cast<unsigned char>(c) >= 0x20)
-                r += c;
+struct StringAppender {
+    std::string& s;
+    void write(std::string_view v) { s.append(v); }
+    void put(char c) { s.push_back(c); }
+};
+
+// Write `s` as JSON string contents (no quotes) with nlohmann's escapes.
+// With dropControl, bytes below 0x20 are removed instead (the sanitize pass
+// applied to type, className and text). Malformed UTF-8, which nlohmann
+// rejects with an exception, is replaced with U+FFFD.
+template <class Out>
+void write_json_escaped(Out& out, std::string_view s, bool dropControl) {
+    static constexpr char kHex[] = "0123456789abcdef";
+    const auto* p = reinterpret_cast<const unsigned char*>(s.data());
+    size_t n = s.size();
+    size_t run = 0;  // start of the pending unescaped run
+    size_t i = 0;
+    while (i < n) {
+        i += text::find_special<text::kStopControl | text::kStopHigh, '"', '\\'>(p + i, n - i);
+        if (i == n) break;
+        unsigned char c = p[i];
+        if (c >= 0x80) {
+            size_t len = utf8_sequence_length(p + i, n - i);
+            if (len) {
+                i += len;
+                continue;
+            }
         }
-        return r;
-    };
-    j["id"] = el.id;
-    j["type"] = sanitize(el.type);
-    j["framework"] = el.framework;
-    if (!el.className.empty()) j["className"] = sanitize(el.className);
-    if (!el.text.empty()) j["text"] = sanitize(el.text);
-    j["bounds"] = bounds_to_json(el.bounds);
-
-    if (!el.properties.empty()) {
-        json props = json::object();
-        for (auto& [k, v] : el.properties) {
-            props[k] = v;
+        out.write(s.substr(run, i - run));
+        if (c >= 0x80) {
+            out.write("\xEF\xBF\xBD");
+        } else if (c < 0x20 && dropControl) {
+            // dropped
+        } else {
+            switch (c) {
+            case '"':  out.write("\\\""); break;
+            case '\\': out.write("\\\\"); break;
+            case '\b': out.write("\\b"); break;
+            case '\t': out.write("\\t"); break;
+            case '\n': out.write("\\n"); break;
+            case '\f': out.write("\\f"); break;
+            case '\r': out.write("\\r"); break;
+            default: {
+                char buf[6] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xF]};
+                out.write(std::string_view(buf, 6));
+            }
+            }
+        }
+        run = ++i;
+    }
+    out.write(s.substr(run));
+}
+
+std::string json_escaped(const std::string& s) {
+    std::string r;
+    StringAppender out{r};
+    write_json_escaped(out, s, false);
+    return r;
+}
+
+std::string json_escaped_clean(const std::string& s) {
+    std::string r;
+    StringAppender out{r};
+    write_json_escaped(out, s, true);
+    return r;
+}
+
+// Indentation is written from one precomputed run of spaces; deeper levels
+// take several chunks.
+constexpr size_t kIndentTableSize = 256;
+const std::string_view kIndentTable = [] {
+    static char spaces[kIndentTableSize];
+    for (char& c : spaces) c = ' ';
+    return std::string_view(spaces, kIndentTableSize);
+}();
+
+void write_indent(OutputSink& out, size_t spaces) {
+    while (spaces > kIndentTableSize) {
+        out.write(kIndentTable);
+        spaces -= kIndentTableSize;
+    }
+    out.write(kIndentTable.substr(0, spaces));
+}
+
+void write_newline_indent(OutputSink& out, size_t level) {
+    out.put('\n');
+    write_indent(out, level * 2);
+}
+
+template <class T>
+void write_number(OutputSink& out, T v) {
+    char buf[24];
+    auto r = std::to_chars(buf, buf + sizeof(buf), v);
+    out.write(std::string_view(buf, r.ptr - buf));
+}
+
+// Element::hash as 16 lowercase hex digits (JSON numbers cannot hold 64 bits).
+void write_hash(OutputSink& out, uint64_t h) {
+    static constexpr char kHex[] = "0123456789abcdef";
+    char buf[16];
+    for (int i = 15; i >= 0; i--, h >>= 4) buf[i] = kHex[h & 0xF];
+    out.write(std::string_view(buf, sizeof(buf)));
+}
+
+class JsonTreeWriter {
+public:
+    // Compact output drops all whitespace, like nlohmann's dump().
+    JsonTreeWriter(OutputSink& out, bool hashes, bool compact = false)
+        : m_out(out), m_hashes(hashes), m_compact(compact) {}
+
+    // Writes the element object for `root`; `level` is the indent level of
+    // its members.
+    void write(const ElementTree& tree, NodeId root, size_t level) {
+        NodeId n = root;
+        open(tree, n, level);
+        for (;;) {
+            if (tree.has_children(n)) {
+                n = tree.first_child(n);
+                level += 2;
+                open(tree, n, level);
+                continue;
+            }
+            for (;;) {
+                close(tree, n, level);
+                if (n == root) return;
+                NodeId sibling = tree.next_sibling(n);
+                if (sibling != kNoNode) {
+                    m_out.put(',');
+                    newline(level - 1);
+                    n = sibling;
+                    open(tree, n, level);
+                    break;
+                }
+                n = tree.parent(n);
+                level -= 2;
+            }
         }
-        j["properties"] = props;
     }
 
-    if (!el.children.empty()) {
-        json kids = json::array();
-        for (auto& child : el.children) {
-            kids.push_back(element_to_json(child));
+private:
+    void newline(size_t level) {
+        if (!m_compact) write_newline_indent(m_out, level);
+    }
+
+    void key(size_t level, std::string_view name) {
+        newline(level);
+        m_out.put('"');
+        m_out.write(name);
+        m_out.write(m_compact ? "\":" : "\": ");
+    }
+
+    void string_value(std::string_view escaped) {
+        m_out.put('"');
+        m_out.write(escaped);
+        m_out.put('"');
+    }
+
+    // Members that sort before "children", then the opening of the array.
+    // Element levels step by two: one for the object, one for "children".
+    void open(const ElementTree& tree, NodeId node, size_t level) {
+        const Element& el = tree[node];
+        m_out.put('{');
+        key(level, "bounds");
+        m_out.put('{');
+        key(level + 1, "height");
+        write_number(m_out, el.bounds.height);
+        m_out.put(',');
+        key(level + 1, "width");
+        write_number(m_out, el.bounds.width);
+        m_out.put(',');
+        key(level + 1, "x");
+        write_number(m_out, el.bounds.x);
+        m_out.put(',');
+        key(level + 1, "y");
+        write_number(m_out, el.bounds.y);
+        newline(level);
+        m_out.put('}');
+        if (tree.has_children(node)) {
+            m_out.put(',');
+            key(level, "children");
+            m_out.put('[');
+            newline(level + 1);
         }
-        j["children"] = kids;
     }
 
-    return j;
+    // Closes the children array (if any) and writes the remaining members.
+    void close(const ElementTree& tree, NodeId node, size_t level) {
+        const Element& el = tree[node];
+        if (tree.has_children(node)) {
+            newline(level);
+            m_out.put(']');
+        }
+        if (!el.className.empty()) {
+            m_out.put(',');
+            key(level, "className");
+            string_value(m_clean.get(el.className));
+        }
+        m_out.put(',');
+        key(level, "framework");
+        string_value(m_escaped.get(el.framework));
+        if (m_hashes) {
+            m_out.put(',');
+            key(level, "hash");
+            m_out.put('"');
+            write_hash(m_out, el.hash);
+            m_out.put('"');
+        }
+        m_out.put(',');
+        key(level, "id");
+        m_out.put('"');
+        write_json_escaped(m_out, el.id, false);
+        m_out.put('"');
+        if (!el.properties.empty()) {
+            m_out.put(',');
+            key(level, "properties");
+            m_out.put('{');
+            bool first = true;
+            for (auto& [k, v] : el.properties) {
+                if (!first) m_out.put(',');
+                first = false;
+                newline(level + 1);
+                string_value(m_escaped.get(k));
+                m_out.write(m_compact ? ":\"" : ": \"");
+                if (v.is_string()) {
+                    write_json_escaped(m_out, std::get<std::string>(v.storage()), false);
+                } else {
+                    // Non-string values print as plain ASCII digits/words.
+                    m_scratch.clear();
+                    v.append_to(m_scratch);
+                    m_out.write(m_scratch);
+                }
+                m_out.put('"');
+            }
+            newline(level);
+            m_out.put('}');
+        }
+        if (!el.text.empty()) {
+            m_out.put(',');
+            key(level, "text");
+            m_out.put('"');
+            write_json_escaped(m_out, el.text, true);
+            m_out.put('"');
+        }
+        m_out.put(',');
+        key(level, "type");
+        string_value(m_clean.get(el.type));
+        newline(level - 1);
+        m_out.put('}');
+    }
+
+    OutputSink& m_out;
+    bool m_hashes;
+    bool m_compact;
+    SymbolTextCache m_clean{json_escaped_clean};
+    SymbolTextCache m_escaped{json_escaped};
+    std::string m_scratch;
+};
+
+} // namespace
+
+void write_json(OutputSink& out, const ElementTree& tree, NodeId root, HWND hwnd, DWORD pid,
+                const std::string& processName,
+                const std::vector<std::string>& frameworks, bool hashes, bool compact) {
+    // The document's own whitespace, pretty or compact.
+    auto text = [&](std::string_view pretty, std::string_view tight) { out.write(compact ? tight : pretty); };
+
+    text("{\n  \"frameworks\": ", "{\"frameworks\":");
+    if (frameworks.empty()) {
+        out.write("[]");
+    } else {
+        out.put('[');
+        for (size_t i = 0; i < frameworks.size(); i++) {
+            if (i) out.put(',');
+            text("\n    \"", "\"");
+            write_json_escaped(out, frameworks[i], false);
+            out.put('"');
+        }
+        text("\n  ]", "]");
+    }
+
+    text(",\n  \"root\": ", ",\"root\":");
+    if (root == kNoNode || tree.empty()) {
+        out.write("null");
+    } else {
+        JsonTreeWriter(out, hashes, compact).write(tree, root, 2);
+    }
+
+    // Target info; hwnd is zero-padded to at least 8 hex digits
+    char hwndBuf[32];
+    snprintf(hwndBuf, sizeof(hwndBuf), "0x%08llX",
+             static_cast<unsigned long long>(reinterpret_cast<uintptr_t>(hwnd)));
+    text(",\n  \"target\": {\n    \"hwnd\": \"", ",\"target\":{\"hwnd\":\"");
+    out.write(hwndBuf);
+    text("\",\n    \"pid\": ", "\",\"pid\":");
+    write_number(out, static_cast<unsigned long long>(pid));
+    text(",\n    \"processName\": \"", ",\"processName\":\"");
+    write_json_escaped(out, processName, false);
+    text("\"\n  }\n}", "\"}}");
 }
 
-std::string serialize_to_json(const Element& root, HWND hwnd, DWORD pid,
-                              const std::string& processName,
-                              const std::vector<std::string>& frameworks) {
-    json output;
-
-    // Target info
-    std::ostringstream hwndStr;
-    hwndStr << "0x" << std::hex << std::uppercase
-            << std::setfill('0') << std::setw(8)
-            << reinterpret_cast<uintptr_t>(hwnd);
-    output["target"] = json{
-        {"hwnd", hwndStr.str()},
-        {"pid", pid},
-        {"processName", processName}
-    };
+void write_json_element(OutputSink& out, const ElementTree& tree, NodeId node, bool hashes) {
+    JsonTreeWriter(out, hashes, true).write(tree, node, 1);
+}
 
-    output["frameworks"] = frameworks;
-    output["root"] = element_to_json(root);
+void write_json_string(OutputSink& out, std::string_view s, bool sanitize) {
+    out.put('"');
+    write_json_escaped(out, s, sanitize);
+    out.put('"');
+}
 
-    return output.dump(2);
+std::string serialize_to_json(const ElementTree& tree, NodeId root, HWND hwnd, DWORD pid,
+                              const std::string& processName,
+                              const std::vector<std::string>& frameworks, bool hashes) {
+    std::string result;
+    {
+        StringSink sink(result);
+        write_json(sink, tree, root, hwnd, pid, processName, frameworks, hashes);
+    }
+    return result;
 }
 
 // --- XML serialization ---
 
-static std::string xml_escape(const std::string& s) {
-    std::string r;
-    r.reserve(s.size());
-    for (char c : s) {
-        switch (c) {
-        case '&':  r += "&amp;";  break;
-        case '<':  r += "&lt;";   break;
-        case '>':  r += "&gt;";   break;
-        case '"':  r += "&quot;"; break;
-        case '\'': r += "&apos;"; break;
-        default:
-            if (static_cast<unsigned char>(c) >= 0x20)
-                r += c;
+namespace {
+
+// Write `s` as XML attribute text: the five markup characters become
+// entities and control characters are dropped.
+template <class Out>
+void write_xml_escaped(Out& out, std::string_view s) {
+    size_t i = 0;
+    for (;;) {
+        size_t next = i + text::find_special<text::kStopControl, '&', '<', '>', '"', '\''>(
+                              s.data() + i, s.size() - i);
+        out.write(s.substr(i, next - i));
+        if (next == s.size()) return;
+        switch (s[next]) {
+        case '&':  out.write("&amp;");  break;
+        case '<':  out.write("&lt;");   break;
+        case '>':  out.write("&gt;");   break;
+        case '"':  out.write("&quot;"); break;
+        case '\'': out.write("&apos;"); break;
+        default:   break;  // control characters are dropped
         }
+        i = next + 1;
     }
+}
+
+std::string xml_escape(const std::string& s) {
+    std::string r;
+    StringAppender out{r};
+    write_xml_escaped(out, s);
     return r;
 }
 
 // Make a valid XML tag name from a type string
-static std::string xml_tag(const std::string& type) {
+std::string xml_tag(const std::string& type) {
     std::string tag;
-    for (char c : type) {
-        if (static_cast<unsigned char>(c) >= 0x20 && c != '<' && c != '>' && c != ' ')
-            tag += c;
+    std::string_view rest = type;
+    for (;;) {
+        size_t i = text::find_special<text::kStopControl, '<', '>', ' '>(rest);
+        tag.append(rest.substr(0, i));
+        if (i == rest.size()) break;
+        rest.remove_prefix(i + 1);
     }
     if (tag.empty() || !(isalpha((unsigned char)tag[0]) || tag[0] == '_'))
         tag = "Element";
     return tag;
 }
 
-static void element_to_xml(const Element& el, std::ostringstream& out, int indent) {
-    std::string pad(indent * 2, ' ');
-    std::string tag = xml_tag(el.type);
+void write_attr(OutputSink& out, std::string_view name, std::string_view escapedValue) {
+    out.put(' ');
+    out.write(name);
+    out.write("=\"");
+    out.write(escapedValue);
+    out.put('"');
+}
 
-    out << pad << "<" << tag;
-    out << " id=\"" << xml_escape(el.id) << "\"";
-    out << " framework=\"" << xml_escape(el.framework) << "\"";
-    if (!el.className.empty() && el.className != el.type)
-        out << " className=\"" << xml_escape(el.className) << "\"";
-    if (!el.text.empty())
-        out << " text=\"" << xml_escape(el.text) << "\"";
-    if (el.bounds.width > 0 || el.bounds.height > 0)
-        out << " bounds=\"" << el.bounds.x << "," << el.bounds.y
-            << "," << el.bounds.width << "," << el.bounds.height << "\"";
+class XmlTreeWriter {
+public:
+    XmlTreeWriter(OutputSink& out, bool hashes) : m_out(out), m_hashes(hashes) {}
 
-    for (auto& [k, v] : el.properties) {
-        out << " " << xml_escape(k) << "=\"" << xml_escape(v) << "\"";
+    // Elements nest one indent level (two spaces) per tree level, starting
+    // at `level` for `root`.
+    void write(const ElementTree& tree, NodeId root, size_t level) {
+        NodeId n = root;
+        for (;;) {
+            open(tree, n, level);
+            if (tree.has_children(n)) {
+                n = tree.first_child(n);
+                level++;
+                continue;
+            }
+            for (;;) {
+                if (n == root) return;
+                NodeId sibling = tree.next_sibling(n);
+                if (sibling != kNoNode) {
+                    n = sibling;
+                    break;
+                }
+                n = tree.parent(n);
+                level--;
+                close(tree, n, level);
+            }
+        }
     }
 
-    if (el.children.empty()) {
-        out << " />\n";
-    } else {
-        out << ">\n";
-        for (auto& child : el.children) {
-            element_to_xml(child, out, indent + 1);
+private:
+    void open(const ElementTree& tree, NodeId node, size_t level) {
+        const Element& el = tree[node];
+        write_indent(m_out, level * 2);
+        m_out.put('<');
+        m_out.write(m_tags.get(el.type));
+
+        m_out.write(" id=\"");
+        write_xml_escaped(m_out, el.id);
+        m_out.put('"');
+        if (m_hashes) {
+            m_out.write(" hash=\"");
+            write_hash(m_out, el.hash);
+            m_out.put('"');
+        }
+        write_attr(m_out, "framework", m_escaped.get(el.framework));
+        if (!el.className.empty() && el.className != el.type)
+            write_attr(m_out, "className", m_escaped.get(el.className));
+        if (!el.text.empty()) {
+            m_out.write(" text=\"");
+            write_xml_escaped(m_out, el.text);
+            m_out.put('"');
+        }
+        if (el.bounds.width > 0 || el.bounds.height > 0) {
+            m_out.write(" bounds=\"");
+            write_number(m_out, el.bounds.x);
+            m_out.put(',');
+            write_number(m_out, el.bounds.y);
+            m_out.put(',');
+            write_number(m_out, el.bounds.width);
+            m_out.put(',');
+            write_number(m_out, el.bounds.height);
+            m_out.put('"');
         }
-        out << pad << "</" << tag << ">\n";
+
+        for (auto& [k, v] : el.properties) {
+            m_out.put(' ');
+            m_out.write(m_escaped.get(k));
+            m_out.write("=\"");
+            if (v.is_string()) {
+                write_xml_escaped(m_out, std::get<std::string>(v.storage()));
+            } else {
+                // Non-string values print as plain ASCII and never need escaping.
+                m_scratch.clear();
+                v.append_to(m_scratch);
+                m_out.write(m_scratch);
+            }
+            m_out.put('"');
+        }
+
+        m_out.write(tree.has_children(node) ? ">\n" : " />\n");
     }
-}
 
-std::string serialize_to_xml(const Element& root, HWND hwnd, DWORD pid,
-                             const std::string& processName,
-                             const std::vector<std::string>& frameworks) {
-    std::ostringstream out;
-
-    std::ostringstream hwndStr;
-    hwndStr << "0x" << std::hex << std::uppercase
-            << std::setfill('0') << std::setw(8)
-            << reinterpret_cast<uintptr_t>(hwnd);
-
-    out << "<LiveVisualTree";
-    out << " hwnd=\"" << hwndStr.str() << "\"";
-    out << " pid=\"" << pid << "\"";
-    out << " process=\"" << xml_escape(processName) << "\"";
-    out << " frameworks=\"";
+    void close(const ElementTree& tree, NodeId node, size_t level) {
+        write_indent(m_out, level * 2);
+        m_out.write("</");
+        m_out.write(m_tags.get(tree[node].type));
+        m_out.write(">\n");
+    }
+
+    OutputSink& m_out;
+    bool m_hashes;
+    SymbolTextCache m_tags{xml_tag};
+    SymbolTextCache m_escaped{xml_escape};
+    std::string m_scratch;
+};
+
+} // namespace
+
+void write_xml(OutputSink& out, const ElementTree& tree, NodeId root, HWND hwnd, DWORD pid,
+               const std::string& processName,
+               const std::vector<std::string>& frameworks, bool hashes) {
+    char hwndBuf[32];
+    snprintf(hwndBuf, sizeof(hwndBuf), "0x%08llX",
+             static_cast<unsigned long long>(reinterpret_cast<uintptr_t>(hwnd)));
+
+    out.write("<LiveVisualTree hwnd=\"");
+    out.write(hwndBuf);
+    out.write("\" pid=\"");
+    write_number(out, static_cast<unsigned long long>(pid));
+    out.write("\" process=\"");
+    write_xml_escaped(out, processName);
+    out.write("\" frameworks=\"");
     for (size_t i = 0; i < frameworks.size(); i++) {
-        if (i) out << ",";
-        out << xml_escape(frameworks[i]);
+        if (i) out.put(',');
+        write_xml_escaped(out, frameworks[i]);
     }
-    out << "\">\n";
+    out.write("\">\n");
+
+    if (root != kNoNode && !tree.empty())
+        XmlTreeWriter(out, hashes).write(tree, root, 1);
 
-    element_to_xml(root, out, 1);
+    out.write("</LiveVisualTree>\n");
+}
 
-    out << "</LiveVisualTree>\n";
-    return out.str();
+std::string serialize_to_xml(const ElementTree& tree, NodeId root, HWND hwnd, DWORD pid,
+                             const std::string& processName,
+                             const std::vector<std::string>& frameworks, bool hashes) {
+    std::string result;
+    {
+        StringSink sink(result);
+        write_xml(sink, tree, root, hwnd, pid, processName, frameworks, hashes);
+    }
+    return result;
 }
 
 } // namespace lvt
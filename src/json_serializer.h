@@ -1,18 +1,44 @@
 #pragma once
 #include "element.h"
-#include <Windows.h>
+#include "output_sink.h"
+#include "platform.h"
 #include <string>
+#include <string_view>
 
 namespace lvt {
 
-// Serialize an Element tree to a JSON string.
-std::string serialize_to_json(const Element& root, HWND hwnd, DWORD pid,
+// Stream the subtree of `tree` rooted at `root` as JSON to `out`. Output is
+// identical to the former nlohmann dump(2) of the same document (sorted keys,
+// two-space indent) and carries no trailing newline; `compact` drops all
+// whitespace, like dump(). With `hashes`, each element also has a "hash"
+// member: its Element::hash as 16 hex digits.
+void write_json(OutputSink& out, const ElementTree& tree, NodeId root, HWND hwnd, DWORD pid,
+                const std::string& processName,
+                const std::vector<std::string>& frameworks, bool hashes = false, bool compact = false);
+
+// Serialize the subtree of `tree` rooted at `root` to a JSON string.
+std::string serialize_to_json(const ElementTree& tree, NodeId root, HWND hwnd, DWORD pid,
                               const std::string& processName,
-                              const std::vector<std::string>& frameworks);
+                              const std::vector<std::string>& frameworks, bool hashes = false);
+
+// Write the element object for the subtree at `node` as write_json does, but
+// on one line with no whitespace.
+void write_json_element(OutputSink& out, const ElementTree& tree, NodeId node, bool hashes = false);
+
+// Write `s` as a quoted JSON string with write_json's escapes. With
+// `sanitize`, control characters are dropped, as write_json does for type,
+// className and text.
+void write_json_string(OutputSink& out, std::string_view s, bool sanitize = false);
+
+// Stream the subtree of `tree` rooted at `root` as XML markup to `out`. With
+// `hashes`, each element also has a "hash" attribute, as for JSON.
+void write_xml(OutputSink& out, const ElementTree& tree, NodeId root, HWND hwnd, DWORD pid,
+               const std::string& processName,
+               const std::vector<std::string>& frameworks, bool hashes = false);
 
-// Serialize an Element tree to XML markup.
-std::string serialize_to_xml(const Element& root, HWND hwnd, DWORD pid,
+// Serialize the subtree of `tree` rooted at `root` to XML markup.
+std::string serialize_to_xml(const ElementTree& tree, NodeId root, HWND hwnd, DWORD pid,
                              const std::string& processName,
-                             const std::vector<std::string>& frameworks);
+                             const std::vector<std::string>& frameworks, bool hashes = false);
 
 } // namespace lvt
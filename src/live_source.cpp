@@ -0,0 +1,92 @@
+#include "live_source.h"
+#include "plugin_loader.h"
+#include "providers/wpf_inject.h"
+#include "providers/xaml_diag_common.h"
+#include <Psapi.h>
+#include <wil/resource.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace lvt {
+
+// ---- TAP and plugin payloads ----
+
+// Find the FrameworkUdk.dll path loaded in the target process
+static std::wstring find_framework_udk(DWORD pid) {
+    HANDLE proc = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, pid);
+    if (!proc) return {};
+
+    HMODULE modules[1024];
+    DWORD needed = 0;
+    if (!EnumProcessModulesEx(proc, modules, sizeof(modules), &needed, LIST_MODULES_ALL)) {
+        CloseHandle(proc);
+        return {};
+    }
+
+    for (DWORD i = 0; i < needed / sizeof(HMODULE); i++) {
+        wchar_t name[MAX_PATH]{};
+        if (GetModuleBaseNameW(proc, modules[i], name, MAX_PATH)) {
+            if (_wcsicmp(name, L"Microsoft.Internal.FrameworkUdk.dll") == 0) {
+                wchar_t fullPath[MAX_PATH]{};
+                GetModuleFileNameExW(proc, modules[i], fullPath, MAX_PATH);
+                CloseHandle(proc);
+                return fullPath;
+            }
+        }
+    }
+    CloseHandle(proc);
+    return {};
+}
+
+std::string LiveSource::tap_payload(Framework framework, HWND host, DWORD pid) {
+    // build_tree may ask for several frameworks at once. Injections stage
+    // the TAP DLLs in shared locations and may target the same process, so
+    // run them one at a time; control messages and plugins still overlap.
+    static std::mutex injectMutex;
+    std::lock_guard<std::mutex> lock(injectMutex);
+
+    switch (framework) {
+    case Framework::Xaml: {
+        // The CoreWindow may belong to a different process than the frame
+        // window (UWP apps under ApplicationFrameHost.exe).
+        DWORD corePid = host ? m_ws.process_id(host) : pid;
+        std::string tree = query_resident_tap(corePid, L"VisualDiagConnection", m_xamlProperties);
+        if (!tree.empty()) return tree;
+        return collect_xaml_tree(corePid, L"", L"Windows.UI.Xaml.dll", L"VisualDiagConnection",
+                                 m_xamlProperties);
+    }
+    case Framework::WinUI3: {
+        // WinUI3 registers "WinUIVisualDiagConnection" endpoints
+        // InitializeXamlDiagnosticsEx can be loaded from FrameworkUdk.dll (WinAppSDK)
+        // or from Windows.UI.Xaml.dll (System32)
+        std::string tree = query_resident_tap(pid, L"WinUIVisualDiagConnection", m_xamlProperties);
+        if (!tree.empty()) return tree;
+        std::wstring initDll = find_framework_udk(pid);
+        if (initDll.empty()) {
+            // Fall back to system XAML
+            initDll = L"Windows.UI.Xaml.dll";
+        }
+        return collect_xaml_tree(pid, L"", initDll, L"WinUIVisualDiagConnection", m_xamlProperties);
+    }
+    case Framework::Wpf:
+        return collect_wpf_tree(pid);
+    default:
+        return {};
+    }
+}
+
+std::string LiveSource::plugin_payload(const std::string& name, HWND hwnd, DWORD pid, HWND scope) {
+    // Look up the plugin by name
+    for (auto& p : get_plugins()) {
+        if (p.info && p.info->name && name == p.info->name) {
+            PluginFrameworkInfo pf;
+            pf.name = name;
+            pf.plugin = &p;
+            return collect_plugin_tree(pf, hwnd, pid, scope);
+        }
+    }
+    return {};
+}
+
+} // namespace lvt
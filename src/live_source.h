@@ -0,0 +1,25 @@
+#pragma once
+#include "win32_window_system.h"
+#include <Windows.h>
+#include <string>
+#include <vector>
+
+namespace lvt {
+
+// CaptureSource backed by the running desktop: windows and common controls
+// through Win32WindowSystem, plus TAP DLL injection and loaded plugins.
+// XAML elements come with `xamlProperties` (e.g. "Text") where they have them.
+class LiveSource : public WindowSystemSource {
+public:
+    explicit LiveSource(std::vector<std::string> xamlProperties = {})
+        : WindowSystemSource(Win32WindowSystem::instance()), m_xamlProperties(std::move(xamlProperties)) {}
+
+    std::string tap_payload(Framework framework, HWND host, DWORD pid) override;
+    std::string plugin_payload(const std::string& name, HWND hwnd, DWORD pid,
+                               HWND scope) override;
+
+private:
+    std::vector<std::string> m_xamlProperties;
+};
+
+} // namespace lvt
@@ -1,16 +1,33 @@
 #include "target.h"
 #include "framework_detector.h"
 #include "tree_builder.h"
+#include "stable_ids.h"
+#include "live_source.h"
+#include "recording.h"
 #include "json_serializer.h"
+#include "snapshot.h"
+#include "delta_stream.h"
+#include "json_reader.h"
+#include "tree_diff.h"
+#include "rpc_server.h"
 #include "screenshot.h"
 #include "plugin_loader.h"
 #include "debug.h"
+#include "tap/tap_tree.h"
 
+#include <cctype>
+#include <cerrno>
+#include <climits>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <string>
-#include <fstream>
+#include <string_view>
+#include <vector>
+#include <future>
+#include <memory>
+#include <fcntl.h>
+#include <io.h>
 
 static void print_usage() {
     fprintf(stderr,
@@ -21,21 +38,53 @@ static void print_usage() {
         "  lvt --pid <pid>      [options]\n"
         "  lvt --name <exe>     [options]\n"
         "  lvt --title <text>   [options]\n"
+        "  lvt --from-snapshot <file> [options]\n"
+        "  lvt --replay <file>  [options]\n"
+        "  lvt diff <before> <after> [--output <file>]\n"
+        "  lvt serve [--pipe <name>]\n"
+        "  lvt rpc <method> [<params-json>] [--pipe <name>]\n"
         "\n"
         "Options:\n"
         "  --hwnd <handle>      Target window by HWND (hex, e.g. 0x1A0B3C)\n"
         "  --pid <pid>          Target process by PID (finds main window)\n"
         "  --name <exe>         Target by process name (e.g. notepad.exe)\n"
         "  --title <text>       Target by window title substring\n"
+        "  --from-snapshot <f>  Load a tree saved with --format lvtbin instead of\n"
+        "                       capturing a live window\n"
+        "  --record <file>      Also save the raw inputs of the live capture (window\n"
+        "                       enumeration, control replies, TAP and plugin data)\n"
+        "  --replay <file>      Rebuild the tree from a --record file instead of\n"
+        "                       capturing a live window\n"
         "  --output <file>      Write output to file instead of stdout\n"
-        "  --format <fmt>       Output format: json (default) or xml\n"
+        "  --format <fmt>       Output format: json (default), xml, or lvtbin\n"
+        "                       (binary snapshot for --from-snapshot)\n"
         "  --screenshot <file>  Capture annotated screenshot to PNG\n"
         "  --dump               Output the tree (default; implied unless --screenshot)\n"
         "  --element <id>       Scope to a specific element subtree\n"
+        "  --stable-ids         Give elements IDs that survive between runs (hashes of\n"
+        "                       their path from the root) instead of e0, e1, ...\n"
+        "  --previous <file>    Reuse the IDs of matching elements in an earlier\n"
+        "                       lvtbin snapshot (implies --stable-ids)\n"
+        "  --hashes             Include each element's subtree hash in the output\n"
+        "                       (equal hashes mean equal subtrees)\n"
+        "  --watch [ms]         Keep capturing, every <ms> milliseconds (default 1000)\n"
+        "                       or sooner when the UI changes, and write what changed\n"
+        "                       as NDJSON JSON Patches (implies --stable-ids)\n"
         "  --frameworks         Just detect and list frameworks\n"
         "  --depth <n>          Max tree traversal depth (default: unlimited)\n"
+        "  --xaml-props <names> Also read these XAML properties, comma-separated\n"
+        "                       (e.g. Text,IsEnabled,AutomationProperties.Name)\n"
         "  --debug              Show verbose diagnostic output\n"
         "  --help               Show this help\n"
+        "\n"
+        "diff compares two saved trees (json or lvtbin, in any mix) and writes a\n"
+        "JSON Patch (RFC 6902) that turns the first's JSON into the second's. Exit\n"
+        "status: 0 if they are the same, 1 if they differ, 2 on error.\n"
+        "\n"
+        "serve keeps running and answers JSON-RPC 2.0 requests, one per line, on the\n"
+        "named pipe \\\\.\\pipe\\<name> (default lvt): dump, query, diff, screenshot and\n"
+        "shutdown. Plugins, framework detection and the last tree stay loaded\n"
+        "between requests. rpc sends one request and prints its result.\n"
     );
 }
 
@@ -44,11 +93,19 @@ struct Args {
     DWORD pid = 0;
     std::string processName;
     std::string windowTitle;
+    std::string snapshotFile;
+    std::string recordFile;
+    std::string replayFile;
     std::string outputFile;
     std::string format = "json";
     std::string screenshotFile;
     std::string elementId;
+    std::string previousFile;
+    std::vector<std::string> xamlProperties;
     int depth = -1;
+    int watchMs = -1;       // --watch interval, or -1
+    bool stableIds = false;
+    bool hashes = false;
     bool frameworksOnly = false;
     bool dump = false;      // explicitly requested via --dump
     bool dumpSet = false;   // true if --dump was passed on command line
@@ -69,6 +126,12 @@ static Args parse_args(int argc, char* argv[]) {
             args.processName = argv[++i];
         } else if (strcmp(argv[i], "--title") == 0 && i + 1 < argc) {
             args.windowTitle = argv[++i];
+        } else if (strcmp(argv[i], "--from-snapshot") == 0 && i + 1 < argc) {
+            args.snapshotFile = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            args.recordFile = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            args.replayFile = argv[++i];
         } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
             args.outputFile = argv[++i];
         } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
@@ -77,8 +140,34 @@ static Args parse_args(int argc, char* argv[]) {
             args.screenshotFile = argv[++i];
         } else if (strcmp(argv[i], "--element") == 0 && i + 1 < argc) {
             args.elementId = argv[++i];
+        } else if (strcmp(argv[i], "--stable-ids") == 0) {
+            args.stableIds = true;
+        } else if (strcmp(argv[i], "--previous") == 0 && i + 1 < argc) {
+            args.previousFile = argv[++i];
+            args.stableIds = true;
+        } else if (strcmp(argv[i], "--hashes") == 0) {
+            args.hashes = true;
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            args.watchMs = 1000;
+            // The interval is optional: take the next argument unless it is
+            // another option.
+            const char* next = i + 1 < argc ? argv[i + 1] : nullptr;
+            if (next && (next[0] != '-' || isdigit(static_cast<unsigned char>(next[1])))) {
+                char* end = nullptr;
+                errno = 0;
+                long ms = strtol(argv[++i], &end, 10);
+                if (!isdigit(static_cast<unsigned char>(next[0])) || *end || errno || ms <= 0 || ms > INT_MAX) {
+                    fprintf(stderr, "lvt: --watch interval must be a positive number of milliseconds, not '%s'\n",
+                            next);
+                    exit(1);
+                }
+                args.watchMs = static_cast<int>(ms);
+            }
+            args.stableIds = true;
         } else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
             args.depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--xaml-props") == 0 && i + 1 < argc) {
+            args.xamlProperties = lvt::tap::parse_property_list(std::string_view(argv[++i]));
         } else if (strcmp(argv[i], "--frameworks") == 0) {
             args.frameworksOnly = true;
         } else if (strcmp(argv[i], "--dump") == 0) {
@@ -95,42 +184,188 @@ static Args parse_args(int argc, char* argv[]) {
     return args;
 }
 
-static lvt::Element* find_element(lvt::Element& root, const std::string& id) {
-    if (root.id == id) return &root;
-    for (auto& child : root.children) {
-        auto* found = find_element(child, id);
-        if (found) return found;
+// What the output stages need: a tree plus the target it describes, captured
+// live, replayed from a recording or loaded from a snapshot.
+struct Capture {
+    HWND hwnd = nullptr;
+    DWORD pid = 0;
+    std::string processName;
+    std::vector<std::string> frameworks;  // display names, with versions
+    std::vector<lvt::FrameworkInfo> detected;  // live captures: what to rebuild with
+    lvt::ElementTree tree;
+    lvt::ElementIndex index;
+    // Live --screenshot frame, captured while the tree is built.
+    std::future<lvt::Image> frame;
+};
+
+static bool load_snapshot(const std::string& path, Capture& capture) {
+    lvt::MappedFile file;
+    lvt::SnapshotView view;
+    std::string error;
+    if (!file.open(path, &error) || !view.open(file.data(), file.size(), &error)) {
+        fprintf(stderr, "lvt: cannot read snapshot '%s': %s\n", path.c_str(), error.c_str());
+        return false;
     }
-    return nullptr;
+    capture.hwnd = view.hwnd();
+    capture.pid = view.pid();
+    capture.processName = view.process_name();
+    for (size_t i = 0; i < view.framework_count(); i++)
+        capture.frameworks.emplace_back(view.framework(i));
+    capture.tree = view.to_tree();
+    if (!view.has_hashes()) lvt::hash_subtrees(capture.tree);
+    capture.index.sync(capture.tree);
+    return true;
 }
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        print_usage();
-        return 1;
+// The tree of an earlier snapshot, whose IDs --previous carries over.
+static bool load_previous_tree(const std::string& path, lvt::ElementTree& tree) {
+    lvt::MappedFile file;
+    lvt::SnapshotView view;
+    std::string error;
+    if (!file.open(path, &error) || !view.open(file.data(), file.size(), &error)) {
+        fprintf(stderr, "lvt: cannot read snapshot '%s': %s\n", path.c_str(), error.c_str());
+        return false;
     }
+    tree = view.to_tree();
+    return true;
+}
 
-    auto args = parse_args(argc, argv);
+// A tree saved with --format lvtbin or json, for `lvt diff`.
+static bool load_document(const std::string& path, lvt::TreeDocument& doc) {
+    lvt::MappedFile file;
+    std::string error;
+    if (!file.open(path, &error)) {
+        fprintf(stderr, "lvt: cannot read '%s': %s\n", path.c_str(), error.c_str());
+        return false;
+    }
+    std::string_view bytes(static_cast<const char*>(file.data()), file.size());
+    if (bytes.starts_with(std::string_view(lvt::snapshot::kMagic, sizeof(lvt::snapshot::kMagic)))) {
+        lvt::SnapshotView view;
+        if (!view.open(file.data(), file.size(), &error)) {
+            fprintf(stderr, "lvt: cannot read snapshot '%s': %s\n", path.c_str(), error.c_str());
+            return false;
+        }
+        doc.hwnd = view.hwnd();
+        doc.pid = view.pid();
+        doc.processName = view.process_name();
+        for (size_t i = 0; i < view.framework_count(); i++) doc.frameworks.emplace_back(view.framework(i));
+        doc.tree = view.to_tree();
+        if (!view.has_hashes()) lvt::hash_subtrees(doc.tree);
+        return true;
+    }
+    if (!lvt::read_json_document(bytes, doc, &error)) {
+        fprintf(stderr, "lvt: cannot read tree '%s': %s\n", path.c_str(), error.c_str());
+        return false;
+    }
+    lvt::hash_subtrees(doc.tree);
+    return true;
+}
 
-    // Load plugins from %USERPROFILE%/.lvt/plugins/
-    lvt::load_plugins();
+// lvt diff <before> <after> [--output <file>]
+static int run_diff(int argc, char* argv[]) {
+    std::vector<std::string> files;
+    std::string outputFile;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            outputFile = argv[++i];
+        } else if (strcmp(argv[i], "--debug") == 0) {
+            lvt::g_debug = true;
+        } else if (argv[i][0] != '-' && files.size() < 2) {
+            files.push_back(argv[i]);
+        } else {
+            fprintf(stderr, "lvt: unknown argument '%s'\n", argv[i]);
+            print_usage();
+            return 2;
+        }
+    }
+    if (files.size() != 2) {
+        fprintf(stderr, "lvt: diff needs two files\n");
+        return 2;
+    }
+    lvt::TreeDocument before, after;
+    if (!load_document(files[0], before) || !load_document(files[1], after)) return 2;
 
-    // --dump is default unless --screenshot is specified without --dump
-    if (!args.dumpSet)
-        args.dump = args.screenshotFile.empty();
+    lvt::TreeDiff diff = lvt::diff_trees(before.tree, after.tree);
+    if (lvt::g_debug) {
+        fprintf(stderr, "lvt: %zu changes, %zu nodes in identical subtrees\n", diff.ops.size(),
+                diff.identical);
+    }
+
+    std::unique_ptr<lvt::FileSink> fileSink;
+    if (!outputFile.empty()) {
+        fileSink = std::make_unique<lvt::FileSink>(outputFile);
+        if (!fileSink->is_open()) {
+            fprintf(stderr, "lvt: cannot write to '%s'\n", outputFile.c_str());
+            return 2;
+        }
+    }
+    lvt::FileSink stdoutSink(stdout);
+    lvt::OutputSink& out = fileSink ? static_cast<lvt::OutputSink&>(*fileSink) : stdoutSink;
+    lvt::write_json_patch(out, before, after, diff);
+    out.write("\n");
+    out.flush();
+    if (!out.ok()) {
+        fprintf(stderr, "lvt: error writing output\n");
+        return 2;
+    }
+    bool same = diff.empty() && before.hwnd == after.hwnd && before.pid == after.pid &&
+                before.processName == after.processName && before.frameworks == after.frameworks;
+    return same ? 0 : 1;
+}
+
+// The part of the tree to build for --element and --depth. A stable ID does
+// not say where its element is (and one carried over may look like any
+// other ID), so with --stable-ids only --depth alone narrows the build.
+static lvt::TreeScope build_scope(const Args& args) {
+    if (args.stableIds && !args.elementId.empty()) return {};
+    return {args.elementId, args.depth};
+}
+
+static void add_framework_names(const std::vector<lvt::FrameworkInfo>& frameworks, Capture& capture) {
+    for (auto& fi : frameworks) {
+        auto name = lvt::framework_display_name(fi);
+        if (fi.version.empty())
+            capture.frameworks.push_back(name);
+        else
+            capture.frameworks.push_back(name + " " + fi.version);
+    }
+}
 
+static bool load_recording(const std::string& path, const lvt::TreeScope& scope, Capture& capture) {
+    lvt::MappedFile file;
+    lvt::Recording rec;
+    std::string error;
+    if (!file.open(path, &error) ||
+        !lvt::read_recording({static_cast<const char*>(file.data()), file.size()}, rec, &error)) {
+        fprintf(stderr, "lvt: cannot read recording '%s': %s\n", path.c_str(), error.c_str());
+        return false;
+    }
+    capture.hwnd = reinterpret_cast<HWND>(static_cast<uintptr_t>(rec.hwnd));
+    capture.pid = rec.pid;
+    capture.processName = rec.processName;
+    add_framework_names(rec.frameworks, capture);
+    lvt::ReplayProvider replay(rec);
+    capture.tree = replay.build(scope, &capture.index);
+    return true;
+}
+
+// Resolve the target window, detect frameworks and build the tree. Returns
+// false (after reporting why) if there is nothing to capture.
+static bool capture_live(Args& args, Capture& capture) {
     if (!args.hwnd && !args.pid && args.processName.empty() && args.windowTitle.empty()) {
-        fprintf(stderr, "lvt: must specify --hwnd, --pid, --name, or --title\n");
-        return 1;
+        fprintf(stderr, "lvt: must specify --hwnd, --pid, --name, --title, --replay, or --from-snapshot\n");
+        return false;
     }
 
+    lvt::IWindowSystem& ws = lvt::Win32WindowSystem::instance();
+
     // Resolve target via --name or --title (with multi-match handling)
     if (!args.processName.empty()) {
-        auto matches = lvt::find_by_process_name(args.processName);
+        auto matches = lvt::find_by_process_name(ws, args.processName);
         if (matches.empty()) {
             fprintf(stderr, "lvt: no visible windows found for process '%s'\n",
                     args.processName.c_str());
-            return 1;
+            return false;
         }
         if (matches.size() > 1) {
             fprintf(stderr, "lvt: multiple windows match '%s':\n", args.processName.c_str());
@@ -139,15 +374,15 @@ int main(int argc, char* argv[]) {
                         static_cast<void*>(m.hwnd), m.pid,
                         m.processName.c_str(), m.windowTitle.c_str());
             }
-            return 1;
+            return false;
         }
         args.hwnd = matches[0].hwnd;
     } else if (!args.windowTitle.empty()) {
-        auto matches = lvt::find_by_title(args.windowTitle);
+        auto matches = lvt::find_by_title(ws, args.windowTitle);
         if (matches.empty()) {
             fprintf(stderr, "lvt: no visible windows found with title containing '%s'\n",
                     args.windowTitle.c_str());
-            return 1;
+            return false;
         }
         if (matches.size() > 1) {
             fprintf(stderr, "lvt: multiple windows match title '%s':\n",
@@ -157,7 +392,7 @@ int main(int argc, char* argv[]) {
                         static_cast<void*>(m.hwnd), m.pid,
                         m.processName.c_str(), m.windowTitle.c_str());
             }
-            return 1;
+            return false;
         }
         args.hwnd = matches[0].hwnd;
     }
@@ -166,12 +401,12 @@ int main(int argc, char* argv[]) {
     auto target = lvt::resolve_target(args.hwnd, args.pid);
     if (!target.hwnd) {
         fprintf(stderr, "lvt: could not find window for target\n");
-        return 1;
+        return false;
     }
     if (!IsWindow(target.hwnd)) {
         fprintf(stderr, "lvt: target HWND 0x%p is not a valid window\n",
                 static_cast<void*>(target.hwnd));
-        return 1;
+        return false;
     }
 
     // Check architecture match
@@ -185,81 +420,427 @@ int main(int argc, char* argv[]) {
             "lvt: architecture mismatch - this is lvt.exe (%s) but the target process "
             "(pid %lu) is %s.\nRun lvt-%s.exe instead.\n",
             hostArchName, target.pid, targetArchName, targetArchName);
-        return 1;
+        return false;
     }
 
+    // The frame needs no tree; grab it while the tree is built, so the two
+    // are also closer in time.
+    if (!args.screenshotFile.empty() && !args.frameworksOnly)
+        capture.frame = lvt::capture_window_frame_async(target.hwnd);
+
     // Detect frameworks
-    auto frameworks = lvt::detect_frameworks(target.hwnd, target.pid);
+    auto frameworks = lvt::detect_frameworks(ws, target.hwnd, target.pid);
+    for (auto& pf : lvt::detect_plugin_frameworks(target.hwnd, target.pid))
+        frameworks.push_back({lvt::Framework::Plugin, pf.version, pf.name});
+    add_framework_names(frameworks, capture);
+    capture.detected = frameworks;
+    capture.hwnd = target.hwnd;
+    capture.pid = target.pid;
+    capture.processName = target.processName;
+    if (args.frameworksOnly) return true;
+
+    // Build only what --element and --depth ask for; IDs come out as in a
+    // full build. Providers wait on the target concurrently, one worker per
+    // framework.
+    lvt::TreeScope scope = build_scope(args);
+    lvt::ElementIdAnchor anchor;
+    if (!scope.element.empty() && lvt::parse_element_id(scope.element, anchor) && anchor.window &&
+        !IsChild(target.hwnd, reinterpret_cast<HWND>(anchor.window))) {
+        fprintf(stderr, "lvt: element '%s' not found\n", scope.element.c_str());
+        return false;
+    }
+    lvt::LiveSource live(args.xamlProperties);
+    std::unique_ptr<lvt::ThreadPool> pool;
+    if (frameworks.size() > 1) pool = std::make_unique<lvt::ThreadPool>(frameworks.size());
+    if (args.recordFile.empty()) {
+        capture.tree = lvt::build_tree(live, target.hwnd, target.pid, frameworks, scope, &capture.index,
+                                       pool.get());
+        return true;
+    }
+
+    lvt::Recording rec;
+    rec.hwnd = reinterpret_cast<uintptr_t>(target.hwnd);
+    rec.pid = target.pid;
+    rec.processName = target.processName;
+    rec.frameworks = frameworks;
+    lvt::RecordingSource recorder(live, rec);
+    capture.tree = lvt::build_tree(recorder, target.hwnd, target.pid, frameworks, scope, &capture.index,
+                                   pool.get());
+
+    lvt::FileSink sink(args.recordFile);
+    if (sink.is_open()) {
+        lvt::write_recording(sink, rec);
+        sink.flush();
+    }
+    if (!sink.is_open() || !sink.ok()) {
+        fprintf(stderr, "lvt: cannot write recording to '%s'\n", args.recordFile.c_str());
+        return false;
+    }
+    if (lvt::g_debug)
+        fprintf(stderr, "lvt: recorded capture to %s\n", args.recordFile.c_str());
+    return true;
+}
+
+// --watch hears about changes through WinEvents from the target process,
+// delivered on this thread while it pumps messages.
+static bool g_uiChanged = false;
+
+static void CALLBACK on_ui_event(HWINEVENTHOOK, DWORD, HWND, LONG, LONG, DWORD, DWORD) {
+    g_uiChanged = true;
+}
+
+// Pump messages for `ms` milliseconds, or until a UI change arrives when
+// `untilChange` is set. Returns whether one did.
+static bool pump_messages(DWORD ms, bool untilChange) {
+    ULONGLONG deadline = GetTickCount64() + ms;
+    for (ULONGLONG now = GetTickCount64(); now < deadline; now = GetTickCount64()) {
+        MsgWaitForMultipleObjects(0, nullptr, FALSE, static_cast<DWORD>(deadline - now), QS_ALLINPUT);
+        MSG msg;
+        while (PeekMessageW(&msg, nullptr, 0, 0, PM_REMOVE)) {
+            TranslateMessage(&msg);
+            DispatchMessageW(&msg);
+        }
+        if (untilChange && g_uiChanged) return true;
+    }
+    return g_uiChanged;
+}
+
+// --watch: keep the target resolved and its frameworks detected, rebuild the
+// tree every interval (sooner after a UI change) and stream the differences.
+// Runs until the target window closes.
+static int run_watch(const Args& args, Capture& capture) {
+    // Changes tend to come in bursts; let one settle before rebuilding.
+    constexpr DWORD kSettleMs = 50;
+
+    std::unique_ptr<lvt::FileSink> fileSink;
+    if (!args.outputFile.empty()) {
+        fileSink = std::make_unique<lvt::FileSink>(args.outputFile);
+        if (!fileSink->is_open()) {
+            fprintf(stderr, "lvt: cannot write to '%s'\n", args.outputFile.c_str());
+            return 1;
+        }
+    }
+    lvt::FileSink stdoutSink(stdout);
+    lvt::OutputSink& out = fileSink ? static_cast<lvt::OutputSink&>(*fileSink) : stdoutSink;
+    lvt::DeltaStream stream(out);
+
+    HWINEVENTHOOK hook = SetWinEventHook(EVENT_OBJECT_CREATE, EVENT_OBJECT_VALUECHANGE, nullptr, on_ui_event,
+                                         capture.pid, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+    std::unique_ptr<lvt::ThreadPool> pool;
+    if (capture.detected.size() > 1) pool = std::make_unique<lvt::ThreadPool>(capture.detected.size());
+    lvt::TreeScope scope = build_scope(args);
+    bool scoped = !args.elementId.empty();
+    lvt::ElementTree previous;  // the last full tree, when only part of it is written
+
+    int rc = 0;
+    for (;;) {
+        lvt::ElementTree& tree = capture.tree;
+        const lvt::ElementTree* carry = scoped ? &previous : &stream.current().tree;
+        lvt::assign_stable_ids(tree, &capture.index, stream.lines() ? carry : nullptr);
+
+        lvt::TreeDocument doc;
+        doc.hwnd = capture.hwnd;
+        doc.pid = capture.pid;
+        doc.processName = capture.processName;
+        doc.frameworks = capture.frameworks;
+        lvt::NodeId outputRoot = scoped ? capture.index.find_by_id(args.elementId) : tree.root();
+        if (scoped && outputRoot == lvt::kNoNode) {
+            fprintf(stderr, "lvt: element '%s' not found\n", args.elementId.c_str());
+            rc = 1;
+            break;
+        }
+        if (args.depth >= 0 && outputRoot != lvt::kNoNode) lvt::trim_to_depth(tree, outputRoot, args.depth);
+        if (scoped) {
+            doc.tree.append_subtree(lvt::kNoNode, tree, outputRoot);
+            previous = std::move(tree);
+        } else {
+            doc.tree = std::move(tree);
+        }
+        bool wrote = stream.push(std::move(doc));
+        if (!out.ok()) {
+            fprintf(stderr, "lvt: error writing output\n");
+            rc = 1;
+            break;
+        }
+        if (wrote && lvt::g_debug)
+            fprintf(stderr, "lvt: wrote delta %llu\n", static_cast<unsigned long long>(stream.lines() - 1));
+
+        g_uiChanged = false;
+        if (pump_messages(static_cast<DWORD>(args.watchMs), true)) pump_messages(kSettleMs, false);
+        if (!IsWindow(capture.hwnd)) {
+            if (lvt::g_debug) fprintf(stderr, "lvt: target window closed\n");
+            break;
+        }
+        // A source is good for one capture: it keeps the window hierarchy it
+        // enumerated, which would hide windows created since.
+        capture.index.clear();
+        lvt::LiveSource live(args.xamlProperties);
+        capture.tree = lvt::build_tree(live, capture.hwnd, capture.pid, capture.detected, scope,
+                                       &capture.index, pool.get());
+    }
+    if (hook) UnhookWinEvent(hook);
+    return rc;
+}
+
+// `lvt serve` captures from the desktop, with plugins loaded once for the
+// life of the server.
+class LiveBackend : public lvt::ServerBackend {
+public:
+    lvt::IWindowSystem& window_system() override { return lvt::Win32WindowSystem::instance(); }
+
+    std::unique_ptr<lvt::CaptureSource> make_source() override { return std::make_unique<lvt::LiveSource>(); }
+
+    bool check_target(HWND, DWORD pid, std::string* error) override {
+        auto hostArch = lvt::get_host_architecture();
+        auto targetArch = lvt::detect_process_architecture(pid);
+        if (targetArch == lvt::Architecture::unknown || hostArch == lvt::Architecture::unknown ||
+            targetArch == hostArch)
+            return true;
+        *error = std::string("architecture mismatch - this is lvt.exe (") + lvt::architecture_name(hostArch) +
+                 ") but the target process is " + lvt::architecture_name(targetArch);
+        return false;
+    }
+
+    std::vector<lvt::FrameworkInfo> plugin_frameworks(HWND hwnd, DWORD pid) override {
+        std::vector<lvt::FrameworkInfo> frameworks;
+        for (auto& pf : lvt::detect_plugin_frameworks(hwnd, pid))
+            frameworks.push_back({lvt::Framework::Plugin, pf.version, pf.name});
+        return frameworks;
+    }
+
+    bool screenshot(HWND hwnd, const std::string& path, const lvt::ElementTree& tree, lvt::NodeId crop,
+                    std::string* error) override {
+        if (lvt::capture_screenshot(hwnd, path, &tree, crop)) return true;
+        *error = "cannot capture a screenshot to '" + path + "'";
+        return false;
+    }
+};
+
+// lvt serve [--pipe <name>]
+static int run_serve(int argc, char* argv[]) {
+    std::string pipe = "lvt";
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--pipe") == 0 && i + 1 < argc) {
+            pipe = argv[++i];
+        } else if (strcmp(argv[i], "--debug") == 0) {
+            lvt::g_debug = true;
+        } else {
+            fprintf(stderr, "lvt: unknown argument '%s'\n", argv[i]);
+            print_usage();
+            return 1;
+        }
+    }
+    std::string error;
+    auto listener = lvt::ipc_listen(pipe, &error);
+    if (!listener) {
+        fprintf(stderr, "lvt: %s\n", error.c_str());
+        return 1;
+    }
+    lvt::load_plugins();
+    LiveBackend backend;
+    lvt::RpcServer server(backend);
+    if (lvt::g_debug) fprintf(stderr, "lvt: serving on %s\n", lvt::ipc_endpoint(pipe).c_str());
+    lvt::serve(*listener, server);
+    if (lvt::g_debug) {
+        auto& stats = server.stats();
+        fprintf(stderr, "lvt: %llu requests, %llu captures, %llu detections\n",
+                static_cast<unsigned long long>(stats.requests), static_cast<unsigned long long>(stats.captures),
+                static_cast<unsigned long long>(stats.detections));
+    }
+    lvt::unload_plugins();
+    return 0;
+}
+
+// lvt rpc <method> [<params-json>] [--pipe <name>]
+static int run_rpc(int argc, char* argv[]) {
+    std::string pipe = "lvt";
+    std::vector<std::string> positional;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--pipe") == 0 && i + 1 < argc) {
+            pipe = argv[++i];
+        } else if (argv[i][0] != '-' && positional.size() < 2) {
+            positional.push_back(argv[i]);
+        } else {
+            fprintf(stderr, "lvt: unknown argument '%s'\n", argv[i]);
+            print_usage();
+            return 1;
+        }
+    }
+    if (positional.empty()) {
+        fprintf(stderr, "lvt: rpc needs a method\n");
+        return 1;
+    }
+
+    std::string request;
+    {
+        lvt::StringSink sink(request);
+        sink.write("{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":");
+        lvt::write_json_string(sink, positional[0]);
+        if (positional.size() > 1) {
+            sink.write(",\"params\":");
+            sink.write(positional[1]);
+        }
+        sink.write("}\n");
+        sink.flush();
+    }
+    std::string error, response;
+    auto connection = lvt::ipc_connect(pipe, &error);
+    if (!connection) {
+        fprintf(stderr, "lvt: %s\n", error.c_str());
+        return 1;
+    }
+    if (!connection->write(request) || !connection->read_line(response)) {
+        fprintf(stderr, "lvt: the server hung up\n");
+        return 1;
+    }
+    // RpcServer writes successful responses with this prefix, the result
+    // after it; anything else is an error object.
+    constexpr std::string_view kResult = "{\"jsonrpc\":\"2.0\",\"id\":1,\"result\":";
+    if (!response.starts_with(kResult) || response.back() != '}') {
+        fprintf(stderr, "lvt: %s\n", response.c_str());
+        return 1;
+    }
+    std::string_view result(response);
+    result = result.substr(kResult.size(), result.size() - kResult.size() - 1);
+    fwrite(result.data(), 1, result.size(), stdout);
+    fputc('\n', stdout);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        print_usage();
+        return 1;
+    }
+
+    if (strcmp(argv[1], "diff") == 0) return run_diff(argc, argv);
+    if (strcmp(argv[1], "serve") == 0) return run_serve(argc, argv);
+    if (strcmp(argv[1], "rpc") == 0) return run_rpc(argc, argv);
+
+    auto args = parse_args(argc, argv);
+
+    if (args.watchMs >= 0 && (!args.snapshotFile.empty() || !args.replayFile.empty() ||
+                              !args.recordFile.empty() || !args.screenshotFile.empty() ||
+                              args.frameworksOnly || args.format != "json")) {
+        fprintf(stderr, "lvt: --watch needs a live target and writes json only; it cannot be combined "
+                        "with --from-snapshot, --replay, --record, --screenshot, --frameworks or --format\n");
+        return 1;
+    }
+
+    // --dump is default unless --screenshot is specified without --dump
+    if (!args.dumpSet)
+        args.dump = args.screenshotFile.empty();
+
+    Capture capture;
+    if (!args.snapshotFile.empty()) {
+        if (!load_snapshot(args.snapshotFile, capture)) return 1;
+    } else if (!args.replayFile.empty()) {
+        if (!load_recording(args.replayFile, build_scope(args), capture)) return 1;
+    } else {
+        // Load plugins from %USERPROFILE%/.lvt/plugins/
+        lvt::load_plugins();
+        if (!capture_live(args, capture)) {
+            lvt::unload_plugins();
+            return 1;
+        }
+    }
+    lvt::ElementTree& tree = capture.tree;
 
     if (args.frameworksOnly) {
         // Just print detected frameworks
-        for (auto& fi : frameworks) {
-            auto name = lvt::framework_display_name(fi);
-            if (fi.version.empty())
-                printf("%s\n", name.c_str());
-            else
-                printf("%s %s\n", name.c_str(), fi.version.c_str());
-        }
+        for (auto& name : capture.frameworks)
+            printf("%s\n", name.c_str());
         lvt::unload_plugins();
         return 0;
     }
 
-    // Build full tree (no depth limit) so element IDs are stable
-    auto tree = lvt::build_tree(target.hwnd, target.pid, frameworks);
+    if (args.watchMs >= 0) {
+        int rc = run_watch(args, capture);
+        lvt::unload_plugins();
+        return rc;
+    }
+
+    if (args.stableIds) {
+        lvt::ElementTree previous;
+        if (!args.previousFile.empty() && !load_previous_tree(args.previousFile, previous)) return 1;
+        lvt::assign_stable_ids(tree, &capture.index, args.previousFile.empty() ? nullptr : &previous);
+    }
 
     // Scope to element if requested
-    lvt::Element* outputRoot = &tree;
+    lvt::NodeId outputRoot = tree.root();
     if (!args.elementId.empty()) {
-        outputRoot = find_element(tree, args.elementId);
-        if (!outputRoot) {
+        outputRoot = capture.index.find_by_id(args.elementId);
+        if (outputRoot == lvt::kNoNode) {
             fprintf(stderr, "lvt: element '%s' not found\n", args.elementId.c_str());
             return 1;
         }
     }
 
     // Apply depth limit relative to the output root
-    if (args.depth >= 0) {
-        lvt::trim_to_depth(*outputRoot, args.depth);
+    if (args.depth >= 0 && outputRoot != lvt::kNoNode) {
+        lvt::trim_to_depth(tree, outputRoot, args.depth);
     }
 
     // Serialize and output tree (unless suppressed by --screenshot without --dump)
     if (args.dump) {
-        std::vector<std::string> frameworkNames;
-        for (auto& fi : frameworks) {
-            auto name = lvt::framework_display_name(fi);
-            if (fi.version.empty())
-                frameworkNames.push_back(name);
-            else
-                frameworkNames.push_back(name + " " + fi.version);
-        }
+        bool binary = args.format == "lvtbin";
 
-        std::string serialized;
-        if (args.format == "xml") {
-            serialized = lvt::serialize_to_xml(*outputRoot, target.hwnd, target.pid,
-                                                target.processName, frameworkNames);
-        } else {
-            serialized = lvt::serialize_to_json(*outputRoot, target.hwnd, target.pid,
-                                                 target.processName, frameworkNames);
+        // Stream straight to the destination rather than building the whole
+        // document in memory first.
+        std::unique_ptr<lvt::FileSink> fileSink;
+        if (!args.outputFile.empty()) {
+            fileSink = std::make_unique<lvt::FileSink>(args.outputFile, binary);
+            if (!fileSink->is_open()) {
+                fprintf(stderr, "lvt: cannot write to '%s'\n", args.outputFile.c_str());
+                return 1;
+            }
+        } else if (binary) {
+            _setmode(_fileno(stdout), _O_BINARY);
         }
+        lvt::FileSink stdoutSink(stdout);
+        lvt::OutputSink& out = fileSink ? static_cast<lvt::OutputSink&>(*fileSink) : stdoutSink;
 
-        if (args.outputFile.empty()) {
-            printf("%s\n", serialized.c_str());
+        if (binary) {
+            lvt::write_snapshot(out, tree, outputRoot, capture.hwnd, capture.pid,
+                                capture.processName, capture.frameworks, args.hashes);
         } else {
-            std::ofstream out(args.outputFile);
-            if (!out) {
-                fprintf(stderr, "lvt: cannot write to '%s'\n", args.outputFile.c_str());
-                return 1;
+            if (args.format == "xml") {
+                lvt::write_xml(out, tree, outputRoot, capture.hwnd, capture.pid,
+                               capture.processName, capture.frameworks, args.hashes);
+            } else {
+                lvt::write_json(out, tree, outputRoot, capture.hwnd, capture.pid,
+                                capture.processName, capture.frameworks, args.hashes);
             }
-            out << serialized << "\n";
-            if (lvt::g_debug)
-                fprintf(stderr, "lvt: wrote tree to %s\n", args.outputFile.c_str());
+            out.write("\n");
+        }
+        out.flush();
+        if (!out.ok()) {
+            fprintf(stderr, "lvt: error writing output\n");
+            return 1;
         }
+        if (fileSink && lvt::g_debug)
+            fprintf(stderr, "lvt: wrote tree to %s\n", args.outputFile.c_str());
     }
 
     // Screenshot
     if (!args.screenshotFile.empty()) {
-        bool ok = lvt::capture_screenshot(target.hwnd, args.screenshotFile,
-                                          &tree, args.elementId);
+        // A saved tree's boxes can only be drawn over its window while it is still open.
+        bool saved = !args.snapshotFile.empty() || !args.replayFile.empty();
+        if (saved && !IsWindow(capture.hwnd)) {
+            fprintf(stderr, "lvt: window 0x%p from the %s no longer exists\n",
+                    static_cast<void*>(capture.hwnd),
+                    args.snapshotFile.empty() ? "recording" : "snapshot");
+            return 1;
+        }
+        lvt::NodeId cropNode = args.elementId.empty() ? lvt::kNoNode : outputRoot;
+        bool ok;
+        if (capture.frame.valid()) {
+            lvt::Image frame = capture.frame.get();
+            ok = !frame.empty() &&
+                 lvt::save_screenshot(args.screenshotFile, std::move(frame), &tree, cropNode);
+        } else {
+            ok = lvt::capture_screenshot(capture.hwnd, args.screenshotFile, &tree, cropNode);
+        }
         if (ok && lvt::g_debug) {
             fprintf(stderr, "lvt: saved screenshot to %s\n", args.screenshotFile.c_str());
         }
@@ -0,0 +1,48 @@
+#include "output_sink.h"
+
+namespace lvt {
+
+OutputSink::OutputSink(size_t bufferSize)
+    : m_buffer(new char[bufferSize ? bufferSize : 1])
+    , m_capacity(bufferSize ? bufferSize : 1) {}
+
+void OutputSink::drain() {
+    if (m_used && m_ok) m_ok = write_raw(m_buffer.get(), m_used);
+    m_used = 0;
+}
+
+void OutputSink::write_slow(std::string_view s) {
+    drain();
+    if (s.size() >= m_capacity) {
+        // Large writes go straight through rather than being chopped up.
+        if (m_ok) m_ok = write_raw(s.data(), s.size());
+        return;
+    }
+    std::memcpy(m_buffer.get(), s.data(), s.size());
+    m_used = s.size();
+}
+
+void OutputSink::flush() {
+    drain();
+    if (m_ok) m_ok = flush_raw();
+}
+
+FileSink::FileSink(const std::string& path, bool binary)
+    : m_file(fopen(path.c_str(), binary ? "wb" : "w"))
+    , m_owned(true) {}
+
+FileSink::~FileSink() {
+    if (!m_file) return;
+    flush();
+    if (m_owned) fclose(m_file);
+}
+
+bool FileSink::write_raw(const char* data, size_t size) {
+    return m_file && fwrite(data, 1, size, m_file) == size;
+}
+
+bool FileSink::flush_raw() {
+    return m_file && fflush(m_file) == 0;
+}
+
+} // namespace lvt
@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace lvt {
+
+// Buffered, forward-only byte sink for the serializers. Writes collect in a
+// fixed buffer and are handed to write_raw() in large chunks, so emitting a
+// tree never holds more than one buffer of output in memory (unless the sink
+// itself is a string).
+class OutputSink {
+public:
+    explicit OutputSink(size_t bufferSize = 64 * 1024);
+    virtual ~OutputSink() = default;
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+
+    void write(std::string_view s) {
+        if (s.empty()) return;  // an empty view may have a null data()
+        if (s.size() <= m_capacity - m_used) {
+            std::memcpy(m_buffer.get() + m_used, s.data(), s.size());
+            m_used += s.size();
+        } else {
+            write_slow(s);
+        }
+    }
+
+    void put(char c) {
+        if (m_used == m_capacity) drain();
+        m_buffer[m_used++] = c;
+    }
+
+    // Hand buffered bytes to the destination and flush it.
+    void flush();
+
+    // False once any write to the destination has failed.
+    bool ok() const { return m_ok; }
+
+protected:
+    // Derived destructors must call flush(); the base cannot, since the
+    // destination is gone by the time it runs.
+    virtual bool write_raw(const char* data, size_t size) = 0;
+    virtual bool flush_raw() { return true; }
+
+private:
+    void drain();
+    void write_slow(std::string_view s);
+
+    std::unique_ptr<char[]> m_buffer;
+    size_t m_capacity;
+    size_t m_used = 0;
+    bool m_ok = true;
+};
+
+// Appends to a caller-owned string.
+class StringSink final : public OutputSink {
+public:
+    explicit StringSink(std::string& out) : OutputSink(16 * 1024), m_out(out) {}
+    ~StringSink() override { flush(); }
+
+protected:
+    bool write_raw(const char* data, size_t size) override {
+        m_out.append(data, size);
+        return true;
+    }
+
+private:
+    std::string& m_out;
+};
+
+// Writes to a stdio stream: either borrowed (stdout) or opened from a path.
+// Paths open in text mode, matching what printf/std::ofstream produced
+// before, unless `binary` is set (for lvtbin snapshots).
+class FileSink final : public OutputSink {
+public:
+    explicit FileSink(FILE* file) : m_file(file) {}
+    explicit FileSink(const std::string& path, bool binary = false);
+    ~FileSink() override;
+
+    bool is_open() const { return m_file != nullptr; }
+
+protected:
+    bool write_raw(const char* data, size_t size) override;
+    bool flush_raw() override;
+
+private:
+    FILE* m_file = nullptr;
+    bool m_owned = false;
+};
+
+} // namespace lvt
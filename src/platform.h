@@ -0,0 +1,13 @@
+#pragma once
+
+// Win32 handle and integer types used by the portable core (element model,
+// serializers). On Windows this is just <Windows.h>; elsewhere it provides
+// opaque stand-ins so the core builds and is unit-tested on Linux.
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <cstdint>
+typedef struct HWND__* HWND;
+typedef uint32_t DWORD;
+#endif
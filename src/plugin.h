@@ -70,8 +70,10 @@ typedef int (*LvtDetectFrameworkFn)(DWORD pid, HWND hwnd, LvtFrameworkDetection*
 // `json_out` receives a malloc'd JSON string (caller frees with lvt_plugin_free).
 // The JSON follows the same schema as the XAML TAP DLL output:
 //   [{"type":"...", "name":"...", "children":[...], "width":..., "height":..., "offsetX":..., "offsetY":...}]
-// `hwnd_filter` is the HWND of a specific host window to scope enrichment to,
-// or NULL for all.
+// `element_class_filter` names a host window to scope enrichment to, as hex
+// text in the same form as "target_hwnd" ("0x0000000000123ABC"), or is NULL
+// for the whole window. Roots for hosts outside it may be left out; lvt
+// ignores any it does not need.
 // Returns nonzero on success.
 typedef int (*LvtEnrichTreeFn)(HWND hwnd, DWORD pid, const char* element_class_filter, char** json_out);
 
@@ -0,0 +1,129 @@
+#include "plugin_graft.h"
+#include "text_scan.h"
+#include <nlohmann/json.hpp>
+#include <cstdio>
+#include <string>
+
+using json = nlohmann::json;
+
+namespace lvt {
+
+// Recursively graft JSON nodes into an Element tree.
+static void graft_json_node(const json& j, ElementTree& tree, NodeId parent,
+                            Symbol framework,
+                            double parentOffsetX = 0, double parentOffsetY = 0) {
+    NodeId node = tree.append_child(parent);
+    Element& el = tree[node];
+    el.framework = framework;
+    std::string className = text::sanitize(j.value("type", ""));
+    el.className = className;
+    el.text = text::sanitize(j.value("text", ""));
+    if (el.text.empty())
+        el.text = text::sanitize(j.value("name", ""));
+
+    auto lastDot = className.rfind('.');
+    el.type = (lastDot != std::string::npos) ? std::string_view(className).substr(lastDot + 1)
+                                             : std::string_view(className);
+
+    double ox = j.value("offsetX", 0.0);
+    double oy = j.value("offsetY", 0.0);
+    double w = j.value("width", 0.0);
+    double h = j.value("height", 0.0);
+    double absX = parentOffsetX + ox;
+    double absY = parentOffsetY + oy;
+    if (w > 0 && h > 0) {
+        el.bounds.x = static_cast<int>(absX);
+        el.bounds.y = static_cast<int>(absY);
+        el.bounds.width = static_cast<int>(w);
+        el.bounds.height = static_cast<int>(h);
+    }
+
+    // Copy additional properties if present. Keys are arbitrary; booleans and
+    // integers keep their type, as do "true"/"false" strings on well-known flags.
+    if (j.contains("properties") && j["properties"].is_object()) {
+        const json& props = j["properties"];
+        el.properties.reserve(props.size());
+        for (auto& [key, val] : props.items()) {
+            Symbol k(key);
+            if (val.is_boolean()) {
+                el.properties.set(k, val.get<bool>());
+            } else if (val.is_number_integer() &&
+                       !(val.is_number_unsigned() && val.get<uint64_t>() > INT64_MAX)) {
+                el.properties.set(k, val.get<int64_t>());
+            } else if (val.is_string()) {
+                const auto& s = val.get_ref<const std::string&>();
+                if (prop::is_boolean_key(k) && (s == "true" || s == "false"))
+                    el.properties.set(k, s == "true");
+                else
+                    el.properties.set(k, s);
+            } else {
+                el.properties.set(k, val.dump());
+            }
+        }
+    }
+
+    if (j.contains("children") && j["children"].is_array()) {
+        for (auto& child : j["children"]) {
+            graft_json_node(child, tree, node, framework, absX, absY);
+        }
+    }
+}
+
+void graft_plugin_tree(ElementTree& tree, NodeId root, const json& treeJson,
+                       Symbol framework, ElementIndex& index) {
+    if (treeJson.is_array()) {
+        index.sync(tree);
+        for (auto& node : treeJson) {
+            std::string targetHwnd = node.value("target_hwnd", "");
+
+            NodeId host = kNoNode;
+            if (!targetHwnd.empty()) {
+                host = index.find_by_hwnd(targetHwnd);
+                if (host != kNoNode && !tree.in_subtree(host, root)) host = kNoNode;
+            }
+
+            if (host != kNoNode) {
+                double baseX = tree[host].bounds.x;
+                double baseY = tree[host].bounds.y;
+                if (node.contains("children") && node["children"].is_array()) {
+                    for (auto& child : node["children"]) {
+                        graft_json_node(child, tree, host, framework, baseX, baseY);
+                    }
+                } else {
+                    graft_json_node(node, tree, host, framework, baseX, baseY);
+                }
+            } else {
+                // No matching host — graft under root
+                graft_json_node(node, tree, root, framework,
+                                tree[root].bounds.x, tree[root].bounds.y);
+            }
+            // Grafted nodes may carry an "hwnd" and host later roots.
+            index.sync(tree);
+        }
+    } else if (treeJson.is_object()) {
+        graft_json_node(treeJson, tree, root, framework);
+        index.sync(tree);
+    }
+}
+
+bool parse_plugin_payload(std::string_view data, json& treeJson) {
+    if (data.empty()) return false;
+
+    try {
+        treeJson = json::parse(data);
+    } catch (const json::parse_error& e) {
+        fprintf(stderr, "lvt: failed to parse plugin JSON: %s\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+bool graft_plugin_payload(ElementTree& tree, NodeId root, std::string_view data,
+                          Symbol framework, ElementIndex& index) {
+    json treeJson;
+    if (!parse_plugin_payload(data, treeJson)) return false;
+    graft_plugin_tree(tree, root, treeJson, framework, index);
+    return true;
+}
+
+} // namespace lvt
@@ -0,0 +1,29 @@
+#pragma once
+#include "element.h"
+#include "element_index.h"
+#include <nlohmann/json_fwd.hpp>
+#include <string_view>
+
+namespace lvt {
+
+// Graft the JSON returned by a plugin's enrich() into `tree`.
+//
+// `treeJson` is either an array of roots, each with a "target_hwnd" (hex HWND
+// string) naming the element to graft under, or a single object grafted
+// under `root`. Roots whose host is missing or outside `root`'s subtree are
+// grafted under `root`. Hosts are found through `index`, which is synced
+// before the first lookup and after each graft, so the cost is linear in
+// the tree plus the grafted nodes rather than per root.
+void graft_plugin_tree(ElementTree& tree, NodeId root, const nlohmann::json& treeJson,
+                       Symbol framework, ElementIndex& index);
+
+// Parse the text a plugin returned. Returns false (after reporting a parse
+// error) if `data` is empty or not valid JSON.
+bool parse_plugin_payload(std::string_view data, nlohmann::json& treeJson);
+
+// Parse the text a plugin returned and graft it as above. Returns false if
+// `data` is empty or not valid JSON.
+bool graft_plugin_payload(ElementTree& tree, NodeId root, std::string_view data,
+                          Symbol framework, ElementIndex& index);
+
+} // namespace lvt
@@ -1,15 +1,12 @@
 #include "plugin_loader.h"
 #include "debug.h"
-#include <nlohmann/json.hpp>
+#include "plugin_graft.h"
 #include <cstdio>
 #include <cstdlib>
-#include <functional>
 #include <userenv.h>
 
 #pragma comment(lib, "userenv.lib")
 
-using json = nlohmann::json;
-
 namespace lvt {
 
 static std::vector<LoadedPlugin> s_plugins;
@@ -115,127 +112,34 @@ std::vector<PluginFrameworkInfo> detect_plugin_frameworks(HWND hwnd, DWORD pid)
     return result;
 }
 
-// Strip control characters (same as sanitize in xaml_diag_common.cpp)
-static std::string sanitize(const std::string& s) {
-    std::string r;
-    r.reserve(s.size());
-    for (char c : s) {
-        if (static_cast<unsigned char>(c) >= 0x20 || c == '\t')
-            r += c;
-    }
-    return r;
-}
-
-// Recursively graft JSON nodes into an Element tree.
-static void graft_json_node(const json& j, Element& parent, const std::string& framework,
-                            double parentOffsetX = 0, double parentOffsetY = 0) {
-    Element el;
-    el.framework = framework;
-    el.className = sanitize(j.value("type", ""));
-    el.text = sanitize(j.value("text", ""));
-    if (el.text.empty())
-        el.text = sanitize(j.value("name", ""));
-
-    auto lastDot = el.className.rfind('.');
-    el.type = (lastDot != std::string::npos) ? el.className.substr(lastDot + 1) : el.className;
-
-    double ox = j.value("offsetX", 0.0);
-    double oy = j.value("offsetY", 0.0);
-    double w = j.value("width", 0.0);
-    double h = j.value("height", 0.0);
-    double absX = parentOffsetX + ox;
-    double absY = parentOffsetY + oy;
-    if (w > 0 && h > 0) {
-        el.bounds.x = static_cast<int>(absX);
-        el.bounds.y = static_cast<int>(absY);
-        el.bounds.width = static_cast<int>(w);
-        el.bounds.height = static_cast<int>(h);
-    }
-
-    // Copy additional properties if present
-    if (j.contains("properties") && j["properties"].is_object()) {
-        for (auto& [key, val] : j["properties"].items()) {
-            el.properties[key] = val.is_string() ? val.get<std::string>() : val.dump();
-        }
-    }
-
-    if (j.contains("children") && j["children"].is_array()) {
-        for (auto& child : j["children"]) {
-            graft_json_node(child, el, framework, absX, absY);
-        }
-    }
-
-    parent.children.push_back(std::move(el));
-}
+std::string collect_plugin_tree(const PluginFrameworkInfo& pluginFw, HWND hwnd, DWORD pid,
+                                HWND scope) {
+    if (!pluginFw.plugin || !pluginFw.plugin->enrich) return {};
 
-bool enrich_with_plugin(Element& root, HWND hwnd, DWORD pid,
-                        const PluginFrameworkInfo& pluginFw) {
-    if (!pluginFw.plugin || !pluginFw.plugin->enrich) return false;
+    // The filter is the scope window in the same form as "target_hwnd".
+    char filter[24] = {};
+    if (scope) snprintf(filter, sizeof(filter), "0x%p", static_cast<void*>(scope));
 
     char* jsonOut = nullptr;
-    int ok = pluginFw.plugin->enrich(hwnd, pid, nullptr, &jsonOut);
-    if (!ok || !jsonOut) return false;
-
-    json treeJson;
-    try {
-        treeJson = json::parse(jsonOut);
-    } catch (const json::parse_error& e) {
-        fprintf(stderr, "lvt: failed to parse plugin JSON: %s\n", e.what());
-        if (pluginFw.plugin->free_fn) pluginFw.plugin->free_fn(jsonOut);
-        return false;
-    }
-
-    if (g_debug)
-        fprintf(stderr, "lvt: plugin '%s' returned %zu bytes of tree data\n",
-                pluginFw.name.c_str(), strlen(jsonOut));
+    int ok = pluginFw.plugin->enrich(hwnd, pid, scope ? filter : nullptr, &jsonOut);
+    if (!ok || !jsonOut) return {};
 
+    std::string data(jsonOut);
     if (pluginFw.plugin->free_fn) pluginFw.plugin->free_fn(jsonOut);
 
-    // The plugin JSON is an array of tree roots. Each root has a "target_hwnd"
-    // field (hex HWND string) indicating which existing element to graft under.
-    // We walk the tree fresh for each root to find the matching host element by
-    // its "hwnd" property, avoiding stale pointers from vector reallocations.
-    if (treeJson.is_array()) {
-        for (auto& node : treeJson) {
-            std::string targetHwnd = node.value("target_hwnd", "");
-
-            // Find the element whose "hwnd" property matches target_hwnd
-            Element* host = nullptr;
-            if (!targetHwnd.empty()) {
-                std::function<Element*(Element&)> findHost = [&](Element& el) -> Element* {
-                    auto it = el.properties.find("hwnd");
-                    if (it != el.properties.end() && it->second == targetHwnd)
-                        return &el;
-                    for (auto& child : el.children) {
-                        auto* found = findHost(child);
-                        if (found) return found;
-                    }
-                    return nullptr;
-                };
-                host = findHost(root);
-            }
-
-            if (host) {
-                double baseX = host->bounds.x;
-                double baseY = host->bounds.y;
-                if (node.contains("children") && node["children"].is_array()) {
-                    for (auto& child : node["children"]) {
-                        graft_json_node(child, *host, pluginFw.name, baseX, baseY);
-                    }
-                } else {
-                    graft_json_node(node, *host, pluginFw.name, baseX, baseY);
-                }
-            } else {
-                // No matching host — graft under root
-                graft_json_node(node, root, pluginFw.name,
-                                root.bounds.x, root.bounds.y);
-            }
-        }
-    } else if (treeJson.is_object()) {
-        graft_json_node(treeJson, root, pluginFw.name);
-    }
+    if (g_debug)
+        fprintf(stderr, "lvt: plugin '%s' returned %zu bytes of tree data\n",
+                pluginFw.name.c_str(), data.size());
+    return data;
+}
 
-    return true;
+bool enrich_with_plugin(ElementTree& tree, NodeId root, HWND hwnd, DWORD pid,
+                        const PluginFrameworkInfo& pluginFw, ElementIndex* index) {
+    std::string data = collect_plugin_tree(pluginFw, hwnd, pid);
+    if (index)
+        return graft_plugin_payload(tree, root, data, pluginFw.name, *index);
+    ElementIndex local;
+    return graft_plugin_payload(tree, root, data, pluginFw.name, local);
 }
 
 } // namespace lvt
@@ -1,6 +1,7 @@
 #pragma once
 #include "plugin.h"
 #include "element.h"
+#include "element_index.h"
 #include <string>
 #include <vector>
 #include <Windows.h>
@@ -33,9 +34,16 @@ struct PluginFrameworkInfo {
 // Ask all loaded plugins to detect frameworks in the given process.
 std::vector<PluginFrameworkInfo> detect_plugin_frameworks(HWND hwnd, DWORD pid);
 
+// Ask the plugin for its tree JSON, for the windows below `scope` if given
+// (plugins may return more). Returns an empty string if it has none.
+std::string collect_plugin_tree(const PluginFrameworkInfo& pluginFw, HWND hwnd, DWORD pid,
+                                HWND scope = nullptr);
+
 // Ask the relevant plugin to enrich the tree for a plugin-detected framework.
-// Parses the JSON response and grafts elements under matching Win32 nodes.
-bool enrich_with_plugin(Element& root, HWND hwnd, DWORD pid,
-                        const PluginFrameworkInfo& pluginFw);
+// Parses the JSON response and grafts elements under matching Win32 nodes
+// in the subtree rooted at `root` (see graft_plugin_tree). Pass the tree's
+// index to keep it current; otherwise a temporary one is built.
+bool enrich_with_plugin(ElementTree& tree, NodeId root, HWND hwnd, DWORD pid,
+                        const PluginFrameworkInfo& pluginFw, ElementIndex* index = nullptr);
 
 } // namespace lvt
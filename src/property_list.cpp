@@ -0,0 +1,106 @@
+#include "property_list.h"
+#include <charconv>
+#include <cstdio>
+#include <ostream>
+
+namespace lvt {
+
+namespace {
+
+void append_int(std::string& out, int64_t v) {
+    char buf[24];
+    auto r = std::to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, r.ptr);
+}
+
+} // namespace
+
+void PropertyValue::append_to(std::string& out) const {
+    switch (m_v.index()) {
+    case 0:
+        out += std::get<bool>(m_v) ? "true" : "false";
+        break;
+    case 1:
+        append_int(out, std::get<int64_t>(m_v));
+        break;
+    case 2: {
+        char buf[32];
+        int n = snprintf(buf, sizeof(buf), "%g", std::get<double>(m_v));
+        out.append(buf, n > 0 ? static_cast<size_t>(n) : 0);
+        break;
+    }
+    case 3:
+        out += std::get<std::string>(m_v);
+        break;
+    case 4: {
+        const Bounds& b = std::get<Bounds>(m_v);
+        append_int(out, b.x);
+        out += ',';
+        append_int(out, b.y);
+        out += ',';
+        append_int(out, b.width);
+        out += ',';
+        append_int(out, b.height);
+        break;
+    }
+    case 5: {
+        char buf[24];
+        int n = snprintf(buf, sizeof(buf), "0x%0*llX", static_cast<int>(sizeof(void*) * 2),
+                         static_cast<unsigned long long>(std::get<HandleValue>(m_v).value));
+        out.append(buf, n > 0 ? static_cast<size_t>(n) : 0);
+        break;
+    }
+    }
+}
+
+std::string PropertyValue::to_string() const {
+    if (auto* s = std::get_if<std::string>(&m_v)) return *s;
+    std::string out;
+    append_to(out);
+    return out;
+}
+
+bool PropertyValue::text_equals(std::string_view s) const {
+    if (auto* str = std::get_if<std::string>(&m_v)) return *str == s;
+    if (auto* b = std::get_if<bool>(&m_v)) return s == (*b ? "true" : "false");
+    return to_string() == s;
+}
+
+std::ostream& operator<<(std::ostream& os, const PropertyValue& v) {
+    return os << v.to_string();
+}
+
+void PropertyList::set(Symbol key, PropertyValue value) {
+    auto it = m_entries.begin();
+    for (; it != m_entries.end(); ++it) {
+        if (it->key == key) {
+            it->value = std::move(value);
+            return;
+        }
+        if (key.view() < it->key.view()) break;
+    }
+    m_entries.insert(it, Entry{key, std::move(value)});
+}
+
+const PropertyValue* PropertyList::find(Symbol key) const {
+    for (auto& e : m_entries) {
+        if (e.key == key) return &e.value;
+    }
+    return nullptr;
+}
+
+std::string PropertyList::text(Symbol key) const {
+    auto* v = find(key);
+    return v ? v->to_string() : std::string();
+}
+
+namespace prop {
+
+bool is_boolean_key(Symbol key) {
+    return key == kVisible || key == kEnabled || key == kSelected || key == kExpanded ||
+           key == kChecked || key == kHasChildren || key == kTruncated;
+}
+
+} // namespace prop
+
+} // namespace lvt
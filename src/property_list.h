@@ -0,0 +1,114 @@
+#pragma once
+#include "symbol.h"
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+namespace lvt {
+
+struct Bounds {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// Native handle value (HWND, HTREEITEM, ...). Printed as 0x-prefixed,
+// pointer-width uppercase hex, matching MSVC's "0x%p".
+struct HandleValue {
+    uint64_t value = 0;
+};
+
+// Typed property value. Text is produced only when serializing.
+class PropertyValue {
+public:
+    using Storage = std::variant<bool, int64_t, double, std::string, Bounds, HandleValue>;
+
+    PropertyValue() : m_v(std::string()) {}
+    PropertyValue(bool b) : m_v(b) {}
+    template <class T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>, int> = 0>
+    PropertyValue(T i) : m_v(static_cast<int64_t>(i)) {}
+    PropertyValue(double d) : m_v(d) {}
+    PropertyValue(std::string s) : m_v(std::move(s)) {}
+    PropertyValue(std::string_view s) : m_v(std::string(s)) {}
+    PropertyValue(const char* s) : m_v(std::string(s ? s : "")) {}
+    PropertyValue(const Bounds& r) : m_v(r) {}
+    PropertyValue(HandleValue h) : m_v(h) {}
+
+    const Storage& storage() const { return m_v; }
+    bool is_bool() const { return std::holds_alternative<bool>(m_v); }
+    bool is_string() const { return std::holds_alternative<std::string>(m_v); }
+
+    // Append the text form: "true"/"false", decimal, "x,y,w,h" for rects.
+    void append_to(std::string& out) const;
+    std::string to_string() const;
+
+    // Compare against the text form without materializing it for strings.
+    bool text_equals(std::string_view s) const;
+
+    friend bool operator==(const PropertyValue& a, std::string_view b) { return a.text_equals(b); }
+    friend bool operator==(const PropertyValue& a, const char* b) { return a.text_equals(b ? b : ""); }
+    friend bool operator==(const PropertyValue& a, const std::string& b) { return a.text_equals(b); }
+
+private:
+    Storage m_v;
+};
+
+std::ostream& operator<<(std::ostream& os, const PropertyValue& v);
+
+// Small flat property map keyed by interned names. Entries are kept sorted by
+// key text so serialization order matches the old std::map output. Lookups
+// compare symbol ids; nodes carry only a handful of properties, so a linear
+// scan beats any tree or hash.
+class PropertyList {
+public:
+    struct Entry {
+        Symbol key;
+        PropertyValue value;
+    };
+
+    using const_iterator = std::vector<Entry>::const_iterator;
+
+    bool empty() const { return m_entries.empty(); }
+    size_t size() const { return m_entries.size(); }
+    void reserve(size_t n) { m_entries.reserve(n); }
+    void clear() { m_entries.clear(); }
+
+    const_iterator begin() const { return m_entries.begin(); }
+    const_iterator end() const { return m_entries.end(); }
+
+    // Insert or overwrite.
+    void set(Symbol key, PropertyValue value);
+
+    const PropertyValue* find(Symbol key) const;
+    bool contains(Symbol key) const { return find(key) != nullptr; }
+
+    // Text of a property, or "" when absent.
+    std::string text(Symbol key) const;
+
+private:
+    std::vector<Entry> m_entries;
+};
+
+// Well-known property names, interned once.
+namespace prop {
+inline const Symbol kHwnd{"hwnd"};
+inline const Symbol kStyle{"style"};
+inline const Symbol kVisible{"visible"};
+inline const Symbol kEnabled{"enabled"};
+inline const Symbol kSelected{"selected"};
+inline const Symbol kExpanded{"expanded"};
+inline const Symbol kChecked{"checked"};
+inline const Symbol kHasChildren{"hasChildren"};
+inline const Symbol kTruncated{"truncated"};
+inline const Symbol kIndex{"index"};
+
+// True for names whose "true"/"false" text is stored as a bool.
+bool is_boolean_key(Symbol key);
+} // namespace prop
+
+} // namespace lvt
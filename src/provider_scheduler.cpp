@@ -0,0 +1,86 @@
+#include "provider_scheduler.h"
+#include <exception>
+#include <utility>
+
+namespace lvt {
+
+ProviderScheduler::~ProviderScheduler() {
+    // Fetches capture state owned by the caller.
+    for (auto& f : m_fetched)
+        if (f.valid()) f.wait();
+}
+
+void ProviderScheduler::add(Stage stage) {
+    if (m_pool) {
+        std::future<void> fetched;
+        if (stage.fetch && !stage.wanted) fetched = m_pool->submit(stage.fetch);
+        m_fetched.push_back(std::move(fetched));
+    }
+    m_stages.push_back(std::move(stage));
+}
+
+void ProviderScheduler::run() {
+    std::vector<Stage> stages = std::move(m_stages);
+    std::vector<std::future<void>> fetched = std::move(m_fetched);
+    m_stages.clear();
+    m_fetched.clear();
+
+    std::exception_ptr error;
+    auto attempt = [&error](auto&& step) {
+        try {
+            step();
+        } catch (...) {
+            if (!error) error = std::current_exception();
+        }
+    };
+
+    // Every prepare sees the Win32 tree before any provider grafts into it.
+    for (auto& s : stages)
+        if (s.prepare) attempt(s.prepare);
+    for (auto& s : stages) {
+        bool wanted = true;
+        if (s.wanted) attempt([&] { wanted = s.wanted(); });
+        if (!wanted) s.fetch = s.collect = nullptr;
+    }
+
+    if (!m_pool) {
+        for (auto& s : stages) {
+            if (error) break;
+            if (s.fetch) attempt(s.fetch);
+            if (!error && s.collect) attempt(s.collect);
+            if (!error && s.apply) attempt(s.apply);
+        }
+        if (error) std::rethrow_exception(error);
+        return;
+    }
+
+    // Fetches held back for a wanted check start now. Each collect waits for
+    // its own fetch on the worker. All fetches are queued before any collect,
+    // so a collect never waits on a fetch that no worker has picked up.
+    for (size_t i = 0; i < stages.size(); i++) {
+        if (!error && stages[i].fetch && !fetched[i].valid())
+            fetched[i] = m_pool->submit(stages[i].fetch);
+    }
+    std::vector<std::future<void>> collected;
+    collected.reserve(stages.size());
+    for (size_t i = 0; i < stages.size(); i++) {
+        std::function<void()> collect;
+        if (!error) collect = stages[i].collect;
+        collected.push_back(m_pool->submit([fetch = std::move(fetched[i]), collect]() mutable {
+            if (fetch.valid()) fetch.get();
+            if (collect) collect();
+        }));
+    }
+
+    // Never return while a fetch or collect is still running, even if an
+    // earlier step failed.
+    for (size_t i = 0; i < stages.size(); i++) {
+        attempt([&] {
+            collected[i].get();
+            if (!error && stages[i].apply) stages[i].apply();
+        });
+    }
+    if (error) std::rethrow_exception(error);
+}
+
+} // namespace lvt
@@ -0,0 +1,62 @@
+#pragma once
+#include "thread_pool.h"
+#include <functional>
+#include <future>
+#include <vector>
+
+namespace lvt {
+
+// Runs the framework providers of one build_tree() call.
+//
+// Each provider is split into up to four steps, any of which may be empty:
+//
+//   fetch    waits on the target for inputs that do not depend on the Win32
+//            tree (a TAP injection into the target process, a plugin call).
+//            With a pool it starts as soon as the stage is added, so it
+//            overlaps the Win32 walk.
+//   prepare  finds the provider's targets in the finished Win32 tree. Runs on
+//            the thread that calls run(), before any apply.
+//   wanted   says, after prepare, whether fetch and collect are worth running
+//            at all (build_tree skips providers with nothing in the part of
+//            the tree it was asked for). A stage with a wanted check starts
+//            its fetch only once the check said yes. apply runs either way.
+//   collect  waits on the target for the rest and builds the provider's
+//            elements off to the side. Starts once prepare and fetch are done.
+//   apply    grafts the collected elements into the tree.
+//
+// fetch and collect must not touch the tree being built. Applies run on the
+// thread that calls run(), in the order the stages were added, each after its
+// own collect. So the tree, and with it every element ID, comes out exactly
+// as if the providers had run one after another, while the waits on the
+// target overlap each other and the walk. Without a pool everything runs in
+// order on the calling thread.
+class ProviderScheduler {
+public:
+    struct Stage {
+        std::function<void()> fetch;
+        std::function<void()> prepare;
+        std::function<bool()> wanted;
+        std::function<void()> collect;
+        std::function<void()> apply;
+    };
+
+    explicit ProviderScheduler(ThreadPool* pool = nullptr) : m_pool(pool) {}
+    // Waits for fetches still running if run() was never reached.
+    ~ProviderScheduler();
+
+    ProviderScheduler(const ProviderScheduler&) = delete;
+    ProviderScheduler& operator=(const ProviderScheduler&) = delete;
+
+    void add(Stage stage);
+
+    // Run every stage added so far. An exception thrown by any step is
+    // rethrown here, after the steps already started have finished.
+    void run();
+
+private:
+    ThreadPool* m_pool;
+    std::vector<Stage> m_stages;
+    std::vector<std::future<void>> m_fetched;  // parallel to m_stages, with a pool
+};
+
+} // namespace lvt
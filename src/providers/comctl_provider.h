@@ -1,22 +1,49 @@
 #pragma once
 #include "provider.h"
+#include <vector>
 
 namespace lvt {
 
 class ComCtlProvider : public IProvider {
 public:
+    // Items read back per control; larger controls are sampled.
+    static constexpr int kMaxListViewItems = 50;
+    static constexpr int kMaxTreeViewItems = 100;
+    static constexpr int kMaxToolbarButtons = 50;
+
+    // True for the window classes enrich() understands.
+    static bool is_supported_class(Symbol className);
+
     // Enrich an existing Win32 element tree with ComCtl-specific details.
     // Walks the tree and for any HWND whose class matches a known ComCtl class,
-    // replaces/augments the element with richer information.
-    void enrich(Element& root);
+    // replaces/augments the element with the control's replies from `source`.
+    // Equivalent to prepare(), collect(), apply().
+    void enrich(ElementTree& tree, NodeId root, CaptureSource& source);
+
+    struct Control {
+        NodeId node;
+        HWND hwnd;
+        Symbol className;
+        bool answered = false;
+        ComCtlReply reply;
+    };
+    struct Pending {
+        std::vector<Control> controls;  // tree order
+    };
+
+    // Find the supported controls under `root`. Reads `tree` only.
+    Pending prepare(const ElementTree& tree, NodeId root);
+    // Query every control. Does not touch the element tree.
+    void collect(Pending& pending, CaptureSource& source);
+    // Enrich each control that answered.
+    void apply(ElementTree& tree, const Pending& pending);
 
 private:
-    void enrich_recursive(Element& el);
-    void enrich_listview(Element& el, HWND hwnd);
-    void enrich_treeview(Element& el, HWND hwnd);
-    void enrich_toolbar(Element& el, HWND hwnd);
-    void enrich_statusbar(Element& el, HWND hwnd);
-    void enrich_tabcontrol(Element& el, HWND hwnd);
+    void enrich_listview(ElementTree& tree, NodeId node, const ComCtlReply& reply);
+    void enrich_treeview(ElementTree& tree, NodeId node, const ComCtlReply& reply);
+    void enrich_toolbar(ElementTree& tree, NodeId node, const ComCtlReply& reply);
+    void enrich_statusbar(ElementTree& tree, NodeId node, const ComCtlReply& reply);
+    void enrich_tabcontrol(ElementTree& tree, NodeId node, const ComCtlReply& reply);
 };
 
 } // namespace lvt
@@ -1,13 +1,39 @@
 #pragma once
+#include "../capture_source.h"
 #include "../element.h"
-#include <Windows.h>
+#include <vector>
 
 namespace lvt {
 
-// Base interface for visual tree providers.
+// Base interface for visual tree providers. Providers build and enrich the
+// tree from the raw inputs of a CaptureSource; they make no system calls of
+// their own, so they build and run on every platform.
 class IProvider {
 public:
     virtual ~IProvider() = default;
 };
 
+// Elements a provider built in a tree of their own. This lets the parsing
+// and construction run while the destination tree is busy elsewhere (see
+// ProviderScheduler). The staged roots are the children of `tree`'s root.
+// The i-th one belongs under hosts[i], a node of the destination tree.
+struct StagedGraft {
+    ElementTree tree;
+    std::vector<NodeId> hosts;
+
+    // Node to build the next staged root under; attach() moves it under `host`.
+    NodeId stage(NodeId host) {
+        if (tree.empty()) tree.add_root();
+        hosts.push_back(host);
+        return tree.root();
+    }
+
+    // Copy every staged root under its host, in staging order.
+    void attach(ElementTree& dest) const {
+        if (tree.empty()) return;
+        size_t i = 0;
+        for (NodeId n : tree.children(tree.root())) dest.append_subtree(hosts[i++], tree, n);
+    }
+};
+
 } // namespace lvt
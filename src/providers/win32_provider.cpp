@@ -1,108 +1,91 @@
 #include "win32_provider.h"
+#include <cstdint>
 #include <vector>
 
 namespace lvt {
 
-static std::string wstr_to_str(const wchar_t* ws, int len = -1) {
-    if (!ws || (len == 0)) return {};
-    if (len < 0) len = static_cast<int>(wcslen(ws));
-    int sz = WideCharToMultiByte(CP_UTF8, 0, ws, len, nullptr, 0, nullptr, nullptr);
-    std::string s(sz, '\0');
-    WideCharToMultiByte(CP_UTF8, 0, ws, len, s.data(), sz, nullptr, nullptr);
-    return s;
-}
-
-static std::string get_window_class(HWND hwnd) {
-    wchar_t cls[256]{};
-    GetClassNameW(hwnd, cls, 256);
-    return wstr_to_str(cls);
-}
-
-static std::string get_window_text(HWND hwnd) {
-    int len = GetWindowTextLengthW(hwnd);
-    if (len == 0) return {};
-    std::wstring buf(len + 1, L'\0');
-    GetWindowTextW(hwnd, buf.data(), len + 1);
-    return wstr_to_str(buf.c_str(), len);
-}
-
-static std::string style_to_string(LONG style) {
+// Window style bits, spelled out so the provider builds off-Windows.
+namespace ws {
+constexpr uint32_t kOverlappedWindow = 0x00CF0000;
+constexpr uint32_t kPopup = 0x80000000;
+constexpr uint32_t kChild = 0x40000000;
+constexpr uint32_t kMinimize = 0x20000000;
+constexpr uint32_t kVisible = 0x10000000;
+constexpr uint32_t kDisabled = 0x08000000;
+constexpr uint32_t kMaximize = 0x01000000;
+constexpr uint32_t kVScroll = 0x00200000;
+constexpr uint32_t kHScroll = 0x00100000;
+} // namespace ws
+
+#ifdef _WIN32
+static_assert(ws::kOverlappedWindow == WS_OVERLAPPEDWINDOW && ws::kPopup == WS_POPUP &&
+              ws::kChild == WS_CHILD && ws::kMinimize == WS_MINIMIZE &&
+              ws::kVisible == WS_VISIBLE && ws::kDisabled == WS_DISABLED &&
+              ws::kMaximize == WS_MAXIMIZE && ws::kVScroll == WS_VSCROLL &&
+              ws::kHScroll == WS_HSCROLL);
+#endif
+
+static std::string style_to_string(uint32_t style) {
     std::string s;
-    if (style & WS_OVERLAPPEDWINDOW) s += "WS_OVERLAPPEDWINDOW ";
-    if (style & WS_POPUP) s += "WS_POPUP ";
-    if (style & WS_CHILD) s += "WS_CHILD ";
-    if (style & WS_VISIBLE) s += "WS_VISIBLE ";
-    if (style & WS_DISABLED) s += "WS_DISABLED ";
-    if (style & WS_MINIMIZE) s += "WS_MINIMIZE ";
-    if (style & WS_MAXIMIZE) s += "WS_MAXIMIZE ";
-    if (style & WS_HSCROLL) s += "WS_HSCROLL ";
-    if (style & WS_VSCROLL) s += "WS_VSCROLL ";
+    if (style & ws::kOverlappedWindow) s += "WS_OVERLAPPEDWINDOW ";
+    if (style & ws::kPopup) s += "WS_POPUP ";
+    if (style & ws::kChild) s += "WS_CHILD ";
+    if (style & ws::kVisible) s += "WS_VISIBLE ";
+    if (style & ws::kDisabled) s += "WS_DISABLED ";
+    if (style & ws::kMinimize) s += "WS_MINIMIZE ";
+    if (style & ws::kMaximize) s += "WS_MAXIMIZE ";
+    if (style & ws::kHScroll) s += "WS_HSCROLL ";
+    if (style & ws::kVScroll) s += "WS_VSCROLL ";
     if (!s.empty() && s.back() == ' ') s.pop_back();
     return s;
 }
 
 // Map well-known class names to friendly type names
-static std::string classify_window(const std::string& className) {
-    if (className == "Button") return "Button";
-    if (className == "Edit") return "Edit";
-    if (className == "Static") return "Static";
-    if (className == "ComboBox") return "ComboBox";
-    if (className == "ListBox") return "ListBox";
-    if (className == "ScrollBar") return "ScrollBar";
-    if (className == "#32770") return "Dialog";
-    return "Window";
+static Symbol classify_window(Symbol className) {
+    static const Symbol kButton("Button"), kEdit("Edit"), kStatic("Static"),
+        kComboBox("ComboBox"), kListBox("ListBox"), kScrollBar("ScrollBar"),
+        kDialogClass("#32770"), kDialog("Dialog"), kWindow("Window");
+    if (className == kButton || className == kEdit || className == kStatic ||
+        className == kComboBox || className == kListBox || className == kScrollBar)
+        return className;
+    if (className == kDialogClass) return kDialog;
+    return kWindow;
 }
 
-struct EnumChildData {
-    std::vector<HWND> children;
-    HWND parent;
-};
-
-static BOOL CALLBACK enum_direct_children(HWND hwnd, LPARAM lParam) {
-    auto* data = reinterpret_cast<EnumChildData*>(lParam);
-    // Only collect direct children
-    if (GetParent(hwnd) == data->parent) {
-        data->children.push_back(hwnd);
-    }
-    return TRUE;
-}
-
-Element Win32Provider::build(HWND hwnd, int maxDepth) {
-    return build_element(hwnd, 0, maxDepth);
+NodeId Win32Provider::build(ElementTree& tree, CaptureSource& source, HWND hwnd, int maxDepth) {
+    NodeId root = tree.add_root();
+    build_element(tree, source, root, hwnd, 0, maxDepth);
+    return root;
 }
 
-Element Win32Provider::build_element(HWND hwnd, int depth, int maxDepth) {
-    Element el;
+void Win32Provider::fill_element(Element& el, HWND hwnd, WindowInfo&& info) {
     el.nativeHandle = reinterpret_cast<uintptr_t>(hwnd);
-    el.framework = "win32";
-    el.className = get_window_class(hwnd);
+    static const Symbol kWin32("win32");
+    el.framework = kWin32;
+    el.className = info.className;
     el.type = classify_window(el.className);
-    el.text = get_window_text(hwnd);
+    el.text = std::move(info.text);
+    el.bounds = info.rect;
 
-    RECT rc{};
-    GetWindowRect(hwnd, &rc);
-    el.bounds = {rc.left, rc.top, rc.right - rc.left, rc.bottom - rc.top};
+    el.properties.reserve(4);
+    el.properties.set(prop::kStyle, style_to_string(info.style));
+    el.properties.set(prop::kVisible, info.visible);
+    el.properties.set(prop::kEnabled, info.enabled);
 
-    LONG style = GetWindowLong(hwnd, GWL_STYLE);
-    el.properties["style"] = style_to_string(style);
-    el.properties["visible"] = (IsWindowVisible(hwnd)) ? "true" : "false";
-    el.properties["enabled"] = (IsWindowEnabled(hwnd)) ? "true" : "false";
+    // HWND for reference; printed as hex when serialized
+    el.properties.set(prop::kHwnd, HandleValue{reinterpret_cast<uintptr_t>(hwnd)});
+}
 
-    // HWND as hex string for reference
-    char hwndBuf[32];
-    snprintf(hwndBuf, sizeof(hwndBuf), "0x%p", hwnd);
-    el.properties["hwnd"] = hwndBuf;
+void Win32Provider::build_element(ElementTree& tree, CaptureSource& source, NodeId node, HWND hwnd,
+                                  int depth, int maxDepth) {
+    fill_element(tree[node], hwnd, source.window(hwnd));
 
     // Enumerate direct children
     if (maxDepth < 0 || depth < maxDepth) {
-        EnumChildData data{{}, hwnd};
-        EnumChildWindows(hwnd, enum_direct_children, reinterpret_cast<LPARAM>(&data));
-        for (auto child : data.children) {
-            el.children.push_back(build_element(child, depth + 1, maxDepth));
+        for (HWND child : source.children(hwnd)) {
+            build_element(tree, source, tree.append_child(node), child, depth + 1, maxDepth);
         }
     }
-
-    return el;
 }
 
 } // namespace lvt
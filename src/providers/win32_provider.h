@@ -5,11 +5,14 @@ namespace lvt {
 
 class Win32Provider : public IProvider {
 public:
-    // Build the full HWND tree starting from the given root window.
-    Element build(HWND hwnd, int maxDepth = -1);
+    // Build the full HWND tree starting from the given root window as the
+    // root of `tree`. Returns the root node.
+    NodeId build(ElementTree& tree, CaptureSource& source, HWND hwnd, int maxDepth = -1);
 
 private:
-    Element build_element(HWND hwnd, int depth, int maxDepth);
+    static void fill_element(Element& el, HWND hwnd, WindowInfo&& info);
+    void build_element(ElementTree& tree, CaptureSource& source, NodeId node, HWND hwnd,
+                       int depth, int maxDepth);
 };
 
 } // namespace lvt
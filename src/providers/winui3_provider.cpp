@@ -1,74 +1,49 @@
 #include "winui3_provider.h"
-#include "xaml_diag_common.h"
-#include <cstdio>
-#include <Windows.h>
-#include <Psapi.h>
-#include <string>
+#include "xaml_provider.h"
 
 namespace lvt {
 
 // Label DesktopChildSiteBridge and related WinUI3 host windows
-static void label_winui3_windows(Element& el) {
-    if (el.className == "Microsoft.UI.Content.DesktopChildSiteBridge") {
-        el.framework = "winui3";
-        el.type = "DesktopChildSiteBridge";
-    } else if (el.className == "InputNonClientPointerSource") {
-        el.framework = "winui3";
-        el.type = "InputNonClientPointerSource";
-    } else if (el.className == "InputSiteWindowClass") {
-        el.framework = "winui3";
-        el.type = "InputSite";
-    }
-    for (auto& child : el.children) {
-        label_winui3_windows(child);
+static void label_winui3_windows(ElementTree& tree, NodeId root) {
+    for (NodeId n = root; n != kNoNode; n = tree.next_preorder(n, root)) {
+        Element& el = tree[n];
+        if (el.className == "Microsoft.UI.Content.DesktopChildSiteBridge") {
+            el.framework = "winui3";
+            el.type = "DesktopChildSiteBridge";
+        } else if (el.className == "InputNonClientPointerSource") {
+            el.framework = "winui3";
+            el.type = "InputNonClientPointerSource";
+        } else if (el.className == "InputSiteWindowClass") {
+            el.framework = "winui3";
+            el.type = "InputSite";
+        }
     }
 }
 
-// Find the FrameworkUdk.dll path loaded in the target process
-static std::wstring find_framework_udk(DWORD pid) {
-    HANDLE proc = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, pid);
-    if (!proc) return {};
-
-    HMODULE modules[1024];
-    DWORD needed = 0;
-    if (!EnumProcessModulesEx(proc, modules, sizeof(modules), &needed, LIST_MODULES_ALL)) {
-        CloseHandle(proc);
-        return {};
-    }
+void WinUI3Provider::enrich(ElementTree& tree, NodeId root, CaptureSource& source, HWND hwnd, DWORD pid) {
+    Pending pending;
+    fetch(pending, source, hwnd, pid);
+    prepare(pending, tree, root);
+    collect(pending);
+    apply(tree, root, pending);
+}
 
-    for (DWORD i = 0; i < needed / sizeof(HMODULE); i++) {
-        wchar_t name[MAX_PATH]{};
-        if (GetModuleBaseNameW(proc, modules[i], name, MAX_PATH)) {
-            if (_wcsicmp(name, L"Microsoft.Internal.FrameworkUdk.dll") == 0) {
-                wchar_t fullPath[MAX_PATH]{};
-                GetModuleFileNameExW(proc, modules[i], fullPath, MAX_PATH);
-                CloseHandle(proc);
-                return fullPath;
-            }
-        }
-    }
-    CloseHandle(proc);
-    return {};
+void WinUI3Provider::fetch(Pending& pending, CaptureSource& source, HWND hwnd, DWORD pid) {
+    pending.data = source.tap_payload(Framework::WinUI3, hwnd, pid);
 }
 
-void WinUI3Provider::enrich(Element& root, HWND hwnd, DWORD pid) {
-    label_winui3_windows(root);
+void WinUI3Provider::prepare(Pending& pending, const ElementTree& tree, NodeId root) {
+    pending.targets = find_xaml_graft_targets(tree, root);
+}
 
-    // Try XAML diagnostics injection for the full visual tree
-    // WinUI3 registers "WinUIVisualDiagConnection" endpoints
-    // InitializeXamlDiagnosticsEx can be loaded from FrameworkUdk.dll (WinAppSDK)
-    // or from Windows.UI.Xaml.dll (System32)
-    std::wstring frameworkUdk = find_framework_udk(pid);
-    std::wstring initDll;
-    if (!frameworkUdk.empty()) {
-        initDll = frameworkUdk;
-    } else {
-        // Fall back to system XAML
-        initDll = L"Windows.UI.Xaml.dll";
-    }
+void WinUI3Provider::collect(Pending& pending) {
+    stage_xaml_tree(pending.targets, pending.data, "winui3", pending.staged);
+    pending.data = std::string();
+}
 
-    inject_and_collect_xaml_tree(root, hwnd, pid, L"", initDll, "winui3",
-                               L"WinUIVisualDiagConnection");
+void WinUI3Provider::apply(ElementTree& tree, NodeId root, const Pending& pending) {
+    label_winui3_windows(tree, root);
+    pending.staged.attach(tree);
 }
 
 } // namespace lvt
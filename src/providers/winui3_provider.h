@@ -1,14 +1,32 @@
 #pragma once
 #include "provider.h"
+#include "xaml_provider.h"
+#include <string>
 
 namespace lvt {
 
 class WinUI3Provider : public IProvider {
 public:
     // Enrich the element tree with WinUI 3 visual tree information.
-    // Injects lvt_tap.dll via InitializeXamlDiagnosticsEx targeting
-    // Microsoft.UI.Xaml.dll in the target process.
-    void enrich(Element& root, HWND hwnd, DWORD pid);
+    // Labels WinUI 3 host windows and grafts the XAML tree that the TAP DLL
+    // collected via InitializeXamlDiagnosticsEx targeting Microsoft.UI.Xaml.dll.
+    // Equivalent to fetch(), prepare(), collect(), apply().
+    void enrich(ElementTree& tree, NodeId root, CaptureSource& source, HWND hwnd, DWORD pid);
+
+    struct Pending {
+        std::string data;  // TAP payload
+        XamlGraftTargets targets;
+        StagedGraft staged;
+    };
+
+    // Fetch the XAML tree from the target. Needs no element tree.
+    void fetch(Pending& pending, CaptureSource& source, HWND hwnd, DWORD pid);
+    // Find the bridge windows the XAML roots go to. Reads `tree` only.
+    void prepare(Pending& pending, const ElementTree& tree, NodeId root);
+    // Stage the fetched XAML tree. Does not touch the element tree.
+    void collect(Pending& pending);
+    // Label host windows and graft the staged XAML.
+    void apply(ElementTree& tree, NodeId root, const Pending& pending);
 };
 
 } // namespace lvt
@@ -1,7 +1,7 @@
 // wpf_inject.cpp — WPF DLL injection and tree collection.
 // Injects lvt_wpf_tap_x64.dll into the target process via
 // CreateRemoteThread + LoadLibraryW, then reads the WPF visual tree
-// JSON over a named pipe.
+// JSON over a named pipe. WpfProvider grafts it.
 
 #include "wpf_inject.h"
 #include "../debug.h"
@@ -13,13 +13,10 @@
 #include <aclapi.h>
 #include <Psapi.h>
 #include <wil/resource.h>
-#include <nlohmann/json.hpp>
 #include <cstdio>
 #include <string>
 #include <fstream>
 
-using json = nlohmann::json;
-
 namespace lvt {
 
 static std::wstring make_pipe_name() {
@@ -42,56 +39,6 @@ static std::wstring get_exe_dir() {
     return dir;
 }
 
-static std::string sanitize(const std::string& s) {
-    std::string r;
-    r.reserve(s.size());
-    for (char c : s) {
-        if (static_cast<unsigned char>(c) >= 0x20 || c == '\t')
-            r += c;
-    }
-    return r;
-}
-
-// Recursively graft JSON tree nodes into an Element tree.
-static void graft_json_node(const json& j, Element& parent, const std::string& framework) {
-    Element el;
-    el.framework = framework;
-    el.className = sanitize(j.value("type", ""));
-
-    // Simplify type name: "System.Windows.Controls.Button" -> "Button"
-    auto lastDot = el.className.rfind('.');
-    el.type = (lastDot != std::string::npos) ? el.className.substr(lastDot + 1) : el.className;
-
-    el.text = sanitize(j.value("text", ""));
-    if (el.text.empty())
-        el.text = sanitize(j.value("name", ""));
-
-    double w = j.value("width", 0.0);
-    double h = j.value("height", 0.0);
-    double ox = j.value("offsetX", 0.0);
-    double oy = j.value("offsetY", 0.0);
-    if (w > 0 && h > 0) {
-        el.bounds.x = static_cast<int>(ox);
-        el.bounds.y = static_cast<int>(oy);
-        el.bounds.width = static_cast<int>(w);
-        el.bounds.height = static_cast<int>(h);
-    }
-
-    // Visibility/enabled as properties
-    if (j.contains("visible") && j["visible"].is_boolean() && !j["visible"].get<bool>())
-        el.properties["visible"] = "false";
-    if (j.contains("enabled") && j["enabled"].is_boolean() && !j["enabled"].get<bool>())
-        el.properties["enabled"] = "false";
-
-    if (j.contains("children") && j["children"].is_array()) {
-        for (auto& child : j["children"]) {
-            graft_json_node(child, el, framework);
-        }
-    }
-
-    parent.children.push_back(std::move(el));
-}
-
 // Write pipe name to a sidecar file next to the TAP DLL so it can read it
 static bool write_pipe_name_file(const std::wstring& dir, const std::wstring& pipeName) {
     std::wstring path = dir + L"\\lvt_wpf_pipe.txt";
@@ -158,7 +105,7 @@ static bool inject_dll(DWORD pid, const std::wstring& dllPath) {
     return true;
 }
 
-bool inject_and_collect_wpf_tree(Element& root, HWND /*hwnd*/, DWORD pid) {
+std::string collect_wpf_tree(DWORD pid) {
     // Check target process bitness matches ours
     wil::unique_handle proc(OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid));
     if (proc) {
@@ -167,7 +114,7 @@ bool inject_and_collect_wpf_tree(Element& root, HWND /*hwnd*/, DWORD pid) {
 #if defined(_M_X64) || defined(_M_ARM64)
             fprintf(stderr,
                 "lvt: WPF target is 32-bit (WoW64) - run lvt-x86.exe instead\n");
-            return false;
+            return {};
 #endif
         }
     }
@@ -181,7 +128,7 @@ bool inject_and_collect_wpf_tree(Element& root, HWND /*hwnd*/, DWORD pid) {
     if (GetFileAttributesW(tapDll.c_str()) == INVALID_FILE_ATTRIBUTES) {
         if (g_debug)
             fprintf(stderr, "lvt: WPF TAP DLL not found: %ls\n", tapDll.c_str());
-        return false;
+        return {};
     }
 
     // Check managed assembly is alongside
@@ -189,7 +136,7 @@ bool inject_and_collect_wpf_tree(Element& root, HWND /*hwnd*/, DWORD pid) {
     if (GetFileAttributesW(managedDll.c_str()) == INVALID_FILE_ATTRIBUTES) {
         if (g_debug)
             fprintf(stderr, "lvt: WPF managed assembly not found: %ls\n", managedDll.c_str());
-        return false;
+        return {};
     }
 
     std::wstring pipeName = make_pipe_name();
@@ -197,7 +144,7 @@ bool inject_and_collect_wpf_tree(Element& root, HWND /*hwnd*/, DWORD pid) {
     // Write pipe name to sidecar file for the TAP DLL to read
     if (!write_pipe_name_file(exeDir, pipeName)) {
         fprintf(stderr, "lvt: failed to write pipe name file\n");
-        return false;
+        return {};
     }
 
     // Create named pipe with AppContainer-accessible DACL
@@ -216,7 +163,7 @@ bool inject_and_collect_wpf_tree(Element& root, HWND /*hwnd*/, DWORD pid) {
 
     if (pipe == INVALID_HANDLE_VALUE) {
         fprintf(stderr, "lvt: failed to create named pipe (error %lu)\n", GetLastError());
-        return false;
+        return {};
     }
 
     // Start overlapped connect before injection
@@ -231,7 +178,7 @@ bool inject_and_collect_wpf_tree(Element& root, HWND /*hwnd*/, DWORD pid) {
         CancelIo(pipe);
         CloseHandle(ov.hEvent);
         CloseHandle(pipe);
-        return false;
+        return {};
     }
 
     if (g_debug)
@@ -244,13 +191,13 @@ bool inject_and_collect_wpf_tree(Element& root, HWND /*hwnd*/, DWORD pid) {
             CancelIo(pipe);
             CloseHandle(ov.hEvent);
             CloseHandle(pipe);
-            return false;
+            return {};
         }
     } else if (connectErr != ERROR_PIPE_CONNECTED) {
         fprintf(stderr, "lvt: WPF ConnectNamedPipe failed (error %lu)\n", connectErr);
         CloseHandle(ov.hEvent);
         CloseHandle(pipe);
-        return false;
+        return {};
     }
     CloseHandle(ov.hEvent);
 
@@ -289,31 +236,9 @@ bool inject_and_collect_wpf_tree(Element& root, HWND /*hwnd*/, DWORD pid) {
     if (g_debug)
         fprintf(stderr, "lvt: received %zu bytes of WPF tree data\n", data.size());
 
-    if (data.empty()) {
-        if (g_debug)
-            fprintf(stderr, "lvt: no WPF tree data received\n");
-        return false;
-    }
-
-    json treeJson;
-    try {
-        treeJson = json::parse(data);
-    } catch (const json::parse_error& e) {
-        fprintf(stderr, "lvt: failed to parse WPF tree JSON: %s\n", e.what());
-        return false;
-    }
-
-    // Graft WPF elements. The JSON is an array of Window roots.
-    // Each maps to an HwndWrapper HWND in the Win32 tree.
-    if (treeJson.is_array()) {
-        for (auto& node : treeJson) {
-            graft_json_node(node, root, "wpf");
-        }
-    } else if (treeJson.is_object()) {
-        graft_json_node(treeJson, root, "wpf");
-    }
-
-    return true;
+    if (data.empty() && g_debug)
+        fprintf(stderr, "lvt: no WPF tree data received\n");
+    return data;
 }
 
 } // namespace lvt
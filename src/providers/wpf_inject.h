@@ -1,14 +1,12 @@
 #pragma once
-#include "../element.h"
 #include <Windows.h>
 #include <string>
 
 namespace lvt {
 
-// Inject the WPF TAP DLL into a target process via CreateRemoteThread+LoadLibrary,
-// collect the WPF visual tree via the managed WpfTreeWalker, and graft it into
-// the element tree.
-// Returns true if the tree was successfully enriched.
-bool inject_and_collect_wpf_tree(Element& root, HWND hwnd, DWORD pid);
+// Inject the WPF TAP DLL into a target process via CreateRemoteThread+LoadLibrary
+// and return the WPF visual tree JSON collected by the managed WpfTreeWalker
+// (graft it with graft_wpf_tree). Returns an empty string on failure.
+std::string collect_wpf_tree(DWORD pid);
 
 } // namespace lvt
@@ -1,25 +1,116 @@
 #include "wpf_provider.h"
-#include "wpf_inject.h"
+#include "../text_scan.h"
+#include <nlohmann/json.hpp>
 #include <cstdio>
-#include <functional>
-#include <Windows.h>
+#include <string>
+
+using json = nlohmann::json;
 
 namespace lvt {
 
 // Label WPF HwndWrapper windows in the element tree
-static void label_wpf_windows(Element& el) {
-    if (el.className.starts_with("HwndWrapper[")) {
-        el.framework = "wpf";
-        el.type = "WpfWindow";
+static void label_wpf_windows(ElementTree& tree, NodeId root) {
+    for (NodeId n = root; n != kNoNode; n = tree.next_preorder(n, root)) {
+        Element& el = tree[n];
+        if (el.className.view().starts_with("HwndWrapper[")) {
+            el.framework = "wpf";
+            el.type = "WpfWindow";
+        }
+    }
+}
+
+void WpfProvider::enrich(ElementTree& tree, NodeId root, CaptureSource& source, HWND hwnd, DWORD pid) {
+    Pending pending;
+    fetch(pending, source, hwnd, pid);
+    collect(pending, root);
+    apply(tree, root, pending);
+}
+
+void WpfProvider::fetch(Pending& pending, CaptureSource& source, HWND hwnd, DWORD pid) {
+    pending.data = source.tap_payload(Framework::Wpf, hwnd, pid);
+}
+
+void WpfProvider::collect(Pending& pending, NodeId root) {
+    stage_wpf_tree(root, pending.data, pending.staged);
+    pending.data = std::string();
+}
+
+void WpfProvider::apply(ElementTree& tree, NodeId root, const Pending& pending) {
+    label_wpf_windows(tree, root);
+    pending.staged.attach(tree);
+}
+
+// Recursively graft JSON tree nodes into an Element tree.
+static void graft_json_node(const json& j, ElementTree& tree, NodeId parent,
+                            Symbol framework) {
+    NodeId node = tree.append_child(parent);
+    Element& el = tree[node];
+    el.framework = framework;
+    std::string className = text::sanitize(j.value("type", ""));
+    el.className = className;
+
+    // Simplify type name: "System.Windows.Controls.Button" -> "Button"
+    auto lastDot = className.rfind('.');
+    el.type = (lastDot != std::string::npos) ? std::string_view(className).substr(lastDot + 1)
+                                             : std::string_view(className);
+
+    el.text = text::sanitize(j.value("text", ""));
+    if (el.text.empty())
+        el.text = text::sanitize(j.value("name", ""));
+
+    double w = j.value("width", 0.0);
+    double h = j.value("height", 0.0);
+    double ox = j.value("offsetX", 0.0);
+    double oy = j.value("offsetY", 0.0);
+    if (w > 0 && h > 0) {
+        el.bounds.x = static_cast<int>(ox);
+        el.bounds.y = static_cast<int>(oy);
+        el.bounds.width = static_cast<int>(w);
+        el.bounds.height = static_cast<int>(h);
+    }
+
+    // Visibility/enabled as properties
+    if (j.contains("visible") && j["visible"].is_boolean() && !j["visible"].get<bool>())
+        el.properties.set(prop::kVisible, false);
+    if (j.contains("enabled") && j["enabled"].is_boolean() && !j["enabled"].get<bool>())
+        el.properties.set(prop::kEnabled, false);
+
+    if (j.contains("children") && j["children"].is_array()) {
+        for (auto& child : j["children"]) {
+            graft_json_node(child, tree, node, framework);
+        }
     }
-    for (auto& child : el.children) {
-        label_wpf_windows(child);
+}
+
+bool stage_wpf_tree(NodeId root, std::string_view data, StagedGraft& out) {
+    if (data.empty()) return false;
+
+    json treeJson;
+    try {
+        treeJson = json::parse(data);
+    } catch (const json::parse_error& e) {
+        fprintf(stderr, "lvt: failed to parse WPF tree JSON: %s\n", e.what());
+        return false;
     }
+
+    // Graft WPF elements. The JSON is an array of Window roots.
+    // Each maps to an HwndWrapper HWND in the Win32 tree.
+    if (treeJson.is_array()) {
+        for (auto& node : treeJson) {
+            graft_json_node(node, out.tree, out.stage(root), "wpf");
+        }
+    } else if (treeJson.is_object()) {
+        graft_json_node(treeJson, out.tree, out.stage(root), "wpf");
+    }
+
+    return true;
 }
 
-void WpfProvider::enrich(Element& root, HWND hwnd, DWORD pid) {
-    label_wpf_windows(root);
-    inject_and_collect_wpf_tree(root, hwnd, pid);
+bool graft_wpf_tree(ElementTree& tree, NodeId root, std::string_view data) {
+    StagedGraft staged;
+    if (!stage_wpf_tree(root, data, staged)) return false;
+    staged.attach(tree);
+    return true;
 }
 
 } // namespace lvt
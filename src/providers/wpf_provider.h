@@ -1,14 +1,37 @@
 #pragma once
 #include "provider.h"
+#include <string>
+#include <string_view>
 
 namespace lvt {
 
 class WpfProvider : public IProvider {
 public:
     // Enrich the element tree with WPF visual tree information.
-    // Labels HwndWrapper windows and (future) injects managed TAP DLL
-    // to walk the WPF visual tree via VisualTreeHelper.
-    void enrich(Element& root, HWND hwnd, DWORD pid);
+    // Labels HwndWrapper windows and grafts the visual tree that the managed
+    // walker (injected via lvt_wpf_tap.dll) collected with VisualTreeHelper.
+    // Equivalent to fetch(), collect(), apply().
+    void enrich(ElementTree& tree, NodeId root, CaptureSource& source, HWND hwnd, DWORD pid);
+
+    struct Pending {
+        std::string data;  // TAP payload
+        StagedGraft staged;
+    };
+
+    // Fetch the WPF tree from the target. Needs no element tree.
+    void fetch(Pending& pending, CaptureSource& source, HWND hwnd, DWORD pid);
+    // Stage the fetched WPF tree for `root`. Does not touch the element tree.
+    void collect(Pending& pending, NodeId root);
+    // Label HwndWrapper windows and graft the staged WPF tree.
+    void apply(ElementTree& tree, NodeId root, const Pending& pending);
 };
 
+// Parse the WPF visual tree JSON (an array of Window roots, or one root) and
+// build its elements into `out`, bound for `root`. Touches no other tree.
+// Returns false if `data` is empty or not valid JSON.
+bool stage_wpf_tree(NodeId root, std::string_view data, StagedGraft& out);
+
+// Stage the WPF tree and graft it under `root`.
+bool graft_wpf_tree(ElementTree& tree, NodeId root, std::string_view data);
+
 } // namespace lvt
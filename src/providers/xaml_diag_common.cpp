@@ -1,8 +1,9 @@
 // xaml_diag_common.cpp — Shared XAML diagnostics injection logic
-// Used by both XamlProvider and WinUI3Provider.
+// Used by LiveSource for both XamlProvider and WinUI3Provider.
 
 #include "xaml_diag_common.h"
 #include "../tap/tap_clsid.h"
+#include "../tap/tap_tree.h"
 #include "../debug.h"
 
 #include "../target.h"
@@ -13,14 +14,12 @@
 #include <userenv.h>
 #include <wil/resource.h>
 #include <xamlOM.h>
-#include <nlohmann/json.hpp>
 #include <cstdio>
 #include <string>
+#include <vector>
 
 #pragma comment(lib, "userenv.lib")
 
-using json = nlohmann::json;
-
 namespace lvt {
 
 static std::wstring make_pipe_name() {
@@ -111,71 +110,98 @@ static std::wstring stage_tap_dll_for_appcontainer(const std::wstring& srcDll) {
     return destPath;
 }
 
-// Strip control characters from XAML type names (runtime sometimes includes them)
-static std::string sanitize(const std::string& s) {
-    std::string r;
-    r.reserve(s.size());
-    for (char c : s) {
-        if (static_cast<unsigned char>(c) >= 0x20 || c == '\t')
-            r += c;
+// Wait up to `timeoutMs` for an overlapped operation on `pipe` started with
+// `started` (the ReadFile/WriteFile result). Cancels it on timeout.
+static bool finish_overlapped(HANDLE pipe, OVERLAPPED& ov, BOOL started, DWORD& bytes, DWORD timeoutMs) {
+    if (!started) {
+        if (GetLastError() != ERROR_IO_PENDING) return false;
+        if (WaitForSingleObject(ov.hEvent, timeoutMs) != WAIT_OBJECT_0) {
+            CancelIo(pipe);
+            GetOverlappedResult(pipe, &ov, &bytes, TRUE);
+            return false;
+        }
     }
-    return r;
+    return GetOverlappedResult(pipe, &ov, &bytes, FALSE) != FALSE;
 }
 
-// Collect all DesktopChildSiteBridge elements in tree order
-static void collect_bridges(Element& el, std::vector<Element*>& bridges) {
-    if (el.className == "Microsoft.UI.Content.DesktopChildSiteBridge") {
-        bridges.push_back(&el);
-    }
-    for (auto& child : el.children) {
-        collect_bridges(child, bridges);
+// "a,b,c" for a PROPS request or init flag.
+static std::string join_properties(const std::vector<std::string>& properties) {
+    std::string list;
+    for (const std::string& name : properties) {
+        if (!list.empty()) list += ',';
+        list += name;
     }
+    return list;
 }
 
-// Recursively graft JSON tree nodes into an Element tree.
-// parentOffsetX/Y accumulate offsets from the XAML root for screen coordinate computation.
-static void graft_json_node(const json& j, Element& parent, const std::string& framework,
-                            double parentOffsetX = 0, double parentOffsetY = 0) {
-    Element el;
-    el.framework = framework;
-    el.className = sanitize(j.value("type", ""));
-    el.text = sanitize(j.value("name", ""));
-
-    // Simplify type name: "Windows.UI.Xaml.Controls.Button" -> "Button"
-    auto lastDot = el.className.rfind('.');
-    el.type = (lastDot != std::string::npos) ? el.className.substr(lastDot + 1) : el.className;
-
-    // Parse bounds from TAP DLL data
-    double ox = j.value("offsetX", 0.0);
-    double oy = j.value("offsetY", 0.0);
-    double w = j.value("width", 0.0);
-    double h = j.value("height", 0.0);
-    double absX = parentOffsetX + ox;
-    double absY = parentOffsetY + oy;
-    if (w > 0 && h > 0) {
-        el.bounds.x = static_cast<int>(absX);
-        el.bounds.y = static_cast<int>(absY);
-        el.bounds.width = static_cast<int>(w);
-        el.bounds.height = static_cast<int>(h);
+std::string query_resident_tap(DWORD pid, const std::wstring& connPrefix,
+                               const std::vector<std::string>& properties) {
+    std::wstring name = tap::resident_pipe_name(pid, connPrefix);
+    HANDLE pipe = CreateFileW(name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_OVERLAPPED, nullptr);
+    if (pipe == INVALID_HANDLE_VALUE && GetLastError() == ERROR_PIPE_BUSY &&
+        WaitNamedPipeW(name.c_str(), 2000)) {
+        pipe = CreateFileW(name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+                           OPEN_EXISTING, FILE_FLAG_OVERLAPPED, nullptr);
+    }
+    if (pipe == INVALID_HANDLE_VALUE) return {};
+    // The name is predictable: only believe a server that is the target.
+    ULONG serverPid = 0;
+    if (!GetNamedPipeServerProcessId(pipe, &serverPid) || serverPid != pid) {
+        CloseHandle(pipe);
+        if (g_debug)
+            fprintf(stderr, "lvt: pipe for pid %lu is served by pid %lu, ignoring it\n", pid, serverPid);
+        return {};
     }
 
-    if (j.contains("children") && j["children"].is_array()) {
-        for (auto& child : j["children"]) {
-            graft_json_node(child, el, framework, absX, absY);
+    OVERLAPPED ov = {};
+    ov.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    // The TAP keeps what an earlier run asked for: say what this one wants.
+    std::string request = "PROPS " + join_properties(properties) + "\nTREE\n";
+    DWORD bytes = 0;
+    bool ok = finish_overlapped(pipe, ov,
+        WriteFile(pipe, request.data(), static_cast<DWORD>(request.size()), &bytes, &ov), bytes, 15000);
+
+    // Two response lines; the tree is in the second.
+    std::string line;
+    char buf[64 * 1024];
+    bool skipped = false;
+    while (ok) {
+        ResetEvent(ov.hEvent);
+        if (!finish_overlapped(pipe, ov, ReadFile(pipe, buf, sizeof(buf), &bytes, &ov), bytes, 15000) ||
+            bytes == 0)
+            break;
+        line.append(buf, bytes);
+        size_t nl = line.find('\n');
+        if (!skipped && nl != std::string::npos) {
+            line.erase(0, nl + 1);
+            skipped = true;
+            nl = line.find('\n');
+        }
+        if (skipped && nl != std::string::npos) {
+            line.resize(nl);
+            std::string tree(tap::tree_payload(line));
+            CloseHandle(ov.hEvent);
+            CloseHandle(pipe);
+            if (tree == "[]") tree.clear();  // its XAML is gone; inject afresh
+            if (g_debug)
+                fprintf(stderr, "lvt: resident TAP in pid %lu answered with %zu bytes\n", pid, tree.size());
+            return tree;
         }
     }
-
-    parent.children.push_back(std::move(el));
+    CloseHandle(ov.hEvent);
+    CloseHandle(pipe);
+    if (g_debug)
+        fprintf(stderr, "lvt: resident TAP in pid %lu did not answer\n", pid);
+    return {};
 }
 
-bool inject_and_collect_xaml_tree(
-    Element& root,
-    HWND /*hwnd*/,
+std::string collect_xaml_tree(
     DWORD pid,
     const std::wstring& xamlDiagDll,
     const std::wstring& initDllPath,
-    const std::string& frameworkLabel,
-    const std::wstring& connPrefix)
+    const std::wstring& connPrefix,
+    const std::vector<std::string>& properties)
 {
     const wchar_t* tapSuffix = (get_host_architecture() == Architecture::arm64)
         ? L"\\lvt_tap_arm64.dll" : L"\\lvt_tap_x64.dll";
@@ -183,7 +209,7 @@ bool inject_and_collect_xaml_tree(
 
     if (GetFileAttributesW(tapDll.c_str()) == INVALID_FILE_ATTRIBUTES) {
         fprintf(stderr, "lvt: TAP DLL not found: %ls\n", tapDll.c_str());
-        return false;
+        return {};
     }
 
     // AppContainer (UWP) processes can't load DLLs from arbitrary paths.
@@ -196,6 +222,17 @@ bool inject_and_collect_xaml_tree(
     }
 
     std::wstring pipeName = make_pipe_name();
+    // The TAP stays behind to serve later runs (query_resident_tap). It may
+    // be unable to create the pipe inside an AppContainer; then every run
+    // injects, as before.
+    std::wstring initData = pipeName + L"|SERVE=" + tap::resident_pipe_name(pid, connPrefix);
+    if (!properties.empty()) {
+        std::string list = join_properties(properties);
+        int n = MultiByteToWideChar(CP_UTF8, 0, list.data(), static_cast<int>(list.size()), nullptr, 0);
+        std::wstring wide(n, L'\0');
+        MultiByteToWideChar(CP_UTF8, 0, list.data(), static_cast<int>(list.size()), wide.data(), n);
+        initData += L"|PROPS=" + wide;
+    }
 
     // Build a security descriptor that allows AppContainer (UWP) processes to connect.
     // S-1-15-2-1 = ALL_APPLICATION_PACKAGES
@@ -214,7 +251,7 @@ bool inject_and_collect_xaml_tree(
 
     if (pipe == INVALID_HANDLE_VALUE) {
         fprintf(stderr, "lvt: failed to create named pipe (error %lu)\n", GetLastError());
-        return false;
+        return {};
     }
 
     // Load InitializeXamlDiagnosticsEx from the specified DLL.
@@ -227,7 +264,7 @@ bool inject_and_collect_xaml_tree(
     if (!hXaml) {
         fprintf(stderr, "lvt: failed to load %ls (error %lu)\n", initDllPath.c_str(), GetLastError());
         CloseHandle(pipe);
-        return false;
+        return {};
     }
 
     using FnInit = HRESULT(WINAPI*)(LPCWSTR, DWORD, LPCWSTR, LPCWSTR, CLSID, LPCWSTR);
@@ -237,7 +274,7 @@ bool inject_and_collect_xaml_tree(
         fprintf(stderr, "lvt: InitializeXamlDiagnosticsEx not found in %ls\n", initDllPath.c_str());
         FreeLibrary(hXaml);
         CloseHandle(pipe);
-        return false;
+        return {};
     }
 
     // Try connection endpoint names: prefix + "1", prefix + "2", ...
@@ -261,7 +298,7 @@ bool inject_and_collect_xaml_tree(
             xamlDiagDll.c_str(),
             tapDll.c_str(),
             CLSID_LvtTap,
-            pipeName.c_str());
+            initData.c_str());
 
         if (g_debug)
             fprintf(stderr, "lvt: %ls pid=%lu -> 0x%08lX\n", endPoint, pid, hr);
@@ -277,7 +314,7 @@ bool inject_and_collect_xaml_tree(
         CancelIo(pipe);
         CloseHandle(ov.hEvent);
         CloseHandle(pipe);
-        return false;
+        return {};
     }
 
     if (g_debug)
@@ -291,13 +328,13 @@ bool inject_and_collect_xaml_tree(
             CancelIo(pipe);
             CloseHandle(ov.hEvent);
             CloseHandle(pipe);
-            return false;
+            return {};
         }
     } else if (connectErr != ERROR_PIPE_CONNECTED) {
         fprintf(stderr, "lvt: ConnectNamedPipe failed (error %lu)\n", connectErr);
         CloseHandle(ov.hEvent);
         CloseHandle(pipe);
-        return false;
+        return {};
     }
     CloseHandle(ov.hEvent);
 
@@ -333,51 +370,9 @@ bool inject_and_collect_xaml_tree(
     if (g_debug)
         fprintf(stderr, "lvt: received %zu bytes of XAML tree data\n", data.size());
 
-    if (data.empty()) {
+    if (data.empty())
         fprintf(stderr, "lvt: no XAML tree data received from target process\n");
-        return false;
-    }
-
-    json treeJson;
-    try {
-        treeJson = json::parse(data);
-    } catch (const json::parse_error& e) {
-        fprintf(stderr, "lvt: failed to parse XAML tree JSON: %s\n", e.what());
-        return false;
-    }
-
-    // Graft XAML elements into corresponding bridge windows.
-    // Each DesktopWindowXamlSource root maps 1:1 to a DesktopChildSiteBridge HWND.
-    // We match them by order since both lists are enumerated in the same order.
-    // XAML element offsets are relative to the XAML root; we add the bridge window's
-    // screen position to convert to screen coordinates for annotation.
-    if (treeJson.is_array()) {
-        std::vector<Element*> bridges;
-        collect_bridges(root, bridges);
-
-        size_t bridgeIdx = 0;
-        for (auto& node : treeJson) {
-            std::string typeName = sanitize(node.value("type", ""));
-            // Try to graft DesktopWindowXamlSource roots into matching bridges
-            if (typeName.find("DesktopWindowXamlSource") != std::string::npos
-                && bridgeIdx < bridges.size()) {
-                auto* bridge = bridges[bridgeIdx];
-                // Use bridge window's screen bounds as coordinate origin for XAML elements
-                double baseX = bridge->bounds.x;
-                double baseY = bridge->bounds.y;
-                graft_json_node(node, *bridge, frameworkLabel, baseX, baseY);
-                bridgeIdx++;
-            } else {
-                // Non-bridge XAML root (e.g. UWP CoreWindow): graft under root,
-                // using root's screen bounds as coordinate base
-                graft_json_node(node, root, frameworkLabel, root.bounds.x, root.bounds.y);
-            }
-        }
-    } else if (treeJson.is_object()) {
-        graft_json_node(treeJson, root, frameworkLabel);
-    }
-
-    return true;
+    return data;
 }
 
 } // namespace lvt
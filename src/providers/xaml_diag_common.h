@@ -1,25 +1,33 @@
 #pragma once
-#include "../element.h"
 #include <Windows.h>
 #include <string>
+#include <vector>
 
 namespace lvt {
 
-// Inject the TAP DLL into a target process using InitializeXamlDiagnosticsEx,
-// collect the XAML visual tree, and graft it into the element tree.
+// Inject the TAP DLL into a target process using InitializeXamlDiagnosticsEx
+// and return the XAML visual tree JSON it sends back over a named pipe
+// (graft it with graft_xaml_tree). Returns an empty string on failure.
+// The TAP stays resident afterwards; see query_resident_tap.
 // `xamlDiagDll` is passed as wszDllXamlDiagnostics to the init function.
 // `initDllPath` is the DLL to load InitializeXamlDiagnosticsEx from
 //   (e.g. L"Windows.UI.Xaml.dll" or full path to FrameworkUdk.dll).
 // `connPrefix` is the connection endpoint name prefix to use
 //   (e.g. L"VisualDiagConnection" for system XAML, L"WinUIVisualDiagConnection" for WinUI3).
-// Returns true if the tree was successfully enriched.
-bool inject_and_collect_xaml_tree(
-    Element& root,
-    HWND hwnd,
+// `properties` are XAML property names (e.g. "Text",
+//   "AutomationProperties.Name") to send with each element that has them.
+std::string collect_xaml_tree(
     DWORD pid,
     const std::wstring& xamlDiagDll,
     const std::wstring& initDllPath,
-    const std::string& frameworkLabel,
-    const std::wstring& connPrefix = L"VisualDiagConnection");
+    const std::wstring& connPrefix = L"VisualDiagConnection",
+    const std::vector<std::string>& properties = {});
+
+// Ask a TAP left resident in `pid` by an earlier collect_xaml_tree for its
+// live tree, with `properties`, without injecting. Returns an empty string if
+// there is none, the pipe is served by a process other than `pid`, or it does
+// not answer in time.
+std::string query_resident_tap(DWORD pid, const std::wstring& connPrefix = L"VisualDiagConnection",
+                               const std::vector<std::string>& properties = {});
 
 } // namespace lvt
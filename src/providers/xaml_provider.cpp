@@ -1,35 +1,165 @@
 #include "xaml_provider.h"
-#include "xaml_diag_common.h"
+#include "../text_scan.h"
+#include <nlohmann/json.hpp>
 #include <cstdio>
-#include <functional>
-#include <Windows.h>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
 
 namespace lvt {
 
-void XamlProvider::enrich(Element& root, HWND hwnd, DWORD pid) {
-    Element* coreWindow = nullptr;
-    std::function<void(Element&)> findCoreWindow = [&](Element& el) {
-        if (el.className == "Windows.UI.Core.CoreWindow") {
+static const Symbol kCoreWindowClass("Windows.UI.Core.CoreWindow");
+static const Symbol kBridgeClass("Microsoft.UI.Content.DesktopChildSiteBridge");
+
+void XamlProvider::enrich(ElementTree& tree, NodeId root, CaptureSource& source, DWORD pid) {
+    Pending pending = prepare(tree, root);
+    collect(pending, source, pid);
+    apply(tree, root, pending);
+}
+
+XamlProvider::Pending XamlProvider::prepare(const ElementTree& tree, NodeId root) {
+    Pending pending;
+    for (NodeId n = root; n != kNoNode; n = tree.next_preorder(n, root)) {
+        if (tree[n].className == kCoreWindowClass) {
+            pending.coreNode = n;
+            break;
+        }
+    }
+    if (pending.coreNode == kNoNode) return pending;
+
+    pending.coreHwnd = reinterpret_cast<HWND>(tree[pending.coreNode].nativeHandle);
+    pending.targets = find_xaml_graft_targets(tree, pending.coreNode);
+    return pending;
+}
+
+void XamlProvider::collect(Pending& pending, CaptureSource& source, DWORD pid) {
+    if (pending.coreNode == kNoNode) return;
+
+    // UWP apps: the CoreWindow belongs to the actual app process (e.g. CalculatorApp.exe),
+    // not the ApplicationFrameHost.exe that owns the top-level window, so the
+    // source collects from the CoreWindow's owning process.
+    stage_xaml_tree(pending.targets, source.tap_payload(Framework::Xaml, pending.coreHwnd, pid),
+                    "xaml", pending.staged);
+}
+
+void XamlProvider::apply(ElementTree& tree, NodeId root, const Pending& pending) {
+    for (NodeId n = root; n != kNoNode; n = tree.next_preorder(n, root)) {
+        Element& el = tree[n];
+        if (el.className == kCoreWindowClass) {
             el.framework = "xaml";
             el.type = "CoreWindow";
-            if (!coreWindow) coreWindow = &el;
         }
-        for (auto& child : el.children) findCoreWindow(child);
-    };
-    findCoreWindow(root);
+    }
+    pending.staged.attach(tree);
+}
 
-    if (!coreWindow) return;
+XamlGraftTargets find_xaml_graft_targets(const ElementTree& tree, NodeId root) {
+    XamlGraftTargets targets;
+    targets.root = root;
+    targets.rootBounds = tree[root].bounds;
+    for (NodeId n = root; n != kNoNode; n = tree.next_preorder(n, root)) {
+        if (tree[n].className == kBridgeClass)
+            targets.bridges.push_back({n, tree[n].bounds});
+    }
+    return targets;
+}
 
-    // UWP apps: the CoreWindow belongs to the actual app process (e.g. CalculatorApp.exe),
-    // not the ApplicationFrameHost.exe that owns the top-level window.
-    // We must inject into the CoreWindow's owning process.
-    DWORD corePid = pid;
-    if (coreWindow->nativeHandle) {
-        HWND coreHwnd = reinterpret_cast<HWND>(coreWindow->nativeHandle);
-        GetWindowThreadProcessId(coreHwnd, &corePid);
+// Recursively graft JSON tree nodes into an Element tree.
+// parentOffsetX/Y accumulate offsets from the XAML root for screen coordinate computation.
+static void graft_json_node(const json& j, ElementTree& tree, NodeId parent,
+                            Symbol framework,
+                            double parentOffsetX = 0, double parentOffsetY = 0) {
+    NodeId node = tree.append_child(parent);
+    Element& el = tree[node];
+    el.framework = framework;
+    std::string className = text::sanitize(j.value("type", ""));
+    el.className = className;
+    el.text = text::sanitize(j.value("name", ""));
+
+    // Simplify type name: "Windows.UI.Xaml.Controls.Button" -> "Button"
+    auto lastDot = className.rfind('.');
+    el.type = (lastDot != std::string::npos) ? std::string_view(className).substr(lastDot + 1)
+                                             : std::string_view(className);
+
+    // Parse bounds from TAP DLL data
+    double ox = j.value("offsetX", 0.0);
+    double oy = j.value("offsetY", 0.0);
+    double w = j.value("width", 0.0);
+    double h = j.value("height", 0.0);
+    double absX = parentOffsetX + ox;
+    double absY = parentOffsetY + oy;
+    if (w > 0 && h > 0) {
+        el.bounds.x = static_cast<int>(absX);
+        el.bounds.y = static_cast<int>(absY);
+        el.bounds.width = static_cast<int>(w);
+        el.bounds.height = static_cast<int>(h);
+    }
+
+    // Properties lvt asked the TAP for (--xaml-props), as the TAP read them.
+    if (auto props = j.find("properties"); props != j.end() && props->is_object()) {
+        for (auto& [key, value] : props->items()) {
+            if (value.is_string()) {
+                el.properties.set(text::sanitize(key), text::sanitize(value.get<std::string>()));
+            }
+        }
     }
 
-    inject_and_collect_xaml_tree(*coreWindow, hwnd, corePid, L"", L"Windows.UI.Xaml.dll", "xaml");
+    if (j.contains("children") && j["children"].is_array()) {
+        for (auto& child : j["children"]) {
+            graft_json_node(child, tree, node, framework, absX, absY);
+        }
+    }
+}
+
+bool stage_xaml_tree(const XamlGraftTargets& targets, std::string_view data, Symbol framework,
+                     StagedGraft& out) {
+    if (data.empty()) return false;
+
+    json treeJson;
+    try {
+        treeJson = json::parse(data);
+    } catch (const json::parse_error& e) {
+        fprintf(stderr, "lvt: failed to parse XAML tree JSON: %s\n", e.what());
+        return false;
+    }
+
+    // Graft XAML elements into corresponding bridge windows.
+    // Each DesktopWindowXamlSource root maps 1:1 to a DesktopChildSiteBridge HWND.
+    // We match them by order since both lists are enumerated in the same order.
+    // XAML element offsets are relative to the XAML root; we add the bridge window's
+    // screen position to convert to screen coordinates for annotation.
+    if (treeJson.is_array()) {
+        size_t bridgeIdx = 0;
+        for (auto& node : treeJson) {
+            std::string typeName = text::sanitize(node.value("type", ""));
+            // Try to graft DesktopWindowXamlSource roots into matching bridges
+            if (typeName.find("DesktopWindowXamlSource") != std::string::npos
+                && bridgeIdx < targets.bridges.size()) {
+                auto& [bridge, bounds] = targets.bridges[bridgeIdx];
+                // Use bridge window's screen bounds as coordinate origin for XAML elements
+                graft_json_node(node, out.tree, out.stage(bridge), framework, bounds.x, bounds.y);
+                bridgeIdx++;
+            } else {
+                // Non-bridge XAML root (e.g. UWP CoreWindow): graft under root,
+                // using root's screen bounds as coordinate base
+                graft_json_node(node, out.tree, out.stage(targets.root), framework,
+                                targets.rootBounds.x, targets.rootBounds.y);
+            }
+        }
+    } else if (treeJson.is_object()) {
+        graft_json_node(treeJson, out.tree, out.stage(targets.root), framework);
+    }
+
+    return true;
+}
+
+bool graft_xaml_tree(ElementTree& tree, NodeId root, std::string_view data, Symbol framework) {
+    StagedGraft staged;
+    if (!stage_xaml_tree(find_xaml_graft_targets(tree, root), data, framework, staged))
+        return false;
+    staged.attach(tree);
+    return true;
 }
 
 } // namespace lvt
@@ -1,14 +1,53 @@
 #pragma once
 #include "provider.h"
+#include <string_view>
+#include <utility>
+#include <vector>
 
 namespace lvt {
 
+// Where graft_xaml_tree puts the XAML roots found under `root`:
+// DesktopWindowXamlSource roots go to the DesktopChildSiteBridge windows
+// below `root`, matched in order, and every other root goes under `root`.
+// Bounds are the hosts' screen positions, used as the XAML coordinate origin.
+struct XamlGraftTargets {
+    NodeId root = kNoNode;
+    Bounds rootBounds;
+    std::vector<std::pair<NodeId, Bounds>> bridges;
+};
+
+XamlGraftTargets find_xaml_graft_targets(const ElementTree& tree, NodeId root);
+
+// Parse the XAML visual tree JSON sent by the TAP DLL and build its elements
+// into `out`, each root bound for its host in `targets`. Touches no other
+// tree. Returns false if `data` is empty or not valid JSON.
+bool stage_xaml_tree(const XamlGraftTargets& targets, std::string_view data, Symbol framework,
+                     StagedGraft& out);
+
+// Stage the XAML tree for the hosts under `root` and graft it into `tree`.
+bool graft_xaml_tree(ElementTree& tree, NodeId root, std::string_view data, Symbol framework);
+
 class XamlProvider : public IProvider {
 public:
     // Enrich the element tree with UWP XAML visual tree information.
-    // Injects lvt_tap.dll into the target process via InitializeXamlDiagnosticsEx
-    // and reads the XAML visual tree over a named pipe.
-    void enrich(Element& root, HWND hwnd, DWORD pid);
+    // Labels the CoreWindow and grafts the XAML tree that the TAP DLL
+    // (lvt_tap.dll, injected via InitializeXamlDiagnosticsEx) collected in
+    // the CoreWindow's process. Equivalent to prepare(), collect(), apply().
+    void enrich(ElementTree& tree, NodeId root, CaptureSource& source, DWORD pid);
+
+    struct Pending {
+        NodeId coreNode = kNoNode;
+        HWND coreHwnd = nullptr;
+        XamlGraftTargets targets;
+        StagedGraft staged;
+    };
+
+    // Find the CoreWindow and the hosts for its XAML roots. Reads `tree` only.
+    Pending prepare(const ElementTree& tree, NodeId root);
+    // Fetch and stage the XAML tree. Does not touch the element tree.
+    void collect(Pending& pending, CaptureSource& source, DWORD pid);
+    // Label CoreWindows and graft the staged XAML.
+    void apply(ElementTree& tree, NodeId root, const Pending& pending);
 };
 
 } // namespace lvt
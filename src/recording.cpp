@@ -0,0 +1,295 @@
+#include "recording.h"
+#include "tree_builder.h"
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <thread>
+
+using json = nlohmann::json;
+
+namespace lvt {
+
+static constexpr std::string_view kFormat = "lvt-recording";
+static constexpr int kVersion = 1;
+
+static uint64_t handle_value(HWND hwnd) {
+    return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(hwnd));
+}
+
+static HWND to_hwnd(uint64_t value) {
+    return reinterpret_cast<HWND>(static_cast<uintptr_t>(value));
+}
+
+static bool fail(std::string* error, const std::string& message) {
+    if (error) *error = message;
+    return false;
+}
+
+// ---- Serialization ----
+
+// Payloads and window text are passed through untouched; anything that is not
+// valid UTF-8 is written as U+FFFD rather than failing the whole recording.
+static void write_item(OutputSink& out, const json& j, bool& first) {
+    if (!first) out.put(',');
+    first = false;
+    out.write(j.dump(-1, ' ', false, json::error_handler_t::replace));
+}
+
+static json window_json(const Recording::Window& w) {
+    json j = {
+        {"hwnd", w.hwnd},
+        {"class", w.info.className.view()},
+        {"text", w.info.text},
+        {"bounds", {w.info.rect.x, w.info.rect.y, w.info.rect.width, w.info.rect.height}},
+        {"style", w.info.style},
+        {"visible", w.info.visible},
+        {"enabled", w.info.enabled},
+    };
+    if (w.enumerated) j["children"] = w.children;
+    return j;
+}
+
+static json comctl_json(const Recording::ComCtl& c) {
+    json items = json::array();
+    for (const ComCtlItem& item : c.reply.items)
+        items.push_back({{"text", item.text}, {"commandId", item.commandId}, {"state", item.state}});
+    json j = {
+        {"hwnd", c.hwnd},
+        {"count", c.reply.count},
+        {"viewMode", c.reply.viewMode},
+        {"selected", c.reply.selected},
+        {"items", std::move(items)},
+    };
+    if (c.reply.columnCount) j["columnCount"] = *c.reply.columnCount;
+    return j;
+}
+
+static json payload_json(const Recording::Payload& p) {
+    return {
+        {"framework", framework_to_string(p.framework)},
+        {"name", p.name},
+        {"host", p.host},
+        {"pid", p.pid},
+        {"data", p.data},
+    };
+}
+
+void write_recording(OutputSink& out, const Recording& rec) {
+    json frameworks = json::array();
+    for (const FrameworkInfo& fi : rec.frameworks)
+        frameworks.push_back({{"type", framework_to_string(fi.type)}, {"version", fi.version}, {"name", fi.name}});
+    json header = {
+        {"format", kFormat},
+        {"version", kVersion},
+        {"hwnd", rec.hwnd},
+        {"pid", rec.pid},
+        {"processName", rec.processName},
+        {"frameworks", std::move(frameworks)},
+    };
+
+    // Emit the large sections one item at a time instead of building a
+    // document for the whole capture.
+    std::string head = header.dump(-1, ' ', false, json::error_handler_t::replace);
+    head.pop_back();  // reopen the object
+    out.write(head);
+
+    bool first = true;
+    out.write(",\"windows\":[");
+    for (const auto& w : rec.windows) write_item(out, window_json(w), first);
+
+    first = true;
+    out.write("],\"comctl\":[");
+    for (const auto& c : rec.comctl) write_item(out, comctl_json(c), first);
+
+    first = true;
+    out.write("],\"payloads\":[");
+    for (const auto& p : rec.payloads) write_item(out, payload_json(p), first);
+    out.write("]}\n");
+}
+
+static Framework framework_field(const json& j, const char* key) {
+    Framework f;
+    if (!framework_from_string(j.at(key).get_ref<const std::string&>(), f))
+        throw std::runtime_error("unknown framework '" + j.at(key).get<std::string>() + "'");
+    return f;
+}
+
+bool read_recording(std::string_view data, Recording& rec, std::string* error) {
+    json j = json::parse(data, nullptr, false);
+    if (j.is_discarded() || !j.is_object())
+        return fail(error, "recording is not valid JSON");
+    if (j.value("format", "") != kFormat)
+        return fail(error, "not an lvt recording");
+    if (!j.contains("version") || !j["version"].is_number_integer() || j["version"].get<int>() > kVersion)
+        return fail(error, "unsupported recording version");
+
+    rec = {};
+    try {
+        rec.hwnd = j.at("hwnd").get<uint64_t>();
+        rec.pid = j.at("pid").get<DWORD>();
+        rec.processName = j.value("processName", "");
+        for (const json& f : j.at("frameworks")) {
+            rec.frameworks.push_back({framework_field(f, "type"), f.value("version", ""),
+                                      f.value("name", "")});
+        }
+
+        rec.windows.reserve(j.at("windows").size());
+        for (const json& w : j.at("windows")) {
+            Recording::Window& win = rec.windows.emplace_back();
+            win.hwnd = w.at("hwnd").get<uint64_t>();
+            win.info.className = w.value("class", "");
+            win.info.text = w.value("text", "");
+            const json& b = w.at("bounds");
+            win.info.rect = {b.at(0).get<int>(), b.at(1).get<int>(), b.at(2).get<int>(), b.at(3).get<int>()};
+            win.info.style = w.value("style", 0u);
+            win.info.visible = w.value("visible", false);
+            win.info.enabled = w.value("enabled", false);
+            if (w.contains("children")) {
+                win.enumerated = true;
+                win.children = w["children"].get<std::vector<uint64_t>>();
+            }
+        }
+
+        for (const json& c : j.at("comctl")) {
+            Recording::ComCtl& cc = rec.comctl.emplace_back();
+            cc.hwnd = c.at("hwnd").get<uint64_t>();
+            cc.reply.count = c.value("count", 0);
+            cc.reply.viewMode = c.value("viewMode", 0u);
+            if (c.contains("columnCount")) cc.reply.columnCount = c["columnCount"].get<int32_t>();
+            cc.reply.selected = c.value("selected", -1);
+            for (const json& item : c.at("items")) {
+                cc.reply.items.push_back({item.value("text", ""), item.value("commandId", 0),
+                                          item.value("state", 0u)});
+            }
+        }
+
+        for (const json& p : j.at("payloads")) {
+            rec.payloads.push_back({framework_field(p, "framework"), p.value("name", ""),
+                                    p.at("host").get<uint64_t>(), p.value("pid", DWORD{0}),
+                                    p.at("data").get<std::string>()});
+        }
+    } catch (const std::exception& e) {
+        rec = {};
+        return fail(error, std::string("recording is corrupt: ") + e.what());
+    }
+    return true;
+}
+
+// ---- Recording ----
+
+Recording::Window& RecordingSource::window_record(uint64_t hwnd) {
+    auto [it, inserted] = m_windows.try_emplace(hwnd, m_rec.windows.size());
+    if (inserted) m_rec.windows.emplace_back().hwnd = hwnd;
+    return m_rec.windows[it->second];
+}
+
+WindowInfo RecordingSource::window(HWND hwnd) {
+    WindowInfo info = m_inner.window(hwnd);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    window_record(handle_value(hwnd)).info = info;
+    return info;
+}
+
+std::vector<HWND> RecordingSource::children(HWND hwnd) {
+    std::vector<HWND> children = m_inner.children(hwnd);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Recording::Window& w = window_record(handle_value(hwnd));
+    w.enumerated = true;
+    w.children.clear();
+    for (HWND child : children) w.children.push_back(handle_value(child));
+    return children;
+}
+
+bool RecordingSource::comctl(HWND hwnd, Symbol className, ComCtlReply& reply) {
+    if (!m_inner.comctl(hwnd, className, reply)) return false;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_rec.comctl.push_back({handle_value(hwnd), reply});
+    return true;
+}
+
+std::string RecordingSource::tap_payload(Framework framework, HWND host, DWORD pid) {
+    std::string data = m_inner.tap_payload(framework, host, pid);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_rec.payloads.push_back({framework, {}, handle_value(host), pid, data});
+    return data;
+}
+
+std::string RecordingSource::plugin_payload(const std::string& name, HWND hwnd, DWORD pid,
+                                            HWND scope) {
+    std::string data = m_inner.plugin_payload(name, hwnd, pid, scope);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_rec.payloads.push_back({Framework::Plugin, name, handle_value(hwnd), pid, data});
+    return data;
+}
+
+// ---- Replay ----
+
+// Waits out an injected latency. Short waits spin, since sleeping rounds
+// them up to the scheduler tick and would swamp what is being modeled.
+static void delay(std::chrono::microseconds d) {
+    if (d.count() <= 0) return;
+    if (d >= std::chrono::milliseconds(1)) {
+        std::this_thread::sleep_for(d);
+        return;
+    }
+    auto until = std::chrono::steady_clock::now() + d;
+    while (std::chrono::steady_clock::now() < until) {
+    }
+}
+
+ReplayProvider::ReplayProvider(const Recording& rec, ReplayLatency latency)
+    : m_rec(rec), m_latency(latency) {
+    m_windows.reserve(rec.windows.size());
+    for (const auto& w : rec.windows) m_windows.emplace(w.hwnd, &w);
+    for (const auto& c : rec.comctl) m_comctl.emplace(c.hwnd, &c.reply);
+}
+
+WindowInfo ReplayProvider::window(HWND hwnd) {
+    delay(m_latency.window);
+    auto it = m_windows.find(handle_value(hwnd));
+    return it != m_windows.end() ? it->second->info : WindowInfo{};
+}
+
+std::vector<HWND> ReplayProvider::children(HWND hwnd) {
+    delay(m_latency.window);
+    std::vector<HWND> children;
+    auto it = m_windows.find(handle_value(hwnd));
+    if (it != m_windows.end()) {
+        children.reserve(it->second->children.size());
+        for (uint64_t child : it->second->children) children.push_back(to_hwnd(child));
+    }
+    return children;
+}
+
+bool ReplayProvider::comctl(HWND hwnd, Symbol, ComCtlReply& reply) {
+    delay(m_latency.comctl);
+    auto it = m_comctl.find(handle_value(hwnd));
+    if (it == m_comctl.end()) return false;
+    reply = *it->second;
+    return true;
+}
+
+const Recording::Payload* ReplayProvider::find_payload(Framework framework, std::string_view name,
+                                                       uint64_t host) const {
+    for (const auto& p : m_rec.payloads) {
+        if (p.framework == framework && p.name == name && p.host == host) return &p;
+    }
+    return nullptr;
+}
+
+std::string ReplayProvider::tap_payload(Framework framework, HWND host, DWORD) {
+    delay(m_latency.payload);
+    const Recording::Payload* p = find_payload(framework, {}, handle_value(host));
+    return p ? p->data : std::string();
+}
+
+std::string ReplayProvider::plugin_payload(const std::string& name, HWND hwnd, DWORD, HWND) {
+    delay(m_latency.payload);
+    const Recording::Payload* p = find_payload(Framework::Plugin, name, handle_value(hwnd));
+    return p ? p->data : std::string();
+}
+
+ElementTree ReplayProvider::build(const TreeScope& scope, ElementIndex* index, ThreadPool* pool) {
+    return build_tree(*this, to_hwnd(m_rec.hwnd), m_rec.pid, m_rec.frameworks, scope, index, pool);
+}
+
+} // namespace lvt
@@ -0,0 +1,130 @@
+#pragma once
+#include "capture_source.h"
+#include "element_index.h"
+#include "output_sink.h"
+#include "thread_pool.h"
+#include "tree_builder.h"
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace lvt {
+
+// The raw inputs of one capture: everything a CaptureSource answered while
+// build_tree() ran, plus the target it ran against. Replaying it reproduces
+// the capture exactly, on any platform.
+//
+// Saved as a JSON object (see write_recording):
+//   {"format": "lvt-recording", "version": 1,
+//    "hwnd", "pid", "processName",
+//    "frameworks": [{"type", "version", "name"}],
+//    "windows":  [{"hwnd", "class", "text", "bounds": [x, y, w, h], "style",
+//                  "visible", "enabled", "children": [hwnd...]}],
+//    "comctl":   [{"hwnd", "count", "viewMode", "columnCount", "selected",
+//                  "items": [{"text", "commandId", "state"}]}],
+//    "payloads": [{"framework", "name", "host", "pid", "data"}]}
+// Handles are numbers. "children" is absent for windows whose children were
+// not enumerated (below the depth limit). Payload "data" is the text exactly
+// as the TAP DLL, WPF walker or plugin produced it.
+struct Recording {
+    struct Window {
+        uint64_t hwnd = 0;
+        WindowInfo info;
+        bool enumerated = false;  // children() was called
+        std::vector<uint64_t> children;
+    };
+
+    struct ComCtl {
+        uint64_t hwnd = 0;
+        ComCtlReply reply;
+    };
+
+    struct Payload {
+        Framework framework = Framework::Plugin;
+        std::string name;  // plugin name; empty for TAP payloads
+        uint64_t host = 0;
+        DWORD pid = 0;
+        std::string data;
+    };
+
+    uint64_t hwnd = 0;
+    DWORD pid = 0;
+    std::string processName;
+    std::vector<FrameworkInfo> frameworks;
+
+    std::vector<Window> windows;
+    std::vector<ComCtl> comctl;
+    std::vector<Payload> payloads;
+};
+
+// Write `rec` in the recording format above.
+void write_recording(OutputSink& out, const Recording& rec);
+
+// Parse a recording. On failure returns false and describes the problem in
+// `error`.
+bool read_recording(std::string_view data, Recording& rec, std::string* error = nullptr);
+
+// Forwards every call to `inner` and appends its answers to `rec`. Safe to
+// call from several threads if `inner` is; entries from concurrent calls are
+// appended in completion order.
+class RecordingSource : public CaptureSource {
+public:
+    RecordingSource(CaptureSource& inner, Recording& rec) : m_inner(inner), m_rec(rec) {}
+
+    WindowInfo window(HWND hwnd) override;
+    std::vector<HWND> children(HWND hwnd) override;
+    bool comctl(HWND hwnd, Symbol className, ComCtlReply& reply) override;
+    std::string tap_payload(Framework framework, HWND host, DWORD pid) override;
+    std::string plugin_payload(const std::string& name, HWND hwnd, DWORD pid,
+                               HWND scope) override;
+
+private:
+    Recording::Window& window_record(uint64_t hwnd);
+
+    CaptureSource& m_inner;
+    Recording& m_rec;
+    std::mutex m_mutex;  // guards m_rec and m_windows
+    std::unordered_map<uint64_t, size_t> m_windows;  // hwnd -> index in m_rec.windows
+};
+
+// Simulated cost of each call into a ReplayProvider, to model a slow or
+// remote target. Zero (the default) replays as fast as possible.
+struct ReplayLatency {
+    std::chrono::microseconds window{0};    // per window() and children() call
+    std::chrono::microseconds comctl{0};    // per comctl() call
+    std::chrono::microseconds payload{0};   // per tap_payload() / plugin_payload() call
+};
+
+// Answers from a Recording, so build_tree() runs without a desktop. Windows,
+// controls and payloads that were not recorded read as empty. `rec` must
+// outlive the provider. Calls may come from several threads.
+class ReplayProvider : public CaptureSource {
+public:
+    explicit ReplayProvider(const Recording& rec, ReplayLatency latency = {});
+
+    WindowInfo window(HWND hwnd) override;
+    std::vector<HWND> children(HWND hwnd) override;
+    bool comctl(HWND hwnd, Symbol className, ComCtlReply& reply) override;
+    std::string tap_payload(Framework framework, HWND host, DWORD pid) override;
+    std::string plugin_payload(const std::string& name, HWND hwnd, DWORD pid,
+                               HWND scope) override;
+
+    // Run build_tree() against the recorded target.
+    ElementTree build(const TreeScope& scope = {}, ElementIndex* index = nullptr,
+                      ThreadPool* pool = nullptr);
+
+private:
+    const Recording::Payload* find_payload(Framework framework, std::string_view name,
+                                           uint64_t host) const;
+
+    const Recording& m_rec;
+    ReplayLatency m_latency;
+    std::unordered_map<uint64_t, const Recording::Window*> m_windows;
+    std::unordered_map<uint64_t, const ComCtlReply*> m_comctl;
+};
+
+} // namespace lvt
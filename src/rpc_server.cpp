@@ -0,0 +1,510 @@
+#include "rpc_server.h"
+#include "framework_detector.h"
+#include "json_serializer.h"
+#include "stable_ids.h"
+#include "tree_diff.h"
+#include "window_search.h"
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+namespace lvt {
+
+// JSON-RPC 2.0 error codes.
+static constexpr int kParseError = -32700;
+static constexpr int kInvalidRequest = -32600;
+static constexpr int kMethodNotFound = -32601;
+static constexpr int kInvalidParams = -32602;
+static constexpr int kServerError = -32000;
+
+bool ServerBackend::screenshot(HWND, const std::string&, const ElementTree&, NodeId, std::string* error) {
+    *error = "screenshots are not supported on this platform";
+    return false;
+}
+
+static std::string hwnd_text(HWND hwnd) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "0x%llX", static_cast<unsigned long long>(reinterpret_cast<uintptr_t>(hwnd)));
+    return buf;
+}
+
+// ---- parameters ----
+
+namespace {
+
+template <class Error>
+bool invalid(Error& error, std::string message) {
+    error = {kInvalidParams, std::move(message)};
+    return false;
+}
+
+// Optional members of `params`, left alone when absent. False (with `error`
+// set) when present with the wrong type.
+template <class Error>
+bool get(const nlohmann::json& params, const char* key, std::string& value, Error& error) {
+    auto it = params.find(key);
+    if (it == params.end()) return true;
+    if (!it->is_string()) return invalid(error, std::string("'") + key + "' must be a string");
+    value = it->template get<std::string>();
+    return true;
+}
+
+// Integers outside [min, max] are rejected rather than narrowed.
+template <class Error>
+bool get(const nlohmann::json& params, const char* key, int& value, Error& error, int min = INT_MIN,
+         int max = INT_MAX) {
+    auto it = params.find(key);
+    if (it == params.end()) return true;
+    if (!it->is_number_integer()) return invalid(error, std::string("'") + key + "' must be an integer");
+    bool inRange = it->is_number_unsigned() ? it->template get<uint64_t>() <= static_cast<uint64_t>(max)
+                                            : it->template get<int64_t>() >= min && it->template get<int64_t>() <= max;
+    if (!inRange) {
+        return invalid(error, std::string("'") + key + "' must be from " + std::to_string(min) + " to " +
+                                  std::to_string(max));
+    }
+    value = it->template get<int>();
+    return true;
+}
+
+template <class Error>
+bool get(const nlohmann::json& params, const char* key, bool& value, Error& error) {
+    auto it = params.find(key);
+    if (it == params.end()) return true;
+    if (!it->is_boolean()) return invalid(error, std::string("'") + key + "' must be true or false");
+    value = it->template get<bool>();
+    return true;
+}
+
+// Copy `node`'s subtree of `src` under `parent` of `dst`, `depth` levels deep.
+void copy_to_depth(ElementTree& dst, NodeId parent, const ElementTree& src, NodeId node, int depth) {
+    struct Item {
+        NodeId node;
+        NodeId parent;
+        int depth;
+    };
+    std::vector<Item> stack{{node, parent, 0}};
+    std::vector<NodeId> kids;
+    while (!stack.empty()) {
+        Item item = stack.back();
+        stack.pop_back();
+        NodeId copy = item.parent == kNoNode ? dst.add_root(src[item.node])
+                                             : dst.append_child(item.parent, src[item.node]);
+        if (depth >= 0 && item.depth >= depth) continue;
+        kids.assign(src.children(item.node).begin(), src.children(item.node).end());
+        for (auto it = kids.rbegin(); it != kids.rend(); ++it) stack.push_back({*it, copy, item.depth + 1});
+    }
+}
+
+} // namespace
+
+// ---- requests ----
+
+std::string RpcServer::handle(std::string_view request) {
+    m_stats.requests++;
+    auto error_response = [](const Json& id, int code, const std::string& message) {
+        Json response = {{"jsonrpc", "2.0"}, {"id", id}, {"error", {{"code", code}, {"message", message}}}};
+        return response.dump();
+    };
+
+    Json req = Json::parse(request, nullptr, false);
+    if (req.is_discarded()) return error_response(nullptr, kParseError, "parse error");
+    if (!req.is_object()) {
+        return error_response(nullptr, kInvalidRequest,
+                              req.is_array() ? "batches are not supported" : "request must be an object");
+    }
+    bool notification = !req.contains("id");
+    Json id = notification ? Json() : req["id"];
+    auto method = req.find("method");
+    if (method == req.end() || !method->is_string())
+        return error_response(id, kInvalidRequest, "request needs a method");
+    static const Json kNoParams = Json::object();
+    auto params = req.find("params");
+    if (params != req.end() && !params->is_object())
+        return error_response(id, kInvalidParams, "params must be an object");
+
+    std::string response = "{\"jsonrpc\":\"2.0\",\"id\":" + id.dump() + ",\"result\":";
+    Error error;
+    bool ok;
+    try {
+        StringSink out(response);
+        ok = dispatch(method->get<std::string>(), params != req.end() ? *params : kNoParams, out, error);
+        out.put('}');
+        out.flush();
+    } catch (const std::exception& e) {
+        // One bad capture must not take the server down.
+        ok = false;
+        error = {kServerError, std::string("internal error: ") + e.what()};
+    }
+    if (notification) return {};
+    return ok ? response : error_response(id, error.code, error.message);
+}
+
+bool RpcServer::dispatch(const std::string& method, const Json& params, OutputSink& out, Error& error) {
+    if (method == "dump") return dump(params, out, error);
+    if (method == "query") return query(params, out, error);
+    if (method == "diff") return diff(params, out, error);
+    if (method == "screenshot") return screenshot(params, out, error);
+    if (method == "shutdown") {
+        m_stopping = true;
+        out.write("null");
+        return true;
+    }
+    error = {kMethodNotFound, "unknown method '" + method + "'"};
+    return false;
+}
+
+// ---- targets and captures ----
+
+RpcServer::Target* RpcServer::resolve(const Json& params, Error& error) {
+    IWindowSystem& ws = m_backend.window_system();
+    HWND hwnd = nullptr;
+    int pid = 0;
+    std::string name, title;
+    bool refresh = false;
+    if (!get(params, "pid", pid, error, 0) || !get(params, "name", name, error) ||
+        !get(params, "title", title, error) || !get(params, "refresh", refresh, error))
+        return nullptr;
+
+    if (auto it = params.find("hwnd"); it != params.end()) {
+        std::optional<uint64_t> value;
+        if (it->is_number_unsigned()) value = it->get<uint64_t>();
+        if (it->is_string()) value = ElementIndex::parse_handle(it->get<std::string>());
+        if (!value) {
+            invalid(error, "'hwnd' must be a handle");
+            return nullptr;
+        }
+        hwnd = reinterpret_cast<HWND>(static_cast<uintptr_t>(*value));
+    } else if (pid || !name.empty() || !title.empty()) {
+        // A window found by a search is taken again while it still fits, so
+        // repeated requests skip enumerating the desktop.
+        std::string key = pid ? "pid:" + std::to_string(pid) : name.empty() ? "title:" + title : "name:" + name;
+        auto found = m_lookups.find(key);
+        if (!refresh && found != m_lookups.end()) {
+            auto target = m_targets.find(found->second);
+            HWND h = found->second;
+            if (target != m_targets.end() && ws.visible(h) && ws.process_id(h) == target->second.pid &&
+                (pid ? target->second.pid == static_cast<DWORD>(pid)
+                     : name.empty() ? icontains(ws.text(h), title) : icontains(target->second.processName, name)))
+                hwnd = h;
+        }
+        if (!hwnd && pid) {
+            hwnd = find_main_window(ws, static_cast<DWORD>(pid));
+            if (!hwnd) {
+                error = {kServerError, "no visible window found for pid " + std::to_string(pid)};
+                return nullptr;
+            }
+        } else if (!hwnd) {
+            auto matches = name.empty() ? find_by_title(ws, title) : find_by_process_name(ws, name);
+            const std::string& what = name.empty() ? title : name;
+            if (matches.size() != 1) {
+                std::string message = matches.empty() ? "no visible windows match '" + what + "'"
+                                                       : "multiple windows match '" + what + "':";
+                for (auto& m : matches) message += " " + hwnd_text(m.hwnd) + " (" + m.windowTitle + ")";
+                error = {kServerError, std::move(message)};
+                return nullptr;
+            }
+            hwnd = matches[0].hwnd;
+        }
+        m_lookups[key] = hwnd;
+    } else {
+        invalid(error, "params need a target: hwnd, pid, name or title");
+        return nullptr;
+    }
+
+    DWORD owner = ws.process_id(hwnd);
+    std::string why;
+    if (!owner) {
+        m_targets.erase(hwnd);
+        error = {kServerError, "target HWND " + hwnd_text(hwnd) + " is not a valid window"};
+        return nullptr;
+    }
+    if (!m_backend.check_target(hwnd, owner, &why)) {
+        error = {kServerError, std::move(why)};
+        return nullptr;
+    }
+
+    // Handles are reused: a different process behind the window is a
+    // different target.
+    Target& target = m_targets[hwnd];
+    if (target.hwnd != hwnd || target.pid != owner || refresh) {
+        target = {};
+        target.hwnd = hwnd;
+        target.pid = owner;
+        target.processName = ws.process_name(owner);
+        target.detected = detect_frameworks(ws, hwnd, owner);
+        for (auto& fi : m_backend.plugin_frameworks(hwnd, owner)) target.detected.push_back(std::move(fi));
+        for (auto& fi : target.detected) {
+            std::string display = framework_display_name(fi);
+            target.frameworks.push_back(fi.version.empty() ? display : display + " " + fi.version);
+        }
+        m_stats.detections++;
+    }
+    return &target;
+}
+
+ElementTree RpcServer::capture(Target& target, const TreeScope& scope, ElementIndex& index) {
+    // Providers wait on the target concurrently, one worker per framework.
+    ThreadPool* pool = nullptr;
+    if (target.detected.size() > 1) {
+        if (!m_pool || m_pool->size() < target.detected.size())
+            m_pool = std::make_unique<ThreadPool>(target.detected.size());
+        pool = m_pool.get();
+    }
+    std::unique_ptr<CaptureSource> source = m_backend.make_source();
+    m_stats.captures++;
+    return build_tree(*source, target.hwnd, target.pid, target.detected, scope, &index, pool);
+}
+
+// A full capture with stable IDs, carrying over those of the last snapshot.
+ElementTree RpcServer::capture_stable(Target& target, ElementIndex& index) {
+    ElementTree tree = capture(target, {}, index);
+    assign_stable_ids(tree, &index, target.snapshot.tree.empty() ? nullptr : &target.snapshot.tree);
+    return tree;
+}
+
+void RpcServer::keep(Target& target, ElementTree tree, ElementIndex index) {
+    target.snapshot = document(target, std::move(tree));
+    // The index's keys view the IDs in the tree's nodes, which moving the
+    // tree leaves in place.
+    target.index = std::move(index);
+    target.dumpedIds.clear();
+}
+
+NodeId RpcServer::find(const Target& target, std::string_view id) const {
+    NodeId node = target.index.find_by_id(id);
+    if (node != kNoNode) return node;
+    auto it = target.dumpedIds.find(std::string(id));
+    return it != target.dumpedIds.end() ? it->second : kNoNode;
+}
+
+TreeDocument RpcServer::document(const Target& target, ElementTree tree) const {
+    TreeDocument doc;
+    doc.tree = std::move(tree);
+    doc.hwnd = target.hwnd;
+    doc.pid = target.pid;
+    doc.processName = target.processName;
+    doc.frameworks = target.frameworks;
+    return doc;
+}
+
+// ---- methods ----
+
+bool RpcServer::dump(const Json& params, OutputSink& out, Error& error) {
+    std::string format = "json", element;
+    int depth = -1;
+    bool hashes = false, stableIds = false;
+    if (!get(params, "format", format, error) || !get(params, "element", element, error) ||
+        !get(params, "depth", depth, error, -1) || !get(params, "hashes", hashes, error) ||
+        !get(params, "stableIds", stableIds, error))
+        return false;
+    if (format != "json" && format != "xml") return invalid(error, "'format' must be json or xml");
+    Target* target = resolve(params, error);
+    if (!target) return false;
+
+    // As for --element and --depth: a stable ID does not say where its
+    // element is, so it needs the whole tree.
+    TreeScope scope{element, depth};
+    if (stableIds && !element.empty()) scope = {};
+    ElementIdAnchor anchor;
+    if (!scope.element.empty() && parse_element_id(scope.element, anchor) && anchor.window) {
+        IWindowSystem& ws = m_backend.window_system();
+        HWND window = reinterpret_cast<HWND>(anchor.window);
+        while (window && window != target->hwnd) window = ws.parent(window);
+        if (!window) {
+            error = {kServerError, "element '" + element + "' not found"};
+            return false;
+        }
+    }
+
+    ElementIndex index;
+    ElementTree tree = stableIds ? capture_stable(*target, index) : capture(*target, scope, index);
+    NodeId root = element.empty() ? tree.root() : index.find_by_id(element);
+    if (root == kNoNode) {
+        error = {kServerError, "element '" + element + "' not found"};
+        return false;
+    }
+    bool whole = scope.element.empty() && depth < 0;
+    if (depth >= 0) trim_to_depth(tree, root, depth);
+
+    if (format == "xml") {
+        write_json_string(out, serialize_to_xml(tree, root, target->hwnd, target->pid, target->processName,
+                                                target->frameworks, hashes));
+    } else {
+        write_json(out, tree, root, target->hwnd, target->pid, target->processName, target->frameworks, hashes,
+                   true);
+    }
+    if (whole) {
+        // The snapshot is what later requests carry IDs over from, so it
+        // always has stable ones; the IDs this response showed still resolve.
+        std::unordered_map<std::string, NodeId> dumped;
+        if (!stableIds) {
+            for (NodeId n = tree.root(); n != kNoNode; n = tree.next_preorder(n, tree.root())) dumped[tree[n].id] = n;
+            assign_stable_ids(tree, &index, target->snapshot.tree.empty() ? nullptr : &target->snapshot.tree);
+        }
+        keep(*target, std::move(tree), std::move(index));
+        target->dumpedIds = std::move(dumped);
+    }
+    return true;
+}
+
+bool RpcServer::query(const Json& params, OutputSink& out, Error& error) {
+    std::string id, type, className, framework, text;
+    int depth = 0, limit = 100;
+    bool refresh = false;
+    if (!get(params, "id", id, error) || !get(params, "type", type, error) ||
+        !get(params, "className", className, error) || !get(params, "framework", framework, error) ||
+        !get(params, "text", text, error) || !get(params, "depth", depth, error, -1) ||
+        !get(params, "limit", limit, error, -1) || !get(params, "refresh", refresh, error))
+        return false;
+    Target* target = resolve(params, error);
+    if (!target) return false;
+    if (refresh || target->snapshot.tree.empty()) {
+        ElementIndex index;
+        ElementTree tree = capture_stable(*target, index);
+        keep(*target, std::move(tree), std::move(index));
+    }
+
+    const ElementTree& tree = target->snapshot.tree;
+    auto matches = [&](NodeId n) {
+        const Element& el = tree[n];
+        return (type.empty() || el.type == type) && (className.empty() || el.className == className) &&
+               (framework.empty() || el.framework == framework) && (text.empty() || icontains(el.text, text));
+    };
+    size_t count = 0;
+    out.write("{\"count\":");
+    std::string elements;
+    {
+        StringSink list(elements);
+        auto add = [&](NodeId n) {
+            if (!matches(n)) return;
+            if (limit < 0 || count < static_cast<size_t>(limit)) {
+                if (count) list.put(',');
+                ElementTree part;
+                copy_to_depth(part, kNoNode, tree, n, depth);
+                write_json_element(list, part, part.root());
+            }
+            count++;
+        };
+        if (!id.empty()) {
+            if (NodeId n = find(*target, id); n != kNoNode) add(n);
+        } else {
+            for (NodeId n = tree.root(); n != kNoNode; n = tree.next_preorder(n, tree.root())) add(n);
+        }
+        list.flush();
+    }
+    out.write(std::to_string(count));
+    out.write(",\"elements\":[");
+    out.write(elements);
+    out.write("]}");
+    return true;
+}
+
+bool RpcServer::diff(const Json& params, OutputSink& out, Error& error) {
+    Target* target = resolve(params, error);
+    if (!target) return false;
+    ElementIndex index;
+    TreeDocument doc = document(*target, capture_stable(*target, index));
+    const TreeDocument& before = target->snapshot;
+    if (before.tree.empty()) {
+        out.write("{\"changed\":true,\"tree\":");
+        write_json(out, doc.tree, doc.tree.root(), doc.hwnd, doc.pid, doc.processName, doc.frameworks, false,
+                   true);
+    } else {
+        TreeDiff changes = diff_trees(before.tree, doc.tree);
+        bool changed = !changes.empty() || doc.processName != before.processName ||
+                       doc.frameworks != before.frameworks;
+        out.write(changed ? "{\"changed\":true,\"patch\":" : "{\"changed\":false,\"patch\":");
+        write_json_patch(out, before, doc, changes, true);
+    }
+    out.put('}');
+    keep(*target, std::move(doc.tree), std::move(index));
+    return true;
+}
+
+bool RpcServer::screenshot(const Json& params, OutputSink& out, Error& error) {
+    std::string path, element;
+    bool refresh = false;
+    if (!get(params, "path", path, error) || !get(params, "element", element, error) ||
+        !get(params, "refresh", refresh, error))
+        return false;
+    if (path.empty()) return invalid(error, "screenshot needs a 'path'");
+    Target* target = resolve(params, error);
+    if (!target) return false;
+    if (refresh || target->snapshot.tree.empty()) {
+        ElementIndex index;
+        ElementTree tree = capture_stable(*target, index);
+        keep(*target, std::move(tree), std::move(index));
+    }
+    NodeId crop = kNoNode;
+    if (!element.empty()) {
+        crop = find(*target, element);
+        if (crop == kNoNode) {
+            error = {kServerError, "element '" + element + "' not found"};
+            return false;
+        }
+    }
+    std::string why;
+    if (!m_backend.screenshot(target->hwnd, path, target->snapshot.tree, crop, &why)) {
+        error = {kServerError, why.empty() ? "cannot capture a screenshot" : why};
+        return false;
+    }
+    out.write("{\"path\":");
+    write_json_string(out, path);
+    out.put('}');
+    return true;
+}
+
+// ---- serving ----
+
+void serve(IpcListener& listener, RpcServer& server) {
+    struct Client {
+        std::unique_ptr<IpcConnection> connection;
+        std::thread thread;
+        std::atomic<bool> done{false};
+    };
+    std::mutex mutex;  // one request at a time; guards `server`
+    std::vector<std::unique_ptr<Client>> clients;
+
+    auto run = [&](Client& client) {
+        std::string line;
+        while (client.connection->read_line(line)) {
+            std::string response;
+            bool stopping;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                response = server.handle(line);
+                stopping = server.stopping();
+            }
+            if (!response.empty()) {
+                response.push_back('\n');
+                if (!client.connection->write(response)) break;
+            }
+            if (stopping) {
+                listener.close();
+                break;
+            }
+        }
+        client.done = true;
+    };
+
+    while (auto connection = listener.accept()) {
+        // Reap clients that hung up.
+        std::erase_if(clients, [](const std::unique_ptr<Client>& c) {
+            if (!c->done) return false;
+            c->thread.join();
+            return true;
+        });
+        auto& client = clients.emplace_back(std::make_unique<Client>());
+        client->connection = std::move(connection);
+        client->thread = std::thread(run, std::ref(*client));
+    }
+    for (auto& c : clients) c->connection->close();
+    for (auto& c : clients) c->thread.join();
+}
+
+} // namespace lvt
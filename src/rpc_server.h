@@ -0,0 +1,142 @@
+#pragma once
+#include "capture_source.h"
+#include "element_index.h"
+#include "framework.h"
+#include "ipc.h"
+#include "json_reader.h"
+#include "output_sink.h"
+#include "thread_pool.h"
+#include "tree_builder.h"
+#include "window_system.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <nlohmann/json_fwd.hpp>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace lvt {
+
+// What `lvt serve` captures through: the live desktop and loaded plugins on
+// Windows, a FakeWindowSystem in tests.
+class ServerBackend {
+public:
+    virtual ~ServerBackend() = default;
+
+    virtual IWindowSystem& window_system() = 0;
+
+    // A source for one capture (WindowSystemSource reads the window
+    // hierarchy once per source).
+    virtual std::unique_ptr<CaptureSource> make_source() = 0;
+
+    // Whether `hwnd` can be captured by this process; if not, why in `error`.
+    virtual bool check_target(HWND, DWORD, std::string*) { return true; }
+
+    // Frameworks found by plugins, added to what detect_frameworks finds.
+    virtual std::vector<FrameworkInfo> plugin_frameworks(HWND, DWORD) { return {}; }
+
+    // Save a PNG of `hwnd` with `tree`'s elements outlined, cropped to
+    // `crop` unless that is kNoNode.
+    virtual bool screenshot(HWND hwnd, const std::string& path, const ElementTree& tree, NodeId crop,
+                            std::string* error);
+};
+
+// JSON-RPC 2.0 over the capture pipeline, for `lvt serve`. Between requests
+// it keeps, per target window, the process and framework detection (module
+// scans) and the last full tree captured with its index; plugins stay
+// loaded for the life of the process.
+//
+// Every method takes the target as "hwnd" (number or hex string), "pid",
+// "name" or "title", as on the command line, and:
+//   dump       Capture and return write_json's document (compact), or with
+//              "format":"xml" the XML as a string. "element", "depth",
+//              "hashes" and "stableIds" as for the options; stable IDs carry
+//              over from the last snapshot, as with --previous.
+//   query      Elements of the last snapshot (captured first if there is none
+//              or with "refresh"), filtered by "id", "type", "className",
+//              "framework" (exact) and "text" (substring, any case); at most
+//              "limit" (100), each "depth" (0) levels deep (-1 for no limit):
+//                {"count":<matches>,"elements":[{...},...]}
+//   diff       Capture again and return what changed since the last snapshot
+//              as the JSON Patch `lvt diff` writes, {"changed":b,"patch":[..]},
+//              or the first time {"changed":true,"tree":{...}}.
+//   screenshot Save a PNG to "path", cropped to "element" of the last snapshot.
+//   shutdown   Stop serving.
+// Captures that are not trimmed by "element" or "depth" become the last
+// snapshot, which always has stable IDs; "id" and "element" also take the
+// IDs the dump that made it returned. Integers out of range are invalid
+// params, not wrapped. A window found by pid, name or title is reused while
+// it is still visible and still fits, without searching the desktop again. A
+// different process behind the window, or "refresh":true, redoes the search
+// and the detection.
+//
+// Not thread-safe: serve() hands it one request at a time.
+class RpcServer {
+public:
+    struct Stats {
+        uint64_t requests = 0;
+        uint64_t captures = 0;    // build_tree calls
+        uint64_t detections = 0;  // framework detections (module scans)
+    };
+
+    explicit RpcServer(ServerBackend& backend) : m_backend(backend) {}
+
+    // Handle one request line. Returns the response line (without a newline),
+    // or an empty string for a notification.
+    std::string handle(std::string_view request);
+
+    // Whether a shutdown request was handled.
+    bool stopping() const { return m_stopping; }
+
+    const Stats& stats() const { return m_stats; }
+
+private:
+    struct Error {
+        int code = 0;
+        std::string message;
+    };
+
+    // What is kept for a target window.
+    struct Target {
+        HWND hwnd = nullptr;
+        DWORD pid = 0;
+        std::string processName;
+        std::vector<FrameworkInfo> detected;
+        std::vector<std::string> frameworks;  // display names
+        TreeDocument snapshot;                // empty tree until a full capture
+        ElementIndex index;                   // over snapshot.tree
+        // The ordinal IDs a dump without stableIds returned for the snapshot.
+        std::unordered_map<std::string, NodeId> dumpedIds;
+    };
+
+    using Json = nlohmann::json;
+
+    bool dispatch(const std::string& method, const Json& params, OutputSink& out, Error& error);
+    bool dump(const Json& params, OutputSink& out, Error& error);
+    bool query(const Json& params, OutputSink& out, Error& error);
+    bool diff(const Json& params, OutputSink& out, Error& error);
+    bool screenshot(const Json& params, OutputSink& out, Error& error);
+
+    Target* resolve(const Json& params, Error& error);
+    ElementTree capture(Target& target, const TreeScope& scope, ElementIndex& index);
+    ElementTree capture_stable(Target& target, ElementIndex& index);
+    void keep(Target& target, ElementTree tree, ElementIndex index);
+    NodeId find(const Target& target, std::string_view id) const;  // by stable or dumped ID
+    TreeDocument document(const Target& target, ElementTree tree) const;
+
+    ServerBackend& m_backend;
+    std::map<HWND, Target> m_targets;
+    std::map<std::string, HWND> m_lookups;  // "pid:", "name:" or "title:" -> window found
+    std::unique_ptr<ThreadPool> m_pool;  // providers of multi-framework targets
+    Stats m_stats;
+    bool m_stopping = false;
+};
+
+// Accept connections on `listener` and answer each request line of each with
+// a response line, until a shutdown request. Connections are served on
+// threads of their own; requests are handled one at a time.
+void serve(IpcListener& listener, RpcServer& server);
+
+} // namespace lvt
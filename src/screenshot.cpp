@@ -12,12 +12,12 @@
 
 #include <d3d11.h>
 #include <dxgi1_2.h>
-#include <wincodec.h>
 #include <dwmapi.h>
 #include <d3d11_4.h>
 
 #include <vector>
 #include <functional>
+#include <future>
 #include <mutex>
 #include <condition_variable>
 
@@ -29,22 +29,6 @@ IDirect3DDxgiInterfaceAccess : public IUnknown {
 
 namespace lvt {
 
-static const Element* find_element_by_id(const Element& root, const std::string& id) {
-    if (root.id == id) return &root;
-    for (auto& child : root.children) {
-        auto* found = find_element_by_id(child, id);
-        if (found) return found;
-    }
-    return nullptr;
-}
-
-static void collect_elements(const Element& el, std::vector<const Element*>& out) {
-    out.push_back(&el);
-    for (auto& child : el.children) {
-        collect_elements(child, out);
-    }
-}
-
 // Get the IDXGISurface from a WinRT IDirect3DSurface via the interop interface.
 static wil::com_ptr<IDXGISurface> get_dxgi_surface(
     const winrt::Windows::Graphics::DirectX::Direct3D11::IDirect3DSurface& surface) {
@@ -168,172 +152,17 @@ static bool capture_frame(HWND hwnd, ID3D11Device* d3dDevice, ID3D11DeviceContex
     return true;
 }
 
-// Draw annotation overlays onto raw BGRA pixel buffer
-static void annotate_pixels(BYTE* pixels, int bmpWidth, int bmpHeight,
-                            HWND hwnd, const Element* tree) {
-    if (!tree) return;
-
-    // Create a GDI bitmap backed by the pixel data so we can draw on it
-    BITMAPINFO bmi{};
-    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-    bmi.bmiHeader.biWidth = bmpWidth;
-    bmi.bmiHeader.biHeight = -bmpHeight; // top-down
-    bmi.bmiHeader.biPlanes = 1;
-    bmi.bmiHeader.biBitCount = 32;
-    bmi.bmiHeader.biCompression = BI_RGB;
-
-    void* dibBits = nullptr;
-    HDC memDC = CreateCompatibleDC(nullptr);
-    HBITMAP hBitmap = CreateDIBSection(memDC, &bmi, DIB_RGB_COLORS, &dibBits, nullptr, 0);
-    if (!hBitmap || !dibBits) { DeleteDC(memDC); return; }
-
-    // Copy pixels into the DIB
-    memcpy(dibBits, pixels, bmpWidth * bmpHeight * 4);
-    HGDIOBJ old = SelectObject(memDC, hBitmap);
-
+// Screen position of the pixels WGC captures: the visible frame, without the
+// invisible resize borders GetWindowRect includes.
+static RECT frame_bounds(HWND hwnd) {
     RECT winRect{};
     if (DwmGetWindowAttribute(hwnd, DWMWA_EXTENDED_FRAME_BOUNDS, &winRect, sizeof(winRect)) != S_OK) {
         GetWindowRect(hwnd, &winRect);
     }
-
-    std::vector<const Element*> elements;
-    collect_elements(*tree, elements);
-
-    HPEN pen = CreatePen(PS_SOLID, 2, RGB(255, 50, 50));
-    HBRUSH brush = static_cast<HBRUSH>(GetStockObject(NULL_BRUSH));
-    HGDIOBJ oldPen = SelectObject(memDC, pen);
-    HGDIOBJ oldBrush = SelectObject(memDC, brush);
-    SetBkMode(memDC, TRANSPARENT);
-    SetTextColor(memDC, RGB(255, 50, 50));
-
-    HFONT font = CreateFontW(-12, 0, 0, 0, FW_BOLD, FALSE, FALSE, FALSE,
-                             DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS,
-                             CLEARTYPE_QUALITY, DEFAULT_PITCH | FF_SWISS, L"Consolas");
-    HGDIOBJ oldFont = SelectObject(memDC, font);
-
-    for (auto* el : elements) {
-        if (el->bounds.width <= 0 || el->bounds.height <= 0) continue;
-        int x = el->bounds.x - winRect.left;
-        int y = el->bounds.y - winRect.top;
-        int w = el->bounds.width;
-        int h = el->bounds.height;
-        if (x + w <= 0 || y + h <= 0 || x >= bmpWidth || y >= bmpHeight) continue;
-
-        Rectangle(memDC, x, y, x + w, y + h);
-
-        if (!el->id.empty()) {
-            std::wstring label(el->id.begin(), el->id.end());
-            SIZE textSize{};
-            GetTextExtentPoint32W(memDC, label.c_str(), static_cast<int>(label.size()), &textSize);
-            RECT labelRect = {x, y - textSize.cy - 2, x + textSize.cx + 4, y};
-            if (labelRect.top < 0) { labelRect.top = y; labelRect.bottom = y + textSize.cy + 2; }
-            HBRUSH bgBrush = CreateSolidBrush(RGB(255, 255, 220));
-            FillRect(memDC, &labelRect, bgBrush);
-            DeleteObject(bgBrush);
-            TextOutW(memDC, labelRect.left + 2, labelRect.top + 1,
-                     label.c_str(), static_cast<int>(label.size()));
-        }
-    }
-
-    SelectObject(memDC, oldFont);
-    SelectObject(memDC, oldBrush);
-    SelectObject(memDC, oldPen);
-    SelectObject(memDC, old);
-    DeleteObject(font);
-    DeleteObject(pen);
-
-    // Copy annotated pixels back
-    memcpy(pixels, dibBits, bmpWidth * bmpHeight * 4);
-
-    // GDI drawing doesn't set the alpha channel — force all pixels to fully opaque
-    // so annotations don't appear as black/transparent in the PNG output.
-    for (int i = 3; i < bmpWidth * bmpHeight * 4; i += 4) {
-        pixels[i] = 255;
-    }
-
-    DeleteObject(hBitmap);
-    DeleteDC(memDC);
+    return winRect;
 }
 
-// Save BGRA pixels to PNG using WIC
-static bool save_pixels_as_png(const BYTE* pixels, int width, int height,
-                               const std::string& outputPath,
-                               const RECT* cropRect = nullptr) {
-    auto hr = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
-    bool needUninit = SUCCEEDED(hr);
-
-    wil::com_ptr<IWICImagingFactory> factory;
-    hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER,
-                          IID_PPV_ARGS(&factory));
-    if (FAILED(hr)) return false;
-
-    int outX = 0, outY = 0, outW = width, outH = height;
-    if (cropRect) {
-        outX = (std::max)(0, static_cast<int>(cropRect->left));
-        outY = (std::max)(0, static_cast<int>(cropRect->top));
-        outW = static_cast<int>(cropRect->right - cropRect->left);
-        outH = static_cast<int>(cropRect->bottom - cropRect->top);
-        if (outX + outW > width) outW = width - outX;
-        if (outY + outH > height) outH = height - outY;
-        if (outW <= 0 || outH <= 0) return false;
-    }
-
-    int wlen = MultiByteToWideChar(CP_UTF8, 0, outputPath.c_str(), -1, nullptr, 0);
-    std::wstring wpath(wlen, L'\0');
-    MultiByteToWideChar(CP_UTF8, 0, outputPath.c_str(), -1, wpath.data(), wlen);
-
-    wil::com_ptr<IWICStream> stream;
-    hr = factory->CreateStream(&stream);
-    if (FAILED(hr)) return false;
-    hr = stream->InitializeFromFilename(wpath.c_str(), GENERIC_WRITE);
-    if (FAILED(hr)) return false;
-
-    wil::com_ptr<IWICBitmapEncoder> encoder;
-    hr = factory->CreateEncoder(GUID_ContainerFormatPng, nullptr, &encoder);
-    if (FAILED(hr)) return false;
-    hr = encoder->Initialize(stream.get(), WICBitmapEncoderNoCache);
-    if (FAILED(hr)) return false;
-
-    wil::com_ptr<IWICBitmapFrameEncode> frame;
-    hr = encoder->CreateNewFrame(&frame, nullptr);
-    if (FAILED(hr)) return false;
-    hr = frame->Initialize(nullptr);
-    if (FAILED(hr)) return false;
-    hr = frame->SetSize(outW, outH);
-    if (FAILED(hr)) return false;
-
-    WICPixelFormatGUID pixelFormat = GUID_WICPixelFormat32bppBGRA;
-    hr = frame->SetPixelFormat(&pixelFormat);
-    if (FAILED(hr)) return false;
-
-    UINT srcStride = width * 4;
-    UINT outStride = outW * 4;
-    const BYTE* startPixel = pixels + outY * srcStride + outX * 4;
-
-    if (outX == 0 && outW == width) {
-        hr = frame->WritePixels(outH, srcStride, outH * srcStride,
-                                const_cast<BYTE*>(startPixel));
-    } else {
-        for (int row = 0; row < outH; row++) {
-            hr = frame->WritePixels(1, outStride, outStride,
-                                    const_cast<BYTE*>(startPixel + row * srcStride));
-            if (FAILED(hr)) break;
-        }
-    }
-    if (FAILED(hr)) return false;
-
-    hr = frame->Commit();
-    if (FAILED(hr)) return false;
-    hr = encoder->Commit();
-    if (FAILED(hr)) return false;
-
-    if (needUninit) CoUninitialize();
-    return true;
-}
-
-bool capture_screenshot(HWND hwnd, const std::string& outputPath,
-                        const Element* tree,
-                        const std::string& elementId) {
+bool capture_window_frame(HWND hwnd, Image& frame) {
     if (!IsWindow(hwnd)) {
         fprintf(stderr, "lvt: invalid window handle for screenshot\n");
         return false;
@@ -359,35 +188,43 @@ bool capture_screenshot(HWND hwnd, const std::string& outputPath,
         return false;
     }
 
-    // Annotate if tree is provided
-    if (tree) {
-        annotate_pixels(pixels.data(), width, height, hwnd, tree);
-    }
+    RECT origin = frame_bounds(hwnd);
+    frame.width = width;
+    frame.height = height;
+    frame.originX = origin.left;
+    frame.originY = origin.top;
+    frame.pixels = std::move(pixels);
+    return true;
+}
 
-    // Determine crop rect if element scoping requested
-    RECT cropRect{};
-    const RECT* cropPtr = nullptr;
-    if (!elementId.empty() && tree) {
-        auto* el = find_element_by_id(*tree, elementId);
-        if (el && el->bounds.width > 0 && el->bounds.height > 0) {
-            RECT winRect{};
-            if (DwmGetWindowAttribute(hwnd, DWMWA_EXTENDED_FRAME_BOUNDS,
-                                      &winRect, sizeof(winRect)) != S_OK) {
-                GetWindowRect(hwnd, &winRect);
-            }
-            cropRect.left = el->bounds.x - winRect.left;
-            cropRect.top = el->bounds.y - winRect.top;
-            cropRect.right = cropRect.left + el->bounds.width;
-            cropRect.bottom = cropRect.top + el->bounds.height;
-            cropPtr = &cropRect;
-        }
-    }
+std::future<Image> capture_window_frame_async(HWND hwnd) {
+    return std::async(std::launch::async, [hwnd] {
+        Image frame;
+        if (!capture_window_frame(hwnd, frame)) frame = Image();
+        return frame;
+    });
+}
 
-    bool ok = save_pixels_as_png(pixels.data(), width, height, outputPath, cropPtr);
+bool save_screenshot(const std::string& outputPath, Image frame, const ElementTree* tree,
+                     NodeId cropNode) {
+    FileSink sink(outputPath, true);
+    bool ok = sink.is_open() && write_screenshot(sink, std::move(frame), tree, cropNode);
+    if (ok) {
+        sink.flush();
+        ok = sink.ok();
+    }
     if (!ok) {
         fprintf(stderr, "lvt: failed to save screenshot as PNG\n");
     }
     return ok;
 }
 
+bool capture_screenshot(HWND hwnd, const std::string& outputPath,
+                        const ElementTree* tree,
+                        NodeId cropNode) {
+    Image frame;
+    if (!capture_window_frame(hwnd, frame)) return false;
+    return save_screenshot(outputPath, std::move(frame), tree, cropNode);
+}
+
 } // namespace lvt
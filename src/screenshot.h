@@ -1,15 +1,30 @@
 #pragma once
 #include "element.h"
+#include "image.h"
 #include <Windows.h>
+#include <future>
 #include <string>
 
 namespace lvt {
 
+// Grab one frame of the given window with Windows.Graphics.Capture.
+// Needs no tree, so it can run while the tree is being built.
+bool capture_window_frame(HWND hwnd, Image& frame);
+
+// capture_window_frame on a thread of its own. The image is empty if the
+// capture failed (the reason has been printed).
+std::future<Image> capture_window_frame_async(HWND hwnd);
+
+// Annotate, crop and encode a captured frame (see write_screenshot) into a
+// PNG file.
+bool save_screenshot(const std::string& outputPath, Image frame, const ElementTree* tree = nullptr,
+                     NodeId cropNode = kNoNode);
+
 // Capture a screenshot of the given window and save as PNG.
 // If tree is provided, overlay bounding boxes and element IDs.
-// If elementId is non-empty, crop to that element's bounds.
+// If cropNode is a node of tree, crop to that element's bounds.
 bool capture_screenshot(HWND hwnd, const std::string& outputPath,
-                        const Element* tree = nullptr,
-                        const std::string& elementId = {});
+                        const ElementTree* tree = nullptr,
+                        NodeId cropNode = kNoNode);
 
 } // namespace lvt
@@ -0,0 +1,410 @@
+#include "snapshot.h"
+#include <bit>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lvt {
+
+// The format is little-endian and read in place, so hosts must be too.
+static_assert(std::endian::native == std::endian::little, "lvtbin assumes a little-endian host");
+
+using namespace snapshot;
+
+// --- Reader ---
+
+std::string_view SnapshotProperty::key() const { return m_view->string(m_p->key); }
+
+std::string_view SnapshotProperty::as_string() const { return m_view->string(load<String>()); }
+
+Bounds SnapshotProperty::as_rect() const {
+    int32_t r[4];
+    std::memcpy(r, m_p->value, sizeof(r));
+    return {r[0], r[1], r[2], r[3]};
+}
+
+PropertyValue SnapshotProperty::value() const {
+    switch (kind()) {
+    case PropertyKind::Bool:   return as_bool();
+    case PropertyKind::Int:    return as_int();
+    case PropertyKind::Double: return as_double();
+    case PropertyKind::String: return as_string();
+    case PropertyKind::Rect:   return as_rect();
+    case PropertyKind::Handle: return HandleValue{as_handle()};
+    }
+    return {};
+}
+
+SnapshotNode::SnapshotNode(const SnapshotView* view, NodeId index)
+    : m_view(view), m_n(view->m_nodes + index), m_index(index) {}
+
+std::string_view SnapshotNode::id() const { return m_view->string(m_n->id); }
+std::string_view SnapshotNode::type() const { return m_view->string(m_n->type); }
+std::string_view SnapshotNode::framework() const { return m_view->string(m_n->framework); }
+std::string_view SnapshotNode::class_name() const { return m_view->string(m_n->className); }
+std::string_view SnapshotNode::text() const { return m_view->string(m_n->text); }
+
+uint64_t SnapshotNode::hash() const {
+    return m_view->m_hashes ? m_view->m_hashes[m_index] : 0;
+}
+
+SnapshotProperty SnapshotNode::property(size_t i) const {
+    return SnapshotProperty(m_view, m_view->m_properties + m_n->firstProperty + i);
+}
+
+static bool fail(std::string* error, const char* message) {
+    if (error) *error = message;
+    return false;
+}
+
+// True if [offset, offset + count * elementSize) lies within `size` and
+// starts 8-byte aligned.
+static bool section_fits(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t size) {
+    if (offset % 8 != 0 || offset > size) return false;
+    return count <= (size - offset) / (elementSize ? elementSize : 1);
+}
+
+bool SnapshotView::check_string(String s) const {
+    return s.offset <= m_header->stringSize && s.size <= m_header->stringSize - s.offset;
+}
+
+bool SnapshotView::open(const void* data, size_t size, std::string* error) {
+    m_header = nullptr;
+    if (reinterpret_cast<uintptr_t>(data) % 8 != 0)
+        return fail(error, "snapshot data is not 8-byte aligned");
+    if (size < kHeaderSizeV1)
+        return fail(error, "file is too small to be a snapshot");
+    auto* header = static_cast<const Header*>(data);
+    if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0)
+        return fail(error, "not an lvtbin snapshot");
+    if (header->version == 0 || header->version > kVersion)
+        return fail(error, "unsupported snapshot version");
+    size_t minHeader = header->version == 1 ? kHeaderSizeV1 : sizeof(Header);
+    if (header->headerSize < minHeader || header->headerSize > size || header->fileSize > size)
+        return fail(error, "snapshot is truncated");
+
+    uint64_t fileSize = header->fileSize;
+    uint64_t hashOffset = header->version == 1 ? 0 : header->hashOffset;
+    if (!section_fits(header->nodeOffset, header->nodeCount, sizeof(Node), fileSize) ||
+        !section_fits(header->propertyOffset, header->propertyCount, sizeof(Property), fileSize) ||
+        !section_fits(header->frameworkOffset, header->frameworkCount, sizeof(String), fileSize) ||
+        header->stringOffset > fileSize || header->stringSize > fileSize - header->stringOffset ||
+        header->stringSize > UINT32_MAX ||
+        (hashOffset && !section_fits(hashOffset, header->nodeCount, sizeof(uint64_t), fileSize)))
+        return fail(error, "snapshot section out of bounds");
+
+    auto* base = static_cast<const char*>(data);
+    m_header = header;
+    m_nodes = reinterpret_cast<const Node*>(base + header->nodeOffset);
+    m_properties = reinterpret_cast<const Property*>(base + header->propertyOffset);
+    m_frameworks = reinterpret_cast<const String*>(base + header->frameworkOffset);
+    m_strings = base + header->stringOffset;
+    m_hashes = hashOffset ? reinterpret_cast<const uint64_t*>(base + hashOffset) : nullptr;
+
+    // Validate everything accessors and walks rely on, so that they never
+    // need to check again: strings in the pool, property runs in the table,
+    // and links that only ever move forward (pre-order), which rules out cycles.
+    bool ok = check_string(header->processName);
+    for (uint32_t i = 0; ok && i < header->frameworkCount; i++)
+        ok = check_string(m_frameworks[i]);
+    for (uint32_t i = 0; ok && i < header->propertyCount; i++) {
+        const Property& p = m_properties[i];
+        ok = check_string(p.key) && p.kind <= PropertyKind::Handle;
+        if (ok && p.kind == PropertyKind::String) {
+            String s;
+            std::memcpy(&s, p.value, sizeof(s));
+            ok = check_string(s);
+        }
+    }
+    const uint32_t count = header->nodeCount;
+    for (uint32_t i = 0; ok && i < count; i++) {
+        const Node& n = m_nodes[i];
+        ok = check_string(n.id) && check_string(n.type) && check_string(n.framework) &&
+             check_string(n.className) && check_string(n.text) &&
+             n.firstProperty <= header->propertyCount &&
+             n.propertyCount <= header->propertyCount - n.firstProperty;
+        ok = ok && (i == 0 ? n.parent == kNone : n.parent < i);
+        ok = ok && (n.firstChild == kNone ||
+                    (n.firstChild == i + 1 && n.firstChild < count && m_nodes[i + 1].parent == i));
+        ok = ok && (n.nextSibling == kNone ||
+                    (i != 0 && n.nextSibling > i && n.nextSibling < count &&
+                     m_nodes[n.nextSibling].parent == n.parent));
+    }
+    if (!ok) {
+        m_header = nullptr;
+        return fail(error, "snapshot is corrupt");
+    }
+    return true;
+}
+
+NodeId SnapshotView::next_preorder(NodeId node, NodeId scope) const {
+    const Node* n = m_nodes + node;
+    if (n->firstChild != kNone) return n->firstChild;
+    while (node != scope) {
+        if (m_nodes[node].nextSibling != kNone) return m_nodes[node].nextSibling;
+        node = m_nodes[node].parent;
+    }
+    return kNoNode;
+}
+
+HWND SnapshotView::hwnd() const {
+    return reinterpret_cast<HWND>(static_cast<uintptr_t>(m_header->hwnd));
+}
+
+ElementTree SnapshotView::to_tree() const {
+    ElementTree tree;
+    // Type, framework and class names come from a deduplicated pool, so each
+    // distinct one is interned once, keyed by its pool location.
+    std::unordered_map<uint64_t, Symbol> symbols;
+    auto intern = [&](String s) {
+        auto [it, added] = symbols.try_emplace((uint64_t{s.offset} << 32) | s.size);
+        if (added) it->second = Symbol(string(s));
+        return it->second;
+    };
+    for (NodeId i = 0; i < node_count(); i++) {
+        const Node& n = m_nodes[i];
+        NodeId id = (n.parent == kNone) ? tree.add_root() : tree.append_child(n.parent);
+        Element& el = tree[id];
+        el.id = string(n.id);
+        el.type = intern(n.type);
+        el.framework = intern(n.framework);
+        el.className = intern(n.className);
+        el.text = string(n.text);
+        el.bounds = {n.x, n.y, n.width, n.height};
+        el.nativeHandle = static_cast<uintptr_t>(n.nativeHandle);
+        if (m_hashes) el.hash = m_hashes[i];
+        if (n.propertyCount) {
+            el.properties.reserve(n.propertyCount);
+            SnapshotNode view(this, i);
+            for (size_t p = 0; p < n.propertyCount; p++) {
+                SnapshotProperty prop = view.property(p);
+                el.properties.set(intern(m_properties[n.firstProperty + p].key), prop.value());
+            }
+        }
+    }
+    return tree;
+}
+
+// --- Mapping ---
+
+MappedFile::~MappedFile() { close(); }
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path, std::string* error) {
+    close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return fail(error, "cannot open file");
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return fail(error, "file is empty");
+    }
+    m_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!m_mapping) return fail(error, "cannot map file");
+    m_data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!m_data) {
+        close();
+        return fail(error, "cannot map file");
+    }
+    m_size = static_cast<size_t>(size.QuadPart);
+    return true;
+}
+
+void MappedFile::close() {
+    if (m_data) UnmapViewOfFile(m_data);
+    if (m_mapping) CloseHandle(m_mapping);
+    m_data = nullptr;
+    m_mapping = nullptr;
+    m_size = 0;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path, std::string* error) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return fail(error, "cannot open file");
+    struct stat st {};
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return fail(error, "file is empty");
+    }
+    void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return fail(error, "cannot map file");
+    m_data = p;
+    m_size = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+void MappedFile::close() {
+    if (m_data) munmap(const_cast<void*>(m_data), m_size);
+    m_data = nullptr;
+    m_size = 0;
+}
+
+#endif
+
+// --- Writer ---
+
+namespace {
+
+class StringPool {
+public:
+    String add(std::string_view s) {
+        auto it = m_offsets.find(s);
+        if (it != m_offsets.end()) return {it->second, static_cast<uint32_t>(s.size())};
+        uint32_t offset = static_cast<uint32_t>(m_bytes.size());
+        m_bytes.append(s);
+        // Keys view the caller's strings (tree elements and interned symbols),
+        // which outlive the pool.
+        m_offsets.emplace(s, offset);
+        return {offset, static_cast<uint32_t>(s.size())};
+    }
+
+    // Per-node strings (ids, text) rarely repeat, so hashing them costs more
+    // than the bytes it would save; they are appended as-is.
+    String append(std::string_view s) {
+        uint32_t offset = static_cast<uint32_t>(m_bytes.size());
+        m_bytes.append(s);
+        return {offset, static_cast<uint32_t>(s.size())};
+    }
+
+    // Symbols are looked up by id first; most nodes repeat a few of them.
+    String add(Symbol s) {
+        if (s.id() >= m_symbols.size()) m_symbols.resize(s.id() + 1, {kNone, 0});
+        String& slot = m_symbols[s.id()];
+        if (slot.offset == kNone) slot = add(s.view());
+        return slot;
+    }
+
+    const std::string& bytes() const { return m_bytes; }
+
+private:
+    std::string m_bytes;
+    std::unordered_map<std::string_view, uint32_t> m_offsets;
+    std::vector<String> m_symbols;
+};
+
+Property make_property(StringPool& pool, Symbol key, const PropertyValue& v) {
+    Property p{};
+    p.key = pool.add(key);
+    auto store = [&p](const auto& x) { std::memcpy(p.value, &x, sizeof(x)); };
+    std::visit([&](const auto& x) {
+        using T = std::decay_t<decltype(x)>;
+        if constexpr (std::is_same_v<T, bool>) {
+            p.kind = PropertyKind::Bool;
+            store(uint64_t{x ? 1u : 0u});
+        } else if constexpr (std::is_same_v<T, int64_t>) {
+            p.kind = PropertyKind::Int;
+            store(x);
+        } else if constexpr (std::is_same_v<T, double>) {
+            p.kind = PropertyKind::Double;
+            store(x);
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            p.kind = PropertyKind::String;
+            store(pool.add(std::string_view(x)));
+        } else if constexpr (std::is_same_v<T, Bounds>) {
+            p.kind = PropertyKind::Rect;
+            int32_t r[4] = {x.x, x.y, x.width, x.height};
+            store(r);
+        } else {
+            p.kind = PropertyKind::Handle;
+            store(x.value);
+        }
+    }, v.storage());
+    return p;
+}
+
+void write_bytes(OutputSink& out, const void* data, size_t size) {
+    out.write(std::string_view(static_cast<const char*>(data), size));
+}
+
+} // namespace
+
+void write_snapshot(OutputSink& out, const ElementTree& tree, NodeId root, HWND hwnd, DWORD pid,
+                    const std::string& processName,
+                    const std::vector<std::string>& frameworks, bool hashes) {
+    StringPool pool;
+    std::vector<Node> nodes;
+    std::vector<uint64_t> nodeHashes;
+    std::vector<Property> properties;
+
+    if (root != kNoNode && !tree.empty()) {
+        // First pass: pre-order position of every reachable node.
+        std::vector<uint32_t> order(tree.size(), kNone);
+        uint32_t count = 0;
+        for (NodeId n = root; n != kNoNode; n = tree.next_preorder(n, root)) order[n] = count++;
+        auto remap = [&](NodeId n) { return n == kNoNode ? kNone : order[n]; };
+
+        nodes.reserve(count);
+        if (hashes) nodeHashes.reserve(count);
+        for (NodeId n = root; n != kNoNode; n = tree.next_preorder(n, root)) {
+            const Element& el = tree[n];
+            if (hashes) nodeHashes.push_back(el.hash);
+            Node rec{};
+            rec.parent = (n == root) ? kNone : remap(tree.parent(n));
+            rec.firstChild = remap(tree.first_child(n));
+            rec.nextSibling = (n == root) ? kNone : remap(tree.next_sibling(n));
+            rec.childCount = static_cast<uint32_t>(tree.child_count(n));
+            rec.id = pool.append(el.id);
+            rec.type = pool.add(el.type);
+            rec.framework = pool.add(el.framework);
+            rec.className = pool.add(el.className);
+            rec.text = pool.append(el.text);
+            rec.x = el.bounds.x;
+            rec.y = el.bounds.y;
+            rec.width = el.bounds.width;
+            rec.height = el.bounds.height;
+            rec.firstProperty = static_cast<uint32_t>(properties.size());
+            rec.propertyCount = static_cast<uint32_t>(el.properties.size());
+            rec.nativeHandle = el.nativeHandle;
+            for (auto& [k, v] : el.properties) properties.push_back(make_property(pool, k, v));
+            nodes.push_back(rec);
+        }
+    }
+
+    std::vector<String> frameworkRefs;
+    for (auto& f : frameworks) frameworkRefs.push_back(pool.add(std::string_view(f)));
+
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.headerSize = sizeof(Header);
+    header.hwnd = reinterpret_cast<uintptr_t>(hwnd);
+    header.pid = pid;
+    header.processName = pool.add(std::string_view(processName));
+    header.nodeCount = static_cast<uint32_t>(nodes.size());
+    header.propertyCount = static_cast<uint32_t>(properties.size());
+    header.frameworkCount = static_cast<uint32_t>(frameworkRefs.size());
+    header.nodeOffset = sizeof(Header);
+    header.propertyOffset = header.nodeOffset + nodes.size() * sizeof(Node);
+    header.frameworkOffset = header.propertyOffset + properties.size() * sizeof(Property);
+    header.stringOffset = header.frameworkOffset + frameworkRefs.size() * sizeof(String);
+    header.stringSize = pool.bytes().size();
+    uint64_t stringEnd = header.stringOffset + header.stringSize;
+    uint64_t padding = hashes ? (8 - stringEnd % 8) % 8 : 0;
+    header.hashOffset = hashes ? stringEnd + padding : 0;
+    header.fileSize = stringEnd + padding + nodeHashes.size() * sizeof(uint64_t);
+
+    write_bytes(out, &header, sizeof(header));
+    write_bytes(out, nodes.data(), nodes.size() * sizeof(Node));
+    write_bytes(out, properties.data(), properties.size() * sizeof(Property));
+    write_bytes(out, frameworkRefs.data(), frameworkRefs.size() * sizeof(String));
+    out.write(pool.bytes());
+    if (hashes) {
+        static constexpr char kZeros[8] = {};
+        write_bytes(out, kZeros, padding);
+        write_bytes(out, nodeHashes.data(), nodeHashes.size() * sizeof(uint64_t));
+    }
+}
+
+} // namespace lvt
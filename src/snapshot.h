@@ -0,0 +1,233 @@
+#pragma once
+#include "element.h"
+#include "output_sink.h"
+#include "platform.h"
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lvt {
+
+// lvtbin: a compact, versioned snapshot of a captured tree that can be mapped
+// into memory and read in place.
+//
+// Layout (little-endian; every section starts on an 8-byte boundary):
+//   Header
+//   node table       nodeCount x Node, in depth-first pre-order (node 0 is
+//                    the root), so a node's children and descendants follow it
+//   property table   propertyCount x Property; each node owns one contiguous run
+//   framework table  frameworkCount x String
+//   string pool      UTF-8 referenced by offset and size; names, property
+//                    keys and property strings are stored once
+//   hash table       (version 2, optional) nodeCount x uint64 Element::hash
+//
+// Readers reject files whose version is newer than kVersion. Sections are
+// located through the header's offsets, so later versions may grow the header
+// or append sections without moving existing ones.
+namespace snapshot {
+
+inline constexpr char kMagic[8] = {'L', 'V', 'T', 'B', 'I', 'N', '\0', '\x1A'};
+inline constexpr uint32_t kVersion = 2;
+inline constexpr uint32_t kNone = UINT32_MAX;
+
+struct String {
+    uint32_t offset;
+    uint32_t size;
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t hwnd;
+    uint32_t pid;
+    String processName;
+    uint32_t nodeCount;
+    uint32_t propertyCount;
+    uint32_t frameworkCount;
+    uint64_t nodeOffset;
+    uint64_t propertyOffset;
+    uint64_t frameworkOffset;
+    uint64_t stringOffset;
+    uint64_t stringSize;
+    uint64_t fileSize;
+    // Version 2: the hash table, or 0 when the snapshot has none.
+    uint64_t hashOffset;
+};
+
+// Version 1 headers end before hashOffset.
+inline constexpr uint32_t kHeaderSizeV1 = 96;
+
+struct Node {
+    uint32_t parent;       // kNone for the root
+    uint32_t firstChild;   // kNone or this node's index + 1
+    uint32_t nextSibling;  // kNone or a later index
+    uint32_t childCount;
+    String id;
+    String type;
+    String framework;
+    String className;
+    String text;
+    int32_t x, y, width, height;
+    uint32_t firstProperty;
+    uint32_t propertyCount;
+    uint64_t nativeHandle;
+};
+
+enum class PropertyKind : uint32_t { Bool, Int, Double, String, Rect, Handle };
+
+struct Property {
+    String key;
+    PropertyKind kind;
+    uint32_t reserved;
+    // Bool/Int/Handle: uint64; Double: IEEE-754 bits; String: snapshot::String;
+    // Rect: four int32 (x, y, width, height).
+    unsigned char value[16];
+};
+
+static_assert(sizeof(Header) == 104, "lvtbin header layout");
+static_assert(sizeof(Node) == 88, "lvtbin node layout");
+static_assert(sizeof(Property) == 32, "lvtbin property layout");
+
+} // namespace snapshot
+
+class SnapshotView;
+
+// One property of a mapped node. Accessors read the mapping directly.
+class SnapshotProperty {
+public:
+    SnapshotProperty(const SnapshotView* view, const snapshot::Property* p) : m_view(view), m_p(p) {}
+
+    std::string_view key() const;
+    snapshot::PropertyKind kind() const { return m_p->kind; }
+
+    bool as_bool() const { return load<uint64_t>() != 0; }
+    int64_t as_int() const { return static_cast<int64_t>(load<uint64_t>()); }
+    double as_double() const { return load<double>(); }
+    std::string_view as_string() const;
+    Bounds as_rect() const;
+    uint64_t as_handle() const { return load<uint64_t>(); }
+
+    // The equivalent in-memory value (allocates for strings).
+    PropertyValue value() const;
+
+private:
+    template <class T>
+    T load() const {
+        T v;
+        std::memcpy(&v, m_p->value, sizeof(T));
+        return v;
+    }
+
+    const SnapshotView* m_view;
+    const snapshot::Property* m_p;
+};
+
+// One node of a mapped snapshot. NodeIds are indices into the node table and
+// match the ElementTree that to_tree() produces.
+class SnapshotNode {
+public:
+    SnapshotNode(const SnapshotView* view, NodeId index);
+
+    NodeId index() const { return m_index; }
+    NodeId parent() const { return m_n->parent; }
+    NodeId first_child() const { return m_n->firstChild; }
+    NodeId next_sibling() const { return m_n->nextSibling; }
+    size_t child_count() const { return m_n->childCount; }
+    bool has_children() const { return m_n->firstChild != kNoNode; }
+
+    std::string_view id() const;
+    std::string_view type() const;
+    std::string_view framework() const;
+    std::string_view class_name() const;
+    std::string_view text() const;
+    Bounds bounds() const { return {m_n->x, m_n->y, m_n->width, m_n->height}; }
+    uint64_t native_handle() const { return m_n->nativeHandle; }
+    // Element::hash, or 0 when the snapshot has no hashes.
+    uint64_t hash() const;
+
+    size_t property_count() const { return m_n->propertyCount; }
+    SnapshotProperty property(size_t i) const;
+
+private:
+    const SnapshotView* m_view;
+    const snapshot::Node* m_n;
+    NodeId m_index;
+};
+
+static_assert(snapshot::kNone == kNoNode, "snapshot links use NodeId sentinels");
+
+// Read-only view over an lvtbin image in memory (usually a MappedFile).
+// open() validates every offset and link once, after which accessors index
+// the image directly: walking or querying nodes allocates nothing.
+class SnapshotView {
+public:
+    // Check the image and bind to it. `data` must stay valid and 8-byte
+    // aligned while the view is used. On failure returns false and describes
+    // the problem in `error`.
+    bool open(const void* data, size_t size, std::string* error = nullptr);
+
+    size_t node_count() const { return m_header ? m_header->nodeCount : 0; }
+    NodeId root() const { return node_count() ? 0 : kNoNode; }
+    SnapshotNode node(NodeId index) const { return SnapshotNode(this, index); }
+
+    // Next node in depth-first pre-order within the subtree at `scope`.
+    NodeId next_preorder(NodeId node, NodeId scope) const;
+
+    HWND hwnd() const;
+    DWORD pid() const { return m_header->pid; }
+    std::string_view process_name() const { return string(m_header->processName); }
+    size_t framework_count() const { return m_header->frameworkCount; }
+    std::string_view framework(size_t i) const { return string(m_frameworks[i]); }
+    bool has_hashes() const { return m_hashes != nullptr; }
+
+    // Materialize the whole snapshot as an ElementTree (node ids preserved).
+    ElementTree to_tree() const;
+
+private:
+    friend class SnapshotNode;
+    friend class SnapshotProperty;
+
+    std::string_view string(snapshot::String s) const { return {m_strings + s.offset, s.size}; }
+    bool check_string(snapshot::String s) const;
+
+    const snapshot::Header* m_header = nullptr;
+    const snapshot::Node* m_nodes = nullptr;
+    const snapshot::Property* m_properties = nullptr;
+    const snapshot::String* m_frameworks = nullptr;
+    const char* m_strings = nullptr;
+    const uint64_t* m_hashes = nullptr;
+};
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path, std::string* error = nullptr);
+    void close();
+
+    const void* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    const void* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    HANDLE m_mapping = nullptr;
+#endif
+};
+
+// Write the subtree of `tree` rooted at `root` as an lvtbin snapshot. Nodes
+// are renumbered in pre-order; detached nodes are not written. With `hashes`
+// the snapshot also carries each node's Element::hash.
+void write_snapshot(OutputSink& out, const ElementTree& tree, NodeId root, HWND hwnd, DWORD pid,
+                    const std::string& processName,
+                    const std::vector<std::string>& frameworks, bool hashes = false);
+
+} // namespace lvt
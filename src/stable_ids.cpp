@@ -0,0 +1,167 @@
+#include "stable_ids.h"
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace lvt {
+
+// FNV-1a over the key fields, finished with a splitmix64 round. Only the
+// text of symbols is hashed, never their interned ids, so IDs are the same
+// in every process.
+static constexpr uint64_t kFnvOffset = 0xCBF29CE484222325ull;
+
+static uint64_t fnv(uint64_t h, const void* data, size_t size) {
+    auto* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
+static uint64_t fnv(uint64_t h, uint64_t v) {
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; i++) bytes[i] = static_cast<unsigned char>(v >> (8 * i));
+    return fnv(h, bytes, sizeof(bytes));
+}
+
+static uint64_t fnv(uint64_t h, std::string_view s) {
+    return fnv(fnv(h, uint64_t{s.size()}), s.data(), s.size());
+}
+
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// What tells an element from its siblings: `loose` is framework, type and
+// class; `key` adds the window handle or, for anything else, the text.
+struct SiblingKey {
+    NodeId node;
+    uint64_t key;
+    uint64_t loose;
+    uint32_t ordinal;  // among earlier siblings with the same key
+};
+
+static void sibling_keys(const ElementTree& tree, NodeId parent, std::vector<SiblingKey>& out,
+                         std::vector<std::pair<uint64_t, uint32_t>>& order) {
+    out.clear();
+    for (NodeId c : tree.children(parent)) {
+        const Element& el = tree[c];
+        uint64_t loose = fnv(fnv(fnv(kFnvOffset, el.framework.view()), el.type.view()), el.className.view());
+        uint64_t key = el.nativeHandle ? fnv(loose, uint64_t{el.nativeHandle}) : fnv(loose, el.text);
+        out.push_back({c, key, loose, 0});
+    }
+    // Ordinals come from runs of equal keys, in sibling order.
+    order.resize(out.size());
+    for (size_t i = 0; i < out.size(); i++) order[i] = {out[i].key, static_cast<uint32_t>(i)};
+    std::sort(order.begin(), order.end());
+    for (size_t i = 1; i < order.size(); i++) {
+        if (order[i].first == order[i - 1].first)
+            out[order[i].second].ordinal = out[order[i - 1].second].ordinal + 1;
+    }
+}
+
+// Pair the children of `node` (in `tree`) with those of `prev` (in
+// `previous`): first by key and ordinal, then leftovers by loose key in order.
+static void match_children(const ElementTree& tree, NodeId node, const ElementTree& previous, NodeId prev,
+                           std::vector<NodeId>& match) {
+    std::vector<SiblingKey> cur, old;
+    std::vector<std::pair<uint64_t, uint32_t>> order;
+    sibling_keys(tree, node, cur, order);
+    sibling_keys(previous, prev, old, order);
+    if (cur.empty() || old.empty()) return;
+
+    std::vector<size_t> byKey(old.size());
+    for (size_t i = 0; i < old.size(); i++) byKey[i] = i;
+    std::sort(byKey.begin(), byKey.end(), [&](size_t a, size_t b) {
+        return std::pair(old[a].key, old[a].ordinal) < std::pair(old[b].key, old[b].ordinal);
+    });
+    std::vector<bool> taken(old.size());
+    bool leftovers = false;
+    for (const SiblingKey& c : cur) {
+        auto it = std::lower_bound(byKey.begin(), byKey.end(), c, [&](size_t i, const SiblingKey& k) {
+            return std::pair(old[i].key, old[i].ordinal) < std::pair(k.key, k.ordinal);
+        });
+        if (it != byKey.end() && old[*it].key == c.key && old[*it].ordinal == c.ordinal) {
+            match[c.node] = old[*it].node;
+            taken[*it] = true;
+        } else {
+            leftovers = true;
+        }
+    }
+    if (!leftovers) return;
+
+    std::unordered_map<uint64_t, std::vector<size_t>> free;  // loose key -> untaken, in order
+    for (size_t i = old.size(); i-- > 0;)
+        if (!taken[i]) free[old[i].loose].push_back(i);
+    for (const SiblingKey& c : cur) {
+        if (match[c.node] != kNoNode) continue;
+        auto it = free.find(c.loose);
+        if (it == free.end() || it->second.empty()) continue;
+        match[c.node] = old[it->second.back()].node;
+        it->second.pop_back();
+    }
+}
+
+void assign_stable_ids(ElementTree& tree, ElementIndex* index, const ElementTree* previous) {
+    NodeId root = tree.root();
+    std::vector<uint64_t> path(tree.size());
+    std::vector<NodeId> match(tree.size(), kNoNode);
+    if (root != kNoNode) {
+        std::vector<SiblingKey> keys;
+        std::vector<std::pair<uint64_t, uint32_t>> order;
+        const Element& r = tree[root];
+        path[root] = mix(fnv(fnv(fnv(kFnvOffset, r.framework.view()), r.type.view()), r.className.view()));
+        for (NodeId n = root; n != kNoNode; n = tree.next_preorder(n, root)) {
+            sibling_keys(tree, n, keys, order);
+            for (const SiblingKey& k : keys) path[k.node] = mix(fnv(fnv(path[n], k.key), uint64_t{k.ordinal}));
+        }
+
+        if (previous && !previous->empty()) {
+            NodeId prevRoot = previous->root();
+            const Element& p = (*previous)[prevRoot];
+            if (p.framework == r.framework && p.type == r.type && p.className == r.className)
+                match[root] = prevRoot;
+            for (NodeId n = root; n != kNoNode; n = tree.next_preorder(n, root)) {
+                if (match[n] != kNoNode) match_children(tree, n, *previous, match[n], match);
+            }
+        }
+    }
+
+    // Carried IDs first, so a fresh hash never takes one that is carried later.
+    std::unordered_set<std::string_view> used;
+    used.reserve(tree.size());
+    for (NodeId n = root; n != kNoNode; n = tree.next_preorder(n, root)) {
+        if (match[n] == kNoNode) continue;
+        const std::string& id = (*previous)[match[n]].id;
+        if (id.empty() || !used.insert(id).second) {
+            match[n] = kNoNode;
+            continue;
+        }
+        tree[n].id = id;
+    }
+    for (NodeId n = root; n != kNoNode; n = tree.next_preorder(n, root)) {
+        if (match[n] != kNoNode) continue;
+        static const char kHex[] = "0123456789abcdef";
+        char id[13] = {'s'};
+        for (uint64_t h = path[n];; h = mix(h + 0x9E3779B97F4A7C15ull)) {
+            for (int i = 0; i < 12; i++) id[12 - i] = kHex[(h >> (4 * i)) & 0xF];
+            if (!used.contains(std::string_view(id, sizeof(id)))) break;
+        }
+        tree[n].id.assign(id, sizeof(id));
+        used.insert(tree[n].id);
+    }
+
+    if (index) {
+        index->sync(tree);
+        index->reindex_ids(tree);
+    }
+}
+
+} // namespace lvt
@@ -0,0 +1,32 @@
+#pragma once
+#include "element.h"
+#include "element_index.h"
+
+namespace lvt {
+
+// Assign element IDs that survive between invocations, instead of the
+// numbering of assign_element_ids (where one new toast renumbers everything
+// after it).
+//
+// An element's ID is "s" and 12 hex digits of a hash of its path from the
+// root. Each step is the element's framework, type and class, its window
+// handle (windows) or text (everything else: x:Name for XAML, item text for
+// controls), and its ordinal among the earlier siblings that share all of
+// those. So an element keeps its ID as long as its ancestors and its
+// like-keyed earlier siblings do; inserting, removing or renaming anything
+// else leaves it alone. The rare collision is resolved by rehashing the
+// later element in depth-first order, so IDs are unique within the tree.
+//
+// With `previous` (typically loaded from an earlier snapshot), elements that
+// correspond to one in `previous` keep that element's ID, whatever scheme it
+// came from. Correspondence is matched top-down from the roots: children
+// pair up by the full key and ordinal above, then any left over by
+// framework, type and class in order. This carries IDs across changes the
+// hash alone cannot, such as a retitled window or a restarted app whose
+// windows have new handles. Elements with no counterpart get hash IDs.
+//
+// When `index` is given it is synced and its ID table rebuilt.
+void assign_stable_ids(ElementTree& tree, ElementIndex* index = nullptr,
+                       const ElementTree* previous = nullptr);
+
+} // namespace lvt
@@ -0,0 +1,100 @@
+#include "symbol.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <shared_mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace lvt {
+
+namespace {
+
+// Strings live in fixed-size chunks reached through a fixed top-level table,
+// so text(id) never has to lock: a chunk pointer is published once and the
+// strings it holds are written before their id is handed out.
+constexpr unsigned kChunkShift = 10;
+constexpr size_t kChunkSize = size_t{1} << kChunkShift;
+constexpr size_t kChunkMask = kChunkSize - 1;
+constexpr size_t kMaxChunks = size_t{1} << 16;
+
+struct Chunk {
+    std::string strings[kChunkSize];
+};
+
+struct Pool {
+    std::atomic<Chunk*> chunks[kMaxChunks] = {};
+    std::shared_mutex mutex;
+    std::unordered_map<std::string_view, uint32_t> lookup;
+    uint32_t count = 0;
+    size_t textBytes = 0;
+
+    Pool() {
+        chunks[0].store(new Chunk, std::memory_order_release);
+        lookup.emplace(std::string_view(), 0);
+        count = 1;
+    }
+};
+
+Pool& pool() {
+    static Pool* p = new Pool;  // leaked so symbols stay valid during static destruction
+    return *p;
+}
+
+} // namespace
+
+uint32_t Symbol::intern(std::string_view s) {
+    if (s.empty()) return 0;
+    Pool& p = pool();
+    {
+        std::shared_lock lock(p.mutex);
+        auto it = p.lookup.find(s);
+        if (it != p.lookup.end()) return it->second;
+    }
+
+    std::unique_lock lock(p.mutex);
+    auto it = p.lookup.find(s);
+    if (it != p.lookup.end()) return it->second;
+
+    uint32_t id = p.count;
+    size_t chunkIndex = id >> kChunkShift;
+    if (chunkIndex >= kMaxChunks) throw std::length_error("symbol pool exhausted");
+    Chunk* chunk = p.chunks[chunkIndex].load(std::memory_order_relaxed);
+    if (!chunk) {
+        chunk = new Chunk;
+        p.chunks[chunkIndex].store(chunk, std::memory_order_release);
+    }
+    std::string& slot = chunk->strings[id & kChunkMask];
+    slot.assign(s.data(), s.size());
+    p.lookup.emplace(std::string_view(slot), id);
+    if (slot.capacity() > std::string().capacity()) p.textBytes += slot.capacity() + 1;
+    p.count = id + 1;
+    return id;
+}
+
+const std::string& Symbol::text(uint32_t id) {
+    Chunk* chunk = pool().chunks[id >> kChunkShift].load(std::memory_order_acquire);
+    return chunk->strings[id & kChunkMask];
+}
+
+size_t Symbol::pool_size() {
+    Pool& p = pool();
+    std::shared_lock lock(p.mutex);
+    return p.count;
+}
+
+size_t Symbol::pool_bytes() {
+    Pool& p = pool();
+    std::shared_lock lock(p.mutex);
+    size_t chunks = (p.count + kChunkMask) >> kChunkShift;
+    size_t buckets = p.lookup.bucket_count() * sizeof(void*);
+    size_t entries = p.lookup.size() * (sizeof(std::string_view) + sizeof(uint32_t) + 2 * sizeof(void*));
+    return chunks * sizeof(Chunk) + p.textBytes + buckets + entries;
+}
+
+std::ostream& operator<<(std::ostream& os, Symbol s) {
+    return os << s.view();
+}
+
+} // namespace lvt
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+namespace lvt {
+
+// Interned string. Element type, framework and className values repeat
+// heavily across a tree ("Border", "Grid", "winui3"), so each distinct value
+// is stored once in a process-wide pool and elements hold a 32-bit handle.
+//
+// Symbols are never freed. Interning is thread-safe; reading a symbol's text
+// is lock-free. Id 0 is always the empty string.
+class Symbol {
+public:
+    Symbol() = default;
+    Symbol(std::string_view s) : m_id(intern(s)) {}
+    Symbol(const std::string& s) : m_id(intern(s)) {}
+    Symbol(const char* s) : m_id(intern(s ? std::string_view(s) : std::string_view())) {}
+
+    uint32_t id() const { return m_id; }
+    bool empty() const { return m_id == 0; }
+
+    // Pooled text. The reference stays valid for the life of the process.
+    const std::string& str() const { return text(m_id); }
+    std::string_view view() const { return str(); }
+    const char* c_str() const { return str().c_str(); }
+    size_t size() const { return str().size(); }
+
+    friend bool operator==(Symbol a, Symbol b) { return a.m_id == b.m_id; }
+    friend bool operator==(Symbol a, std::string_view b) { return a.view() == b; }
+    friend bool operator==(Symbol a, const std::string& b) { return a.view() == b; }
+    friend bool operator==(Symbol a, const char* b) { return a.view() == std::string_view(b ? b : ""); }
+
+    // Number of distinct symbols interned so far (including the empty one).
+    static size_t pool_size();
+
+    // Bytes held by the pool: string storage plus lookup table overhead.
+    static size_t pool_bytes();
+
+private:
+    static uint32_t intern(std::string_view s);
+    static const std::string& text(uint32_t id);
+
+    uint32_t m_id = 0;
+};
+
+std::ostream& operator<<(std::ostream& os, Symbol s);
+
+} // namespace lvt
+
+template <>
+struct std::hash<lvt::Symbol> {
+    size_t operator()(lvt::Symbol s) const noexcept { return std::hash<uint32_t>()(s.id()); }
+};
@@ -2,16 +2,23 @@
 // Injected into the target process by InitializeXamlDiagnosticsEx.
 // Implements IObjectWithSite → receives IXamlDiagnostics → walks XAML tree
 // via IVisualTreeService::AdviseVisualTreeChange → sends JSON over named pipe.
+// With a SERVE pipe in the init data it then stays advised, keeping the tree
+// live, and answers further requests on that pipe (see tap_tree.h).
 
 #include <Windows.h>
+#include <sddl.h>
 #include <objbase.h>
 #include <ocidl.h>
 #include <xamlOM.h>
 #include <string>
-#include <map>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <cstdio>
 
+#include "tap_tree.h"
+
 // GUIDs only forward-declared in xamlOM.h (no .lib provides them)
 const IID IID_IVisualTreeServiceCallback =
     { 0xAA7A8931, 0x80E4, 0x4FEC, { 0x8F, 0x3B, 0x55, 0x3F, 0x87, 0xB4, 0x96, 0x6E } };
@@ -48,23 +55,30 @@ static HMODULE GetCurrentModuleHandle() {
     return hm;
 }
 
-struct TreeNode {
-    InstanceHandle handle = 0;
-    std::wstring type;
-    std::wstring name;
-    unsigned int numChildren = 0;
-    InstanceHandle parent = 0;
-    unsigned int childIndex = 0;
-    std::vector<InstanceHandle> childHandles;
-    std::vector<std::pair<std::wstring, std::wstring>> properties; // name, value
-    double width = 0, height = 0;
-    double offsetX = 0, offsetY = 0;
-    bool hasBounds = false;
-};
-
 class LvtTap;
 
 // Forward declaration for WndProc
+// A DACL that lets only this process's user open the serve pipe, so no
+// other user on the machine can query the app through it. Free with
+// LocalFree; null on failure.
+static PSECURITY_DESCRIPTOR OwnerOnlyDescriptor() {
+    HANDLE token = nullptr;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token)) return nullptr;
+    DWORD size = 0;
+    GetTokenInformation(token, TokenUser, nullptr, 0, &size);
+    std::vector<BYTE> user(size);
+    bool ok = size && GetTokenInformation(token, TokenUser, user.data(), size, &size);
+    CloseHandle(token);
+    LPWSTR sid = nullptr;
+    if (!ok || !ConvertSidToStringSidW(reinterpret_cast<TOKEN_USER*>(user.data())->User.Sid, &sid))
+        return nullptr;
+    std::wstring sddl = L"D:P(A;;GA;;;" + std::wstring(sid) + L")";
+    LocalFree(sid);
+    PSECURITY_DESCRIPTOR sd = nullptr;
+    ConvertStringSecurityDescriptorToSecurityDescriptorW(sddl.c_str(), SDDL_REVISION_1, &sd, nullptr);
+    return sd;
+}
+
 static LRESULT CALLBACK LvtTapMsgWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
 class LvtTap : public IObjectWithSite, public IVisualTreeServiceCallback2 {
@@ -72,14 +86,29 @@ class LvtTap : public IObjectWithSite, public IVisualTreeServiceCallback2 {
     IUnknown* m_site = nullptr;
     IXamlDiagnostics* m_diag = nullptr;
     HWND m_msgWnd = nullptr; // Message-only window for UI thread dispatch
-    std::map<InstanceHandle, TreeNode> m_nodes;
-    std::vector<InstanceHandle> m_roots;
+    // Mutations arrive on the UI thread; requests are served on the advise
+    // thread.
+    std::mutex m_lock;
+    std::condition_variable m_changed;  // signaled after each mutation
+    lvt::tap::TreeModel m_model;
     std::wstring m_pipeName;
-    bool m_collectProps = false;
+    std::wstring m_servePipe;
+    size_t m_lastPayload = 0;  // bytes in the last tree sent
+    // The properties to send, with their per-type index cache. Only the UI
+    // thread reads through it; a PROPS request puts a new one in its place.
+    std::shared_ptr<lvt::tap::PropertySelection> m_selection =
+        std::make_shared<lvt::tap::PropertySelection>();
+    // The collection the UI thread is reading, until it is done or given up.
+    std::shared_ptr<lvt::tap::BoundsCollector> m_collection;
+    bool m_collecting = false;  // a slice is queued or running
 
 public:
     IVisualTreeService* m_vts = nullptr;
     static constexpr UINT WM_COLLECT_BOUNDS = WM_USER + 100;
+    static constexpr UINT_PTR kCollectTimer = 1;
+    // How long the tree waits for bounds (lvt gives up on the TAP after
+    // 15 s). A hung UI thread gets those read so far.
+    static constexpr DWORD kCollectTimeoutMs = 10000;
 
 public:
     HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppv) override {
@@ -143,18 +172,13 @@ public:
         BSTR initData = nullptr;
         diag->GetInitializationData(&initData);
         if (initData) {
-            std::wstring data(initData);
+            lvt::tap::InitData init = lvt::tap::parse_init_data(initData);
             SysFreeString(initData);
-            // Format: "pipe_name" or "pipe_name|PROPS"
-            auto sep = data.find(L'|');
-            if (sep != std::wstring::npos) {
-                m_pipeName = data.substr(0, sep);
-                std::wstring flags = data.substr(sep + 1);
-                m_collectProps = (flags.find(L"PROPS") != std::wstring::npos);
-            } else {
-                m_pipeName = data;
-            }
-            LogMsg("Pipe name: %ls, collectProps: %d", m_pipeName.c_str(), m_collectProps);
+            m_pipeName = std::move(init.pipe);
+            m_servePipe = std::move(init.servePipe);
+            LogMsg("Pipe name: %ls, collectProps: %d (%zu), serve: %ls",
+                   m_pipeName.c_str(), init.collectProps, init.properties.size(), m_servePipe.c_str());
+            m_selection = std::make_shared<lvt::tap::PropertySelection>(std::move(init.properties));
         }
 
         hr = diag->QueryInterface(__uuidof(IVisualTreeService), (void**)&m_vts);
@@ -204,22 +228,16 @@ public:
                     static_cast<IVisualTreeServiceCallback2*>(self));
 
             HRESULT hr = self->m_vts->AdviseVisualTreeChange(cb);
-            LogMsg("AdviseVisualTreeChange returned 0x%08X, nodes=%zu, roots=%zu",
-                   hr, self->m_nodes.size(), self->m_roots.size());
+            LogMsg("AdviseVisualTreeChange returned 0x%08X, nodes=%zu",
+                   hr, self->ModelSize());
 
             if (SUCCEEDED(hr)) {
-                if (self->m_nodes.empty()) {
-                    Sleep(500);
-                    LogMsg("After sleep: nodes=%zu", self->m_nodes.size());
-                }
-                // Dispatch GetPropertyValuesChain to UI thread via message window.
-                // SendMessage blocks until the UI thread processes the message.
-                if (self->m_msgWnd) {
-                    LogMsg("Dispatching CollectBounds to UI thread via SendMessage");
-                    SendMessageW(self->m_msgWnd, WM_COLLECT_BOUNDS, 0,
-                                 reinterpret_cast<LPARAM>(self));
-                }
+                self->WaitForTree();
+                self->CollectBounds(0, -1);
                 self->SerializeAndSend();
+                // Stay advised, so the model follows the app, for as long
+                // as we serve.
+                if (!self->m_servePipe.empty()) self->ServeRequests();
                 self->m_vts->UnadviseVisualTreeChange(cb);
             }
         } __except(EXCEPTION_EXECUTE_HANDLER) {
@@ -242,24 +260,16 @@ public:
         VisualMutationType mutationType) override
     {
         if (mutationType == VisualMutationType::Add) {
-            TreeNode node;
-            node.handle = element.Handle;
-            node.type = element.Type ? element.Type : L"";
-            node.name = element.Name ? element.Name : L"";
-            node.numChildren = element.NumChildren;
-            node.parent = relation.Parent;
-            node.childIndex = relation.ChildIndex;
-            m_nodes[element.Handle] = std::move(node);
-
-            if (relation.Parent != 0) {
-                auto it = m_nodes.find(relation.Parent);
-                if (it != m_nodes.end()) {
-                    it->second.childHandles.push_back(element.Handle);
-                }
-            } else {
-                m_roots.push_back(element.Handle);
-            }
+            std::string type = lvt::tap::to_utf8(element.Type);
+            std::string name = lvt::tap::to_utf8(element.Name);
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_model.add(element.Handle, relation.Parent, relation.ChildIndex,
+                        std::move(type), std::move(name), element.NumChildren);
+        } else if (mutationType == VisualMutationType::Remove) {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_model.remove(element.Handle);
         }
+        m_changed.notify_all();
         return S_OK;
     }
 
@@ -270,24 +280,92 @@ public:
         return S_OK;
     }
 
+    // Called on the UI thread for each slice of m_collection. The model is
+    // only locked to store the results, not around GetPropertyValuesChain,
+    // so the serving thread is not held up and a mutation delivered meanwhile
+    // cannot deadlock.
+    void CollectSlice() {
+        std::shared_ptr<lvt::tap::BoundsCollector> collection;
+        std::shared_ptr<lvt::tap::PropertySelection> selection;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            collection = m_collection;
+            selection = m_selection;
+            if (!collection) m_collecting = false;
+        }
+        if (!collection) {
+            Release();
+            return;
+        }
+        bool done = collection->step([&](lvt::tap::Handle handle, std::string_view type,
+                                         lvt::tap::NodeData& data) {
+            int code = CollectBoundsForNodeSEH(m_vts, *selection, type, data, handle);
+            if (code != 0)
+                LogMsg("GetPropertyValuesChain crashed for handle %llu: 0x%08X",
+                       (unsigned long long)handle, code);
+        });
+        bool more;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            collection->store(m_model);
+            if (done && m_collection == collection) m_collection = nullptr;
+            more = m_collection != nullptr;
+            if (!more) m_collecting = false;
+        }
+        if (done) {
+            LogMsg("CollectBounds: collected bounds for %zu/%zu nodes in %zu slices, longest %lld ms",
+                   collection->collected(), collection->size(), collection->slices(),
+                   (long long)std::chrono::duration_cast<std::chrono::milliseconds>(
+                       collection->longest()).count());
+            m_changed.notify_all();
+        }
+        if (!more) {
+            Release();
+            return;
+        }
+        // A posted message is retrieved before input and paint, WM_TIMER
+        // after them: let whatever the user is waiting for go first.
+        bool queued = HIWORD(GetQueueStatus(QS_INPUT | QS_PAINT))
+            ? SetTimer(m_msgWnd, kCollectTimer, USER_TIMER_MINIMUM, nullptr) != 0
+            : PostMessageW(m_msgWnd, WM_COLLECT_BOUNDS, 0, 0) != FALSE;
+        if (!queued) {
+            LogMsg("Cannot queue the next slice: %lu", GetLastError());
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_collection = nullptr;
+                m_collecting = false;
+            }
+            m_changed.notify_all();
+            Release();
+        }
+    }
+
 private:
-    // Parse "x,y,z" or "<x, y, z>" formatted offset string
-    static bool ParseOffset(const std::wstring& val, double& x, double& y) {
-        // Try "x,y,z" or "<x, y, z>" format
-        const wchar_t* p = val.c_str();
-        while (*p && (*p == L'<' || *p == L' ')) p++;
-        wchar_t* end = nullptr;
-        x = wcstod(p, &end);
-        if (end == p) return false;
-        p = end;
-        while (*p && (*p == L',' || *p == L' ')) p++;
-        y = wcstod(p, &end);
-        return end != p;
+    size_t ModelSize() {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_model.size();
+    }
+
+    // Wait until the replay that AdviseVisualTreeChange started has
+    // delivered every announced child (see lvt::tap::Quiescence).
+    void WaitForTree() {
+        using lvt::tap::Quiescence;
+        auto start = Quiescence::Clock::now();
+        Quiescence settle(start);
+        std::unique_lock<std::mutex> lock(m_lock);
+        Quiescence::State state;
+        while ((state = settle.observe(Quiescence::Clock::now(), m_model)) == Quiescence::State::Waiting)
+            m_changed.wait_until(lock, settle.deadline(m_model));
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(Quiescence::Clock::now() - start);
+        LogMsg("Tree %s after %lld ms: nodes=%zu", lvt::tap::to_string(state),
+               static_cast<long long>(ms.count()), m_model.size());
     }
 
-    // Collect bounds for a single node — isolated for SEH compatibility
-    static void CollectBoundsForNode(IVisualTreeService* vts, TreeNode& node, InstanceHandle handle,
-                                     bool /*logDetail*/) {
+    // Read one element's layout and selected properties from its property
+    // chain — isolated for SEH compatibility
+    static void CollectBoundsForNode(IVisualTreeService* vts, lvt::tap::PropertySelection& selection,
+                                     std::string_view type, lvt::tap::NodeData& node,
+                                     InstanceHandle handle) {
         unsigned int srcCount = 0, propCount = 0;
         PropertyChainSource* sources = nullptr;
         PropertyChainValue* props = nullptr;
@@ -296,22 +374,14 @@ private:
         if (FAILED(hr)) {
             return;
         }
-        bool hasWidth = false, hasHeight = false;
+        auto reader = selection.read(type, node);
         for (unsigned int i = 0; i < propCount; i++) {
-            std::wstring name = props[i].PropertyName ? props[i].PropertyName : L"";
-            std::wstring value = props[i].Value ? props[i].Value : L"";
-            if (name == L"ActualWidth" && !value.empty()) {
-                node.width = _wtof(value.c_str());
-                hasWidth = true;
-            } else if (name == L"ActualHeight" && !value.empty()) {
-                node.height = _wtof(value.c_str());
-                hasHeight = true;
-            } else if (name == L"ActualOffset" && !value.empty()) {
-                ParseOffset(value, node.offsetX, node.offsetY);
-            }
+            reader.add(props[i].Index, props[i].PropertyName, props[i].DeclaringType, props[i].Value,
+                       props[i].Overridden != FALSE);
             if (props[i].Type) SysFreeString(props[i].Type);
             if (props[i].DeclaringType) SysFreeString(props[i].DeclaringType);
             if (props[i].ValueType) SysFreeString(props[i].ValueType);
+            if (props[i].ItemType) SysFreeString(props[i].ItemType);
             if (props[i].PropertyName) SysFreeString(props[i].PropertyName);
             if (props[i].Value) SysFreeString(props[i].Value);
         }
@@ -321,111 +391,65 @@ private:
         }
         if (props) CoTaskMemFree(props);
         if (sources) CoTaskMemFree(sources);
-        node.hasBounds = hasWidth && hasHeight;
+        reader.finish();
     }
 
     // SEH wrapper for single-node bounds collection (cannot use __try with C++ objects)
-    static int CollectBoundsForNodeSEH(IVisualTreeService* vts, TreeNode& node, InstanceHandle handle,
-                                       bool logDetail) {
+    static int CollectBoundsForNodeSEH(IVisualTreeService* vts, lvt::tap::PropertySelection& selection,
+                                       std::string_view type, lvt::tap::NodeData& node,
+                                       InstanceHandle handle) {
         __try {
-            CollectBoundsForNode(vts, node, handle, logDetail);
+            CollectBoundsForNode(vts, selection, type, node, handle);
             return 0;
         } __except(EXCEPTION_EXECUTE_HANDLER) {
             return GetExceptionCode();
         }
     }
 
-    void CollectBounds(IVisualTreeService* vts) {
-        LogMsg("CollectBounds: collecting layout for %zu nodes on thread %lu",
-               m_nodes.size(), GetCurrentThreadId());
-        int collected = 0;
-        int idx = 0;
-        for (auto& [handle, node] : m_nodes) {
-            bool logDetail = (idx < 3); // Log details for first 3 nodes
-            int code = CollectBoundsForNodeSEH(vts, node, handle, logDetail);
-            if (code != 0) {
-                LogMsg("GetPropertyValuesChain crashed for handle %llu: 0x%08X",
-                       (unsigned long long)handle, code);
-            }
-            if (node.hasBounds) collected++;
-            idx++;
-        }
-        LogMsg("CollectBounds: collected bounds for %d/%zu nodes", collected, m_nodes.size());
-    }
-
-    // Called on the UI thread via SendMessage from the worker thread
-public:
-    void CollectBoundsOnUIThread() {
-        CollectBounds(m_vts);
-    }
-private:
-
-    static std::wstring Escape(const std::wstring& s) {
-        std::wstring r;
-        r.reserve(s.size());
-        for (wchar_t c : s) {
-            if (c == L'"') { r += L"\\\""; }
-            else if (c == L'\\') { r += L"\\\\"; }
-            else if (c < 0x20) {
-                // Escape all control characters as \uXXXX
-                wchar_t buf[8];
-                swprintf_s(buf, L"\\u%04X", (unsigned)c);
-                r += buf;
+    // Collect bounds for `scope` and its subtree (every root's for 0),
+    // `depth` levels of it, on the UI thread. GetPropertyValuesChain has to
+    // run there, and one pass over a large tree froze the app for seconds,
+    // so the reads come in slices of BoundsCollector's budget (CollectSlice).
+    // Waits until they are done or kCollectTimeoutMs has passed.
+    void CollectBounds(lvt::tap::Handle scope, int depth) {
+        if (!m_msgWnd) return;
+        auto collection = std::make_shared<lvt::tap::BoundsCollector>();
+        std::unique_lock<std::mutex> lock(m_lock);
+        if (!collection->start(m_model, scope, depth) || collection->done()) return;
+        LogMsg("CollectBounds: %zu nodes under %llu, depth %d", collection->size(),
+               (unsigned long long)scope, depth);
+        m_collection = collection;
+        if (!m_collecting) {
+            AddRef();  // for the queued slice
+            m_collecting = PostMessageW(m_msgWnd, WM_COLLECT_BOUNDS, 0, 0) != FALSE;
+            if (!m_collecting) {
+                LogMsg("PostMessage failed: %lu", GetLastError());
+                m_collection = nullptr;
+                Release();
+                return;
             }
-            else { r += c; }
         }
-        return r;
-    }
-
-    std::wstring SerializeNode(InstanceHandle handle) {
-        auto it = m_nodes.find(handle);
-        if (it == m_nodes.end()) return L"null";
-        auto& n = it->second;
-
-        std::wstring j = L"{\"type\":\"" + Escape(n.type) + L"\"";
-        if (!n.name.empty())
-            j += L",\"name\":\"" + Escape(n.name) + L"\"";
-        j += L",\"handle\":" + std::to_wstring(n.handle);
-
-        if (n.hasBounds) {
-            // Use snprintf for consistent decimal formatting
-            char buf[128];
-            snprintf(buf, sizeof(buf), ",\"width\":%.1f,\"height\":%.1f,\"offsetX\":%.1f,\"offsetY\":%.1f",
-                     n.width, n.height, n.offsetX, n.offsetY);
-            // Convert to wide string
-            for (const char* p = buf; *p; p++) j += static_cast<wchar_t>(*p);
-        }
-
-        if (!n.childHandles.empty()) {
-            j += L",\"children\":[";
-            for (size_t i = 0; i < n.childHandles.size(); i++) {
-                if (i) j += L",";
-                j += SerializeNode(n.childHandles[i]);
-            }
-            j += L"]";
+        if (!m_changed.wait_for(lock, std::chrono::milliseconds(kCollectTimeoutMs),
+                                [&] { return m_collection != collection; })) {
+            LogMsg("CollectBounds: UI thread too slow, sending the bounds read so far");
+            m_collection = nullptr;  // the next slice stops
         }
-        j += L"}";
-        return j;
     }
 
+    // The tree is written into one buffer under the lock and sent after it
+    // is released: streaming to the pipe with the lock held would let a slow
+    // reader stall the UI thread's next mutation.
     void SerializeAndSend() {
-        LogMsg("SerializeAndSend: nodes=%zu, roots=%zu, pipe=%ls",
-               m_nodes.size(), m_roots.size(), m_pipeName.c_str());
-
-        if (m_pipeName.empty() || m_nodes.empty()) return;
-
-        std::wstring json = L"[";
-        for (size_t i = 0; i < m_roots.size(); i++) {
-            if (i) json += L",";
-            json += SerializeNode(m_roots[i]);
+        std::string utf8;
+        utf8.reserve(m_lastPayload);
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            LogMsg("SerializeAndSend: nodes=%zu, roots=%zu, pipe=%ls",
+                   m_model.size(), m_model.roots().size(), m_pipeName.c_str());
+            if (m_pipeName.empty() || m_model.empty()) return;
+            lvt::tap::write_tree(utf8, m_model);
         }
-        json += L"]";
-
-        int len = WideCharToMultiByte(CP_UTF8, 0, json.c_str(), (int)json.size(),
-                                      nullptr, 0, nullptr, nullptr);
-        std::string utf8(len, '\0');
-        WideCharToMultiByte(CP_UTF8, 0, json.c_str(), (int)json.size(),
-                            utf8.data(), len, nullptr, nullptr);
+        m_lastPayload = utf8.size();
 
         HANDLE pipe = CreateFileW(m_pipeName.c_str(), GENERIC_WRITE, 0,
                                   nullptr, OPEN_EXISTING, 0, nullptr);
@@ -440,6 +464,77 @@ private:
         }
     }
 
+    // Answer requests on m_servePipe, one client at a time, until the pipe
+    // fails. Only the first TAP in the process gets the name; any later one
+    // (lvt injected again) returns at once and unadvises.
+    void ServeRequests() {
+        SECURITY_ATTRIBUTES sa = {sizeof(sa), OwnerOnlyDescriptor(), FALSE};
+        if (!sa.lpSecurityDescriptor) {
+            LogMsg("Not serving on %ls: no security descriptor (%lu)", m_servePipe.c_str(), GetLastError());
+            return;
+        }
+        HANDLE pipe = CreateNamedPipeW(m_servePipe.c_str(),
+            PIPE_ACCESS_DUPLEX | FILE_FLAG_FIRST_PIPE_INSTANCE,
+            PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+            1, 64 * 1024, 64 * 1024, 0, &sa);
+        LocalFree(sa.lpSecurityDescriptor);
+        if (pipe == INVALID_HANDLE_VALUE) {
+            LogMsg("Not serving on %ls: %lu", m_servePipe.c_str(), GetLastError());
+            return;
+        }
+        LogMsg("Serving on %ls", m_servePipe.c_str());
+        for (;;) {
+            if (!ConnectNamedPipe(pipe, nullptr) && GetLastError() != ERROR_PIPE_CONNECTED) {
+                LogMsg("ConnectNamedPipe failed: %lu", GetLastError());
+                break;
+            }
+            ServeClient(pipe);
+            DisconnectNamedPipe(pipe);
+        }
+        CloseHandle(pipe);
+    }
+
+    void ServeClient(HANDLE pipe) {
+        std::string buffer, response;
+        response.reserve(m_lastPayload);
+        char chunk[4096];
+        for (;;) {
+            size_t nl;
+            while ((nl = buffer.find('\n')) != std::string::npos) {
+                lvt::tap::Request request =
+                    lvt::tap::parse_request(std::string_view(buffer).substr(0, nl));
+                buffer.erase(0, nl + 1);
+                if (request.kind == lvt::tap::Request::Props) {
+                    auto selection = std::make_shared<lvt::tap::PropertySelection>(request.properties);
+                    std::lock_guard<std::mutex> lock(m_lock);
+                    m_selection = std::move(selection);
+                }
+                // Layout has moved on since the last request.
+                if (request.kind == lvt::tap::Request::Tree)
+                    CollectBounds(0, request.depth);
+                else if (request.kind == lvt::tap::Request::Subtree)
+                    CollectBounds(request.argument, request.depth);
+                response.clear();
+                {
+                    std::lock_guard<std::mutex> lock(m_lock);
+                    lvt::tap::respond(m_model, request, response);
+                }
+                response += '\n';
+                const char* p = response.data();
+                size_t left = response.size();
+                while (left) {
+                    DWORD written = 0;
+                    if (!WriteFile(pipe, p, static_cast<DWORD>(left), &written, nullptr)) return;
+                    p += written;
+                    left -= written;
+                }
+            }
+            DWORD read = 0;
+            if (!ReadFile(pipe, chunk, sizeof(chunk), &read, nullptr) || read == 0) return;
+            buffer.append(chunk, read);
+        }
+    }
+
     ~LvtTap() {
         if (m_msgWnd) DestroyWindow(m_msgWnd);
         if (m_vts) m_vts->Release();
@@ -450,10 +545,12 @@ private:
 
 // Window procedure for dispatching GetPropertyValuesChain to UI thread
 static LRESULT CALLBACK LvtTapMsgWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
-    if (msg == LvtTap::WM_COLLECT_BOUNDS) {
-        auto* self = reinterpret_cast<LvtTap*>(lParam);
+    if (msg == LvtTap::WM_COLLECT_BOUNDS ||
+        (msg == WM_TIMER && wParam == LvtTap::kCollectTimer)) {
+        if (msg == WM_TIMER) KillTimer(hwnd, LvtTap::kCollectTimer);
+        auto* self = reinterpret_cast<LvtTap*>(GetWindowLongPtrW(hwnd, GWLP_USERDATA));
         if (self) {
-            self->CollectBoundsOnUIThread();
+            self->CollectSlice();  // may release the last reference
         }
         return 0;
     }
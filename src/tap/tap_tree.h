@@ -0,0 +1,993 @@
+#pragma once
+// The XAML TAP's model of the visual tree and the protocol lvt talks to it
+// with. Header-only and free of Windows headers, like text_scan.h, so the TAP
+// DLL uses it without linking lvt_core and the core tests run it anywhere.
+//
+// The model is kept live from IVisualTreeService's Add and Remove mutations.
+// A TAP injected with a "SERVE=<pipe>" init flag stays advised after sending
+// its first tree and answers requests on <pipe> (resident_pipe_name), one
+// line each way:
+//   TREE [<depth>]     {"version":V,"tree":[<root>,...]}
+//   SUBTREE <handle> [<depth>]
+//                      {"version":V,"tree":[<node>]}, or "tree":[] if unknown
+//   CHANGES <version>  {"version":V,"removed":[<handle>,...],
+//                       "added":[{"parent":P,"index":I,"node":<node>},...]}
+//                      or {"version":V,"reset":true} when changes that old are
+//                      no longer known; the client asks for TREE instead.
+//                      Removed handles the client no longer has are no-ops.
+//   PROPS [<name>,...] {"version":V,"properties":[<name>,...]}: the properties
+//                      TREE and SUBTREE send from now on (none without names),
+//                      in place of those of the PROPS init flag.
+// Anything else gets {"error":"..."}. Nodes are written as the one-shot
+// payload always has been:
+//   {"type":..,"name":..,"handle":N,"width":..,"height":..,"offsetX":..,
+//    "offsetY":..,"properties":{..},"children":[...]}
+// with "properties" holding those asked for with PROPS= that the element has.
+// A depth cuts the tree that many levels below the roots or the handle (0:
+// just those). CHANGES covers structure only; bounds are collected again for
+// each TREE or SUBTREE request, for the nodes it returns (BoundsCollector).
+
+#include "text_scan.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace lvt::tap {
+
+using Handle = uint64_t;  // InstanceHandle
+
+// ---- text ----
+
+// Append UTF-16 (2-byte units) or UTF-32 text as UTF-8. Unpaired surrogates
+// become U+FFFD.
+template <class CharT>
+void append_utf8(std::string& out, const CharT* s, size_t n) {
+    static_assert(sizeof(CharT) == 2 || sizeof(CharT) == 4, "append_utf8 takes UTF-16 or UTF-32");
+    for (size_t i = 0; i < n; i++) {
+        uint32_t c = static_cast<uint32_t>(s[i]);
+        if (c < 0x80) {
+            out.push_back(static_cast<char>(c));
+            continue;
+        }
+        if constexpr (sizeof(CharT) == 2) {
+            c &= 0xFFFF;
+            if (c >= 0xD800 && c <= 0xDBFF && i + 1 < n) {
+                uint32_t low = static_cast<uint32_t>(s[i + 1]) & 0xFFFF;
+                if (low >= 0xDC00 && low <= 0xDFFF) {
+                    c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                    i++;
+                }
+            }
+        }
+        if ((c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF) c = 0xFFFD;
+        if (c < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (c >> 6)));
+        } else if (c < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | (c >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+        } else {
+            out.push_back(static_cast<char>(0xF0 | (c >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+        }
+        out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+    }
+}
+
+// A null-terminated UTF-16/32 string (null for none) as UTF-8.
+template <class CharT>
+std::string to_utf8(const CharT* s) {
+    std::string out;
+    if (s) append_utf8(out, s, std::char_traits<CharT>::length(s));
+    return out;
+}
+
+// Append `s` as a quoted JSON string. Clean runs are found with the shared
+// vector scan and copied in one piece.
+inline void append_json_string(std::string& out, std::string_view s) {
+    using namespace lvt::text;
+    out.push_back('"');
+    size_t i = 0;
+    for (;;) {
+        size_t next = i + find_special<kStopControl, '"', '\\'>(s.data() + i, s.size() - i);
+        out.append(s, i, next - i);
+        if (next == s.size()) break;
+        char c = s[next];
+        if (c == '"') {
+            out += "\\\"";
+        } else if (c == '\\') {
+            out += "\\\\";
+        } else {
+            static constexpr char kHex[] = "0123456789ABCDEF";
+            out += "\\u00";
+            out += kHex[(c >> 4) & 0xF];
+            out += kHex[c & 0xF];
+        }
+        i = next + 1;
+    }
+    out.push_back('"');
+}
+
+// ---- model ----
+
+struct Node {
+    Handle handle = 0;
+    Handle parent = 0;         // 0 for a root
+    std::string type;          // UTF-8
+    std::string name;
+    uint32_t numChildren = 0;  // as announced when added, less those removed
+    std::vector<Handle> children;  // in ChildIndex order
+    double width = 0, height = 0;
+    double offsetX = 0, offsetY = 0;
+    bool hasBounds = false;
+    std::vector<std::pair<std::string, std::string>> properties;  // those lvt asked for
+    bool attached = false;     // false while waiting for its parent's Add
+    uint64_t added = 0;        // model version of the Add that placed it
+};
+
+// What changed between a version of the model and the current one.
+struct Changes {
+    struct Added {
+        Handle parent;  // 0 for a root
+        uint32_t index;
+        Handle node;    // with its subtree
+    };
+    bool reset = false;            // too old to say; send the whole tree
+    std::vector<Handle> removed;   // with their subtrees, applied first
+    std::vector<Added> added;      // then these, in order
+};
+
+// The visual tree as the mutations describe it. Every mutation that changes
+// something bumps version(). Not thread-safe: the TAP locks around it.
+class TreeModel {
+public:
+    // Removals remembered for changes_since(); older versions get a reset.
+    static constexpr size_t kMaxRemovals = 4096;
+
+    uint64_t version() const { return m_version; }
+    size_t size() const { return m_nodes.size(); }
+    bool empty() const { return m_nodes.empty(); }
+    const std::vector<Handle>& roots() const { return m_roots; }
+
+    // Whether every child announced so far has arrived: each node has its
+    // numChildren and none is waiting for its parent.
+    bool complete() const { return !m_nodes.empty() && m_awaiting == 0 && m_orphans == 0; }
+
+    const Node* find(Handle handle) const {
+        auto it = m_nodes.find(handle);
+        return it == m_nodes.end() ? nullptr : &it->second;
+    }
+    Node* find(Handle handle) { return const_cast<Node*>(std::as_const(*this).find(handle)); }
+
+    // Every node, attached or not, for collecting bounds.
+    template <class Fn>
+    void for_each(Fn fn) {
+        for (auto& [handle, node] : m_nodes) fn(node);
+    }
+
+    // Apply an Add: `handle` goes at `index` among `parent`'s children (0
+    // makes it a root). A child announced before its parent waits for it. A
+    // node added again without a Remove is moved, keeping its children.
+    void add(Handle handle, Handle parent, uint32_t index, std::string type, std::string name,
+             uint32_t numChildren) {
+        if (parent == handle) return;
+        Node* node = find(handle);
+        // Moved under its own subtree: start it afresh rather than make a loop.
+        if (node && parent && is_ancestor(handle, parent)) {
+            remove(handle);
+            node = nullptr;
+        }
+        m_version++;
+        if (node) {
+            detach(*node);
+        } else {
+            node = &m_nodes[handle];
+            node->handle = handle;
+        }
+        node->parent = parent;
+        node->type = std::move(type);
+        node->name = std::move(name);
+        update(*node, [&] { node->numChildren = numChildren; });
+        node->added = m_version;
+        attach(*node, index);
+
+        // Children that arrived first.
+        auto waiting = m_waiting.find(handle);
+        if (waiting == m_waiting.end()) return;
+        auto orphans = std::move(waiting->second);
+        m_waiting.erase(waiting);
+        m_orphans -= orphans.size();
+        std::stable_sort(orphans.begin(), orphans.end());
+        for (auto& [childIndex, child] : orphans) {
+            Node* c = find(child);
+            if (!c) continue;
+            // Never make a node its own ancestor; it waits on.
+            if (is_ancestor(child, handle)) {
+                m_waiting[handle].push_back({childIndex, child});
+                m_orphans++;
+                continue;
+            }
+            c->added = m_version;  // the client sees it from now on
+            attach(*c, childIndex);
+        }
+    }
+
+    // Apply a Remove: drop `handle` and everything under it. The runtime
+    // announces a re-added element's children again.
+    void remove(Handle handle) {
+        Node* node = find(handle);
+        if (!node) return;
+        m_version++;
+        detach(*node);
+        std::vector<Handle> stack{handle};
+        while (!stack.empty()) {
+            Handle h = stack.back();
+            stack.pop_back();
+            auto it = m_nodes.find(h);
+            if (it == m_nodes.end()) continue;
+            stack.insert(stack.end(), it->second.children.begin(), it->second.children.end());
+            if (awaiting(it->second)) m_awaiting--;
+            m_nodes.erase(it);
+        }
+    }
+
+    // What to apply to the tree as of `since` to get the current one.
+    Changes changes_since(uint64_t since) const {
+        Changes changes;
+        if (since > m_version || since < m_forgotten) {
+            changes.reset = true;
+            return changes;
+        }
+        for (const Removal& r : m_removals) {
+            // Nodes added after `since` were never seen by the client.
+            if (r.version > since && r.added <= since) changes.removed.push_back(r.handle);
+        }
+        if (m_lastAdd <= since) return changes;
+        // The top-most nodes added since, each with its subtree, in preorder
+        // so siblings go in at increasing indexes.
+        auto visit = [&](Handle parent, const std::vector<Handle>& kids, auto& self) -> void {
+            for (size_t i = 0; i < kids.size(); i++) {
+                const Node* n = find(kids[i]);
+                if (!n) continue;
+                if (n->added > since)
+                    changes.added.push_back({parent, static_cast<uint32_t>(i), n->handle});
+                else
+                    self(n->handle, n->children, self);
+            }
+        };
+        visit(0, m_roots, visit);
+        return changes;
+    }
+
+private:
+    struct Removal {
+        uint64_t version;  // of the mutation that removed it
+        Handle handle;
+        uint64_t added;    // when it had been added
+    };
+
+    // Whether `ancestor` is `handle` or above it, up to the first node still
+    // waiting for its parent.
+    bool is_ancestor(Handle ancestor, Handle handle) const {
+        for (const Node* n = find(handle); n; n = n->attached && n->parent ? find(n->parent) : nullptr) {
+            if (n->handle == ancestor) return true;
+        }
+        return false;
+    }
+
+    static bool awaiting(const Node& node) { return node.children.size() < node.numChildren; }
+
+    // Apply `change` to `node`'s children or numChildren, keeping m_awaiting.
+    template <class Fn>
+    void update(Node& node, Fn change) {
+        if (awaiting(node)) m_awaiting--;
+        change();
+        if (awaiting(node)) m_awaiting++;
+    }
+
+    void attach(Node& node, uint32_t index) {
+        m_lastAdd = m_version;
+        node.attached = !node.parent;
+        if (!node.parent) {
+            // Roots keep their arrival order, as the one-shot payload did.
+            m_roots.push_back(node.handle);
+            return;
+        }
+        Node* parent = find(node.parent);
+        if (!parent) {
+            m_waiting[node.parent].push_back({index, node.handle});
+            m_orphans++;
+            return;
+        }
+        update(*parent, [&] {
+            auto& kids = parent->children;
+            kids.insert(kids.begin() + std::min<size_t>(index, kids.size()), node.handle);
+        });
+        node.attached = true;
+    }
+
+    void detach(Node& node) {
+        if (!node.attached) {
+            auto waiting = m_waiting.find(node.parent);
+            if (waiting != m_waiting.end()) {
+                m_orphans -= std::erase_if(waiting->second, [&](auto& w) { return w.second == node.handle; });
+                if (waiting->second.empty()) m_waiting.erase(waiting);
+            }
+            return;
+        }
+        if (!node.parent) {
+            m_roots.erase(std::find(m_roots.begin(), m_roots.end(), node.handle));
+        } else {
+            // The parent no longer waits for this child.
+            Node& parent = *find(node.parent);
+            update(parent, [&] {
+                parent.children.erase(std::find(parent.children.begin(), parent.children.end(), node.handle));
+                if (parent.numChildren) parent.numChildren--;
+            });
+        }
+        node.attached = false;
+        m_removals.push_back({m_version, node.handle, node.added});
+        if (m_removals.size() > kMaxRemovals) {
+            m_forgotten = m_removals.front().version;
+            m_removals.pop_front();
+        }
+    }
+
+    std::unordered_map<Handle, Node> m_nodes;
+    std::vector<Handle> m_roots;
+    std::unordered_map<Handle, std::vector<std::pair<uint32_t, Handle>>> m_waiting;  // parent -> (index, child)
+    std::deque<Removal> m_removals;
+    size_t m_awaiting = 0;     // nodes with fewer children than announced
+    size_t m_orphans = 0;      // entries in m_waiting
+    uint64_t m_version = 0;
+    uint64_t m_lastAdd = 0;    // version of the last Add
+    uint64_t m_forgotten = 0;  // removals up to here were dropped from the log
+};
+
+// ---- quiescence ----
+
+// Decides when the tree the runtime replays after AdviseVisualTreeChange is
+// whole. That is as soon as every announced child has arrived
+// (TreeModel::complete()). An element's NumChildren can count children that
+// are never announced, so a pause in mutations also ends the wait, as does
+// an overall limit under constant churn. With no element at all by
+// `firstNode` there is no XAML to wait for.
+class Quiescence {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Ms = std::chrono::milliseconds;
+
+    struct Settings {
+        Ms firstNode{500};
+        Ms idleGap{100};
+        Ms limit{5000};
+    };
+
+    enum class State { Waiting, Complete, Idle, Empty, TimedOut };
+
+    explicit Quiescence(Clock::time_point start) : Quiescence(start, Settings()) {}
+    Quiescence(Clock::time_point start, Settings settings)
+        : m_settings(settings), m_start(start), m_last(start) {}
+
+    // Look at `model` at `now`: a changed version means mutations arrived
+    // since the last look.
+    State observe(Clock::time_point now, const TreeModel& model) {
+        if (model.version() != m_version) {
+            m_version = model.version();
+            m_last = now;
+        }
+        if (model.complete()) return State::Complete;
+        if (now - m_start >= m_settings.limit) return State::TimedOut;
+        if (model.empty()) return now - m_start >= m_settings.firstNode ? State::Empty : State::Waiting;
+        return now - m_last >= m_settings.idleGap ? State::Idle : State::Waiting;
+    }
+
+    // When to look again, if no mutation comes first.
+    Clock::time_point deadline(const TreeModel& model) const {
+        Clock::time_point next = model.empty() ? m_start + m_settings.firstNode : m_last + m_settings.idleGap;
+        return std::min(next, m_start + m_settings.limit);
+    }
+
+private:
+    Settings m_settings;
+    Clock::time_point m_start;
+    Clock::time_point m_last;  // first look after the latest mutation
+    uint64_t m_version = 0;
+};
+
+inline const char* to_string(Quiescence::State state) {
+    switch (state) {
+    case Quiescence::State::Waiting: return "waiting";
+    case Quiescence::State::Complete: return "complete";
+    case Quiescence::State::Idle: return "idle";
+    case Quiescence::State::Empty: return "empty";
+    case Quiescence::State::TimedOut: return "timed out";
+    }
+    return "?";
+}
+
+// ---- bounds and properties ----
+
+// What is read for one element on the UI thread: its layout, and the
+// properties lvt asked for in the order it asked.
+struct NodeData {
+    double width = 0, height = 0;
+    double offsetX = 0, offsetY = 0;
+    bool hasBounds = false;
+    std::vector<std::pair<std::string, std::string>> properties;  // name, value (UTF-8)
+};
+
+// Properties lvt asks for with a bare PROPS init flag.
+inline const std::vector<std::string>& default_properties() {
+    static const std::vector<std::string> names{"Text", "IsEnabled", "Visibility", "AutomationProperties.Name"};
+    return names;
+}
+
+// Comma-separated property names, as after "PROPS=". Spaces around a name
+// and empty or repeated names are dropped.
+template <class CharT>
+std::vector<std::string> parse_property_list(std::basic_string_view<CharT> list) {
+    std::vector<std::string> names;
+    while (!list.empty()) {
+        size_t comma = list.find(CharT(','));
+        std::basic_string_view<CharT> name = list.substr(0, comma);
+        list.remove_prefix(comma == list.npos ? list.size() : comma + 1);
+        while (!name.empty() && name.front() == CharT(' ')) name.remove_prefix(1);
+        while (!name.empty() && name.back() == CharT(' ')) name.remove_suffix(1);
+        std::string utf8;
+        if constexpr (sizeof(CharT) == 1)
+            utf8 = name;
+        else
+            append_utf8(utf8, name.data(), name.size());
+        if (!utf8.empty() && std::find(names.begin(), names.end(), utf8) == names.end())
+            names.push_back(std::move(utf8));
+    }
+    return names;
+}
+
+namespace detail {
+
+// The number at `p`, after any '<', ',' or space, as in ActualOffset's
+// "<12.5, 40, 0>". Advances `p` past it.
+template <class CharT>
+bool parse_number(const CharT*& p, double& value) {
+    while (*p == CharT(' ') || *p == CharT('<') || *p == CharT(',')) p++;
+    char buf[64];
+    size_t n = 0;
+    for (const CharT* q = p; n < sizeof(buf); q++, n++) {
+        CharT c = *q;
+        if (!((c >= CharT('0') && c <= CharT('9')) || c == CharT('-') || c == CharT('+') || c == CharT('.') ||
+              c == CharT('e') || c == CharT('E')))
+            break;
+        buf[n] = static_cast<char>(c);
+    }
+    const char* first = n && buf[0] == '+' ? buf + 1 : buf;  // from_chars takes no '+'
+    auto [end, ec] = std::from_chars(first, buf + n, value);
+    if (ec != std::errc() || end == first) return false;
+    p += end - buf;
+    return true;
+}
+
+} // namespace detail
+
+// Picks layout and the properties lvt asked for out of property chains.
+// GetPropertyValuesChain returns every property an element has, each named
+// by a string. What a property's Index stands for is worked out by name the
+// first time it shows up for an element type, then cached: later elements of
+// the type cost one hash lookup per property, and unwanted ones are not even
+// converted. A name matches a chain entry's PropertyName ("Text"), or with a
+// dot, the short name of its declaring type and PropertyName
+// ("AutomationProperties.Name").
+class PropertySelection {
+    enum : int { kOther = -1, kWidth = -2, kHeight = -3, kOffset = -4 };
+    using Slots = std::unordered_map<uint32_t, int>;  // Index -> name's position, or the above
+
+public:
+    // Fills in one element's NodeData: add() each chain entry, then finish().
+    class Reader {
+    public:
+        template <class CharT>
+        void add(uint32_t index, const CharT* name, const CharT* declaringType, const CharT* value,
+                 bool overridden) {
+            auto [it, fresh] = m_slots.try_emplace(index, kOther);
+            if (fresh) it->second = m_selection.match(name, declaringType);
+            int slot = it->second;
+            if (slot == kOther || !value) return;
+            const CharT* p = value;
+            if (slot == kWidth) {
+                m_width = detail::parse_number(p, m_data.width);
+            } else if (slot == kHeight) {
+                m_height = detail::parse_number(p, m_data.height);
+            } else if (slot == kOffset) {
+                double x, y;
+                if (detail::parse_number(p, x) && detail::parse_number(p, y)) {
+                    m_data.offsetX = x;
+                    m_data.offsetY = y;
+                }
+            } else if (!overridden && std::find_if(m_found.begin(), m_found.end(), [&](auto& f) {
+                           return f.first == slot;
+                       }) == m_found.end()) {
+                m_found.push_back({slot, to_utf8(value)});
+            }
+        }
+
+        void finish() {
+            m_data.hasBounds = m_width && m_height;
+            std::sort(m_found.begin(), m_found.end(), [](auto& a, auto& b) { return a.first < b.first; });
+            m_data.properties.clear();
+            for (auto& [slot, value] : m_found)
+                m_data.properties.push_back({m_selection.m_names[slot], std::move(value)});
+        }
+
+    private:
+        friend class PropertySelection;
+        Reader(PropertySelection& selection, Slots& slots, NodeData& data)
+            : m_selection(selection), m_slots(slots), m_data(data) {}
+
+        PropertySelection& m_selection;
+        Slots& m_slots;
+        NodeData& m_data;
+        bool m_width = false, m_height = false;
+        std::vector<std::pair<int, std::string>> m_found;  // position in names(), value
+    };
+
+    PropertySelection() = default;
+    explicit PropertySelection(std::vector<std::string> names) : m_names(std::move(names)) {}
+
+    const std::vector<std::string>& names() const { return m_names; }
+
+    // Start reading the chain of an element of `type` into `data`.
+    Reader read(std::string_view type, NodeData& data) {
+        m_key.assign(type);
+        auto it = m_types.find(m_key);
+        if (it == m_types.end()) it = m_types.emplace(m_key, Slots()).first;
+        return Reader(*this, it->second, data);
+    }
+
+    size_t types() const { return m_types.size(); }
+    size_t lookups() const { return m_lookups; }  // chain entries matched by name
+
+private:
+    template <class CharT>
+    int match(const CharT* name, const CharT* declaringType) {
+        m_lookups++;
+        std::string property = to_utf8(name);
+        if (property == "ActualWidth") return kWidth;
+        if (property == "ActualHeight") return kHeight;
+        if (property == "ActualOffset") return kOffset;
+        std::string owner = to_utf8(declaringType);
+        std::string qualified = owner.substr(owner.rfind('.') + 1) + "." + property;
+        for (size_t i = 0; i < m_names.size(); i++) {
+            if (m_names[i] == property || m_names[i] == qualified) return static_cast<int>(i);
+        }
+        return kOther;
+    }
+
+    std::vector<std::string> m_names;
+    std::unordered_map<std::string, Slots> m_types;  // by element type
+    std::string m_key;  // reused, so a lookup does not allocate
+    size_t m_lookups = 0;
+};
+
+// Reads bounds on the UI thread in slices, so the app goes on handling input
+// and painting between them instead of freezing for the whole tree. start()
+// lists the nodes, each step() reads until its budget is spent and store()
+// puts what was read (NodeData) into the model. The clock is checked after
+// each read: a slice overruns the budget by at most one read.
+class BoundsCollector {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::chrono::milliseconds kDefaultBudget{8};  // half a frame at 60 Hz
+
+    explicit BoundsCollector(Clock::duration budget = kDefaultBudget) : m_budget(budget) {}
+
+    // List `scope` and its subtree (every root's for 0) in preorder, down to
+    // `maxDepth` levels below it (-1 for no limit). False if `scope` is not
+    // in the tree.
+    bool start(const TreeModel& model, Handle scope = 0, int maxDepth = -1) {
+        m_plan.clear();
+        m_types.clear();
+        m_results.clear();
+        m_next = m_collected = m_slices = 0;
+        m_longest = {};
+        std::unordered_map<std::string_view, uint32_t> types;  // views of the model's strings
+        std::vector<std::pair<Handle, int>> stack;
+        auto push = [&](const std::vector<Handle>& list, int depth) {
+            for (size_t i = list.size(); i-- > 0;) stack.push_back({list[i], depth});
+        };
+        if (scope) {
+            const Node* node = model.find(scope);
+            if (!node || !node->attached) return false;
+            stack.push_back({scope, 0});
+        } else {
+            push(model.roots(), 0);
+        }
+        while (!stack.empty()) {
+            auto [handle, depth] = stack.back();
+            stack.pop_back();
+            const Node* node = model.find(handle);
+            if (!node) continue;
+            auto [type, fresh] = types.try_emplace(node->type, static_cast<uint32_t>(m_types.size()));
+            if (fresh) m_types.push_back(node->type);
+            m_plan.push_back({handle, type->second});
+            if (maxDepth < 0 || depth < maxDepth) push(node->children, depth + 1);
+        }
+        return true;
+    }
+
+    // Read the next nodes with `read(Handle, std::string_view type, NodeData&)`
+    // until all are read or `now()` is a budget past the start of the slice;
+    // at least one node is read. Returns done().
+    template <class Read, class Now>
+    bool step(Read&& read, Now&& now) {
+        Clock::time_point start = now(), last = start;
+        while (m_next < m_plan.size()) {
+            const Entry& entry = m_plan[m_next++];
+            NodeData data;
+            read(entry.handle, std::string_view(m_types[entry.type]), data);
+            m_results.push_back({entry.handle, std::move(data)});
+            last = now();
+            if (last - start >= m_budget) break;
+        }
+        m_slices++;
+        m_longest = std::max(m_longest, last - start);
+        return done();
+    }
+
+    template <class Read>
+    bool step(Read&& read) {
+        return step(read, [] { return Clock::now(); });
+    }
+
+    // Put what was read since the last store() into `model`, skipping nodes
+    // removed meanwhile. Returns how many of them had bounds.
+    size_t store(TreeModel& model) {
+        size_t collected = 0;
+        for (auto& [handle, data] : m_results) {
+            Node* node = model.find(handle);
+            if (!node) continue;
+            node->width = data.width;
+            node->height = data.height;
+            node->offsetX = data.offsetX;
+            node->offsetY = data.offsetY;
+            node->hasBounds = data.hasBounds;
+            node->properties = std::move(data.properties);
+            if (data.hasBounds) collected++;
+        }
+        m_results.clear();
+        m_collected += collected;
+        return collected;
+    }
+
+    bool done() const { return m_next == m_plan.size(); }
+    size_t size() const { return m_plan.size(); }  // nodes listed
+    size_t visited() const { return m_next; }      // nodes read so far
+    size_t collected() const { return m_collected; }  // stored with bounds
+    size_t slices() const { return m_slices; }
+    Clock::duration longest() const { return m_longest; }  // the longest slice
+
+private:
+    struct Entry {
+        Handle handle;
+        uint32_t type;  // in m_types
+    };
+
+    Clock::duration m_budget;
+    std::vector<Entry> m_plan;
+    std::vector<std::string> m_types;
+    size_t m_next = 0;
+    size_t m_collected = 0;
+    size_t m_slices = 0;
+    Clock::duration m_longest{};
+    std::vector<std::pair<Handle, NodeData>> m_results;  // read, not yet stored
+};
+
+// ---- serialization ----
+
+// Where the tree writers put their UTF-8 JSON: one growable buffer, kept
+// whole, or with a `flush` function handed over each time it passes `chunk`
+// bytes and then reused, so a large tree is never in memory at once.
+class JsonBuffer {
+public:
+    using Flush = std::function<bool(std::string_view)>;
+
+    explicit JsonBuffer(std::string& out) : m_out(out) {}
+    JsonBuffer(std::string& out, Flush flush, size_t chunk = 64 * 1024)
+        : m_out(out), m_flush(std::move(flush)), m_chunk(chunk) {}
+
+    std::string& str() { return m_out; }
+
+    // Hand the buffer over if it is full. The writers call this between
+    // nodes.
+    void checkpoint() {
+        if (m_flush && m_out.size() >= m_chunk) drain();
+    }
+
+    // Hand over the rest. False if a flush failed; output after that is
+    // dropped.
+    bool finish() {
+        if (m_flush && !m_out.empty()) drain();
+        return m_ok;
+    }
+
+private:
+    void drain() {
+        if (m_ok) m_ok = m_flush(m_out);
+        m_out.clear();
+    }
+
+    std::string& m_out;
+    Flush m_flush;
+    size_t m_chunk = 0;
+    bool m_ok = true;
+};
+
+namespace detail {
+
+inline void append_number(std::string& out, uint64_t value) {
+    char buf[24];
+    out.append(buf, std::to_chars(buf, buf + sizeof(buf), value).ptr);
+}
+
+// As "%.1f" writes it.
+inline void append_number(std::string& out, double value) {
+    char buf[352];
+    out.append(buf, std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::fixed, 1).ptr);
+}
+
+// `node`'s own members, up to where its children go.
+inline void open_node(std::string& out, const Node& node) {
+    out += "{\"type\":";
+    append_json_string(out, node.type);
+    if (!node.name.empty()) {
+        out += ",\"name\":";
+        append_json_string(out, node.name);
+    }
+    out += ",\"handle\":";
+    append_number(out, node.handle);
+    if (node.hasBounds) {
+        out += ",\"width\":";
+        append_number(out, node.width);
+        out += ",\"height\":";
+        append_number(out, node.height);
+        out += ",\"offsetX\":";
+        append_number(out, node.offsetX);
+        out += ",\"offsetY\":";
+        append_number(out, node.offsetY);
+    }
+    if (!node.properties.empty()) {
+        out += ",\"properties\":{";
+        for (size_t i = 0; i < node.properties.size(); i++) {
+            if (i) out += ',';
+            append_json_string(out, node.properties[i].first);
+            out += ':';
+            append_json_string(out, node.properties[i].second);
+        }
+        out += '}';
+    }
+}
+
+// The nodes `list[0..count)` with their subtrees down to `maxDepth` levels
+// below them (-1 for no limit), comma-separated. An explicit stack keeps deep
+// trees off the call stack, and every byte is appended once, where it
+// finally goes.
+inline void write_nodes(JsonBuffer& out, const TreeModel& model, const Handle* list, size_t count,
+                        int maxDepth) {
+    struct Frame {
+        const Handle* next;
+        const Handle* end;
+        bool any;  // a node written at this level
+    };
+    std::vector<Frame> stack{{list, list + count, false}};
+    std::string& s = out.str();
+    while (!stack.empty()) {
+        out.checkpoint();
+        Frame& top = stack.back();
+        const Node* node = nullptr;
+        while (top.next != top.end && !(node = model.find(*top.next++))) {
+        }
+        if (!node) {
+            stack.pop_back();
+            if (!stack.empty()) s += "]}";
+            continue;
+        }
+        if (top.any) s += ',';
+        top.any = true;
+        open_node(s, *node);
+        if (node->children.empty() || (maxDepth >= 0 && stack.size() > static_cast<size_t>(maxDepth))) {
+            s += '}';
+        } else {
+            s += ",\"children\":[";
+            const Handle* kids = node->children.data();
+            stack.push_back({kids, kids + node->children.size(), false});
+        }
+    }
+}
+
+} // namespace detail
+
+// `node` and its subtree, `maxDepth` levels of it (-1 for all), as JSON.
+inline void write_node(JsonBuffer& out, const TreeModel& model, const Node& node, int maxDepth = -1) {
+    detail::write_nodes(out, model, &node.handle, 1, maxDepth);
+}
+
+// The whole tree, or the roots and `maxDepth` levels below them: an array of
+// the roots.
+inline void write_tree(JsonBuffer& out, const TreeModel& model, int maxDepth = -1) {
+    out.str() += '[';
+    detail::write_nodes(out, model, model.roots().data(), model.roots().size(), maxDepth);
+    out.str() += ']';
+}
+
+inline void write_node(std::string& out, const TreeModel& model, const Node& node, int maxDepth = -1) {
+    JsonBuffer buffer(out);
+    write_node(buffer, model, node, maxDepth);
+}
+
+inline void write_tree(std::string& out, const TreeModel& model, int maxDepth = -1) {
+    JsonBuffer buffer(out);
+    write_tree(buffer, model, maxDepth);
+}
+
+// ---- protocol ----
+
+struct Request {
+    enum Kind { Invalid, Tree, Subtree, Changes, Props } kind = Invalid;
+    uint64_t argument = 0;  // the handle or version
+    int depth = -1;         // levels below the roots or the handle; -1 for all
+    std::vector<std::string> properties;  // PROPS names
+};
+
+// Parse one request line (a trailing "\r" is ignored).
+inline Request parse_request(std::string_view line) {
+    while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.remove_suffix(1);
+    // The next space-separated number, which must be there.
+    auto number = [&](auto& value) {
+        if (line.empty() || line.front() != ' ') return false;
+        line.remove_prefix(1);
+        auto [end, ec] = std::from_chars(line.data(), line.data() + line.size(), value);
+        if (ec != std::errc() || (end != line.data() + line.size() && *end != ' ')) return false;
+        line.remove_prefix(end - line.data());
+        return true;
+    };
+    auto verb = [&](std::string_view name) {
+        if (line.substr(0, name.size()) != name || (line.size() > name.size() && line[name.size()] != ' '))
+            return false;
+        line.remove_prefix(name.size());
+        return true;
+    };
+    Request request;
+    if (verb("TREE")) {
+        request.kind = Request::Tree;
+    } else if (verb("SUBTREE")) {
+        if (!number(request.argument)) return {};
+        request.kind = Request::Subtree;
+    } else if (verb("CHANGES")) {
+        if (!number(request.argument) || !line.empty()) return {};
+        request.kind = Request::Changes;
+        return request;
+    } else if (verb("PROPS")) {
+        request.kind = Request::Props;
+        request.properties = parse_property_list(line);
+        return request;
+    } else {
+        return {};
+    }
+    if (!line.empty() && (!number(request.depth) || request.depth < 0 || !line.empty())) return {};
+    return request;
+}
+
+// Append the response line to `request` (without the newline).
+inline void respond(const TreeModel& model, const Request& request, std::string& out) {
+    if (request.kind == Request::Invalid) {
+        out += "{\"error\":\"unknown request\"}";
+        return;
+    }
+    out += "{\"version\":";
+    detail::append_number(out, model.version());
+    if (request.kind == Request::Props) {
+        out += ",\"properties\":[";
+        for (size_t i = 0; i < request.properties.size(); i++) {
+            if (i) out += ',';
+            append_json_string(out, request.properties[i]);
+        }
+        out += ']';
+    } else if (request.kind == Request::Tree) {
+        out += ",\"tree\":";
+        write_tree(out, model, request.depth);
+    } else if (request.kind == Request::Subtree) {
+        out += ",\"tree\":[";
+        if (const Node* node = model.find(request.argument); node && node->attached)
+            write_node(out, model, *node, request.depth);
+        out += "]";
+    } else {
+        Changes changes = model.changes_since(request.argument);
+        if (changes.reset) {
+            out += ",\"reset\":true}";
+            return;
+        }
+        out += ",\"removed\":[";
+        for (size_t i = 0; i < changes.removed.size(); i++) {
+            if (i) out += ",";
+            detail::append_number(out, changes.removed[i]);
+        }
+        out += "],\"added\":[";
+        for (size_t i = 0; i < changes.added.size(); i++) {
+            const Changes::Added& a = changes.added[i];
+            if (i) out += ",";
+            out += "{\"parent\":";
+            detail::append_number(out, a.parent);
+            out += ",\"index\":";
+            detail::append_number(out, uint64_t{a.index});
+            out += ",\"node\":";
+            write_node(out, model, *model.find(a.node));
+            out += "}";
+        }
+        out += "]";
+    }
+    out += "}";
+}
+
+// The tree array of a TREE or SUBTREE response line, or empty if `response`
+// is not one.
+inline std::string_view tree_payload(std::string_view response) {
+    constexpr std::string_view kVersion = "{\"version\":", kTree = ",\"tree\":";
+    if (response.substr(0, kVersion.size()) != kVersion || response.empty() || response.back() != '}') return {};
+    size_t i = kVersion.size();
+    while (i < response.size() && response[i] >= '0' && response[i] <= '9') i++;
+    if (i == kVersion.size() || response.substr(i, kTree.size()) != kTree) return {};
+    std::string_view tree = response.substr(i + kTree.size());
+    tree.remove_suffix(1);
+    if (tree.empty() || tree.front() != '[' || tree.back() != ']') return {};
+    return tree;
+}
+
+// What lvt passes to the TAP as the initialization data:
+// "<pipe>[|PROPS[=<name>,...]][|SERVE=<pipe>]". A bare PROPS asks for
+// default_properties().
+struct InitData {
+    std::wstring pipe;       // where to send the first tree
+    bool collectProps = false;
+    std::vector<std::string> properties;  // to send with each node (PropertySelection)
+    std::wstring servePipe;  // where to answer requests afterwards, if anywhere
+};
+
+inline InitData parse_init_data(std::wstring_view data) {
+    InitData init;
+    size_t sep = data.find(L'|');
+    init.pipe = data.substr(0, sep);
+    while (sep != std::wstring_view::npos) {
+        data.remove_prefix(sep + 1);
+        sep = data.find(L'|');
+        std::wstring_view flag = data.substr(0, sep);
+        if (flag == L"PROPS") {
+            init.collectProps = true;
+            init.properties = default_properties();
+        } else if (flag.substr(0, 6) == L"PROPS=") {
+            init.collectProps = true;
+            init.properties = parse_property_list(flag.substr(6));
+        } else if (flag.substr(0, 6) == L"SERVE=") {
+            init.servePipe = flag.substr(6);
+        }
+    }
+    return init;
+}
+
+// The pipe a resident TAP in process `pid` answers on, one per XAML runtime
+// (`connPrefix` tells system XAML from WinUI 3).
+inline std::wstring resident_pipe_name(uint32_t pid, std::wstring_view connPrefix) {
+    std::wstring name = L"\\\\.\\pipe\\lvt_tap_" + std::to_wstring(pid) + L"_";
+    name += connPrefix;
+    return name;
+}
+
+} // namespace lvt::tap
@@ -1,4 +1,5 @@
 #pragma once
+#include "window_search.h"
 #include <Windows.h>
 #include <string>
 #include <vector>
@@ -19,20 +20,7 @@ struct TargetInfo {
     Architecture architecture = Architecture::unknown;
 };
 
-struct WindowMatch {
-    HWND hwnd;
-    DWORD pid;
-    std::string processName;
-    std::string windowTitle;
-};
-
 // Resolve a target from either an HWND or PID.
 TargetInfo resolve_target(HWND hwnd, DWORD pid);
 
-// Find windows by process name (e.g. "notepad.exe" or "notepad").
-std::vector<WindowMatch> find_by_process_name(const std::string& name);
-
-// Find windows by title substring (case-insensitive).
-std::vector<WindowMatch> find_by_title(const std::string& title);
-
 } // namespace lvt
@@ -0,0 +1,282 @@
+#pragma once
+// Vectorized scanning for the characters the serializers and grafters have to
+// strip or escape. Header-only so the TAP DLLs can use it without linking
+// lvt_core. The vector width is chosen at compile time: AVX2 when the
+// compiler targets it, otherwise SSE2 (always present on x64) or NEON, with a
+// scalar fallback everywhere else and for the tail of each string.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define LVT_SCAN_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LVT_SCAN_SSE2 1
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define LVT_SCAN_NEON 1
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace lvt::text {
+
+// What a scan stops at, besides the explicit characters passed to it.
+enum ScanFlags : unsigned {
+    kStopControl = 1,  // code units below 0x20
+    kKeepTab     = 2,  // ...except '\t'
+    kStopHigh    = 4,  // code units >= 0x80 (non-ASCII)
+};
+
+namespace detail {
+
+inline unsigned count_trailing_zeros(uint32_t v) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long i;
+    _BitScanForward(&i, v);
+    return static_cast<unsigned>(i);
+#else
+    return static_cast<unsigned>(__builtin_ctz(v));
+#endif
+}
+
+template <unsigned Flags, auto... Extra, class U>
+constexpr bool is_special(U u) {
+    if ((Flags & kStopControl) && u < 0x20 && !((Flags & kKeepTab) && u == '\t')) return true;
+    if ((Flags & kStopHigh) && u >= 0x80) return true;
+    return ((u == static_cast<U>(Extra)) || ...);
+}
+
+// Unsigned code unit of the same width as CharT.
+template <class CharT>
+using unit_t = std::conditional_t<sizeof(CharT) == 1, unsigned char,
+               std::conditional_t<sizeof(CharT) == 2, uint16_t, uint32_t>>;
+
+template <unsigned Flags, auto... Extra, class CharT>
+size_t find_special_scalar(const CharT* p, size_t n, size_t i) {
+    for (; i < n; i++) {
+        if (is_special<Flags, Extra...>(static_cast<unit_t<CharT>>(p[i]))) return i;
+    }
+    return n;
+}
+
+#if defined(LVT_SCAN_AVX2)
+
+template <unsigned Flags, auto... Extra, class CharT>
+size_t find_special_vector(const CharT* p, size_t n) {
+    constexpr size_t kLanes = 32 / sizeof(CharT);
+    size_t i = 0;
+    for (; i + kLanes <= n; i += kLanes) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        __m256i hit = _mm256_setzero_si256();
+        if constexpr (sizeof(CharT) == 1) {
+            if constexpr ((Flags & kStopControl) != 0) {
+                __m256i ctl = _mm256_cmpeq_epi8(_mm256_subs_epu8(v, _mm256_set1_epi8(0x1F)),
+                                                _mm256_setzero_si256());
+                if constexpr ((Flags & kKeepTab) != 0)
+                    ctl = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')), ctl);
+                hit = _mm256_or_si256(hit, ctl);
+            }
+            if constexpr ((Flags & kStopHigh) != 0) hit = _mm256_or_si256(hit, v);
+            ((hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(static_cast<char>(Extra))))), ...);
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+            if (mask) return i + count_trailing_zeros(mask);
+        } else {
+            if constexpr ((Flags & kStopControl) != 0) {
+                __m256i ctl = _mm256_cmpeq_epi16(_mm256_subs_epu16(v, _mm256_set1_epi16(0x1F)),
+                                                 _mm256_setzero_si256());
+                if constexpr ((Flags & kKeepTab) != 0)
+                    ctl = _mm256_andnot_si256(_mm256_cmpeq_epi16(v, _mm256_set1_epi16('\t')), ctl);
+                hit = _mm256_or_si256(hit, ctl);
+            }
+            if constexpr ((Flags & kStopHigh) != 0) {
+                __m256i high = _mm256_cmpeq_epi16(_mm256_subs_epu16(v, _mm256_set1_epi16(0x7F)),
+                                                  _mm256_setzero_si256());
+                hit = _mm256_or_si256(hit, _mm256_xor_si256(high, _mm256_set1_epi16(-1)));
+            }
+            ((hit = _mm256_or_si256(hit, _mm256_cmpeq_epi16(v, _mm256_set1_epi16(static_cast<short>(Extra))))), ...);
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+            if (mask) return i + count_trailing_zeros(mask) / 2;
+        }
+    }
+    return find_special_scalar<Flags, Extra...>(p, n, i);
+}
+
+#elif defined(LVT_SCAN_SSE2)
+
+template <unsigned Flags, auto... Extra, class CharT>
+size_t find_special_vector(const CharT* p, size_t n) {
+    constexpr size_t kLanes = 16 / sizeof(CharT);
+    size_t i = 0;
+    for (; i + kLanes <= n; i += kLanes) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i hit = _mm_setzero_si128();
+        if constexpr (sizeof(CharT) == 1) {
+            if constexpr ((Flags & kStopControl) != 0) {
+                __m128i ctl = _mm_cmpeq_epi8(_mm_subs_epu8(v, _mm_set1_epi8(0x1F)), _mm_setzero_si128());
+                if constexpr ((Flags & kKeepTab) != 0)
+                    ctl = _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')), ctl);
+                hit = _mm_or_si128(hit, ctl);
+            }
+            if constexpr ((Flags & kStopHigh) != 0) hit = _mm_or_si128(hit, v);
+            ((hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8(static_cast<char>(Extra))))), ...);
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(hit));
+            if (mask) return i + count_trailing_zeros(mask);
+        } else {
+            if constexpr ((Flags & kStopControl) != 0) {
+                __m128i ctl = _mm_cmpeq_epi16(_mm_subs_epu16(v, _mm_set1_epi16(0x1F)), _mm_setzero_si128());
+                if constexpr ((Flags & kKeepTab) != 0)
+                    ctl = _mm_andnot_si128(_mm_cmpeq_epi16(v, _mm_set1_epi16('\t')), ctl);
+                hit = _mm_or_si128(hit, ctl);
+            }
+            if constexpr ((Flags & kStopHigh) != 0) {
+                __m128i high = _mm_cmpeq_epi16(_mm_subs_epu16(v, _mm_set1_epi16(0x7F)), _mm_setzero_si128());
+                hit = _mm_or_si128(hit, _mm_xor_si128(high, _mm_set1_epi16(-1)));
+            }
+            ((hit = _mm_or_si128(hit, _mm_cmpeq_epi16(v, _mm_set1_epi16(static_cast<short>(Extra))))), ...);
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(hit));
+            if (mask) return i + count_trailing_zeros(mask) / 2;
+        }
+    }
+    return find_special_scalar<Flags, Extra...>(p, n, i);
+}
+
+#elif defined(LVT_SCAN_NEON)
+
+inline unsigned count_trailing_zeros64(uint64_t v) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long i;
+    _BitScanForward64(&i, v);
+    return static_cast<unsigned>(i);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(v));
+#endif
+}
+
+template <unsigned Flags, auto... Extra, class CharT>
+size_t find_special_vector(const CharT* p, size_t n) {
+    constexpr size_t kLanes = 16 / sizeof(CharT);
+    size_t i = 0;
+    for (; i + kLanes <= n; i += kLanes) {
+        uint64_t mask;
+        if constexpr (sizeof(CharT) == 1) {
+            uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p + i));
+            uint8x16_t hit = vdupq_n_u8(0);
+            if constexpr ((Flags & kStopControl) != 0) {
+                uint8x16_t ctl = vcltq_u8(v, vdupq_n_u8(0x20));
+                if constexpr ((Flags & kKeepTab) != 0)
+                    ctl = vbicq_u8(ctl, vceqq_u8(v, vdupq_n_u8('\t')));
+                hit = vorrq_u8(hit, ctl);
+            }
+            if constexpr ((Flags & kStopHigh) != 0) hit = vorrq_u8(hit, vcgeq_u8(v, vdupq_n_u8(0x80)));
+            ((hit = vorrq_u8(hit, vceqq_u8(v, vdupq_n_u8(static_cast<uint8_t>(Extra))))), ...);
+            // Narrow each byte lane to a nibble: bit 4k set for a hit in lane k.
+            mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);
+            if (mask) return i + count_trailing_zeros64(mask) / 4;
+        } else {
+            uint16x8_t v = vld1q_u16(reinterpret_cast<const uint16_t*>(p + i));
+            uint16x8_t hit = vdupq_n_u16(0);
+            if constexpr ((Flags & kStopControl) != 0) {
+                uint16x8_t ctl = vcltq_u16(v, vdupq_n_u16(0x20));
+                if constexpr ((Flags & kKeepTab) != 0)
+                    ctl = vbicq_u16(ctl, vceqq_u16(v, vdupq_n_u16('\t')));
+                hit = vorrq_u16(hit, ctl);
+            }
+            if constexpr ((Flags & kStopHigh) != 0) hit = vorrq_u16(hit, vcgeq_u16(v, vdupq_n_u16(0x80)));
+            ((hit = vorrq_u16(hit, vceqq_u16(v, vdupq_n_u16(static_cast<uint16_t>(Extra))))), ...);
+            // Narrow each 16-bit lane to a byte: bits 8k..8k+7 set for lane k.
+            mask = vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(hit)), 0);
+            if (mask) return i + count_trailing_zeros64(mask) / 8;
+        }
+    }
+    return find_special_scalar<Flags, Extra...>(p, n, i);
+}
+
+#endif
+
+} // namespace detail
+
+// Index of the first code unit in [p, p + n) that matches `Flags` or equals
+// one of `Extra`, or n if there is none. Works on 8-bit (UTF-8) and 16-bit
+// (UTF-16 wchar_t) text; other widths use the scalar loop.
+template <unsigned Flags, auto... Extra, class CharT>
+size_t find_special(const CharT* p, size_t n) {
+#if defined(LVT_SCAN_AVX2) || defined(LVT_SCAN_SSE2) || defined(LVT_SCAN_NEON)
+    if constexpr (sizeof(CharT) <= 2) {
+        // Callers resume right after each hit; checking that unit first keeps
+        // runs of adjacent specials from paying for a vector load apiece.
+        if (n && detail::is_special<Flags, Extra...>(static_cast<detail::unit_t<CharT>>(p[0])))
+            return 0;
+        return detail::find_special_vector<Flags, Extra...>(p, n);
+    } else
+#endif
+        return detail::find_special_scalar<Flags, Extra...>(p, n, 0);
+}
+
+template <unsigned Flags, auto... Extra>
+size_t find_special(std::string_view s) {
+    return find_special<Flags, Extra...>(s.data(), s.size());
+}
+
+namespace detail {
+
+// Index of the first kept unit at or after `i`, which is a dropped one.
+template <unsigned Flags>
+size_t skip_dropped(std::string_view s, size_t i) {
+    do i++;
+    while (i < s.size() && is_special<Flags>(static_cast<unsigned char>(s[i])));
+    return i;
+}
+
+} // namespace detail
+
+// Strip control characters. Returns `s` itself when it has none; otherwise
+// copies the kept bytes into `scratch` in one pass and returns a view of it.
+template <unsigned Flags = kStopControl>
+std::string_view strip_controls(std::string_view s, std::string& scratch) {
+    static_assert((Flags & ~kKeepTab) == kStopControl, "strip_controls only takes kKeepTab");
+    size_t i = find_special<Flags>(s);
+    if (i == s.size()) return s;
+    scratch.assign(s.data(), i);
+    while (i < s.size()) {
+        size_t start = detail::skip_dropped<Flags>(s, i);
+        size_t next = start + find_special<Flags>(s.data() + start, s.size() - start);
+        scratch.append(s.data() + start, next - start);
+        i = next;
+    }
+    return scratch;
+}
+
+// In-place variant: compacts `s` from the first control character onward.
+template <unsigned Flags = kStopControl>
+void strip_controls_in_place(std::string& s) {
+    static_assert((Flags & ~kKeepTab) == kStopControl, "strip_controls only takes kKeepTab");
+    size_t i = find_special<Flags>(std::string_view(s));
+    if (i == s.size()) return;
+    size_t out = i;
+    while (i < s.size()) {
+        size_t start = detail::skip_dropped<Flags>(s, i);
+        size_t next = start + find_special<Flags>(s.data() + start, s.size() - start);
+        std::char_traits<char>::move(&s[out], s.data() + start, next - start);
+        out += next - start;
+        i = next;
+    }
+    s.resize(out);
+}
+
+// The grafters' sanitize pass for text from TAP/plugin JSON: drops control
+// characters but keeps tabs. Takes the string by value so clean input (the
+// common case) is moved through without a copy.
+inline std::string sanitize(std::string s) {
+    strip_controls_in_place<kStopControl | kKeepTab>(s);
+    return s;
+}
+
+} // namespace lvt::text
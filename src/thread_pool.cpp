@@ -0,0 +1,31 @@
+#include "thread_pool.h"
+#include <cstddef>
+
+namespace lvt {
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) threads = 1;
+    m_threads.reserve(threads);
+    for (size_t i = 0; i < threads; i++) m_threads.emplace_back([this] { worker(); });
+}
+
+ThreadPool::~ThreadPool() {
+    m_ready.release(static_cast<std::ptrdiff_t>(m_threads.size()));
+    for (auto& t : m_threads) t.join();
+}
+
+void ThreadPool::worker() {
+    for (;;) {
+        m_ready.acquire();
+        std::function<void()> task;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_queue.empty()) return;  // stopping and drained
+            task = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        task();
+    }
+}
+
+} // namespace lvt
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <semaphore>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace lvt {
+
+// Fixed set of worker threads running submitted tasks in FIFO order. Used to
+// overlap the target-side round trips of independent providers.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads);
+    // Runs every task already submitted, then joins the workers.
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return m_threads.size(); }
+
+    // Queue `fn`. Its result, or the exception it threw, is delivered through
+    // the returned future.
+    template <class F>
+    auto submit(F&& fn) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+        using R = std::invoke_result_t<std::decay_t<F>>;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(fn));
+        std::future<R> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue.emplace_back([task] { (*task)(); });
+        }
+        m_ready.release();
+        return result;
+    }
+
+private:
+    void worker();
+
+    std::mutex m_mutex;  // guards m_queue
+    std::deque<std::function<void()>> m_queue;
+    // One count per queued task, plus one per worker once stopping: a worker
+    // that wakes to an empty queue exits.
+    std::counting_semaphore<> m_ready{0};
+    std::vector<std::thread> m_threads;
+};
+
+} // namespace lvt
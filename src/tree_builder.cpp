@@ -1,82 +1,152 @@
 #include "tree_builder.h"
+#include "provider_scheduler.h"
 #include "providers/provider.h"
 #include "providers/win32_provider.h"
 #include "providers/comctl_provider.h"
 #include "providers/xaml_provider.h"
 #include "providers/winui3_provider.h"
 #include "providers/wpf_provider.h"
-#include "plugin_loader.h"
-#include <algorithm>
+#include "plugin_graft.h"
+#include <nlohmann/json.hpp>
+#include <functional>
 #include <memory>
 
 namespace lvt {
 
-static void assign_ids_recursive(Element& el, int& counter) {
-    el.id = "e" + std::to_string(counter++);
-    for (auto& child : el.children) {
-        assign_ids_recursive(child, counter);
+// Levels from `scope` down to `node`, or -1 if `node` is not in its subtree.
+static int depth_below(const ElementTree& tree, NodeId node, NodeId scope) {
+    for (int depth = 0; node != kNoNode; node = tree.parent(node), depth++) {
+        if (node == scope) return depth;
     }
+    return -1;
 }
 
-static void trim_to_depth_impl(Element& el, int currentDepth, int maxDepth) {
-    if (maxDepth >= 0 && currentDepth >= maxDepth) {
-        el.children.clear();
-        return;
-    }
-    for (auto& child : el.children) {
-        trim_to_depth_impl(child, currentDepth + 1, maxDepth);
-    }
-}
+ElementTree build_tree(CaptureSource& source, HWND hwnd, DWORD pid,
+                       const std::vector<FrameworkInfo>& frameworks, const TreeScope& scope,
+                       ElementIndex* index, ThreadPool* pool) {
+    ElementIndex localIndex;
+    if (!index) index = &localIndex;
+    index->clear();
 
-void assign_element_ids(Element& root) {
-    int counter = 0;
-    assign_ids_recursive(root, counter);
-}
+    // The scope is a window (the target unless the ID names another) and
+    // how many levels of windows below it are needed. An element that is not
+    // a window has no windows below it, only what providers graft into its
+    // window. Other IDs (see assign_stable_ids) do not say where their
+    // element is, so they scope nothing.
+    ElementIdAnchor anchor{0, true};
+    bool scoped = scope.element.empty() ? scope.depth >= 0 : parse_element_id(scope.element, anchor);
+    HWND scopeHwnd = anchor.window ? reinterpret_cast<HWND>(anchor.window) : hwnd;
+    int windowDepth = anchor.isWindow ? scope.depth : 0;
 
-void trim_to_depth(Element& root, int maxDepth) {
-    trim_to_depth_impl(root, 0, maxDepth);
-}
+    // XAML roots go to bridge windows matched in order, and plugin roots name
+    // their hosts anywhere, so those need every window walked.
+    bool wholeWindow = !scoped;
+    for (auto& fi : frameworks) {
+        if (fi.type == Framework::Xaml || fi.type == Framework::WinUI3 || fi.type == Framework::Plugin)
+            wholeWindow = true;
+    }
 
-Element build_tree(HWND hwnd, DWORD pid, const std::vector<FrameworkInfo>& frameworks, int maxDepth) {
-    // Start with the Win32 provider as the base — it always applies
-    Win32Provider win32;
-    Element root = win32.build(hwnd, maxDepth);
+    ElementTree tree;
+    NodeId root = kNoNode;
+    NodeId target = kNoNode;     // the node of `hwnd`, if walked
+    NodeId scopeNode = kNoNode;  // the node of `scopeHwnd`, if walked
+
+    // Whether `node` is in the scope, and whether what a provider grafts
+    // under `host` can be.
+    auto in_scope = [&](NodeId node) {
+        int depth = depth_below(tree, node, scopeNode);
+        return depth >= 0 && (windowDepth < 0 || depth <= windowDepth);
+    };
+    auto feeds_scope = [&](NodeId host) {
+        int depth = depth_below(tree, host, scopeNode);
+        if (!anchor.isWindow) return depth == 0;
+        return depth >= 0 && (scope.depth < 0 || depth < scope.depth);
+    };
+    auto feeds_scope_any = [&](const XamlGraftTargets& targets) {
+        if (feeds_scope(targets.root)) return true;
+        for (auto& [bridge, bounds] : targets.bridges)
+            if (feeds_scope(bridge)) return true;
+        return false;
+    };
+    // A provider with a wanted check waits for the walk before it fetches,
+    // so unscoped builds go without one.
+    auto wanted = [scoped](std::function<bool()> check) {
+        return scoped ? std::move(check) : std::function<bool()>();
+    };
 
-    // Layer on framework-specific providers
+    // Framework-specific providers layer on top of the Win32 tree. With a
+    // pool, each one starts waiting on the target now, for whatever it can
+    // fetch without the Win32 tree, and grafts in framework order once the
+    // tree is built (see ProviderScheduler).
+    ProviderScheduler scheduler(pool);
     for (auto& fi : frameworks) {
         switch (fi.type) {
         case Framework::ComCtl: {
-            ComCtlProvider comctl;
-            comctl.enrich(root);
+            auto p = std::make_shared<ComCtlProvider::Pending>();
+            scheduler.add({
+                .prepare = [p, &tree, &root, scoped, &in_scope] {
+                    *p = ComCtlProvider().prepare(tree, root);
+                    if (scoped)
+                        std::erase_if(p->controls, [&](const auto& c) { return !in_scope(c.node); });
+                },
+                .collect = [p, &source] { ComCtlProvider().collect(*p, source); },
+                .apply = [p, &tree] { ComCtlProvider().apply(tree, *p); },
+            });
             break;
         }
         case Framework::Xaml: {
-            XamlProvider xaml;
-            xaml.enrich(root, hwnd, pid);
+            // The TAP goes into the CoreWindow's process, which only the
+            // Win32 tree tells us, so nothing is fetched early.
+            auto p = std::make_shared<XamlProvider::Pending>();
+            scheduler.add({
+                .prepare = [p, &tree, &root] { *p = XamlProvider().prepare(tree, root); },
+                .wanted = wanted([p, &feeds_scope_any] {
+                    return p->coreNode != kNoNode && feeds_scope_any(p->targets);
+                }),
+                .collect = [p, &source, pid] { XamlProvider().collect(*p, source, pid); },
+                .apply = [p, &tree, &root] { XamlProvider().apply(tree, root, *p); },
+            });
             break;
         }
         case Framework::WinUI3: {
-            WinUI3Provider winui3;
-            winui3.enrich(root, hwnd, pid);
+            auto p = std::make_shared<WinUI3Provider::Pending>();
+            scheduler.add({
+                .fetch = [p, &source, hwnd, pid] { WinUI3Provider().fetch(*p, source, hwnd, pid); },
+                .prepare = [p, &tree, &root] { WinUI3Provider().prepare(*p, tree, root); },
+                .wanted = wanted([p, &feeds_scope_any] { return feeds_scope_any(p->targets); }),
+                .collect = [p] { WinUI3Provider().collect(*p); },
+                .apply = [p, &tree, &root] { WinUI3Provider().apply(tree, root, *p); },
+            });
             break;
         }
         case Framework::Wpf: {
-            WpfProvider wpf;
-            wpf.enrich(root, hwnd, pid);
+            auto p = std::make_shared<WpfProvider::Pending>();
+            scheduler.add({
+                .fetch = [p, &source, hwnd, pid] { WpfProvider().fetch(*p, source, hwnd, pid); },
+                .wanted = wanted([&feeds_scope, &target] { return feeds_scope(target); }),
+                .collect = [p, &root] { WpfProvider().collect(*p, root); },
+                .apply = [p, &tree, &root] { WpfProvider().apply(tree, root, *p); },
+            });
             break;
         }
         case Framework::Plugin: {
-            // Look up the plugin by name and enrich
-            for (auto& p : get_plugins()) {
-                if (p.info && p.info->name && fi.name == p.info->name) {
-                    PluginFrameworkInfo pf;
-                    pf.name = fi.name;
-                    pf.version = fi.version;
-                    pf.plugin = &p;
-                    enrich_with_plugin(root, hwnd, pid, pf);
-                    break;
-                }
-            }
+            // Plugin roots name their hosts by handle, possibly inside what an
+            // earlier provider grafted, so only the parse happens up front.
+            struct Parsed {
+                bool ok = false;
+                nlohmann::json tree;
+            };
+            auto p = std::make_shared<Parsed>();
+            HWND pluginScope = anchor.window ? scopeHwnd : nullptr;
+            scheduler.add({
+                .fetch = [p, &source, &fi, hwnd, pid, pluginScope] {
+                    p->ok = parse_plugin_payload(source.plugin_payload(fi.name, hwnd, pid, pluginScope),
+                                                 p->tree);
+                },
+                .apply = [p, &tree, &fi, &root, index] {
+                    if (p->ok) graft_plugin_tree(tree, root, p->tree, fi.name, *index);
+                },
+            });
             break;
         }
         default:
@@ -84,10 +154,24 @@ Element build_tree(HWND hwnd, DWORD pid, const std::vector<FrameworkInfo>& frame
         }
     }
 
-    // Assign IDs on the full tree so that element IDs are stable regardless of --depth.
-    assign_element_ids(root);
+    // The Win32 provider builds the base tree; it always applies. Scoped,
+    // and with no provider that needs the rest, it walks only the scope.
+    Win32Provider win32;
+    if (wholeWindow) {
+        root = win32.build(tree, source, hwnd);
+        target = root;
+        index->sync(tree);
+        scopeNode = anchor.window ? index->find_by_handle(anchor.window) : root;
+    } else {
+        root = win32.build(tree, source, scopeHwnd, windowDepth);
+        scopeNode = root;
+        if (scopeHwnd == hwnd) target = root;
+    }
+    scheduler.run();
+
+    assign_element_ids(tree, index, reinterpret_cast<uintptr_t>(hwnd));
 
-    return root;
+    return tree;
 }
 
 } // namespace lvt
@@ -1,17 +1,38 @@
 #pragma once
+#include "capture_source.h"
 #include "element.h"
-#include "framework_detector.h"
+#include "element_index.h"
+#include "framework.h"
+#include "thread_pool.h"
+#include <string>
 #include <vector>
 
 namespace lvt {
 
-// Build a unified visual tree from the given HWND using detected frameworks.
-Element build_tree(HWND hwnd, DWORD pid, const std::vector<FrameworkInfo>& frameworks, int maxDepth = -1);
-
-// Assign deterministic element IDs (e0, e1, ...) in depth-first order.
-void assign_element_ids(Element& root);
+// The part of the tree a caller is going to look at: the subtree of the
+// element with ID `element` (the whole tree if empty), `depth` levels deep
+// (0 = the element only, -1 = all of it).
+struct TreeScope {
+    std::string element;
+    int depth = -1;
+};
 
-// Trim element tree to a maximum depth (0 = root only, 1 = root + children, etc.)
-void trim_to_depth(Element& root, int maxDepth);
+// Build a unified visual tree from the given HWND using detected frameworks.
+// Raw inputs (window enumeration, control replies, TAP and plugin payloads)
+// come from `source`; everything else — element construction, grafting and
+// ID assignment — happens here, identically for live and replayed captures.
+// Only what `scope` needs is enumerated and enriched: the window walk stops
+// at the scope where no provider needs the rest of it, and providers with no
+// host in the scope are not asked for anything. The result may hold more
+// than the scope; callers find the element by ID and trim to the depth.
+// Element IDs are the same as in a full build (see assign_element_ids); an
+// element ID that names a window must name one of `hwnd`'s.
+// If `index` is given it is filled in as the tree grows and covers the result.
+// With a `pool`, the framework providers wait on the target concurrently
+// (`source` must then accept calls from several threads); the result is the
+// same either way.
+ElementTree build_tree(CaptureSource& source, HWND hwnd, DWORD pid,
+                       const std::vector<FrameworkInfo>& frameworks, const TreeScope& scope = {},
+                       ElementIndex* index = nullptr, ThreadPool* pool = nullptr);
 
 } // namespace lvt
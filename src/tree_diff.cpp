@@ -0,0 +1,804 @@
+#include "tree_diff.h"
+#include "hash.h"
+#include "json_serializer.h"
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace lvt {
+
+namespace {
+
+// Next node in pre-order after the whole subtree at `node`, within `scope`.
+NodeId next_after_subtree(const ElementTree& tree, NodeId node, NodeId scope) {
+    while (node != scope) {
+        NodeId sibling = tree.next_sibling(node);
+        if (sibling != kNoNode) return sibling;
+        node = tree.parent(node);
+    }
+    return kNoNode;
+}
+
+// IDs that name the same element in two captures: anything but the ordinal
+// e/w.N forms of assign_element_ids, whose window IDs ("w1A2B") do count.
+bool is_stable_id(std::string_view id) {
+    ElementIdAnchor anchor;
+    return !id.empty() && (!parse_element_id(id, anchor) || anchor.isWindow);
+}
+
+// Properties compare by their text, as serialized, so a tree read back from
+// JSON (all strings) matches one from a snapshot (typed).
+bool same_value(const PropertyValue& x, const PropertyValue& y) {
+    if (x.is_string()) return y.text_equals(std::get<std::string>(x.storage()));
+    if (y.is_string()) return x.text_equals(std::get<std::string>(y.storage()));
+    return x.to_string() == y.to_string();
+}
+
+bool same_properties(const PropertyList& x, const PropertyList& y) {
+    if (x.size() != y.size()) return false;
+    for (auto i = x.begin(), j = y.begin(); i != x.end(); ++i, ++j) {
+        if (i->key != j->key || !same_value(i->value, j->value)) return false;
+    }
+    return true;
+}
+
+uint32_t changed_fields(const Element& a, const Element& b) {
+    uint32_t fields = 0;
+    if (a.id != b.id) fields |= kDiffId;
+    if (a.type != b.type) fields |= kDiffType;
+    if (a.framework != b.framework) fields |= kDiffFramework;
+    if (a.className != b.className) fields |= kDiffClassName;
+    if (a.text != b.text) fields |= kDiffText;
+    if (a.bounds.x != b.bounds.x || a.bounds.y != b.bounds.y || a.bounds.width != b.bounds.width ||
+        a.bounds.height != b.bounds.height)
+        fields |= kDiffBounds;
+    if (!same_properties(a.properties, b.properties)) fields |= kDiffProperties;
+    return fields;
+}
+
+// Marks the members of one longest strictly increasing subsequence of `seq`.
+void longest_increasing(const std::vector<uint32_t>& seq, std::vector<uint8_t>& member) {
+    member.assign(seq.size(), 0);
+    std::vector<uint32_t> tails;  // index into seq of the smallest tail of each length
+    std::vector<uint32_t> prev(seq.size(), UINT32_MAX);
+    for (uint32_t i = 0; i < seq.size(); i++) {
+        auto it = std::lower_bound(tails.begin(), tails.end(), seq[i],
+                                   [&](uint32_t t, uint32_t v) { return seq[t] < v; });
+        if (it != tails.begin()) prev[i] = *(it - 1);
+        if (it == tails.end()) tails.push_back(i);
+        else *it = i;
+    }
+    for (uint32_t i = tails.empty() ? UINT32_MAX : tails.back(); i != UINT32_MAX; i = prev[i]) member[i] = 1;
+}
+
+class Differ {
+    enum class Pass { Hash, Key, Loose };
+
+public:
+    Differ(const ElementTree& before, const ElementTree& after, TreeDiff& diff)
+        : m_a(before), m_b(after), m_d(diff) {}
+
+    void run() {
+        m_d.afterOf.assign(m_a.size(), kNoNode);
+        m_d.beforeOf.assign(m_b.size(), kNoNode);
+        m_whole.assign(m_b.size(), 0);
+        m_stableA.assign(m_a.size(), -1);
+        m_stableB.assign(m_b.size(), -1);
+        NodeId ra = m_a.root(), rb = m_b.root();
+        if (ra == kNoNode || rb == kNoNode) {
+            if (rb != kNoNode) m_d.ops.push_back({DiffOpKind::Insert, kNoNode, rb});
+            if (ra != kNoNode) m_d.ops.push_back({DiffOpKind::Remove, ra, kNoNode});
+            return;
+        }
+        if (m_a[ra].hash == m_b[rb].hash && match_whole(ra, rb)) {
+            emit();
+            return;
+        }
+        match(ra, rb);
+        top_down(Pass::Hash);
+        match_ids();
+        top_down(Pass::Loose);
+        match_leftovers();
+        emit();
+    }
+
+private:
+    void match(NodeId a, NodeId b) {
+        m_d.afterOf[a] = b;
+        m_d.beforeOf[b] = a;
+    }
+
+    static bool stable(const ElementTree& tree, std::vector<int8_t>& cache, NodeId node) {
+        if (cache[node] < 0) cache[node] = is_stable_id(tree[node].id);
+        return cache[node];
+    }
+
+    // Elements with different stable IDs are different elements.
+    bool compatible(NodeId a, NodeId b) {
+        return m_a[a].id == m_b[b].id || !stable(m_a, m_stableA, a) || !stable(m_b, m_stableB, b);
+    }
+
+    // Pair two subtrees with equal hashes node for node. Refuses (matching
+    // nothing) if their shapes differ, a node in them is matched elsewhere
+    // or two of their stable IDs disagree.
+    bool match_whole(NodeId a, NodeId b) {
+        for (NodeId x = a, y = b; x != kNoNode; x = m_a.next_preorder(x, a), y = m_b.next_preorder(y, b)) {
+            if (m_a.child_count(x) != m_b.child_count(y) || !compatible(x, y)) return false;
+            if (m_d.afterOf[x] != y && (m_d.afterOf[x] != kNoNode || m_d.beforeOf[y] != kNoNode)) return false;
+        }
+        for (NodeId x = a, y = b; x != kNoNode; x = m_a.next_preorder(x, a), y = m_b.next_preorder(y, b)) {
+            match(x, y);
+            m_whole[y] = 1;
+        }
+        return true;
+    }
+
+    // Matched pairs from the root down, aligning the children of each pair
+    // that is not part of an identical subtree. Pass::Hash runs the ID and
+    // hash passes only; Pass::Loose all of them.
+    void top_down(Pass last) {
+        NodeId rb = m_b.root();
+        for (NodeId b = rb; b != kNoNode;) {
+            NodeId a = m_d.beforeOf[b];
+            if (m_whole[b] || (a != kNoNode && m_a[a].hash == m_b[b].hash && match_whole(a, b))) {
+                b = next_after_subtree(m_b, b, rb);
+                continue;
+            }
+            if (a != kNoNode) align_children(a, b, last);
+            b = m_b.next_preorder(b, rb);
+        }
+    }
+
+    // Still-unmatched elements with the same stable ID anywhere in the tree:
+    // elements that moved to another parent and changed on the way.
+    void match_ids() {
+        // Walked rather than scanned: trim_to_depth leaves detached nodes.
+        std::unordered_map<std::string_view, NodeId> byId;
+        for (NodeId a = m_a.root(); a != kNoNode; a = m_a.next_preorder(a, m_a.root())) {
+            if (m_d.afterOf[a] == kNoNode && stable(m_a, m_stableA, a)) byId.emplace(m_a[a].id, a);
+        }
+        if (byId.empty()) return;
+        for (NodeId b = m_b.root(); b != kNoNode; b = m_b.next_preorder(b, m_b.root())) {
+            if (m_d.beforeOf[b] != kNoNode || !stable(m_b, m_stableB, b)) continue;
+            auto it = byId.find(m_b[b].id);
+            if (it != byId.end() && m_d.afterOf[it->second] == kNoNode) match(it->second, b);
+        }
+    }
+
+    uint64_t symbol(Symbol s) {
+        if (s.id() >= m_symbols.size()) m_symbols.resize(s.id() + 1);
+        uint64_t& slot = m_symbols[s.id()];
+        if (!slot) slot = hash::bytes(s.view()) | 1;
+        return slot;
+    }
+
+    uint64_t loose_key(const Element& el) {
+        return hash::combine(hash::combine(symbol(el.framework), symbol(el.type)), symbol(el.className));
+    }
+
+    uint64_t full_key(const Element& el) {
+        return hash::combine(loose_key(el), el.nativeHandle ? uint64_t{el.nativeHandle} : hash::bytes(el.text));
+    }
+
+    // Longest common subsequence of two key sequences, as index pairs. Common
+    // prefixes and suffixes are taken directly; a middle too large for the
+    // quadratic table is matched greedily in order instead.
+    void common_subsequence(const std::vector<uint64_t>& ka, const std::vector<uint64_t>& kb,
+                            std::vector<std::pair<uint32_t, uint32_t>>& pairs) {
+        static constexpr size_t kMaxCells = size_t{1} << 20;
+        pairs.clear();
+        uint32_t n = static_cast<uint32_t>(ka.size()), m = static_cast<uint32_t>(kb.size());
+        uint32_t lo = 0;
+        while (lo < n && lo < m && ka[lo] == kb[lo]) pairs.push_back({lo, lo}), lo++;
+        uint32_t suffix = 0;
+        while (suffix < n - lo && suffix < m - lo && ka[n - 1 - suffix] == kb[m - 1 - suffix]) suffix++;
+        uint32_t rows = n - lo - suffix, cols = m - lo - suffix;
+        if (rows && cols && size_t{rows} * cols <= kMaxCells) {
+            // lcs[i][j]: length for ka[lo+i..] and kb[lo+j..]. It never
+            // exceeds min(rows, cols) <= 1024, so 16 bits hold it.
+            size_t stride = cols + 1;
+            m_table.assign((rows + 1) * stride, 0);
+            for (uint32_t i = rows; i-- > 0;) {
+                for (uint32_t j = cols; j-- > 0;) {
+                    m_table[i * stride + j] = ka[lo + i] == kb[lo + j]
+                        ? static_cast<uint16_t>(m_table[(i + 1) * stride + j + 1] + 1)
+                        : std::max(m_table[(i + 1) * stride + j], m_table[i * stride + j + 1]);
+                }
+            }
+            for (uint32_t i = 0, j = 0; i < rows && j < cols;) {
+                if (ka[lo + i] == kb[lo + j]) {
+                    pairs.push_back({lo + i, lo + j});
+                    i++, j++;
+                } else if (m_table[(i + 1) * stride + j] >= m_table[i * stride + j + 1]) {
+                    i++;
+                } else {
+                    j++;
+                }
+            }
+        } else if (rows && cols) {
+            std::unordered_map<uint64_t, std::vector<uint32_t>> positions;  // ascending from back()
+            for (uint32_t i = lo + rows; i-- > lo;) positions[ka[i]].push_back(i);
+            uint32_t next = lo;
+            for (uint32_t j = lo; j < lo + cols; j++) {
+                auto it = positions.find(kb[j]);
+                if (it == positions.end()) continue;
+                auto& list = it->second;
+                while (!list.empty() && list.back() < next) list.pop_back();
+                if (list.empty()) continue;
+                pairs.push_back({list.back(), j});
+                next = list.back() + 1;
+                list.pop_back();
+            }
+        }
+        for (uint32_t k = suffix; k-- > 0;) pairs.push_back({n - 1 - k, m - 1 - k});
+    }
+
+    void align_children(NodeId a, NodeId b, Pass last) {
+        auto& ca = m_ca;
+        auto& cb = m_cb;
+        ca.clear();
+        cb.clear();
+        for (NodeId c : m_a.children(a))
+            if (m_d.afterOf[c] == kNoNode) ca.push_back(c);
+        for (NodeId c : m_b.children(b))
+            if (m_d.beforeOf[c] == kNoNode) cb.push_back(c);
+        if (ca.empty() || cb.empty()) return;
+        // Same stable ID.
+        m_byId.clear();
+        for (NodeId x : ca)
+            if (stable(m_a, m_stableA, x)) m_byId.emplace(m_a[x].id, x);
+        if (!m_byId.empty()) {
+            for (NodeId y : cb) {
+                if (!stable(m_b, m_stableB, y)) continue;
+                auto it = m_byId.find(m_b[y].id);
+                if (it != m_byId.end() && m_d.afterOf[it->second] == kNoNode) match(it->second, y);
+            }
+            std::erase_if(ca, [&](NodeId x) { return m_d.afterOf[x] != kNoNode; });
+            std::erase_if(cb, [&](NodeId y) { return m_d.beforeOf[y] != kNoNode; });
+        }
+        for (Pass pass : {Pass::Hash, Pass::Key, Pass::Loose}) {
+            if (ca.empty() || cb.empty() || pass > last) return;
+            auto key = [&](const ElementTree& t, NodeId n) {
+                return pass == Pass::Hash ? t[n].hash : pass == Pass::Key ? full_key(t[n]) : loose_key(t[n]);
+            };
+            auto pair = [&](NodeId x, NodeId y) {
+                if (compatible(x, y) && (pass != Pass::Hash || !match_whole(x, y))) match(x, y);
+            };
+            auto& ka = m_ka;
+            auto& kb = m_kb;
+            ka.resize(ca.size());
+            kb.resize(cb.size());
+            for (size_t i = 0; i < ca.size(); i++) ka[i] = key(m_a, ca[i]);
+            for (size_t j = 0; j < cb.size(); j++) kb[j] = key(m_b, cb[j]);
+            common_subsequence(ka, kb, m_pairs);
+            for (auto [i, j] : m_pairs) pair(ca[i], cb[j]);
+            if (pass != Pass::Loose && m_pairs.size() < std::min(ca.size(), cb.size())) {
+                // Equal keys out of order: moves.
+                auto& rest = m_rest;
+                rest.clear();
+                for (size_t i = ca.size(); i-- > 0;)
+                    if (m_d.afterOf[ca[i]] == kNoNode) rest[ka[i]].push_back(ca[i]);
+                for (size_t j = 0; j < cb.size(); j++) {
+                    if (m_d.beforeOf[cb[j]] != kNoNode) continue;
+                    auto it = rest.find(kb[j]);
+                    if (it == rest.end() || it->second.empty() || !compatible(it->second.back(), cb[j])) continue;
+                    pair(it->second.back(), cb[j]);
+                    it->second.pop_back();
+                }
+            }
+            std::erase_if(ca, [&](NodeId x) { return m_d.afterOf[x] != kNoNode; });
+            std::erase_if(cb, [&](NodeId y) { return m_d.beforeOf[y] != kNoNode; });
+        }
+    }
+
+    // Whole subtrees that moved to another parent: hashes that only one
+    // unmatched node on each side has.
+    void match_leftovers() {
+        struct Seen {
+            NodeId node;
+            uint32_t count;
+        };
+        std::unordered_map<uint64_t, Seen> inBefore;
+        for (NodeId a = m_a.root(); a != kNoNode; a = m_a.next_preorder(a, m_a.root())) {
+            if (m_d.afterOf[a] != kNoNode) continue;
+            auto [it, added] = inBefore.try_emplace(m_a[a].hash, Seen{a, 0});
+            it->second.count++;
+        }
+        if (inBefore.empty()) return;
+        std::unordered_map<uint64_t, uint32_t> inAfter;
+        NodeId rb = m_b.root();
+        for (NodeId b = rb; b != kNoNode; b = m_b.next_preorder(b, rb))
+            if (m_d.beforeOf[b] == kNoNode) inAfter[m_b[b].hash]++;
+        for (NodeId b = rb; b != kNoNode;) {
+            if (m_d.beforeOf[b] == kNoNode && inAfter[m_b[b].hash] == 1) {
+                auto it = inBefore.find(m_b[b].hash);
+                if (it != inBefore.end() && it->second.count == 1 && match_whole(it->second.node, b)) {
+                    b = next_after_subtree(m_b, b, rb);
+                    continue;
+                }
+            }
+            b = m_b.next_preorder(b, rb);
+        }
+    }
+
+    void emit() {
+        NodeId rb = m_b.root();
+        std::vector<uint32_t> position(m_a.size());
+        std::vector<uint8_t> moved(m_b.size(), 0);
+        std::vector<uint32_t> seq;
+        std::vector<NodeId> seqNodes;
+        std::vector<uint8_t> inOrder;
+        for (NodeId b = rb; b != kNoNode;) {
+            NodeId a = m_d.beforeOf[b];
+            if (a == kNoNode) {
+                if (m_d.beforeOf[m_b.parent(b)] != kNoNode) m_d.ops.push_back({DiffOpKind::Insert, kNoNode, b});
+                b = m_b.next_preorder(b, rb);
+                continue;
+            }
+            if (b != rb && (m_d.beforeOf[m_b.parent(b)] != m_a.parent(a) || moved[b]))
+                m_d.ops.push_back({DiffOpKind::Move, a, b});
+            if (m_whole[b]) {
+                // Identical content below; only the IDs can differ.
+                for (NodeId y = b; y != kNoNode; y = m_b.next_preorder(y, b)) {
+                    NodeId x = m_d.beforeOf[y];
+                    if (m_a[x].id != m_b[y].id) m_d.ops.push_back({DiffOpKind::Update, x, y, kDiffId});
+                    m_d.identical++;
+                }
+                b = next_after_subtree(m_b, b, rb);
+                continue;
+            }
+            if (uint32_t fields = changed_fields(m_a[a], m_b[b]))
+                m_d.ops.push_back({DiffOpKind::Update, a, b, fields});
+
+            uint32_t i = 0;
+            for (NodeId c : m_a.children(a)) {
+                position[c] = i++;
+                if (m_d.afterOf[c] == kNoNode) m_d.ops.push_back({DiffOpKind::Remove, c, kNoNode});
+            }
+            // Children that stay under this parent keep their order where
+            // they can; the rest of them move.
+            seq.clear();
+            seqNodes.clear();
+            for (NodeId c : m_b.children(b)) {
+                NodeId x = m_d.beforeOf[c];
+                if (x != kNoNode && m_a.parent(x) == a) {
+                    seq.push_back(position[x]);
+                    seqNodes.push_back(c);
+                }
+            }
+            longest_increasing(seq, inOrder);
+            for (size_t k = 0; k < seqNodes.size(); k++)
+                if (!inOrder[k]) moved[seqNodes[k]] = 1;
+            b = m_b.next_preorder(b, rb);
+        }
+    }
+
+    const ElementTree& m_a;
+    const ElementTree& m_b;
+    TreeDiff& m_d;
+    std::vector<uint8_t> m_whole;  // node of `after` matched inside an identical subtree
+    std::vector<int8_t> m_stableA;  // is_stable_id per node, or -1 until asked
+    std::vector<int8_t> m_stableB;
+    // Scratch for align_children.
+    std::unordered_map<std::string_view, NodeId> m_byId;
+    std::vector<NodeId> m_ca, m_cb;
+    std::vector<uint64_t> m_ka, m_kb;
+    std::unordered_map<uint64_t, std::vector<NodeId>> m_rest;
+    std::vector<uint64_t> m_symbols;
+    std::vector<uint16_t> m_table;
+    std::vector<std::pair<uint32_t, uint32_t>> m_pairs;
+};
+
+// --- JSON Patch ---
+
+// Replays the diff on a model of the `before` document, so that every path
+// is computed against the document as the earlier operations left it.
+// Model nodes are the nodes of `before`, then those of `after` that were
+// inserted (numbered before.size() + node).
+class PatchWriter {
+public:
+    PatchWriter(OutputSink& out, const TreeDocument& before, const TreeDocument& after, const TreeDiff& diff,
+                bool oneLine)
+        : m_out(out), m_a(before.tree), m_b(after.tree), m_d(diff), m_base(static_cast<uint32_t>(m_a.size())),
+          m_oneLine(oneLine) {}
+
+    void write(const TreeDocument& before, const TreeDocument& after) {
+        m_out.put('[');
+        if (before.hwnd != after.hwnd) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "0x%08llX",
+                     static_cast<unsigned long long>(reinterpret_cast<uintptr_t>(after.hwnd)));
+            op("replace", "/target/hwnd");
+            value_string(buf);
+        }
+        if (before.pid != after.pid) {
+            op("replace", "/target/pid");
+            m_out.write(",\"value\":");
+            m_out.write(std::to_string(after.pid));
+            m_out.put('}');
+        }
+        if (before.processName != after.processName) {
+            op("replace", "/target/processName");
+            value_string(after.processName);
+        }
+        if (before.frameworks != after.frameworks) {
+            op("replace", "/frameworks");
+            m_out.write(",\"value\":[");
+            for (size_t i = 0; i < after.frameworks.size(); i++) {
+                if (i) m_out.put(',');
+                write_json_string(m_out, after.frameworks[i]);
+            }
+            m_out.write("]}");
+        }
+        write_tree();
+        m_out.write(m_first || m_oneLine ? "]" : "\n]");
+    }
+
+private:
+    struct List {
+        std::vector<uint32_t> items;
+        bool dirty = false;
+    };
+
+    void write_tree() {
+        NodeId ra = m_a.root(), rb = m_b.root();
+        if (ra == kNoNode || rb == kNoNode) {
+            if (ra == kNoNode && rb == kNoNode) return;
+            op("replace", "/root");
+            m_out.write(",\"value\":");
+            if (rb == kNoNode) m_out.write("null");
+            else write_json_element(m_out, m_b, rb);
+            m_out.put('}');
+            return;
+        }
+
+        // What to visit: nodes of `after` with an Update or whose children
+        // change, and their ancestors.
+        m_visit.assign(m_b.size(), 0);
+        m_fields.assign(m_b.size(), 0);
+        m_removed.assign(m_a.size(), 0);
+        m_placed.assign(m_b.size(), 0);
+        auto mark = [&](NodeId b, uint8_t bit) {
+            m_visit[b] |= bit;
+            for (NodeId p = m_b.parent(b); p != kNoNode && !(m_visit[p] & kBelow); p = m_b.parent(p))
+                m_visit[p] |= kBelow;
+        };
+        for (const DiffOp& o : m_d.ops) {
+            switch (o.kind) {
+            case DiffOpKind::Update:
+                m_fields[o.after] = o.fields;
+                mark(o.after, kSelf);
+                break;
+            case DiffOpKind::Insert:
+            case DiffOpKind::Move:
+                m_placed[o.after] = 1;
+                mark(m_b.parent(o.after), kSelf | kList);
+                break;
+            case DiffOpKind::Remove:
+                m_removed[o.before] = 1;
+                mark(m_d.afterOf[m_a.parent(o.before)], kSelf | kList);
+                break;
+            }
+        }
+        if (!m_visit[rb]) return;
+
+        // Removed nodes with matched nodes below are taken out last, once
+        // those have moved away.
+        m_keep.assign(m_a.size(), 0);
+        for (NodeId a = m_a.size(); a-- > 0;) {
+            if (m_d.afterOf[a] != kNoNode && m_a.parent(a) != kNoNode) m_keep[m_a.parent(a)] = 1;
+            if (m_keep[a] && m_a.parent(a) != kNoNode) m_keep[m_a.parent(a)] = 1;
+        }
+
+        m_parent.assign(m_base + m_b.size(), kNoNode);
+        m_index.assign(m_base + m_b.size(), 0);
+        for (NodeId a = 0; a < m_a.size(); a++) {
+            uint32_t i = 0;
+            for (NodeId c : m_a.children(a)) {
+                m_parent[c] = a;
+                m_index[c] = i++;
+            }
+        }
+
+        std::vector<NodeId> deferred;
+        for (NodeId b = rb; b != kNoNode;) {
+            if (!m_visit[b]) {
+                b = next_after_subtree(m_b, b, rb);
+                continue;
+            }
+            uint32_t w = model(b);
+            if (m_fields[b]) write_update(w, m_a[m_d.beforeOf[b]], m_b[b], m_fields[b]);
+            if (m_visit[b] & kList) {
+                if (NodeId a = m_d.beforeOf[b]; a != kNoNode) {
+                    for (NodeId c : m_a.children(a)) {
+                        if (!m_removed[c]) continue;
+                        if (m_keep[c]) deferred.push_back(c);
+                        else remove(c);
+                    }
+                }
+                uint32_t pred = kNoNode;
+                for (NodeId c : m_b.children(b)) {
+                    if (m_placed[c]) {
+                        if (m_d.beforeOf[c] == kNoNode) insert(c, w, pred);
+                        else move(m_d.beforeOf[c], w, pred);
+                    }
+                    pred = model(c);
+                }
+            }
+            b = m_b.next_preorder(b, rb);
+        }
+        for (NodeId a : deferred) remove(a);
+    }
+
+    uint32_t model(NodeId b) const {
+        NodeId a = m_d.beforeOf[b];
+        return a != kNoNode ? a : m_base + b;
+    }
+
+    List& list(uint32_t w) {
+        auto [it, added] = m_lists.try_emplace(w);
+        if (added && w < m_base) {
+            for (NodeId c : m_a.children(w)) it->second.items.push_back(c);
+        }
+        return it->second;
+    }
+
+    size_t child_count(uint32_t w) const {
+        auto it = m_lists.find(w);
+        if (it != m_lists.end()) return it->second.items.size();
+        return w < m_base ? m_a.child_count(w) : 0;
+    }
+
+    uint32_t index_of(uint32_t w) {
+        auto it = m_lists.find(m_parent[w]);
+        if (it != m_lists.end() && it->second.dirty) {
+            auto& items = it->second.items;
+            for (uint32_t i = 0; i < items.size(); i++) m_index[items[i]] = i;
+            it->second.dirty = false;
+        }
+        return m_index[w];
+    }
+
+    std::string path(uint32_t w) {
+        m_chain.clear();
+        for (; m_parent[w] != kNoNode; w = m_parent[w]) m_chain.push_back(index_of(w));
+        std::string p = "/root";
+        for (size_t i = m_chain.size(); i-- > 0;) {
+            p += "/children/";
+            p += std::to_string(m_chain[i]);
+        }
+        return p;
+    }
+
+    void detach(uint32_t w) {
+        List& l = list(m_parent[w]);
+        l.items.erase(l.items.begin() + index_of(w));
+        l.dirty = true;
+        m_parent[w] = kNoNode;
+    }
+
+    void attach(uint32_t w, uint32_t parent, uint32_t at) {
+        List& l = list(parent);
+        l.items.insert(l.items.begin() + at, w);
+        l.dirty = true;
+        m_parent[w] = parent;
+    }
+
+    void remove(uint32_t w) {
+        uint32_t parent = m_parent[w];
+        op("remove", child_count(parent) == 1 ? path(parent) + "/children" : path(w));
+        m_out.put('}');
+        detach(w);
+    }
+
+    void insert(NodeId b, uint32_t parent, uint32_t pred) {
+        uint32_t at = pred == kNoNode ? 0 : index_of(pred) + 1;
+        bool first = child_count(parent) == 0;
+        op("add", path(parent) + (first ? "/children" : "/children/" + std::to_string(at)));
+        m_out.write(first ? ",\"value\":[" : ",\"value\":");
+        // Matched nodes below arrive by their own moves; the rest of the
+        // subtree is written here, and modelled if anything moves into it.
+        bool pure = true;
+        for (NodeId y = m_b.next_preorder(b, b); y != kNoNode && pure; y = m_b.next_preorder(y, b))
+            pure = m_d.beforeOf[y] == kNoNode;
+        if (pure) {
+            write_json_element(m_out, m_b, b);
+        } else {
+            ElementTree part;
+            std::vector<std::pair<NodeId, NodeId>> stack{{b, kNoNode}};
+            std::vector<NodeId> kids;
+            while (!stack.empty()) {
+                auto [y, into] = stack.back();
+                stack.pop_back();
+                NodeId copy = into == kNoNode ? part.add_root(m_b[y]) : part.append_child(into, m_b[y]);
+                if (y != b) {
+                    uint32_t parent = m_base + m_b.parent(y);
+                    attach(m_base + y, parent, static_cast<uint32_t>(child_count(parent)));
+                }
+                kids.clear();
+                for (NodeId c : m_b.children(y))
+                    if (m_d.beforeOf[c] == kNoNode) kids.push_back(c);
+                // Pushed last to first so they pop in order.
+                for (size_t k = kids.size(); k-- > 0;) stack.push_back({kids[k], copy});
+            }
+            write_json_element(m_out, part, part.root());
+        }
+        m_out.write(first ? "]}" : "}");
+        attach(m_base + b, parent, at);
+    }
+
+    void move(uint32_t w, uint32_t parent, uint32_t pred) {
+        uint32_t from = m_parent[w];
+        if (from != parent && child_count(parent) == 0) {
+            op("add", path(parent) + "/children");
+            m_out.write(",\"value\":[]}");
+        }
+        std::string fromPath = path(w);
+        detach(w);
+        uint32_t at = pred == kNoNode ? 0 : index_of(pred) + 1;
+        op("move", path(parent) + "/children/" + std::to_string(at));
+        m_out.write(",\"from\":");
+        write_json_string(m_out, fromPath);
+        m_out.put('}');
+        attach(w, parent, at);
+        if (from != parent && child_count(from) == 0) {
+            op("remove", path(from) + "/children");
+            m_out.put('}');
+        }
+    }
+
+    void write_update(uint32_t w, const Element& a, const Element& b, uint32_t fields) {
+        std::string p = path(w);
+        auto replace = [&](std::string_view name, std::string_view value, bool sanitize) {
+            op("replace", p + "/" + std::string(name));
+            m_out.write(",\"value\":");
+            write_json_string(m_out, value, sanitize);
+            m_out.put('}');
+        };
+        // Members write_json leaves out when empty.
+        auto optional = [&](std::string_view name, std::string_view was, std::string_view is) {
+            if (is.empty()) {
+                op("remove", p + "/" + std::string(name));
+                m_out.put('}');
+            } else {
+                op(was.empty() ? "add" : "replace", p + "/" + std::string(name));
+                m_out.write(",\"value\":");
+                write_json_string(m_out, is, true);
+                m_out.put('}');
+            }
+        };
+        if (fields & kDiffClassName) optional("className", a.className.view(), b.className.view());
+        if (fields & kDiffFramework) replace("framework", b.framework.view(), false);
+        if (fields & kDiffId) replace("id", b.id, false);
+        if (fields & kDiffText) optional("text", a.text, b.text);
+        if (fields & kDiffType) replace("type", b.type.view(), true);
+        if (fields & kDiffBounds) {
+            op("replace", p + "/bounds");
+            char buf[96];
+            snprintf(buf, sizeof(buf), ",\"value\":{\"height\":%d,\"width\":%d,\"x\":%d,\"y\":%d}}",
+                     b.bounds.height, b.bounds.width, b.bounds.x, b.bounds.y);
+            m_out.write(buf);
+        }
+        if (fields & kDiffProperties) write_properties(p, a.properties, b.properties);
+    }
+
+    void write_property_value(const PropertyValue& v) {
+        m_out.write(",\"value\":");
+        if (v.is_string()) {
+            write_json_string(m_out, std::get<std::string>(v.storage()));
+        } else {
+            m_scratch.clear();
+            v.append_to(m_scratch);
+            write_json_string(m_out, m_scratch);
+        }
+        m_out.put('}');
+    }
+
+    void write_properties(const std::string& p, const PropertyList& a, const PropertyList& b) {
+        if (a.empty() || b.empty()) {
+            op(a.empty() ? "add" : "remove", p + "/properties");
+            if (!b.empty()) {
+                m_out.write(",\"value\":{");
+                bool first = true;
+                for (auto& [k, v] : b) {
+                    if (!first) m_out.put(',');
+                    first = false;
+                    write_json_string(m_out, k.view());
+                    m_scratch.clear();
+                    v.append_to(m_scratch);
+                    m_out.put(':');
+                    write_json_string(m_out, m_scratch);
+                }
+                m_out.put('}');
+            }
+            m_out.put('}');
+            return;
+        }
+        // Both sorted by key text: merge.
+        auto i = a.begin(), j = b.begin();
+        while (i != a.end() || j != b.end()) {
+            int order = i == a.end() ? 1 : j == b.end() ? -1 : i->key.view().compare(j->key.view());
+            if (order < 0) {
+                op("remove", p + "/properties/" + pointer_token(i->key.view()));
+                m_out.put('}');
+                ++i;
+            } else if (order > 0) {
+                op("add", p + "/properties/" + pointer_token(j->key.view()));
+                write_property_value(j->value);
+                ++j;
+            } else {
+                if (!same_value(i->value, j->value)) {
+                    op("replace", p + "/properties/" + pointer_token(j->key.view()));
+                    write_property_value(j->value);
+                }
+                ++i, ++j;
+            }
+        }
+    }
+
+    // A member name as a JSON Pointer reference token.
+    static std::string pointer_token(std::string_view name) {
+        std::string t;
+        for (char c : name) {
+            if (c == '~') t += "~0";
+            else if (c == '/') t += "~1";
+            else t += c;
+        }
+        return t;
+    }
+
+    // Opens an operation object; the caller writes the rest and closes it.
+    void op(std::string_view name, std::string_view target) {
+        if (!m_first) m_out.put(',');
+        if (!m_oneLine) m_out.put('\n');
+        m_first = false;
+        m_out.write("{\"op\":\"");
+        m_out.write(name);
+        m_out.write("\",\"path\":");
+        write_json_string(m_out, target);
+    }
+
+    void value_string(std::string_view v) {
+        m_out.write(",\"value\":");
+        write_json_string(m_out, v);
+        m_out.put('}');
+    }
+
+    static constexpr uint8_t kSelf = 1;   // has an Update or a list change
+    static constexpr uint8_t kList = 2;   // its children change
+    static constexpr uint8_t kBelow = 4;  // something below does
+
+    OutputSink& m_out;
+    const ElementTree& m_a;
+    const ElementTree& m_b;
+    const TreeDiff& m_d;
+    uint32_t m_base;
+    bool m_oneLine;
+    bool m_first = true;
+    std::vector<uint8_t> m_visit;
+    std::vector<uint32_t> m_fields;
+    std::vector<uint8_t> m_removed;
+    std::vector<uint8_t> m_placed;
+    std::vector<uint8_t> m_keep;
+    std::vector<uint32_t> m_parent;
+    std::vector<uint32_t> m_index;
+    std::unordered_map<uint32_t, List> m_lists;
+    std::vector<uint32_t> m_chain;
+    std::string m_scratch;
+};
+
+} // namespace
+
+TreeDiff diff_trees(const ElementTree& before, const ElementTree& after) {
+    TreeDiff diff;
+    Differ(before, after, diff).run();
+    return diff;
+}
+
+void write_json_patch(OutputSink& out, const TreeDocument& before, const TreeDocument& after,
+                      const TreeDiff& diff, bool oneLine) {
+    PatchWriter(out, before, after, diff, oneLine).write(before, after);
+}
+
+} // namespace lvt
@@ -0,0 +1,74 @@
+#pragma once
+#include "element.h"
+#include "json_reader.h"
+#include "output_sink.h"
+#include <cstdint>
+#include <vector>
+
+namespace lvt {
+
+// Fields an Update changes, as serialized (nativeHandle is not compared).
+enum DiffField : uint32_t {
+    kDiffId         = 1,
+    kDiffType       = 2,
+    kDiffFramework  = 4,
+    kDiffClassName  = 8,
+    kDiffText       = 16,
+    kDiffBounds     = 32,
+    kDiffProperties = 64,
+};
+
+enum class DiffOpKind : uint8_t { Insert, Remove, Move, Update };
+
+// One change between two trees. Insert covers the subtree of `after` below
+// it, and Remove the subtree of `before`, except for nodes with their own
+// Move. A Move puts `before` where `after` is: under a different parent, or
+// out of order among its siblings.
+struct DiffOp {
+    DiffOpKind kind;
+    NodeId before = kNoNode;  // Remove, Move, Update
+    NodeId after = kNoNode;   // Insert, Move, Update
+    uint32_t fields = 0;      // Update: DiffField bits
+};
+
+struct TreeDiff {
+    // In pre-order of `after`. A node's Move comes before its Update, and the
+    // Removes of a parent's children come with that parent.
+    std::vector<DiffOp> ops;
+    std::vector<NodeId> afterOf;   // node of `before` -> its match in `after`, or kNoNode
+    std::vector<NodeId> beforeOf;  // node of `after` -> its match in `before`, or kNoNode
+    size_t identical = 0;          // matched nodes skipped as part of identical subtrees
+
+    bool empty() const { return ops.empty(); }
+};
+
+// Match the nodes of two trees and describe what changed. Both trees need
+// subtree hashes (assign_element_ids or hash_subtrees).
+//
+// The roots always match. Then, in order:
+//   1. Top down from each matched pair, their unmatched children: with the
+//      same stable ID, then with equal subtree hashes. Stable IDs are the
+//      path-hash "s" IDs and "w<hwnd>" window IDs; the ordinal e0, e1, ...
+//      IDs shift with every insertion, so they never match by themselves.
+//   2. Unmatched elements with the same stable ID anywhere in the tree.
+//   3. Top down again: equal framework, type, class and text (or window
+//      handle), then equal framework, type and class.
+//   4. What is still unmatched on both sides, by subtree hashes unique to
+//      each tree: subtrees moved to another parent.
+// Each pass over a list of children takes the longest common subsequence
+// first; all but the last then pair off what is left in any order, as
+// moves. Two elements with different stable IDs are never matched.
+// Subtrees with equal hashes are matched wholesale without comparing their
+// fields; only their IDs are checked.
+TreeDiff diff_trees(const ElementTree& before, const ElementTree& after);
+
+// Write `diff` as an RFC 6902 JSON Patch that turns the write_json output of
+// `before` into that of `after`, one operation per line (all on one line
+// with `oneLine`). Paths index the "children" arrays as they stand when the
+// operation applies; empty "children", "properties", "className" and "text"
+// members are added and removed as write_json would. "hash" members are not
+// patched.
+void write_json_patch(OutputSink& out, const TreeDocument& before, const TreeDocument& after,
+                      const TreeDiff& diff, bool oneLine = false);
+
+} // namespace lvt
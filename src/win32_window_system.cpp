@@ -0,0 +1,440 @@
+#include "win32_window_system.h"
+#include "providers/comctl_provider.h"
+#include <CommCtrl.h>
+#include <Psapi.h>
+#include <wil/resource.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#pragma comment(lib, "version.lib")
+
+namespace lvt {
+
+static std::string wstr_to_str(const wchar_t* ws, int len = -1) {
+    if (!ws || (len == 0)) return {};
+    if (len < 0) len = static_cast<int>(wcslen(ws));
+    int sz = WideCharToMultiByte(CP_UTF8, 0, ws, len, nullptr, 0, nullptr, nullptr);
+    std::string s(sz, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, ws, len, s.data(), sz, nullptr, nullptr);
+    return s;
+}
+
+// ---- Windows ----
+
+// Class names repeat across the whole tree, so intern straight from a stack
+// buffer instead of building a std::string per window.
+static Symbol get_window_class(HWND hwnd) {
+    wchar_t cls[256]{};
+    int len = GetClassNameW(hwnd, cls, 256);
+    if (len <= 0) return {};
+    char buf[256 * 3];
+    int sz = WideCharToMultiByte(CP_UTF8, 0, cls, len, buf, sizeof(buf), nullptr, nullptr);
+    return Symbol(std::string_view(buf, sz > 0 ? sz : 0));
+}
+
+static std::string get_window_text(HWND hwnd) {
+    int len = GetWindowTextLengthW(hwnd);
+    if (len == 0) return {};
+    std::wstring buf(len + 1, L'\0');
+    GetWindowTextW(hwnd, buf.data(), len + 1);
+    return wstr_to_str(buf.c_str(), len);
+}
+
+static BOOL CALLBACK collect_hwnd(HWND hwnd, LPARAM lParam) {
+    reinterpret_cast<std::vector<HWND>*>(lParam)->push_back(hwnd);
+    return TRUE;
+}
+
+std::vector<HWND> Win32WindowSystem::top_level_windows() {
+    std::vector<HWND> windows;
+    EnumWindows(collect_hwnd, reinterpret_cast<LPARAM>(&windows));
+    return windows;
+}
+
+std::vector<HWND> Win32WindowSystem::descendants(HWND hwnd) {
+    std::vector<HWND> windows;
+    EnumChildWindows(hwnd, collect_hwnd, reinterpret_cast<LPARAM>(&windows));
+    return windows;
+}
+
+HWND Win32WindowSystem::parent(HWND hwnd) {
+    return GetParent(hwnd);
+}
+
+Symbol Win32WindowSystem::class_name(HWND hwnd) {
+    return get_window_class(hwnd);
+}
+
+std::string Win32WindowSystem::text(HWND hwnd) {
+    return get_window_text(hwnd);
+}
+
+Bounds Win32WindowSystem::rect(HWND hwnd) {
+    RECT rc{};
+    GetWindowRect(hwnd, &rc);
+    return {rc.left, rc.top, rc.right - rc.left, rc.bottom - rc.top};
+}
+
+uint32_t Win32WindowSystem::style(HWND hwnd) {
+    return static_cast<uint32_t>(GetWindowLong(hwnd, GWL_STYLE));
+}
+
+bool Win32WindowSystem::visible(HWND hwnd) {
+    return IsWindowVisible(hwnd) != FALSE;
+}
+
+bool Win32WindowSystem::enabled(HWND hwnd) {
+    return IsWindowEnabled(hwnd) != FALSE;
+}
+
+DWORD Win32WindowSystem::process_id(HWND hwnd) {
+    DWORD pid = 0;
+    GetWindowThreadProcessId(hwnd, &pid);
+    return pid;
+}
+
+// ---- Processes and modules ----
+
+std::string Win32WindowSystem::process_name(DWORD pid) {
+    wil::unique_handle proc(OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid));
+    if (!proc) return {};
+    wchar_t path[MAX_PATH]{};
+    DWORD size = MAX_PATH;
+    if (QueryFullProcessImageNameW(proc.get(), 0, path, &size)) {
+        std::wstring ws(path, size);
+        auto pos = ws.find_last_of(L"\\/");
+        if (pos != std::wstring::npos) ws = ws.substr(pos + 1);
+        return wstr_to_str(ws.c_str(), static_cast<int>(ws.size()));
+    }
+    return {};
+}
+
+// Get the full path of a module loaded in a remote process.
+static std::wstring get_module_path(HANDLE proc, const wchar_t* moduleName) {
+    HMODULE modules[1024];
+    DWORD needed = 0;
+    if (!EnumProcessModulesEx(proc, modules, sizeof(modules), &needed, LIST_MODULES_ALL))
+        return {};
+
+    for (DWORD i = 0; i < needed / sizeof(HMODULE); i++) {
+        wchar_t name[MAX_PATH]{};
+        if (GetModuleBaseNameW(proc, modules[i], name, MAX_PATH)) {
+            if (_wcsicmp(name, moduleName) == 0) {
+                wchar_t fullPath[MAX_PATH]{};
+                if (GetModuleFileNameExW(proc, modules[i], fullPath, MAX_PATH))
+                    return fullPath;
+                return {};
+            }
+        }
+    }
+    return {};
+}
+
+// Extract version string from a DLL path.
+// useFileVersion=true reads dwFileVersion (e.g. "6.10" for comctl32),
+// useFileVersion=false reads dwProductVersion (e.g. "10.0.26568.5001" for system DLLs).
+static std::string get_file_version(const std::wstring& path, bool useFileVersion) {
+    if (path.empty()) return {};
+    DWORD verHandle = 0;
+    DWORD verSize = GetFileVersionInfoSizeW(path.c_str(), &verHandle);
+    if (verSize == 0) return {};
+
+    std::vector<BYTE> verData(verSize);
+    if (!GetFileVersionInfoW(path.c_str(), verHandle, verSize, verData.data()))
+        return {};
+
+    VS_FIXEDFILEINFO* fileInfo = nullptr;
+    UINT len = 0;
+    if (!VerQueryValueW(verData.data(), L"\\", reinterpret_cast<void**>(&fileInfo), &len))
+        return {};
+
+    DWORD ms = useFileVersion ? fileInfo->dwFileVersionMS : fileInfo->dwProductVersionMS;
+    DWORD ls = useFileVersion ? fileInfo->dwFileVersionLS : fileInfo->dwProductVersionLS;
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%d.%d.%d.%d",
+             HIWORD(ms), LOWORD(ms), HIWORD(ls), LOWORD(ls));
+    return buf;
+}
+
+bool Win32WindowSystem::module_version(DWORD pid, std::string_view module, bool fileVersion,
+                                       std::string& version) {
+    wil::unique_handle proc(OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, pid));
+    if (!proc) return false;
+
+    std::wstring name(module.begin(), module.end());  // module names are ASCII
+    auto path = get_module_path(proc.get(), name.c_str());
+    if (path.empty()) return false;
+
+    version = get_file_version(path, fileVersion);
+    return true;
+}
+
+// ---- Common controls ----
+
+// Timeout in ms for cross-process SendMessage calls
+static constexpr UINT kSendMsgTimeout = 1000;
+
+// Safe cross-process SendMessage with timeout to avoid hanging on unresponsive windows
+static LRESULT SafeSendMessage(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    DWORD_PTR result = 0;
+    LRESULT lr = SendMessageTimeoutW(hwnd, msg, wParam, lParam,
+        SMTO_ABORTIFHUNG | SMTO_ERRORONEXIT, kSendMsgTimeout, &result);
+    if (lr == 0) return 0; // timeout or error
+    return static_cast<LRESULT>(result);
+}
+
+// RAII wrapper for memory allocated in a remote process via VirtualAllocEx.
+struct RemoteBuffer {
+    HANDLE process = nullptr;
+    void* ptr = nullptr;
+    SIZE_T size = 0;
+
+    RemoteBuffer() = default;
+    RemoteBuffer(HANDLE proc, SIZE_T sz)
+        : process(proc)
+        , ptr(VirtualAllocEx(proc, nullptr, sz, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE))
+        , size(sz) {}
+    ~RemoteBuffer() { if (ptr) VirtualFreeEx(process, ptr, 0, MEM_RELEASE); }
+    RemoteBuffer(const RemoteBuffer&) = delete;
+    RemoteBuffer& operator=(const RemoteBuffer&) = delete;
+
+    explicit operator bool() const { return ptr != nullptr; }
+
+    bool write(const void* data, SIZE_T len) const {
+        return WriteProcessMemory(process, ptr, data, len, nullptr) != FALSE;
+    }
+    bool read(void* data, SIZE_T len) const {
+        return ReadProcessMemory(process, ptr, data, len, nullptr) != FALSE;
+    }
+};
+
+// Open the process that owns the given HWND.
+static wil::unique_handle open_hwnd_process(HWND hwnd) {
+    DWORD pid = 0;
+    GetWindowThreadProcessId(hwnd, &pid);
+    if (!pid) return {};
+    return wil::unique_handle(OpenProcess(
+        PROCESS_VM_OPERATION | PROCESS_VM_READ | PROCESS_VM_WRITE, FALSE, pid));
+}
+
+static void query_listview(HWND hwnd, ComCtlReply& reply) {
+    // These messages don't use pointers — safe cross-process
+    reply.count = static_cast<int>(SafeSendMessage(hwnd, LVM_GETITEMCOUNT, 0, 0));
+    reply.viewMode = static_cast<DWORD>(SafeSendMessage(hwnd, LVM_GETVIEW, 0, 0));
+
+    HWND header = reinterpret_cast<HWND>(SafeSendMessage(hwnd, LVM_GETHEADER, 0, 0));
+    if (header)
+        reply.columnCount = static_cast<int>(SafeSendMessage(header, HDM_GETITEMCOUNT, 0, 0));
+
+    // Cross-process: allocate buffers in target process
+    auto proc = open_hwnd_process(hwnd);
+    if (!proc) return;
+
+    constexpr int kTextBufSize = 512;
+    constexpr SIZE_T kRemoteSize = sizeof(LVITEMW) + kTextBufSize * sizeof(wchar_t);
+    RemoteBuffer remote(proc.get(), kRemoteSize);
+    if (!remote) return;
+
+    auto* remoteItem = reinterpret_cast<LVITEMW*>(remote.ptr);
+    auto* remoteText = reinterpret_cast<wchar_t*>(
+        static_cast<char*>(remote.ptr) + sizeof(LVITEMW));
+
+    int maxItems = (reply.count < ComCtlProvider::kMaxListViewItems)
+        ? reply.count : ComCtlProvider::kMaxListViewItems;
+    for (int i = 0; i < maxItems; i++) {
+        ComCtlItem& item = reply.items.emplace_back();
+
+        LVITEMW lvi{};
+        lvi.mask = LVIF_TEXT | LVIF_STATE;
+        lvi.iItem = i;
+        lvi.stateMask = LVIS_SELECTED;
+        lvi.pszText = remoteText;  // pointer valid in target process
+        lvi.cchTextMax = kTextBufSize;
+
+        if (remote.write(&lvi, sizeof(lvi))) {
+            SafeSendMessage(hwnd, LVM_GETITEMW, 0, reinterpret_cast<LPARAM>(remoteItem));
+
+            LVITEMW result{};
+            remote.read(&result, sizeof(result));
+            wchar_t textBuf[kTextBufSize]{};
+            remote.read(textBuf, sizeof(textBuf));
+            item.text = wstr_to_str(textBuf);
+
+            if (result.state & LVIS_SELECTED)
+                item.state |= ComCtlItem::kSelected;
+        }
+    }
+}
+
+static void query_treeview(HWND hwnd, ComCtlReply& reply) {
+    reply.count = static_cast<int>(SafeSendMessage(hwnd, TVM_GETCOUNT, 0, 0));
+
+    // TVM_GETNEXTITEM/TVM_GETROOT don't use pointers — safe
+    HTREEITEM hItem = reinterpret_cast<HTREEITEM>(
+        SafeSendMessage(hwnd, TVM_GETNEXTITEM, TVGN_ROOT, 0));
+
+    auto proc = open_hwnd_process(hwnd);
+    if (!proc || !hItem) return;
+
+    constexpr int kTextBufSize = 512;
+    constexpr SIZE_T kRemoteSize = sizeof(TVITEMW) + kTextBufSize * sizeof(wchar_t);
+    RemoteBuffer remote(proc.get(), kRemoteSize);
+    if (!remote) return;
+
+    auto* remoteItem = reinterpret_cast<TVITEMW*>(remote.ptr);
+    auto* remoteText = reinterpret_cast<wchar_t*>(
+        static_cast<char*>(remote.ptr) + sizeof(TVITEMW));
+
+    int added = 0;
+    while (hItem && added < ComCtlProvider::kMaxTreeViewItems) {
+        ComCtlItem& item = reply.items.emplace_back();
+
+        TVITEMW tvi{};
+        tvi.mask = TVIF_TEXT | TVIF_STATE | TVIF_CHILDREN;
+        tvi.hItem = hItem;
+        tvi.stateMask = TVIS_SELECTED | TVIS_EXPANDED;
+        tvi.pszText = remoteText;
+        tvi.cchTextMax = kTextBufSize;
+
+        if (remote.write(&tvi, sizeof(tvi))) {
+            SafeSendMessage(hwnd, TVM_GETITEMW, 0, reinterpret_cast<LPARAM>(remoteItem));
+
+            TVITEMW result{};
+            remote.read(&result, sizeof(result));
+            wchar_t textBuf[kTextBufSize]{};
+            remote.read(textBuf, sizeof(textBuf));
+            item.text = wstr_to_str(textBuf);
+
+            if (result.state & TVIS_SELECTED)
+                item.state |= ComCtlItem::kSelected;
+            if (result.state & TVIS_EXPANDED)
+                item.state |= ComCtlItem::kExpanded;
+            if (result.cChildren > 0)
+                item.state |= ComCtlItem::kHasChildren;
+        }
+
+        hItem = reinterpret_cast<HTREEITEM>(
+            SafeSendMessage(hwnd, TVM_GETNEXTITEM, TVGN_NEXT,
+                            reinterpret_cast<LPARAM>(hItem)));
+        added++;
+    }
+}
+
+static void query_toolbar(HWND hwnd, ComCtlReply& reply) {
+    reply.count = static_cast<int>(SafeSendMessage(hwnd, TB_BUTTONCOUNT, 0, 0));
+
+    auto proc = open_hwnd_process(hwnd);
+    if (!proc) return;
+
+    // TB_GETBUTTON needs a remote TBBUTTON struct
+    RemoteBuffer remoteBtnBuf(proc.get(), sizeof(TBBUTTON));
+    if (!remoteBtnBuf) return;
+
+    constexpr int kTextBufSize = 256;
+    RemoteBuffer remoteTextBuf(proc.get(), kTextBufSize * sizeof(wchar_t));
+    if (!remoteTextBuf) return;
+
+    for (int i = 0; i < reply.count && i < ComCtlProvider::kMaxToolbarButtons; i++) {
+        SafeSendMessage(hwnd, TB_GETBUTTON, i, reinterpret_cast<LPARAM>(remoteBtnBuf.ptr));
+
+        TBBUTTON btn{};
+        remoteBtnBuf.read(&btn, sizeof(btn));
+
+        ComCtlItem& item = reply.items.emplace_back();
+        item.commandId = btn.idCommand;
+
+        if (btn.fsStyle & BTNS_SEP) {
+            item.state |= ComCtlItem::kSeparator;
+        } else {
+            SafeSendMessage(hwnd, TB_GETBUTTONTEXTW, btn.idCommand,
+                         reinterpret_cast<LPARAM>(remoteTextBuf.ptr));
+            wchar_t textBuf[kTextBufSize]{};
+            remoteTextBuf.read(textBuf, sizeof(textBuf));
+            item.text = wstr_to_str(textBuf);
+        }
+
+        if (btn.fsState & TBSTATE_CHECKED)
+            item.state |= ComCtlItem::kChecked;
+        if (!(btn.fsState & TBSTATE_ENABLED))
+            item.state |= ComCtlItem::kDisabled;
+    }
+}
+
+static void query_statusbar(HWND hwnd, ComCtlReply& reply) {
+    reply.count = static_cast<int>(SafeSendMessage(hwnd, SB_GETPARTS, 0, 0));
+
+    auto proc = open_hwnd_process(hwnd);
+    if (!proc) return;
+
+    constexpr int kTextBufSize = 512;
+    RemoteBuffer remoteTextBuf(proc.get(), kTextBufSize * sizeof(wchar_t));
+    if (!remoteTextBuf) return;
+
+    for (int i = 0; i < reply.count; i++) {
+        // SB_GETTEXTW with a remote buffer
+        SafeSendMessage(hwnd, SB_GETTEXTW, i, reinterpret_cast<LPARAM>(remoteTextBuf.ptr));
+        wchar_t textBuf[kTextBufSize]{};
+        remoteTextBuf.read(textBuf, sizeof(textBuf));
+        reply.items.emplace_back().text = wstr_to_str(textBuf);
+    }
+}
+
+static void query_tabcontrol(HWND hwnd, ComCtlReply& reply) {
+    reply.count = static_cast<int>(SafeSendMessage(hwnd, TCM_GETITEMCOUNT, 0, 0));
+    reply.selected = static_cast<int>(SafeSendMessage(hwnd, TCM_GETCURSEL, 0, 0));
+
+    auto proc = open_hwnd_process(hwnd);
+    if (!proc) return;
+
+    constexpr int kTextBufSize = 256;
+    constexpr SIZE_T kRemoteSize = sizeof(TCITEMW) + kTextBufSize * sizeof(wchar_t);
+    RemoteBuffer remote(proc.get(), kRemoteSize);
+    if (!remote) return;
+
+    auto* remoteItem = reinterpret_cast<TCITEMW*>(remote.ptr);
+    auto* remoteText = reinterpret_cast<wchar_t*>(
+        static_cast<char*>(remote.ptr) + sizeof(TCITEMW));
+
+    for (int i = 0; i < reply.count; i++) {
+        ComCtlItem& item = reply.items.emplace_back();
+
+        TCITEMW tci{};
+        tci.mask = TCIF_TEXT;
+        tci.pszText = remoteText;
+        tci.cchTextMax = kTextBufSize;
+
+        if (remote.write(&tci, sizeof(tci))) {
+            SafeSendMessage(hwnd, TCM_GETITEMW, i, reinterpret_cast<LPARAM>(remoteItem));
+
+            wchar_t textBuf[kTextBufSize]{};
+            remote.read(textBuf, sizeof(textBuf));
+            item.text = wstr_to_str(textBuf);
+        }
+    }
+}
+
+bool Win32WindowSystem::comctl(HWND hwnd, Symbol className, ComCtlReply& reply) {
+    std::string_view cls = className.view();
+    if (cls == "SysListView32") {
+        query_listview(hwnd, reply);
+    } else if (cls == "SysTreeView32") {
+        query_treeview(hwnd, reply);
+    } else if (cls == "ToolbarWindow32") {
+        query_toolbar(hwnd, reply);
+    } else if (cls == "msctls_statusbar32") {
+        query_statusbar(hwnd, reply);
+    } else if (cls == "SysTabControl32") {
+        query_tabcontrol(hwnd, reply);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+IWindowSystem& Win32WindowSystem::instance() {
+    static Win32WindowSystem ws;
+    return ws;
+}
+
+} // namespace lvt
@@ -0,0 +1,30 @@
+#pragma once
+#include "window_system.h"
+#include <Windows.h>
+
+namespace lvt {
+
+// IWindowSystem backed by the running desktop: window APIs, process and
+// module enumeration, and cross-process common control messages.
+class Win32WindowSystem : public IWindowSystem {
+public:
+    // The window system is stateless; share one instance.
+    static IWindowSystem& instance();
+
+    std::vector<HWND> top_level_windows() override;
+    std::vector<HWND> descendants(HWND hwnd) override;
+    HWND parent(HWND hwnd) override;
+    Symbol class_name(HWND hwnd) override;
+    std::string text(HWND hwnd) override;
+    Bounds rect(HWND hwnd) override;
+    uint32_t style(HWND hwnd) override;
+    bool visible(HWND hwnd) override;
+    bool enabled(HWND hwnd) override;
+    DWORD process_id(HWND hwnd) override;
+    std::string process_name(DWORD pid) override;
+    bool module_version(DWORD pid, std::string_view module, bool fileVersion,
+                        std::string& version) override;
+    bool comctl(HWND hwnd, Symbol className, ComCtlReply& reply) override;
+};
+
+} // namespace lvt
@@ -0,0 +1,56 @@
+#include "window_search.h"
+
+namespace lvt {
+
+// Every visible top-level window, with its owning process and title.
+static std::vector<WindowMatch> enum_all_windows(IWindowSystem& ws) {
+    std::vector<WindowMatch> matches;
+    for (HWND hwnd : ws.top_level_windows()) {
+        if (!ws.visible(hwnd)) continue;
+
+        WindowMatch m;
+        m.hwnd = hwnd;
+        m.pid = ws.process_id(hwnd);
+        m.processName = ws.process_name(m.pid);
+        m.windowTitle = ws.text(hwnd);
+        matches.push_back(std::move(m));
+    }
+    return matches;
+}
+
+std::vector<WindowMatch> find_by_process_name(IWindowSystem& ws, const std::string& name) {
+    std::vector<WindowMatch> results;
+    for (auto& m : enum_all_windows(ws)) {
+        if (icontains(m.processName, name)) {
+            results.push_back(std::move(m));
+        }
+    }
+    return results;
+}
+
+std::vector<WindowMatch> find_by_title(IWindowSystem& ws, const std::string& title) {
+    std::vector<WindowMatch> results;
+    for (auto& m : enum_all_windows(ws)) {
+        if (icontains(m.windowTitle, title)) {
+            results.push_back(std::move(m));
+        }
+    }
+    return results;
+}
+
+HWND find_main_window(IWindowSystem& ws, DWORD pid) {
+    HWND best = nullptr;
+    int bestArea = 0;
+    for (HWND h : ws.top_level_windows()) {
+        if (ws.process_id(h) != pid || !ws.visible(h)) continue;
+        Bounds rc = ws.rect(h);
+        int area = rc.width * rc.height;
+        if (area > bestArea) {
+            bestArea = area;
+            best = h;
+        }
+    }
+    return best;
+}
+
+} // namespace lvt
@@ -0,0 +1,24 @@
+#pragma once
+#include "window_system.h"
+#include <string>
+#include <vector>
+
+namespace lvt {
+
+struct WindowMatch {
+    HWND hwnd;
+    DWORD pid;
+    std::string processName;
+    std::string windowTitle;
+};
+
+// Find windows by process name (e.g. "notepad.exe" or "notepad").
+std::vector<WindowMatch> find_by_process_name(IWindowSystem& ws, const std::string& name);
+
+// Find windows by title substring (case-insensitive).
+std::vector<WindowMatch> find_by_title(IWindowSystem& ws, const std::string& title);
+
+// The main window of `pid`: its largest visible top-level window, or null.
+HWND find_main_window(IWindowSystem& ws, DWORD pid);
+
+} // namespace lvt
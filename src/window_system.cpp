@@ -0,0 +1,67 @@
+#include "window_system.h"
+#include <algorithm>
+
+namespace lvt {
+
+static char ascii_lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+bool iequals(std::string_view a, std::string_view b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(),
+                      [](char x, char y) { return ascii_lower(x) == ascii_lower(y); });
+}
+
+bool icontains(std::string_view haystack, std::string_view needle) {
+    if (needle.empty()) return true;
+    auto it = std::search(haystack.begin(), haystack.end(), needle.begin(), needle.end(),
+                          [](char x, char y) { return ascii_lower(x) == ascii_lower(y); });
+    return it != haystack.end();
+}
+
+WindowInfo WindowSystemSource::window(HWND hwnd) {
+    WindowInfo info;
+    info.className = m_ws.class_name(hwnd);
+    info.text = m_ws.text(hwnd);
+    info.rect = m_ws.rect(hwnd);
+    info.style = m_ws.style(hwnd);
+    info.visible = m_ws.visible(hwnd);
+    info.enabled = m_ws.enabled(hwnd);
+    return info;
+}
+
+std::vector<HWND> WindowSystemSource::children(HWND hwnd) {
+    auto it = m_children.find(hwnd);
+    if (it == m_children.end()) {
+        // EnumChildWindows walks the whole subtree, so do it once and build
+        // the parent -> children map for every window in it, rather than
+        // re-walking each subtree and filtering with GetParent per node.
+        // A subtree enumerated earlier may lie inside this one; its lists are
+        // rebuilt along with the rest.
+        std::vector<HWND> all = m_ws.descendants(hwnd);
+        m_children.reserve(m_children.size() + all.size() + 1);
+        m_children.try_emplace(hwnd);
+        for (HWND h : all) m_children[h].clear();
+        for (HWND h : all) {
+            auto parent = m_children.find(m_ws.parent(h));
+            if (parent != m_children.end()) parent->second.push_back(h);
+        }
+        it = m_children.find(hwnd);
+    }
+    return it->second;
+}
+
+bool WindowSystemSource::comctl(HWND hwnd, Symbol className, ComCtlReply& reply) {
+    return m_ws.comctl(hwnd, className, reply);
+}
+
+std::string WindowSystemSource::tap_payload(Framework, HWND, DWORD) {
+    return {};
+}
+
+std::string WindowSystemSource::plugin_payload(const std::string&, HWND, DWORD, HWND) {
+    return {};
+}
+
+} // namespace lvt
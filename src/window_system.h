@@ -0,0 +1,86 @@
+#pragma once
+#include "capture_source.h"
+#include "element.h"
+#include "platform.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace lvt {
+
+// The window-manager primitives lvt reads: the Win32 calls behind window
+// enumeration, framework detection, target search and common control
+// queries. Win32WindowSystem makes the real calls; tests and benchmarks
+// substitute an in-memory fake (tests/fake_window_system.h) to run the
+// traversal code off-Windows and count how often each primitive is hit.
+class IWindowSystem {
+public:
+    virtual ~IWindowSystem() = default;
+
+    // EnumWindows: every top-level window, in z-order.
+    virtual std::vector<HWND> top_level_windows() = 0;
+
+    // EnumChildWindows: every descendant of `hwnd` (not just direct
+    // children), each window before its own descendants.
+    virtual std::vector<HWND> descendants(HWND hwnd) = 0;
+
+    virtual HWND parent(HWND hwnd) = 0;                 // GetParent
+    virtual Symbol class_name(HWND hwnd) = 0;           // GetClassNameW
+    virtual std::string text(HWND hwnd) = 0;            // GetWindowTextW
+    virtual Bounds rect(HWND hwnd) = 0;                 // GetWindowRect
+    virtual uint32_t style(HWND hwnd) = 0;              // GetWindowLong(GWL_STYLE)
+    virtual bool visible(HWND hwnd) = 0;                // IsWindowVisible
+    virtual bool enabled(HWND hwnd) = 0;                // IsWindowEnabled
+    virtual DWORD process_id(HWND hwnd) = 0;            // GetWindowThreadProcessId
+
+    // Executable file name of `pid` (e.g. "notepad.exe"); empty if the
+    // process cannot be opened.
+    virtual std::string process_name(DWORD pid) = 0;
+
+    // Whether `module` (a DLL base name, matched case-insensitively) is loaded
+    // in `pid`. On success `version` receives its file or product version as
+    // "a.b.c.d", or stays empty if the DLL has no version resource.
+    virtual bool module_version(DWORD pid, std::string_view module, bool fileVersion,
+                                std::string& version) = 0;
+
+    // Query the common control `hwnd` (of window class `className`) with
+    // SendMessageTimeout. Returns false for classes that are not queried.
+    virtual bool comctl(HWND hwnd, Symbol className, ComCtlReply& reply) = 0;
+};
+
+// CaptureSource whose window and common control inputs come from an
+// IWindowSystem. TAP and plugin payloads are empty unless a subclass
+// (LiveSource) supplies them.
+//
+// The first children() call for a window outside any enumerated subtree
+// enumerates its whole subtree once and files every descendant under its
+// GetParent; later calls inside that subtree are answered from the map. The
+// window hierarchy is therefore read as of that first call: use one source
+// per capture.
+class WindowSystemSource : public CaptureSource {
+public:
+    explicit WindowSystemSource(IWindowSystem& ws) : m_ws(ws) {}
+
+    WindowInfo window(HWND hwnd) override;
+    std::vector<HWND> children(HWND hwnd) override;
+    bool comctl(HWND hwnd, Symbol className, ComCtlReply& reply) override;
+    std::string tap_payload(Framework framework, HWND host, DWORD pid) override;
+    std::string plugin_payload(const std::string& name, HWND hwnd, DWORD pid,
+                               HWND scope) override;
+
+protected:
+    IWindowSystem& m_ws;
+
+private:
+    // Direct children, in z-order, of every window in an enumerated subtree
+    // (leaves map to an empty list).
+    std::unordered_map<HWND, std::vector<HWND>> m_children;
+};
+
+// ASCII case-insensitive comparisons for class, module and process names.
+bool iequals(std::string_view a, std::string_view b);
+bool icontains(std::string_view haystack, std::string_view needle);
+
+} // namespace lvt
@@ -0,0 +1,1313 @@
+// Micro-benchmarks for the portable core. Not part of ctest; run
+//   lvt_benchmarks [name-filter]
+// and compare the numbers before and after a change. Heap allocations and
+// live heap bytes are tracked by replacing the global operator new.
+
+#include "delta_stream.h"
+#include "element.h"
+#include "element_index.h"
+#include "fake_window_system.h"
+#include "hash.h"
+#include "image.h"
+#include "ipc.h"
+#include "framework_detector.h"
+#include "json_serializer.h"
+#include "plugin_graft.h"
+#include "recording.h"
+#include "rpc_server.h"
+#include "snapshot.h"
+#include "stable_ids.h"
+#include "synthetic_tree.h"
+#include "tap/tap_tree.h"
+#include "text_scan.h"
+#include "thread_pool.h"
+#include "tree_diff.h"
+#include "tree_builder.h"
+#include "window_search.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::atomic<size_t> g_allocCount{0};
+static std::atomic<size_t> g_liveBytes{0};
+static std::atomic<size_t> g_peakBytes{0};
+
+// Each block carries its size in a header so delete can update g_liveBytes.
+static constexpr size_t kAllocHeader = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+void* operator new(size_t size) {
+    g_allocCount.fetch_add(1, std::memory_order_relaxed);
+    size_t live = g_liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    size_t peak = g_peakBytes.load(std::memory_order_relaxed);
+    while (live > peak && !g_peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+    if (auto* p = static_cast<unsigned char*>(std::malloc(size + kAllocHeader))) {
+        *reinterpret_cast<size_t*>(p) = size;
+        return p + kAllocHeader;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept {
+    if (!p) return;
+    auto* base = static_cast<unsigned char*>(p) - kAllocHeader;
+    g_liveBytes.fetch_sub(*reinterpret_cast<size_t*>(base), std::memory_order_relaxed);
+    std::free(base);
+}
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+
+using namespace lvt;
+using namespace lvt::testing;
+
+namespace {
+
+using BenchFn = void (*)();
+struct BenchEntry {
+    const char* name;
+    BenchFn fn;
+};
+
+std::vector<BenchEntry>& registry() {
+    static std::vector<BenchEntry> entries;
+    return entries;
+}
+
+struct BenchRegistrar {
+    BenchRegistrar(const char* name, BenchFn fn) { registry().push_back({name, fn}); }
+};
+
+#define LVT_BENCH(name)                                              \
+    static void bench_##name();                                      \
+    static BenchRegistrar s_reg_##name(#name, &bench_##name);        \
+    static void bench_##name()
+
+// Runs `fn` once and prints wall time, heap allocations per item and how far
+// the live heap peaked above where it started.
+template <class F>
+void measure(const char* label, size_t items, F&& fn) {
+    size_t allocs0 = g_allocCount.load();
+    size_t live0 = g_liveBytes.load();
+    g_peakBytes.store(live0);
+    auto t0 = std::chrono::steady_clock::now();
+    fn();
+    auto t1 = std::chrono::steady_clock::now();
+    size_t allocs = g_allocCount.load() - allocs0;
+    double peakMiB = static_cast<double>(g_peakBytes.load() - live0) / (1024.0 * 1024.0);
+    double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    printf("  %-44s %10.2f ms %9.1f ns/item %8.2f allocs/item %9.1f MiB peak\n",
+           label, ms, ms * 1e6 / static_cast<double>(items),
+           static_cast<double>(allocs) / static_cast<double>(items), peakMiB);
+}
+
+// The pre-ElementTree layout: every node owns its children by value.
+struct LegacyElement {
+    std::string id;
+    std::string type;
+    std::string framework;
+    std::string className;
+    std::string text;
+    Bounds bounds;
+    std::map<std::string, std::string> properties;
+    std::vector<LegacyElement> children;
+    uintptr_t nativeHandle = 0;
+};
+
+// Mirrors the old graft_json_node: build the node on the stack, recurse, then
+// move it into the parent's vector.
+void legacy_graft(LegacyElement& parent, const std::vector<uint32_t>& shape, size_t& cursor,
+                  SynthRng& rng) {
+    LegacyElement el;
+    Element fields;
+    fill_synthetic_element(fields, rng, cursor);
+    el.type = fields.type.str();
+    el.framework = fields.framework.str();
+    el.className = fields.className.str();
+    el.text = fields.text;
+    el.bounds = fields.bounds;
+    uint32_t kids = shape[cursor++];
+    for (uint32_t i = 0; i < kids; i++) legacy_graft(el, shape, cursor, rng);
+    parent.children.push_back(std::move(el));
+}
+
+void legacy_assign_ids(LegacyElement& el, int& counter) {
+    el.id = "e" + std::to_string(counter++);
+    for (auto& child : el.children) legacy_assign_ids(child, counter);
+}
+
+size_t legacy_count_text(const LegacyElement& el) {
+    size_t n = el.text.size() + el.type.size();
+    for (auto& child : el.children) n += legacy_count_text(child);
+    return n;
+}
+
+} // namespace
+
+LVT_BENCH(element_tree_vs_legacy) {
+    constexpr size_t kNodes = 200000;
+    auto shape = make_synthetic_shape(kNodes);
+    printf("  %zu nodes\n", shape.size());
+
+    {
+        LegacyElement holder;
+        measure("legacy: graft (vector<Element> children)", shape.size(), [&] {
+            SynthRng rng(1 ^ 0x9E3779B97F4A7C15ull);
+            size_t cursor = 0;
+            legacy_graft(holder, shape, cursor, rng);
+        });
+        int counter = 0;
+        measure("legacy: assign ids", shape.size(), [&] { legacy_assign_ids(holder, counter); });
+        size_t total = 0;
+        measure("legacy: full traversal", shape.size(), [&] { total = legacy_count_text(holder); });
+        measure("legacy: destroy", shape.size(), [&] { holder.children.clear(); });
+        if (total == 0) printf("  (empty)\n");
+    }
+
+    {
+        ElementTree tree;
+        measure("arena: graft (ElementTree)", shape.size(), [&] {
+            tree = make_synthetic_tree(kNodes);
+        });
+        measure("arena: assign ids", tree.size(), [&] { assign_element_ids(tree); });
+        measure("arena: assign stable ids", tree.size(), [&] { assign_stable_ids(tree); });
+        size_t total = 0;
+        measure("arena: full traversal", tree.size(), [&] {
+            for (NodeId n = tree.root(); n != kNoNode; n = tree.next_preorder(n, tree.root()))
+                total += tree[n].text.size() + tree[n].type.size();
+        });
+        size_t nodes = tree.size();
+        measure("arena: destroy", nodes, [&] { tree.clear(); });
+
+        tree = make_synthetic_tree(kNodes);
+        assign_element_ids(tree);
+        measure("arena: serialize_to_json", nodes, [&] {
+            total += serialize_to_json(tree, tree.root(), nullptr, 0, "bench.exe", {"winui3"}).size();
+        });
+        if (total == 0) printf("  (empty)\n");
+    }
+}
+
+// Resident heap for a large XAML-like tree: legacy per-node std::strings vs
+// the arena tree with interned type/framework/className.
+LVT_BENCH(element_memory_500k) {
+    constexpr size_t kNodes = 500000;
+    auto shape = make_synthetic_shape(kNodes);
+    auto mib = [](size_t bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); };
+    printf("  %zu nodes, sizeof(Element) = %zu, sizeof(LegacyElement) = %zu\n",
+           shape.size(), sizeof(Element), sizeof(LegacyElement));
+
+    {
+        size_t base = g_liveBytes.load();
+        LegacyElement holder;
+        SynthRng rng(1 ^ 0x9E3779B97F4A7C15ull);
+        size_t cursor = 0;
+        legacy_graft(holder, shape, cursor, rng);
+        holder.children.shrink_to_fit();
+        size_t live = g_liveBytes.load() - base;
+        printf("  %-44s %10.1f MiB %9.1f bytes/node\n", "legacy: live heap",
+               mib(live), static_cast<double>(live) / static_cast<double>(shape.size()));
+    }
+    {
+        size_t base = g_liveBytes.load();
+        ElementTree tree = make_synthetic_tree(kNodes);
+        size_t live = g_liveBytes.load() - base;
+        printf("  %-44s %10.1f MiB %9.1f bytes/node\n", "arena + symbols: live heap",
+               mib(live), static_cast<double>(live) / static_cast<double>(tree.size()));
+        printf("  %-44s %10zu symbols, %.1f KiB\n", "symbol pool (process-wide)",
+               Symbol::pool_size(), static_cast<double>(Symbol::pool_bytes()) / 1024.0);
+    }
+}
+
+// The four properties Win32Provider attaches to every window.
+LVT_BENCH(win32_properties) {
+    constexpr size_t kNodes = 200000;
+    printf("  %zu nodes x 4 properties\n", kNodes);
+
+    {
+        std::vector<std::map<std::string, std::string>> nodes(kNodes);
+        measure("legacy: map<string,string>", kNodes, [&] {
+            for (size_t i = 0; i < kNodes; i++) {
+                auto& props = nodes[i];
+                props["style"] = "WS_CHILD WS_VISIBLE";
+                props["visible"] = (i & 1) ? "true" : "false";
+                props["enabled"] = "true";
+                char buf[32];
+                snprintf(buf, sizeof(buf), "0x%016llX", static_cast<unsigned long long>(0x10000 + i));
+                props["hwnd"] = buf;
+            }
+        });
+        size_t total = 0;
+        measure("legacy: read hwnd", kNodes, [&] {
+            for (auto& props : nodes) total += props.find("hwnd")->second.size();
+        });
+        measure("legacy: destroy", kNodes, [&] { nodes.clear(); });
+        if (total == 0) printf("  (empty)\n");
+    }
+    {
+        std::vector<PropertyList> nodes(kNodes);
+        measure("typed: PropertyList", kNodes, [&] {
+            for (size_t i = 0; i < kNodes; i++) {
+                auto& props = nodes[i];
+                props.reserve(4);
+                props.set(prop::kStyle, "WS_CHILD WS_VISIBLE");
+                props.set(prop::kVisible, (i & 1) != 0);
+                props.set(prop::kEnabled, true);
+                props.set(prop::kHwnd, HandleValue{0x10000 + i});
+            }
+        });
+        size_t total = 0;
+        measure("typed: read hwnd", kNodes, [&] {
+            for (auto& props : nodes) total += props.find(prop::kHwnd) != nullptr;
+        });
+        measure("typed: destroy", kNodes, [&] { nodes.clear(); });
+        if (total == 0) printf("  (empty)\n");
+    }
+}
+
+// Plugin host lookup: the old per-root DFS vs the ElementIndex used by
+// graft_plugin_tree (which includes the one-off index build). DFS cost per
+// root is O(nodes); indexed cost per root stays flat as roots grow.
+LVT_BENCH(plugin_graft_scaling) {
+    constexpr size_t kNodes = 100000;
+    ElementTree base = make_synthetic_tree(kNodes);
+    for (size_t i = 0; i < base.size(); i++) {
+        base[static_cast<NodeId>(i)].properties.set(prop::kHwnd, HandleValue{0x10000 + i * 4});
+    }
+    printf("  %zu-node tree\n", base.size());
+
+    for (size_t roots : {500, 1000, 2000, 4000}) {
+        std::vector<uint64_t> targets;
+        nlohmann::json j = nlohmann::json::array();
+        for (size_t r = 0; r < roots; r++) {
+            size_t host = (r * 7919) % kNodes;
+            char buf[32];
+            snprintf(buf, sizeof(buf), "0x%016llX", static_cast<unsigned long long>(0x10000 + host * 4));
+            targets.push_back(0x10000 + host * 4);
+            j.push_back({{"target_hwnd", buf}, {"type", "Plugin.Root"}});
+        }
+
+        char label[64];
+        snprintf(label, sizeof(label), "dfs lookup only, %zu roots", roots);
+        size_t found = 0;
+        measure(label, roots, [&] {
+            for (auto& t : targets) {
+                for (NodeId n = base.root(); n != kNoNode; n = base.next_preorder(n, base.root())) {
+                    // Cheapest possible per-node test: compare the stored handle.
+                    auto* v = base[n].properties.find(prop::kHwnd);
+                    auto* h = v ? std::get_if<HandleValue>(&v->storage()) : nullptr;
+                    if (h && h->value == t) { found++; break; }
+                }
+            }
+        });
+
+        ElementTree tree = base;
+        ElementIndex index;
+        snprintf(label, sizeof(label), "indexed graft_plugin_tree, %zu roots", roots);
+        measure(label, roots, [&] { graft_plugin_tree(tree, tree.root(), j, "mock", index); });
+        if (found != roots) printf("  (dfs missed %zu)\n", roots - found);
+    }
+}
+
+// Discards output; stands in for a file or pipe without measuring disk I/O.
+class NullSink final : public OutputSink {
+public:
+    size_t bytes = 0;
+    ~NullSink() override { flush(); }
+
+protected:
+    bool write_raw(const char*, size_t size) override {
+        bytes += size;
+        return true;
+    }
+};
+
+// The nlohmann DOM + dump(2) serializer that write_json replaced.
+static nlohmann::json legacy_element_json(const ElementTree& tree, NodeId node) {
+    const Element& el = tree[node];
+    nlohmann::json j;
+    j["id"] = el.id;
+    j["type"] = el.type.str();
+    j["framework"] = el.framework.str();
+    if (!el.className.empty()) j["className"] = el.className.str();
+    if (!el.text.empty()) j["text"] = el.text;
+    j["bounds"] = nlohmann::json{{"x", el.bounds.x}, {"y", el.bounds.y},
+                                 {"width", el.bounds.width}, {"height", el.bounds.height}};
+    if (!el.properties.empty()) {
+        nlohmann::json props = nlohmann::json::object();
+        for (auto& [k, v] : el.properties) props[k.str()] = v.to_string();
+        j["properties"] = std::move(props);
+    }
+    if (tree.has_children(node)) {
+        nlohmann::json kids = nlohmann::json::array();
+        for (NodeId c : tree.children(node)) kids.push_back(legacy_element_json(tree, c));
+        j["children"] = std::move(kids);
+    }
+    return j;
+}
+
+LVT_BENCH(json_emit_1m) {
+    constexpr size_t kNodes = 1000000;
+    ElementTree tree = make_synthetic_tree(kNodes);
+    for (size_t i = 0; i < tree.size(); i += 2) {
+        auto& props = tree[static_cast<NodeId>(i)].properties;
+        props.set(prop::kVisible, true);
+        props.set(prop::kHwnd, HandleValue{0x10000 + i});
+    }
+    assign_element_ids(tree);
+    printf("  %zu nodes\n", tree.size());
+
+    size_t domBytes = 0;
+    measure("nlohmann DOM + dump(2) to string", tree.size(), [&] {
+        nlohmann::json output;
+        output["frameworks"] = std::vector<std::string>{"winui3"};
+        output["root"] = legacy_element_json(tree, tree.root());
+        domBytes = output.dump(2).size();
+    });
+    size_t stringBytes = 0;
+    measure("write_json to StringSink", tree.size(), [&] {
+        stringBytes = serialize_to_json(tree, tree.root(), nullptr, 0, "bench.exe", {"winui3"}).size();
+    });
+    NullSink sink;
+    measure("write_json to streaming sink", tree.size(), [&] {
+        write_json(sink, tree, tree.root(), nullptr, 0, "bench.exe", {"winui3"});
+        sink.flush();
+    });
+    printf("  output: %.1f MiB (dom %.1f MiB)\n", static_cast<double>(stringBytes) / (1024.0 * 1024.0),
+           static_cast<double>(domBytes) / (1024.0 * 1024.0));
+}
+
+// The ostringstream serializer that write_xml replaced: one escaped temporary
+// per attribute and a fresh padding string per element.
+static std::string legacy_xml_escape(const std::string& s) {
+    std::string r;
+    r.reserve(s.size());
+    for (char c : s) {
+        switch (c) {
+        case '&':  r += "&amp;";  break;
+        case '<':  r += "&lt;";   break;
+        case '>':  r += "&gt;";   break;
+        case '"':  r += "&quot;"; break;
+        case '\'': r += "&apos;"; break;
+        default:
+            if (static_cast<unsigned char>(c) >= 0x20) r += c;
+        }
+    }
+    return r;
+}
+
+static void legacy_element_xml(const ElementTree& tree, NodeId node, std::ostringstream& out, int indent) {
+    const Element& el = tree[node];
+    std::string pad(indent * 2, ' ');
+    const std::string& tag = el.type.str();
+    out << pad << "<" << tag;
+    out << " id=\"" << legacy_xml_escape(el.id) << "\"";
+    out << " framework=\"" << legacy_xml_escape(el.framework.str()) << "\"";
+    if (!el.className.empty() && el.className != el.type)
+        out << " className=\"" << legacy_xml_escape(el.className.str()) << "\"";
+    if (!el.text.empty()) out << " text=\"" << legacy_xml_escape(el.text) << "\"";
+    if (el.bounds.width > 0 || el.bounds.height > 0)
+        out << " bounds=\"" << el.bounds.x << "," << el.bounds.y
+            << "," << el.bounds.width << "," << el.bounds.height << "\"";
+    for (auto& [k, v] : el.properties)
+        out << " " << k.str() << "=\"" << legacy_xml_escape(v.to_string()) << "\"";
+    if (!tree.has_children(node)) {
+        out << " />\n";
+    } else {
+        out << ">\n";
+        for (NodeId c : tree.children(node)) legacy_element_xml(tree, c, out, indent + 1);
+        out << pad << "</" << tag << ">\n";
+    }
+}
+
+LVT_BENCH(xml_emit_1m) {
+    constexpr size_t kNodes = 1000000;
+    ElementTree tree = make_synthetic_tree(kNodes);
+    for (size_t i = 0; i < tree.size(); i += 2) {
+        auto& props = tree[static_cast<NodeId>(i)].properties;
+        props.set(prop::kVisible, true);
+        props.set(prop::kHwnd, HandleValue{0x10000 + i});
+    }
+    assign_element_ids(tree);
+    printf("  %zu nodes\n", tree.size());
+
+    size_t legacyBytes = 0;
+    measure("ostringstream recursive emitter", tree.size(), [&] {
+        std::ostringstream out;
+        legacy_element_xml(tree, tree.root(), out, 1);
+        legacyBytes = out.str().size();
+    });
+    size_t stringBytes = 0;
+    measure("write_xml to StringSink", tree.size(), [&] {
+        stringBytes = serialize_to_xml(tree, tree.root(), nullptr, 0, "bench.exe", {"winui3"}).size();
+    });
+    NullSink sink;
+    measure("write_xml to streaming sink", tree.size(), [&] {
+        write_xml(sink, tree, tree.root(), nullptr, 0, "bench.exe", {"winui3"});
+        sink.flush();
+    });
+    printf("  output: %.1f MiB (legacy %.1f MiB)\n", static_cast<double>(stringBytes) / (1024.0 * 1024.0),
+           static_cast<double>(legacyBytes) / (1024.0 * 1024.0));
+}
+
+// The per-byte sanitize loop the grafters used before text::sanitize.
+static std::string legacy_sanitize(const std::string& s) {
+    std::string r;
+    r.reserve(s.size());
+    for (char c : s) {
+        if (static_cast<unsigned char>(c) >= 0x20 || c == '\t') r += c;
+    }
+    return r;
+}
+
+// Strings of the kind TAPs and providers actually report: XAML/WPF type
+// names, window classes and titles, control labels, paths and non-ASCII text.
+static const char* const kUiText[] = {
+    "Microsoft.UI.Xaml.Controls.Grid",
+    "Microsoft.UI.Xaml.Controls.Primitives.ScrollContentPresenter",
+    "Windows.UI.Xaml.Controls.TextBlock",
+    "System.Windows.Controls.Border",
+    "Avalonia.Controls.Presenters.ContentPresenter",
+    "DesktopChildSiteBridge",
+    "Microsoft.UI.Content.DesktopChildSiteBridge",
+    "SysListView32",
+    "Untitled - Notepad",
+    "C:\\Users\\someone\\Documents\\Quarterly report (final) v2.docx - Word",
+    "OK",
+    "Cancel",
+    "Minimize",
+    "Search the web and Windows",
+    "Ln 12, Col 48",
+    "100%",
+    "Windows (CRLF)",
+    "UTF-8",
+    "Caf\xC3\xA9 cr\xC3\xA8me br\xC3\xBBl\xC3\xA9""e",
+    "\xE8\xA8\xAD\xE5\xAE\x9A",  // Settings (Japanese)
+    "Back\t(Alt+Left Arrow)",
+    "Type here to search",
+    "NavigationViewItem",
+    "This PC > Local Disk (C:) > Program Files",
+};
+
+static std::vector<std::string> text_corpus(const char* kind, size_t totalBytes) {
+    std::vector<std::string> out;
+    size_t bytes = 0;
+    size_t i = 0;
+    while (bytes < totalBytes) {
+        std::string s;
+        if (strcmp(kind, "ui") == 0) {
+            s = kUiText[i % (sizeof(kUiText) / sizeof(kUiText[0]))];
+        } else if (strcmp(kind, "long-clean") == 0) {
+            s.assign(4096, 'a' + static_cast<char>(i % 26));
+        } else if (strcmp(kind, "long-dirty-tail") == 0) {
+            s.assign(4096, 'a');
+            s.back() = '\x01';
+        } else if (strcmp(kind, "every-8th-control") == 0) {
+            s.assign(256, 'b');
+            for (size_t k = 7; k < s.size(); k += 8) s[k] = '\x1f';
+        } else {  // all-control
+            s.assign(256, '\x02');
+        }
+        bytes += s.size();
+        out.push_back(std::move(s));
+        i++;
+    }
+    return out;
+}
+
+LVT_BENCH(text_scan) {
+    constexpr size_t kBytes = 64 * 1024 * 1024;
+    for (const char* kind : {"ui", "long-clean", "long-dirty-tail", "every-8th-control", "all-control"}) {
+        auto corpus = text_corpus(kind, kBytes);
+        size_t bytes = 0;
+        for (auto& s : corpus) bytes += s.size();
+        printf("  [%s] %zu strings, %.0f MiB (ns/item is per byte)\n", kind, corpus.size(),
+               static_cast<double>(bytes) / (1024.0 * 1024.0));
+
+        volatile size_t keep = 0;
+        measure("scan, scalar", bytes, [&] {
+            for (auto& s : corpus)
+                keep = keep + text::detail::find_special_scalar<text::kStopControl, '"', '\\'>(s.data(), s.size(), 0);
+        });
+        measure("scan, vector", bytes, [&] {
+            for (auto& s : corpus)
+                keep = keep + text::find_special<text::kStopControl, '"', '\\'>(s);
+        });
+        measure("sanitize, per-byte copy", bytes, [&] {
+            for (auto& s : corpus) keep = keep + legacy_sanitize(s).size();
+        });
+        measure("text::sanitize of a moved-in string", bytes, [&] {
+            for (auto& s : corpus) keep = keep + text::sanitize(std::move(s)).size();
+        });
+    }
+
+    // End to end: escaping is most of write_json/write_xml's per-byte work.
+    ElementTree tree = make_synthetic_tree(200000);
+    size_t i = 0;
+    for (NodeId n = tree.root(); n != kNoNode; n = tree.next_preorder(n, tree.root()))
+        tree[n].text = kUiText[i++ % (sizeof(kUiText) / sizeof(kUiText[0]))];
+    assign_element_ids(tree);
+    NullSink sink;
+    measure("write_json, 200k nodes of UI text", tree.size(), [&] {
+        write_json(sink, tree, tree.root(), nullptr, 0, "bench.exe", {"winui3"});
+        sink.flush();
+    });
+    measure("write_xml, 200k nodes of UI text", tree.size(), [&] {
+        write_xml(sink, tree, tree.root(), nullptr, 0, "bench.exe", {"winui3"});
+        sink.flush();
+    });
+}
+
+// The TAP's serializer before the UTF-8 writer: a std::wstring (UTF-16 on
+// Windows) per node, children concatenated into their parent's string
+// (every byte is copied once per ancestor), then converted to UTF-8 in one
+// more full pass.
+struct LegacyTapNode {
+    std::u16string type, name;
+    std::vector<tap::Handle> children;
+    double width = 0, height = 0, offsetX = 0, offsetY = 0;
+    bool hasBounds = false;
+};
+
+static void legacy_tap_escape(std::u16string& out, const std::u16string& s) {
+    size_t i = 0;
+    for (;;) {
+        size_t next = i + text::find_special<text::kStopControl, u'"', u'\\'>(s.data() + i, s.size() - i);
+        out.append(s, i, next - i);
+        if (next == s.size()) return;
+        char16_t c = s[next];
+        if (c == u'"') {
+            out += u"\\\"";
+        } else if (c == u'\\') {
+            out += u"\\\\";
+        } else {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04X", static_cast<unsigned>(c));
+            for (const char* p = buf; *p; p++) out += static_cast<char16_t>(*p);
+        }
+        i = next + 1;
+    }
+}
+
+static std::u16string legacy_tap_node(const std::map<tap::Handle, LegacyTapNode>& nodes, tap::Handle handle) {
+    auto it = nodes.find(handle);
+    if (it == nodes.end()) return u"null";
+    auto& n = it->second;
+    std::u16string j = u"{\"type\":\"";
+    legacy_tap_escape(j, n.type);
+    j += u"\"";
+    if (!n.name.empty()) {
+        j += u",\"name\":\"";
+        legacy_tap_escape(j, n.name);
+        j += u"\"";
+    }
+    j += u",\"handle\":";
+    for (char c : std::to_string(handle)) j += static_cast<char16_t>(c);
+    if (n.hasBounds) {
+        char buf[160];
+        snprintf(buf, sizeof(buf), ",\"width\":%.1f,\"height\":%.1f,\"offsetX\":%.1f,\"offsetY\":%.1f", n.width,
+                 n.height, n.offsetX, n.offsetY);
+        for (const char* p = buf; *p; p++) j += static_cast<char16_t>(*p);
+    }
+    if (!n.children.empty()) {
+        j += u",\"children\":[";
+        for (size_t i = 0; i < n.children.size(); i++) {
+            if (i) j += u",";
+            j += legacy_tap_node(nodes, n.children[i]);
+        }
+        j += u"]";
+    }
+    j += u"}";
+    return j;
+}
+
+// The same XAML-like tree in both layouts, from an ElementTree.
+static void tap_trees(const ElementTree& tree, tap::TreeModel& model, std::map<tap::Handle, LegacyTapNode>& legacy,
+                      std::vector<tap::Handle>& roots) {
+    for (NodeId n = tree.root(); n != kNoNode; n = tree.next_preorder(n, tree.root())) {
+        const Element& el = tree[n];
+        tap::Handle handle = 0x10000 + n, parent = tree.parent(n) == kNoNode ? 0 : 0x10000 + tree.parent(n);
+        uint32_t index = parent ? static_cast<uint32_t>(model.find(parent)->children.size()) : 0;
+        model.add(handle, parent, index, el.className.str(), el.text, static_cast<uint32_t>(tree.child_count(n)));
+        tap::Node& node = *model.find(handle);
+        node.hasBounds = true;
+        node.width = el.bounds.width;
+        node.height = el.bounds.height;
+        node.offsetX = el.bounds.x + 0.5;
+        node.offsetY = el.bounds.y;
+
+        LegacyTapNode& old = legacy[handle];
+        for (char c : node.type) old.type += static_cast<char16_t>(c);
+        for (char c : node.name) old.name += static_cast<char16_t>(c);
+        old.hasBounds = true;
+        old.width = node.width;
+        old.height = node.height;
+        old.offsetX = node.offsetX;
+        old.offsetY = node.offsetY;
+        if (parent)
+            legacy[parent].children.push_back(handle);
+        else
+            roots.push_back(handle);
+    }
+}
+
+// A root with chains of `depth` nested elements, `count` nodes in all.
+static ElementTree deep_tree(size_t count, size_t depth) {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root].className = "Microsoft.UI.Xaml.Controls.Grid";
+    NodeId parent = root;
+    for (size_t i = 1; i < count; i++) {
+        if ((i - 1) % depth == 0) parent = root;
+        parent = tree.append_child(parent);
+        tree[parent].className = "Microsoft.UI.Xaml.Controls.Border";
+        tree[parent].bounds = {static_cast<int>(i % 1920), 0, 100, 20};
+    }
+    return tree;
+}
+
+LVT_BENCH(tap_serialize_200k) {
+    constexpr size_t kNodes = 200000;
+    for (auto& [label, tree] : {std::pair<const char*, ElementTree>{"synthetic", make_synthetic_tree(kNodes)},
+                                std::pair<const char*, ElementTree>{"500-deep chains", deep_tree(kNodes, 500)}}) {
+        tap::TreeModel model;
+        std::map<tap::Handle, LegacyTapNode> legacy;
+        std::vector<tap::Handle> roots;
+        tap_trees(tree, model, legacy, roots);
+        printf("  [%s] %zu nodes\n", label, model.size());
+
+        size_t legacyBytes = 0;
+        measure("legacy: wstring per node + UTF-8 pass", kNodes, [&] {
+            std::u16string wide = u"[";
+            for (size_t i = 0; i < roots.size(); i++) {
+                if (i) wide += u",";
+                wide += legacy_tap_node(legacy, roots[i]);
+            }
+            wide += u"]";
+            std::string utf8;
+            tap::append_utf8(utf8, wide.data(), wide.size());
+            legacyBytes = utf8.size();
+        });
+        size_t bytes = 0;
+        measure("tap::write_tree into one buffer", kNodes, [&] {
+            std::string out;
+            tap::write_tree(out, model);
+            bytes = out.size();
+        });
+        measure("tap::write_tree in 64 KiB chunks", kNodes, [&] {
+            std::string buffer;
+            size_t streamed = 0;
+            tap::JsonBuffer out(buffer, [&](std::string_view piece) {
+                streamed += piece.size();
+                return true;
+            });
+            tap::write_tree(out, model);
+            out.finish();
+            if (streamed != bytes) abort();
+        });
+        if (bytes != legacyBytes) abort();
+        printf("  output: %.1f MiB\n", static_cast<double>(bytes) / (1024.0 * 1024.0));
+    }
+}
+
+// What GetPropertyValuesChain hands back for one element: every property of
+// its type, with values from several sources.
+struct FakeChainEntry {
+    uint32_t index;
+    std::wstring name, declaringType, value;
+    bool overridden;
+};
+
+static std::vector<FakeChainEntry> fake_property_chain(int type) {
+    std::vector<FakeChainEntry> chain;
+    std::wstring owner = L"Microsoft.UI.Xaml.Controls.Type" + std::to_wstring(type);
+    for (uint32_t k = 0; k < 140; k++)
+        chain.push_back({k, L"Property" + std::to_wstring(k), owner, L"value " + std::to_wstring(k), k % 7 == 0});
+    chain.push_back({200, L"ActualWidth", L"Microsoft.UI.Xaml.FrameworkElement", L"120.5", false});
+    chain.push_back({201, L"ActualHeight", L"Microsoft.UI.Xaml.FrameworkElement", L"32", false});
+    chain.push_back({202, L"ActualOffset", L"Microsoft.UI.Xaml.UIElement", L"<4, 8, 0>", false});
+    chain.push_back({210, L"Text", owner, L"Hello", false});
+    chain.push_back({211, L"IsEnabled", L"Microsoft.UI.Xaml.Controls.Control", L"True", false});
+    chain.push_back({212, L"Visibility", L"Microsoft.UI.Xaml.UIElement", L"Visible", false});
+    chain.push_back({213, L"Name", L"Microsoft.UI.Xaml.Automation.AutomationProperties", L"Greeting", false});
+    return chain;
+}
+
+LVT_BENCH(tap_property_chain_100k) {
+    constexpr size_t kElements = 100000;
+    constexpr int kTypes = 40;
+    std::vector<std::vector<FakeChainEntry>> chains;
+    std::vector<std::string> typeNames;
+    for (int t = 0; t < kTypes; t++) {
+        chains.push_back(fake_property_chain(t));
+        typeNames.push_back("Microsoft.UI.Xaml.Controls.Type" + std::to_string(t));
+    }
+    printf("  %zu elements of %d types, %zu properties each\n", kElements, kTypes, chains[0].size());
+
+    // The TAP before: two std::wstring copies and three compares per entry,
+    // layout only.
+    double sink = 0;
+    measure("legacy: wstring compare per property", kElements, [&] {
+        for (size_t e = 0; e < kElements; e++) {
+            tap::NodeData data;
+            bool hasWidth = false, hasHeight = false;
+            for (const FakeChainEntry& p : chains[e % kTypes]) {
+                std::wstring name = p.name;
+                std::wstring value = p.value;
+                if (name == L"ActualWidth" && !value.empty()) {
+                    data.width = wcstod(value.c_str(), nullptr);
+                    hasWidth = true;
+                } else if (name == L"ActualHeight" && !value.empty()) {
+                    data.height = wcstod(value.c_str(), nullptr);
+                    hasHeight = true;
+                } else if (name == L"ActualOffset" && !value.empty()) {
+                    data.offsetX = wcstod(value.c_str() + 1, nullptr);
+                }
+            }
+            data.hasBounds = hasWidth && hasHeight;
+            sink += data.width + data.offsetX;
+        }
+    });
+    for (const std::vector<std::string>& names : {std::vector<std::string>{}, tap::default_properties()}) {
+        tap::PropertySelection selection(names);
+        size_t properties = 0;
+        std::string label = "PropertySelection, " + std::to_string(names.size()) + " names asked for";
+        measure(label.c_str(), kElements, [&] {
+            for (size_t e = 0; e < kElements; e++) {
+                tap::NodeData data;
+                auto reader = selection.read(typeNames[e % kTypes], data);
+                for (const FakeChainEntry& p : chains[e % kTypes])
+                    reader.add(p.index, p.name.c_str(), p.declaringType.c_str(), p.value.c_str(), p.overridden);
+                reader.finish();
+                sink += data.width + data.offsetX;
+                properties += data.properties.size();
+            }
+        });
+        printf("  %zu name lookups, %zu properties kept\n", selection.lookups(), properties);
+    }
+    if (sink == 0) abort();
+}
+
+LVT_BENCH(snapshot_1m) {
+    constexpr size_t kNodes = 1000000;
+    ElementTree tree = make_synthetic_tree(kNodes);
+    for (size_t i = 0; i < tree.size(); i += 2) {
+        auto& props = tree[static_cast<NodeId>(i)].properties;
+        props.set(prop::kVisible, true);
+        props.set(prop::kHwnd, HandleValue{0x10000 + i});
+    }
+    assign_element_ids(tree);
+    printf("  %zu nodes\n", tree.size());
+
+    std::string json = serialize_to_json(tree, tree.root(), nullptr, 0, "bench.exe", {"winui3"});
+    measure("reload: nlohmann::json::parse", tree.size(), [&] {
+        auto doc = nlohmann::json::parse(json);
+        (void)doc;
+    });
+    json = {};
+
+    NullSink null;
+    measure("write_snapshot to streaming sink", tree.size(), [&] {
+        write_snapshot(null, tree, tree.root(), nullptr, 0, "bench.exe", {"winui3"});
+        null.flush();
+    });
+    std::string bytes;
+    {
+        StringSink sink(bytes);
+        write_snapshot(sink, tree, tree.root(), nullptr, 0, "bench.exe", {"winui3"});
+    }
+    // Mappings are page-aligned; copy into aligned storage to match.
+    std::vector<uint64_t> image((bytes.size() + 7) / 8);
+    std::memcpy(image.data(), bytes.data(), bytes.size());
+    printf("  snapshot: %.1f MiB (%.0f bytes/node)\n", static_cast<double>(bytes.size()) / (1024.0 * 1024.0),
+           static_cast<double>(bytes.size()) / static_cast<double>(tree.size()));
+
+    SnapshotView view;
+    measure("SnapshotView::open (validate)", tree.size(), [&] {
+        if (!view.open(image.data(), bytes.size())) abort();
+    });
+    volatile size_t keep = 0;
+    measure("walk in place, read id/type/props", tree.size(), [&] {
+        size_t total = 0;
+        for (NodeId n = view.root(); n != kNoNode; n = view.next_preorder(n, view.root())) {
+            SnapshotNode node = view.node(n);
+            total += node.id().size() + node.type().size() + node.property_count();
+        }
+        keep = total;
+    });
+    measure("to_tree (materialize ElementTree)", tree.size(), [&] {
+        ElementTree loaded = view.to_tree();
+        keep = loaded.size();
+    });
+}
+
+// Subtree hashes on a 1M-node tree: what they add to ID assignment, and what
+// "did the UI change?" costs with and without them.
+LVT_BENCH(subtree_hash_1m) {
+    constexpr size_t kNodes = 1000000;
+    ElementTree tree = make_synthetic_tree(kNodes);
+    for (size_t i = 0; i < tree.size(); i += 2) {
+        auto& props = tree[static_cast<NodeId>(i)].properties;
+        props.set(prop::kVisible, true);
+        props.set(prop::kHwnd, HandleValue{0x10000 + i});
+    }
+    printf("  %zu nodes\n", tree.size());
+
+    measure("assign_element_ids (ids + hashes)", tree.size(), [&] { assign_element_ids(tree); });
+    measure("hash_subtrees", tree.size(), [&] { hash_subtrees(tree); });
+    volatile uint64_t keep = 0;
+    size_t textBytes = 0;
+    measure("hash::bytes over every text", tree.size(), [&] {
+        uint64_t h = 0;
+        for (NodeId n = 0; n < tree.size(); n++) {
+            h += hash::bytes(tree[n].text);
+            textBytes += tree[n].text.size();
+        }
+        keep = h;
+    });
+    printf("  text: %.1f MiB\n", static_cast<double>(textBytes) / (1024.0 * 1024.0));
+
+    ElementTree copy = tree;
+    copy[static_cast<NodeId>(copy.size() - 1)].text += "!";
+    bool same = true;
+    measure("changed? field-by-field walk of two trees", tree.size(), [&] {
+        NodeId a = tree.root(), b = copy.root();
+        for (; a != kNoNode && b != kNoNode && same;
+             a = tree.next_preorder(a, tree.root()), b = copy.next_preorder(b, copy.root())) {
+            const Element& x = tree[a];
+            const Element& y = copy[b];
+            same = x.type == y.type && x.framework == y.framework && x.className == y.className &&
+                   x.text == y.text && x.nativeHandle == y.nativeHandle &&
+                   tree.child_count(a) == copy.child_count(b) &&
+                   x.properties.size() == y.properties.size();
+        }
+    });
+    measure("changed? rehash, compare root hashes", tree.size(), [&] {
+        hash_subtrees(copy);
+        same = copy[copy.root()].hash == tree[tree.root()].hash;
+    });
+    if (same) printf("  (change missed)\n");
+}
+
+// Copy of `tree` with every `stride`-th node edited: its text changed, its
+// subtree dropped, or a new leaf inserted before it, in turn.
+static ElementTree edited_every(const ElementTree& tree, size_t stride) {
+    ElementTree out;
+    std::vector<NodeId> map(tree.size(), kNoNode);
+    NodeId root = tree.root();
+    for (NodeId n = root; n != kNoNode;) {
+        NodeId parent = n == root ? kNoNode : map[tree.parent(n)];
+        size_t edit = n % stride == stride - 1 ? (n / stride) % 3 : 3;
+        if (edit == 1 && parent != kNoNode) {
+            NodeId up = n;
+            while (up != root && tree.next_sibling(up) == kNoNode) up = tree.parent(up);
+            n = up == root ? kNoNode : tree.next_sibling(up);
+            continue;
+        }
+        if (edit == 2 && parent != kNoNode) out.append_child(parent, {.type = "Inserted", .framework = "winui3"});
+        map[n] = parent == kNoNode ? out.add_root(tree[n]) : out.append_child(parent, tree[n]);
+        if (edit == 0) out[map[n]].text += " (edited)";
+        n = tree.next_preorder(n, root);
+    }
+    return out;
+}
+
+LVT_BENCH(tree_diff_500k) {
+    constexpr size_t kNodes = 500000;
+    TreeDocument before, after;
+    before.tree = make_synthetic_tree(kNodes);
+    printf("  %zu nodes\n", before.tree.size());
+
+    // Ordinal IDs shift after the first insertion or removal, so every later
+    // node gets an ID update; stable IDs are what a diff is meant for.
+    auto run = [&](const char* label, ElementTree tree, bool stable = true) {
+        after.tree = std::move(tree);
+        if (stable) {
+            assign_stable_ids(before.tree);
+            assign_stable_ids(after.tree, nullptr, &before.tree);
+            hash_subtrees(before.tree);
+            hash_subtrees(after.tree);
+        } else {
+            assign_element_ids(before.tree);
+            assign_element_ids(after.tree);
+        }
+        TreeDiff diff;
+        char line[96];
+        snprintf(line, sizeof(line), "diff_trees: %s", label);
+        measure(line, before.tree.size(), [&] { diff = diff_trees(before.tree, after.tree); });
+        std::string patch;
+        snprintf(line, sizeof(line), "write_json_patch: %s", label);
+        measure(line, before.tree.size(), [&] {
+            StringSink sink(patch);
+            write_json_patch(sink, before, after, diff);
+        });
+        printf("  %zu ops, %zu identical nodes, %.1f KiB patch\n", diff.ops.size(), diff.identical,
+               static_cast<double>(patch.size()) / 1024.0);
+    };
+    run("identical", before.tree);
+    run("every 5000th node edited", edited_every(before.tree, 5000));
+    run("every 50th node edited", edited_every(before.tree, 50));
+    run("every 5000th, ordinal IDs", edited_every(before.tree, 5000), false);
+
+    std::string full;
+    measure("baseline: serialize_to_json of the new tree", before.tree.size(), [&] {
+        full = serialize_to_json(after.tree, after.tree.root(), nullptr, 0, "bench.exe", {"winui3"});
+    });
+    printf("  %.1f MiB JSON\n", static_cast<double>(full.size()) / (1024.0 * 1024.0));
+}
+
+// --watch output per tick on a 500k-node UI: the first capture in full, then
+// a static tick and ticks with a few changes.
+LVT_BENCH(watch_ticks_500k) {
+    constexpr size_t kNodes = 500000;
+    ElementTree base = make_synthetic_tree(kNodes);
+    std::string out;
+    StringSink sink(out);
+    DeltaStream stream(sink);
+    auto tick = [&](const char* label, ElementTree tree) {
+        TreeDocument doc;
+        doc.tree = std::move(tree);
+        doc.processName = "bench.exe";
+        doc.frameworks = {"winui3"};
+        assign_stable_ids(doc.tree, nullptr, stream.lines() ? &stream.current().tree : nullptr);
+        hash_subtrees(doc.tree);
+        size_t before = out.size();
+        measure(label, kNodes, [&] { stream.push(std::move(doc)); });
+        printf("  %zu bytes written\n", out.size() - before);
+    };
+    tick("first capture (whole tree)", base);
+    tick("unchanged", base);
+    tick("every 50000th node edited", edited_every(base, 50000));
+    tick("unchanged again", edited_every(base, 50000));
+}
+
+// `lvt serve` against a cold run per request, on a modeled desktop: 2000
+// top-level windows of other processes plus a 20k-window target, at 2 us per
+// window system call and 50 ns per enumerated window (as above). A cold run
+// here is a fresh RpcServer per request; process start-up, plugin loading
+// and TAP injection, which a live cold run also pays, are Windows-only and
+// not modeled.
+LVT_BENCH(server_latency) {
+    constexpr size_t kRequests = 10;
+    FakeWindowSystem ws;
+    for (DWORD pid = 1; pid <= 200; pid++) ws.set_process(pid, "app" + std::to_string(pid) + ".exe");
+    auto tops = make_window_forest(ws, 1, 20000, 2000);
+    for (size_t i = 0; i < tops.size(); i++) ws.at(tops[i]).pid = static_cast<DWORD>(i % 200 + 1);
+    ws.set_process(500, "target.exe");
+    ws.add_module(500, "COMCTL32.DLL", "6.10.26100.1");
+    make_window_forest(ws, 500, 20000, 1, 5);
+    ws.latency = std::chrono::microseconds(2);
+    ws.enumLatency = std::chrono::nanoseconds(50);
+    FakeServerBackend backend(ws);
+
+    const std::string dump = R"({"jsonrpc":"2.0","id":1,"method":"dump","params":{"name":"target.exe"}})";
+    const std::string query =
+        R"({"jsonrpc":"2.0","id":2,"method":"query","params":{"name":"target.exe","type":"Button","limit":10}})";
+    auto run = [&](const char* label, auto&& request) {
+        ws.calls = {};
+        measure(label, kRequests, [&] {
+            for (size_t i = 0; i < kRequests; i++) request();
+        });
+        printf("  %-44s %10zu window system calls per request\n", "", ws.calls.total() / kRequests);
+    };
+    run("cold: dump, new server per request", [&] {
+        RpcServer cold(backend);
+        if (cold.handle(dump).find("\"result\"") == std::string::npos) abort();
+    });
+    RpcServer server(backend);
+    server.handle(dump);
+    run("warm: dump", [&] { server.handle(dump); });
+    run("warm: query the last snapshot", [&] { server.handle(query); });
+
+    // The same query through a local socket, one connection.
+    std::string name = "lvt-bench-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    auto listener = ipc_listen(name);
+    if (!listener) abort();
+    std::thread serving([&] { serve(*listener, server); });
+    auto client = ipc_connect(name);
+    if (!client) abort();
+    std::string line;
+    run("warm: query over IPC", [&] {
+        if (!client->write(query + "\n") || !client->read_line(line)) abort();
+    });
+    run("warm: dump over IPC", [&] {
+        if (!client->write(dump + "\n") || !client->read_line(line)) abort();
+    });
+    client->write(R"({"jsonrpc":"2.0","id":3,"method":"shutdown"})" "\n");
+    serving.join();
+}
+
+// A recorded 300k-node WinUI 3 capture replayed through the whole
+// post-acquisition pipeline: window tree, XAML graft, IDs, then JSON. Also
+// shows what a recording costs to save and reload.
+LVT_BENCH(screenshot_1080p) {
+    // The half of --screenshot that runs after the frame arrives: annotate a
+    // 1920x1080 frame with 3000 elements, then encode it.
+    Image frame = make_synthetic_frame(1920, 1080);
+    ElementTree tree = make_synthetic_tree(3000);
+    assign_element_ids(tree, nullptr);
+    size_t pixels = static_cast<size_t>(frame.width) * frame.height;
+
+    measure("annotate_image (3000 elements)", pixels, [&] {
+        Image copy = frame;
+        annotate_image(copy, tree);
+    });
+    Image annotated = frame;
+    annotate_image(annotated, tree);
+    NullSink null;
+    measure("write_png", pixels, [&] {
+        write_png(null, annotated);
+        null.flush();
+    });
+    printf("  PNG: %.2f MiB from %.2f MiB of pixels\n",
+           static_cast<double>(null.bytes) / (1024.0 * 1024.0),
+           static_cast<double>(annotated.pixels.size()) / (1024.0 * 1024.0));
+}
+
+LVT_BENCH(replay_300k) {
+    constexpr size_t kWindows = 2000;
+    constexpr size_t kXaml = 300000;
+    Recording rec = make_synthetic_recording(kWindows, kXaml);
+    printf("  %zu windows, %zu XAML nodes, %.1f MiB TAP payload\n", rec.windows.size(), kXaml,
+           static_cast<double>(rec.payloads[0].data.size()) / (1024.0 * 1024.0));
+    size_t nodes = kWindows + kXaml;
+
+    ReplayProvider replay(rec);
+    ElementIndex index;
+    measure("build_tree from recording", nodes, [&] {
+        ElementTree tree = replay.build({}, &index);
+        if (tree.size() < nodes) abort();
+    });
+
+    ElementTree tree = replay.build({}, &index);
+    NullSink null;
+    measure("build_tree + write_json", nodes, [&] {
+        ElementTree t = replay.build({}, &index);
+        write_json(null, t, t.root(), nullptr, rec.pid, rec.processName, {"winui3 1.6"});
+        null.flush();
+    });
+
+    std::string text;
+    measure("write_recording", nodes, [&] {
+        text.clear();
+        StringSink sink(text);
+        write_recording(sink, rec);
+    });
+    printf("  recording: %.1f MiB\n", static_cast<double>(text.size()) / (1024.0 * 1024.0));
+    measure("read_recording", nodes, [&] {
+        Recording loaded;
+        if (!read_recording(text, loaded)) abort();
+    });
+
+    // 50 us per window call, 20 ms for the TAP round trip: roughly a busy
+    // desktop. Window calls dominate even with only 2000 windows.
+    ReplayLatency latency;
+    latency.window = std::chrono::microseconds(50);
+    latency.payload = std::chrono::milliseconds(20);
+    ReplayProvider slow(rec, latency);
+    measure("build_tree with injected latency", nodes, [&] {
+        ElementTree t = slow.build();
+        if (t.size() < nodes) abort();
+    });
+}
+
+LVT_BENCH(provider_overlap) {
+    // A WinUI 3 app with 100 list views and a plugin: three providers, each
+    // waiting on the target, 1 ms per control message and 50 ms per payload
+    // round trip. Latencies of 1 ms and up sleep, so the waits overlap even
+    // on a single core; parsing the TAP payload does not.
+    constexpr size_t kWindows = 300;
+    constexpr size_t kXaml = 20000;
+    constexpr size_t kListViews = 100;
+    Recording rec = make_synthetic_recording(kWindows, kXaml);
+    rec.frameworks.insert(rec.frameworks.begin(), {Framework::ComCtl, "6.10", ""});
+    rec.frameworks.push_back({Framework::Plugin, "1.0", "dui"});
+    rec.payloads.push_back({Framework::Plugin, "dui", rec.hwnd, rec.pid,
+                            R"({"type":"Dui.Panel","text":"panel"})"});
+    ComCtlReply list;
+    list.count = 3;
+    list.items = {{"a", 0, 0}, {"b", 0, 0}, {"c", 0, 0}};
+    for (size_t i = 1, made = 0; i < rec.windows.size() && made < kListViews; i += 2) {
+        if (rec.windows[i].info.className == "Microsoft.UI.Content.DesktopChildSiteBridge") continue;
+        rec.windows[i].info.className = "SysListView32";
+        rec.comctl.push_back({rec.windows[i].hwnd, list});
+        made++;
+    }
+    size_t nodes = kWindows + kXaml;
+
+    ReplayLatency latency;
+    latency.comctl = std::chrono::milliseconds(1);
+    latency.payload = std::chrono::milliseconds(50);
+    ReplayProvider slow(rec, latency);
+    size_t size = 0;
+    measure("providers one after another", nodes, [&] { size = slow.build().size(); });
+    ThreadPool pool(rec.frameworks.size());
+    measure("providers concurrently (3 workers)", nodes, [&] {
+        if (slow.build({}, nullptr, &pool).size() != size) abort();
+    });
+}
+
+LVT_BENCH(pipeline_overlap) {
+    // End-to-end build_tree against a slow WinUI 3 target: 50 us per window
+    // call over 2000 windows, and 300 ms for each of the TAP injection and a
+    // plugin to answer. With a pool the payload waits can overlap the walk.
+    constexpr size_t kWindows = 2000;
+    constexpr size_t kXaml = 50000;
+    Recording rec = make_synthetic_recording(kWindows, kXaml);
+    rec.frameworks.push_back({Framework::Plugin, "1.0", "dui"});
+    rec.payloads.push_back({Framework::Plugin, "dui", rec.hwnd, rec.pid,
+                            R"({"type":"Dui.Panel","text":"panel"})"});
+    size_t nodes = kWindows + kXaml;
+
+    ReplayLatency latency;
+    latency.window = std::chrono::microseconds(50);
+    latency.payload = std::chrono::milliseconds(300);
+    ReplayProvider slow(rec, latency);
+    size_t size = 0;
+    measure("sequential", nodes, [&] { size = slow.build().size(); });
+    ThreadPool pool(rec.frameworks.size());
+    measure("with provider pool (2 workers)", nodes, [&] {
+        if (slow.build({}, nullptr, &pool).size() != size) abort();
+    });
+}
+
+LVT_BENCH(scoped_build) {
+    // --element on one window of a slow WinUI 3 target, as in
+    // pipeline_overlap: the whole window tree is still walked to place the
+    // XAML, but a window with no XAML island below it skips the TAP. Without
+    // XAML only the scope's windows are walked.
+    constexpr size_t kWindows = 2000;
+    constexpr size_t kXaml = 50000;
+    Recording rec = make_synthetic_recording(kWindows, kXaml);
+    size_t nodes = kWindows + kXaml;
+
+    ReplayLatency latency;
+    latency.window = std::chrono::microseconds(50);
+    latency.payload = std::chrono::milliseconds(300);
+    ReplayProvider slow(rec, latency);
+    ElementTree full = ReplayProvider(rec).build();
+
+    // The window with the most windows below it and no bridge among them.
+    NodeId pick = kNoNode;
+    size_t pickSize = 0;
+    for (NodeId w = full.first_child(full.root()); w != kNoNode; w = full.next_preorder(w, full.root())) {
+        if (!full[w].nativeHandle) continue;
+        size_t size = 0;
+        bool bridge = false;
+        for (NodeId n = w; n != kNoNode; n = full.next_preorder(n, w)) {
+            if (!full[n].nativeHandle) continue;
+            size++;
+            bridge = bridge || full[n].className == "Microsoft.UI.Content.DesktopChildSiteBridge";
+        }
+        if (!bridge && size > pickSize) pick = w, pickSize = size;
+    }
+    TreeScope scope{full[pick].id, 2};
+    printf("  --element %s --depth 2 (%zu windows)\n", scope.element.c_str(), pickSize);
+
+    measure("full build", nodes, [&] { slow.build(); });
+    measure("scoped build", nodes, [&] { slow.build(scope); });
+
+    Recording plain = rec;
+    plain.frameworks.clear();
+    ReplayProvider slowPlain(plain, latency);
+    measure("full build, no XAML", kWindows, [&] { slowPlain.build(); });
+    measure("scoped build, no XAML", kWindows, [&] { slowPlain.build(scope); });
+}
+
+LVT_BENCH(window_forest_300k) {
+    constexpr size_t kWindows = 300000;
+    FakeWindowSystem ws;
+    ws.set_process(1, "SynthApp.exe");
+    HWND root = make_window_forest(ws, 1, kWindows)[0];
+    WindowSystemSource source(ws);
+
+    auto report = [&](const char* what) {
+        printf("  %s: %zu calls, %zu windows enumerated, %zu GetParent\n", what,
+               ws.calls.total(), ws.calls.enumerated, ws.calls.parent);
+        ws.calls = {};
+    };
+
+    measure("build_tree over fake window system", kWindows, [&] {
+        ElementTree tree = build_tree(source, root, 1, {});
+        if (tree.size() != kWindows) abort();
+    });
+    report("build_tree");
+    measure("detect_frameworks", kWindows, [&] { detect_frameworks(ws, root, 1); });
+    report("detect_frameworks");
+
+    // A desktop of 2000 top-level windows across 200 processes.
+    FakeWindowSystem desktop;
+    for (DWORD pid = 1; pid <= 200; pid++) desktop.set_process(pid, "app" + std::to_string(pid) + ".exe");
+    auto tops = make_window_forest(desktop, 1, 20000, 2000);
+    for (size_t i = 0; i < tops.size(); i++) desktop.at(tops[i]).pid = static_cast<DWORD>(i % 200 + 1);
+    measure("find_by_process_name, 2000 top-level", 2000, [&] {
+        if (find_by_process_name(desktop, "app17.exe").empty()) abort();
+    });
+    printf("  find_by_process_name: %zu calls\n", desktop.calls.total());
+
+    // 2 us per call and 50 ns per enumerated window: the cost of a round trip
+    // into win32k, scaled down so the run stays short.
+    FakeWindowSystem slow;
+    HWND slowRoot = make_window_forest(slow, 1, 20000)[0];
+    slow.latency = std::chrono::microseconds(2);
+    slow.enumLatency = std::chrono::nanoseconds(50);
+    WindowSystemSource slowSource(slow);
+    measure("build_tree, 20k windows with latency", 20000, [&] { build_tree(slowSource, slowRoot, 1, {}); });
+}
+
+// Children the pre-adjacency-map way: EnumChildWindows from every window,
+// filtered with GetParent.
+class PerNodeEnumerationSource : public WindowSystemSource {
+public:
+    using WindowSystemSource::WindowSystemSource;
+    std::vector<HWND> children(HWND hwnd) override {
+        std::vector<HWND> children;
+        for (HWND h : m_ws.descendants(hwnd)) {
+            if (m_ws.parent(h) == hwnd) children.push_back(h);
+        }
+        return children;
+    }
+};
+
+LVT_BENCH(hwnd_enumeration_50k) {
+    constexpr size_t kWindows = 50000;
+    FakeWindowSystem ws;
+    HWND root = make_window_forest(ws, 1, kWindows)[0];
+
+    auto run = [&](const char* label, CaptureSource& source) {
+        ws.calls = {};
+        measure(label, kWindows, [&] {
+            if (build_tree(source, root, 1, {}).size() != kWindows) abort();
+        });
+        printf("  %-44s %10zu enumerated %9zu GetParent\n", "", ws.calls.enumerated, ws.calls.parent);
+    };
+    PerNodeEnumerationSource perNode(ws);
+    run("per-node EnumChildWindows", perNode);
+    WindowSystemSource single(ws);
+    run("single pass", single);
+
+    // 1 us per call and 20 ns per enumerated window.
+    ws.latency = std::chrono::microseconds(1);
+    ws.enumLatency = std::chrono::nanoseconds(20);
+    PerNodeEnumerationSource slowPerNode(ws);
+    run("per-node EnumChildWindows, with latency", slowPerNode);
+    WindowSystemSource slowSingle(ws);
+    run("single pass, with latency", slowSingle);
+}
+
+int main(int argc, char* argv[]) {
+    const char* filter = (argc > 1) ? argv[1] : nullptr;
+    for (auto& b : registry()) {
+        if (filter && !strstr(b.name, filter)) continue;
+        printf("%s\n", b.name);
+        b.fn();
+    }
+    return 0;
+}
@@ -0,0 +1,4005 @@
+// Unit tests for the portable core (element model, serializers).
+// No Windows APIs are used, so these run on every platform.
+
+#include <gtest/gtest.h>
+#include "element.h"
+#include "element_index.h"
+#include "fake_window_system.h"
+#include "hash.h"
+#include "framework_detector.h"
+#include "delta_stream.h"
+#include "image.h"
+#include "ipc.h"
+#include "json_reader.h"
+#include "plugin_graft.h"
+#include "png_reader.h"
+#include "provider_scheduler.h"
+#include "providers/xaml_provider.h"
+#include "synthetic_tree.h"
+#include "tap/tap_tree.h"
+#include "text_scan.h"
+#include "thread_pool.h"
+#include "json_serializer.h"
+#include "snapshot.h"
+#include "stable_ids.h"
+#include "tree_diff.h"
+#include "recording.h"
+#include "rpc_server.h"
+#include "tree_builder.h"
+#include "window_search.h"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <functional>
+#include <future>
+#include <iomanip>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using json = nlohmann::json;
+using namespace lvt;
+
+// ---- Element ID assignment ----
+
+TEST(AssignElementIds, SingleElement) {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root].type = "Window";
+    assign_element_ids(tree);
+    EXPECT_EQ(tree[root].id, "e0");
+}
+
+TEST(AssignElementIds, DepthFirstOrder) {
+    // root -> [a -> [a1, a2], b]
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root].type = "Root";
+    NodeId a = tree.append_child(root);
+    NodeId b = tree.append_child(root);
+    NodeId a1 = tree.append_child(a);
+    NodeId a2 = tree.append_child(a);
+    tree[a].type = "A"; tree[a1].type = "A1"; tree[a2].type = "A2"; tree[b].type = "B";
+
+    assign_element_ids(tree);
+    EXPECT_EQ(tree[root].id, "e0");
+    EXPECT_EQ(tree[a].id, "e1");
+    EXPECT_EQ(tree[a1].id, "e2");
+    EXPECT_EQ(tree[a2].id, "e3");
+    EXPECT_EQ(tree[b].id, "e4");
+}
+
+TEST(AssignElementIds, EmptyChildren) {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root].type = "Root";
+    assign_element_ids(tree);
+    EXPECT_EQ(tree[root].id, "e0");
+    EXPECT_FALSE(tree.has_children(root));
+}
+
+TEST(AssignElementIds, DeepTree) {
+    // Chain: root -> c1 -> c2 -> c3
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    NodeId c1 = tree.append_child(root);
+    NodeId c2 = tree.append_child(c1);
+    NodeId c3 = tree.append_child(c2);
+    tree[root].type = "Root"; tree[c1].type = "Mid"; tree[c2].type = "Mid"; tree[c3].type = "Leaf";
+    assign_element_ids(tree);
+    EXPECT_EQ(tree[root].id, "e0");
+    EXPECT_EQ(tree[c1].id, "e1");
+    EXPECT_EQ(tree[c2].id, "e2");
+    EXPECT_EQ(tree[c3].id, "e3");
+}
+
+TEST(AssignElementIds, VeryDeepChainDoesNotRecurse) {
+    ElementTree tree;
+    NodeId n = tree.add_root();
+    for (int i = 0; i < 200000; i++) n = tree.append_child(n);
+    assign_element_ids(tree);
+    EXPECT_EQ(tree[n].id, "e200000");
+}
+
+TEST(AssignElementIds, WindowsStartTheirOwnSegments) {
+    // target 0x100 -> [window 0x1A2B -> [a -> [a1]], b]
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root].nativeHandle = 0x100;
+    NodeId win = tree.append_child(root);
+    tree[win].nativeHandle = 0x1A2B;
+    NodeId a = tree.append_child(win);
+    NodeId a1 = tree.append_child(a);
+    NodeId b = tree.append_child(root);
+
+    assign_element_ids(tree, nullptr, 0x100);
+    EXPECT_EQ(tree[root].id, "e0");
+    EXPECT_EQ(tree[win].id, "w1A2B");
+    EXPECT_EQ(tree[a].id, "w1A2B.1");
+    EXPECT_EQ(tree[a1].id, "w1A2B.2");
+    EXPECT_EQ(tree[b].id, "e1");  // not shifted by the window's elements
+}
+
+TEST(AssignElementIds, RootOtherThanTargetKeepsItsWindowId) {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root].nativeHandle = 0x1A2B;
+    NodeId a = tree.append_child(root);
+    assign_element_ids(tree, nullptr, 0x100);
+    EXPECT_EQ(tree[root].id, "w1A2B");
+    EXPECT_EQ(tree[a].id, "w1A2B.1");
+}
+
+TEST(AssignElementIds, ParsesIds) {
+    ElementIdAnchor anchor;
+    ASSERT_TRUE(parse_element_id("e0", anchor));
+    EXPECT_EQ(anchor.window, 0u);
+    EXPECT_TRUE(anchor.isWindow);
+    ASSERT_TRUE(parse_element_id("e12", anchor));
+    EXPECT_EQ(anchor.window, 0u);
+    EXPECT_FALSE(anchor.isWindow);
+    ASSERT_TRUE(parse_element_id("w1A2B", anchor));
+    EXPECT_EQ(anchor.window, 0x1A2Bu);
+    EXPECT_TRUE(anchor.isWindow);
+    ASSERT_TRUE(parse_element_id("w1A2B.7", anchor));
+    EXPECT_EQ(anchor.window, 0x1A2Bu);
+    EXPECT_FALSE(anchor.isWindow);
+
+    for (const char* bad : {"", "e", "e-1", "ex", "w", "w0", "wXYZ", "w1A2B.", "w1A2B.x", "x5", "w.3",
+                            "w1a2b", "w1a2b.7"})
+        EXPECT_FALSE(parse_element_id(bad, anchor)) << bad;
+}
+
+// ---- Subtree hashes ----
+
+// Two identical dialogs side by side under one root.
+static ElementTree make_twin_tree() {
+    ElementTree tree;
+    NodeId root = tree.add_root({.type = "Window", .framework = "win32", .text = "Twins"});
+    for (int i = 0; i < 2; i++) {
+        NodeId dialog = tree.append_child(root, {.type = "Dialog", .framework = "win32",
+                                                 .bounds = {10, 20, 300, 200}});
+        tree[dialog].properties.set(prop::kVisible, true);
+        tree.append_child(dialog, {.type = "Button", .framework = "win32", .text = "OK"});
+        tree.append_child(dialog, {.type = "Button", .framework = "win32", .text = "Cancel"});
+    }
+    assign_element_ids(tree);
+    return tree;
+}
+
+TEST(SubtreeHashes, EqualSubtreesHashEqualWhereverTheyAre) {
+    auto tree = make_twin_tree();
+    NodeId a = tree.child_at(tree.root(), 0), b = tree.child_at(tree.root(), 1);
+    EXPECT_NE(tree[a].id, tree[b].id);
+    EXPECT_EQ(tree[a].hash, tree[b].hash);
+    EXPECT_NE(tree[a].hash, tree[tree.first_child(a)].hash);
+    EXPECT_NE(tree[tree.first_child(a)].hash, tree[tree.child_at(a, 1)].hash);
+
+    // A change deep down reaches every ancestor and nothing else.
+    uint64_t root = tree[tree.root()].hash, twin = tree[b].hash, ok = tree[tree.first_child(b)].hash;
+    tree[tree.child_at(a, 1)].properties.set(prop::kEnabled, false);
+    hash_subtrees(tree);
+    EXPECT_NE(tree[a].hash, tree[b].hash);
+    EXPECT_NE(tree[tree.root()].hash, root);
+    EXPECT_EQ(tree[b].hash, twin);
+    EXPECT_EQ(tree[tree.first_child(a)].hash, ok);
+}
+
+TEST(SubtreeHashes, CoverEveryFieldButTheId) {
+    auto base = make_twin_tree();
+    NodeId dialog = base.first_child(base.root());
+    auto changed = [&](auto&& edit) {
+        auto tree = base;
+        edit(tree[dialog]);
+        hash_subtrees(tree);
+        return tree[dialog].hash != base[dialog].hash;
+    };
+    EXPECT_FALSE(changed([](Element& el) { el.id = "renamed"; }));
+    EXPECT_TRUE(changed([](Element& el) { el.type = "Window"; }));
+    EXPECT_TRUE(changed([](Element& el) { el.framework = "wpf"; }));
+    EXPECT_TRUE(changed([](Element& el) { el.className = "#32770"; }));
+    EXPECT_TRUE(changed([](Element& el) { el.text = "Title"; }));
+    EXPECT_TRUE(changed([](Element& el) { el.bounds.height++; }));
+    EXPECT_TRUE(changed([](Element& el) { el.nativeHandle = 0x10; }));
+    EXPECT_TRUE(changed([](Element& el) { el.properties.set(prop::kVisible, "true"); }));
+    EXPECT_TRUE(changed([](Element& el) { el.properties.set(prop::kVisible, int64_t{1}); }));
+
+    // Children count in order, and a child's fields are not its parent's.
+    auto swapped = base;
+    std::swap(swapped[swapped.first_child(dialog)].text, swapped[swapped.child_at(dialog, 1)].text);
+    hash_subtrees(swapped);
+    EXPECT_NE(swapped[dialog].hash, base[dialog].hash);
+    auto moved = base;
+    moved[dialog].text = "OK";
+    moved[moved.first_child(dialog)].text = "";
+    hash_subtrees(moved);
+    EXPECT_NE(moved[dialog].hash, base[dialog].hash);
+}
+
+TEST(SubtreeHashes, AssignElementIdsHashesInTheSamePass) {
+    auto tree = lvt::testing::make_synthetic_tree(20000, 5);
+    assign_element_ids(tree);
+    auto rehashed = tree;
+    for (NodeId n = 0; n < rehashed.size(); n++) rehashed[n].hash = 0;
+    hash_subtrees(rehashed);
+    for (NodeId n = 0; n < tree.size(); n++) ASSERT_EQ(tree[n].hash, rehashed[n].hash) << n;
+}
+
+TEST(SubtreeHashes, ByteHashCoversEveryLengthAndPosition) {
+    std::string text(300, 'x');
+    for (size_t i = 0; i < text.size(); i++) text[i] = static_cast<char>('a' + i * 7 % 26);
+    std::unordered_set<uint64_t> seen;
+    for (size_t len = 0; len <= text.size(); len++)
+        EXPECT_TRUE(seen.insert(hash::bytes(std::string_view(text).substr(0, len))).second) << len;
+    // Swapping two 64-byte blocks is a different string.
+    std::string swapped = text.substr(64, 64) + text.substr(0, 64) + text.substr(128);
+    EXPECT_NE(hash::bytes(swapped), hash::bytes(text));
+    EXPECT_NE(hash::bytes(text, 1), hash::bytes(text));
+}
+
+// ---- Symbol interning ----
+
+TEST(Symbol, DefaultIsEmpty) {
+    Symbol s;
+    EXPECT_TRUE(s.empty());
+    EXPECT_EQ(s.id(), 0u);
+    EXPECT_EQ(s.str(), "");
+    EXPECT_EQ(Symbol(""), s);
+    EXPECT_EQ(Symbol(static_cast<const char*>(nullptr)), s);
+}
+
+TEST(Symbol, SameTextSharesStorage) {
+    Symbol a("SymbolTest.Border");
+    Symbol b(std::string("SymbolTest.") + "Border");
+    EXPECT_EQ(a.id(), b.id());
+    EXPECT_EQ(&a.str(), &b.str());
+    EXPECT_NE(Symbol("SymbolTest.Grid").id(), a.id());
+}
+
+TEST(Symbol, ComparesWithPlainStrings) {
+    Symbol s("TextBlock");
+    EXPECT_TRUE(s == "TextBlock");
+    EXPECT_TRUE(s == std::string("TextBlock"));
+    EXPECT_TRUE(s == std::string_view("TextBlock"));
+    EXPECT_TRUE(s != "TextBox");
+    EXPECT_EQ(s.size(), 9u);
+    EXPECT_STREQ(s.c_str(), "TextBlock");
+}
+
+TEST(Symbol, InterningDoesNotGrowPoolForKnownText) {
+    Symbol first("SymbolTest.Repeated");
+    size_t before = Symbol::pool_size();
+    for (int i = 0; i < 1000; i++) {
+        Symbol again("SymbolTest.Repeated");
+        EXPECT_EQ(again, first);
+    }
+    EXPECT_EQ(Symbol::pool_size(), before);
+}
+
+TEST(Symbol, ReferencesStableAcrossPoolGrowth) {
+    Symbol s("SymbolTest.Stable");
+    const std::string* text = &s.str();
+    for (int i = 0; i < 5000; i++) Symbol("SymbolTest.Fill" + std::to_string(i));
+    EXPECT_EQ(&s.str(), text);
+    EXPECT_EQ(*text, "SymbolTest.Stable");
+}
+
+TEST(Symbol, ConcurrentInterningAgrees) {
+    constexpr int kThreads = 4;
+    constexpr int kNames = 2000;
+    std::vector<std::vector<uint32_t>> ids(kThreads, std::vector<uint32_t>(kNames));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([t, &ids] {
+            for (int i = 0; i < kNames; i++) {
+                // Each thread walks the names in a different order.
+                int n = (t % 2) ? kNames - 1 - i : i;
+                ids[t][n] = Symbol("SymbolTest.Concurrent" + std::to_string(n)).id();
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+    for (int t = 1; t < kThreads; t++) EXPECT_EQ(ids[t], ids[0]);
+    EXPECT_EQ(Symbol("SymbolTest.Concurrent17").id(), ids[0][17]);
+}
+
+TEST(Symbol, ElementFieldsAreInterned) {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root].className = "Microsoft.UI.Xaml.Controls.Grid";
+    NodeId child = tree.append_child(root);
+    tree[child].className = std::string("Microsoft.UI.Xaml.Controls.") + "Grid";
+    EXPECT_EQ(tree[root].className.id(), tree[child].className.id());
+}
+
+// ---- PropertyList ----
+
+TEST(PropertyList, KeepsKeysSortedByText) {
+    PropertyList props;
+    props.set("visible", true);
+    props.set("enabled", false);
+    props.set("style", "WS_CHILD");
+    props.set("hwnd", HandleValue{0x1234});
+    std::vector<std::string> keys;
+    for (auto& [k, v] : props) keys.push_back(k.str());
+    EXPECT_EQ(keys, (std::vector<std::string>{"enabled", "hwnd", "style", "visible"}));
+}
+
+TEST(PropertyList, SetOverwritesExistingKey) {
+    PropertyList props;
+    props.set("index", 1);
+    props.set("index", 2);
+    EXPECT_EQ(props.size(), 1u);
+    EXPECT_EQ(props.text("index"), "2");
+}
+
+TEST(PropertyList, MissingKey) {
+    PropertyList props;
+    EXPECT_EQ(props.find("nope"), nullptr);
+    EXPECT_FALSE(props.contains("nope"));
+    EXPECT_EQ(props.text("nope"), "");
+}
+
+TEST(PropertyList, TypedValuesFormatAsText) {
+    EXPECT_EQ(PropertyValue(true).to_string(), "true");
+    EXPECT_EQ(PropertyValue(false).to_string(), "false");
+    EXPECT_EQ(PropertyValue(-42).to_string(), "-42");
+    EXPECT_EQ(PropertyValue(int64_t{1} << 40).to_string(), "1099511627776");
+    EXPECT_EQ(PropertyValue(1.5).to_string(), "1.5");
+    EXPECT_EQ(PropertyValue(Bounds{1, 2, 30, 40}).to_string(), "1,2,30,40");
+    EXPECT_EQ(PropertyValue("text").to_string(), "text");
+}
+
+TEST(PropertyList, HandleFormatsAsPointerWidthHex) {
+    std::string expected = "0x" + std::string(sizeof(void*) * 2 - 4, '0') + "ABCD";
+    EXPECT_EQ(PropertyValue(HandleValue{0xABCD}).to_string(), expected);
+}
+
+TEST(PropertyList, CompareAgainstText) {
+    EXPECT_TRUE(PropertyValue(true) == "true");
+    EXPECT_FALSE(PropertyValue(true) == "false");
+    EXPECT_TRUE(PropertyValue(7) == "7");
+    EXPECT_TRUE(PropertyValue("0x1234") == std::string("0x1234"));
+}
+
+TEST(PropertyList, BooleanKeys) {
+    EXPECT_TRUE(prop::is_boolean_key("visible"));
+    EXPECT_TRUE(prop::is_boolean_key(prop::kEnabled));
+    EXPECT_FALSE(prop::is_boolean_key("style"));
+}
+
+TEST(PropertyList, SerializersPrintTypedValues) {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root].type = "Window";
+    tree[root].framework = "win32";
+    tree[root].properties.set(prop::kVisible, true);
+    tree[root].properties.set(prop::kIndex, 3);
+    tree[root].properties.set("role", "a<b");
+
+    auto j = json::parse(serialize_to_json(tree, root, nullptr, 0, "test.exe", {"win32"}));
+    EXPECT_EQ(j["root"]["properties"]["visible"], "true");
+    EXPECT_EQ(j["root"]["properties"]["index"], "3");
+    EXPECT_EQ(j["root"]["properties"]["role"], "a<b");
+
+    auto xml = serialize_to_xml(tree, root, nullptr, 0, "test.exe", {"win32"});
+    EXPECT_NE(xml.find(" index=\"3\" role=\"a&lt;b\" visible=\"true\""), std::string::npos);
+}
+
+// ---- Text scanning ----
+
+TEST(TextScan, MatchesScalarAtEveryOffset) {
+    // Every length up to a few vector widths, with one special unit at each
+    // position, so both the vector loop and the scalar tail are exercised.
+    const char specials[] = {'\x00', '\x01', '\x1f', '"', '\\', '\x80', '\xff'};
+    for (size_t len = 0; len < 80; len++) {
+        for (size_t pos = 0; pos <= len; pos++) {
+            for (char sp : specials) {
+                std::string s(len, 'a');
+                if (pos < len) s[pos] = sp;
+                size_t expect = text::detail::find_special_scalar<text::kStopControl | text::kStopHigh, '"', '\\'>(
+                    s.data(), s.size(), 0);
+                ASSERT_EQ((text::find_special<text::kStopControl | text::kStopHigh, '"', '\\'>(s)), expect)
+                    << "len " << len << " pos " << pos;
+                ASSERT_EQ(expect, pos);
+            }
+        }
+    }
+}
+
+TEST(TextScan, KeepTabAndExtraCharacters) {
+    std::string s(40, 'x');
+    s[20] = '\t';
+    s[33] = '<';
+    EXPECT_EQ(text::find_special<text::kStopControl>(s), 20u);
+    EXPECT_EQ((text::find_special<text::kStopControl | text::kKeepTab>(s)), 40u);
+    EXPECT_EQ((text::find_special<text::kStopControl | text::kKeepTab, '&', '<'>(s)), 33u);
+    EXPECT_EQ((text::find_special<0, ' '>(s)), 40u);
+    s[2] = '\x7f';  // DEL is not a control character for these scans
+    EXPECT_EQ(text::find_special<text::kStopControl>(s.substr(0, 19)), 19u);
+}
+
+TEST(TextScan, WideUnits) {
+    for (size_t len = 1; len < 40; len++) {
+        for (char16_t sp : {u'\x05', u'"', u'\x100', u'\xFFFF'}) {
+            std::u16string s(len, u'a');
+            s[len - 1] = sp;
+            size_t expect = (sp == u'\x100' || sp == u'\xFFFF') ? len : len - 1;
+            EXPECT_EQ((text::find_special<text::kStopControl, u'"'>(s.data(), s.size())), expect);
+            EXPECT_EQ((text::find_special<text::kStopHigh>(s.data(), s.size())),
+                      sp >= 0x80 ? len - 1 : len);
+        }
+    }
+}
+
+TEST(TextScan, StripControlsReturnsInputWhenClean) {
+    std::string scratch;
+    std::string clean = "a perfectly ordinary window title\twith a tab";
+    auto v = text::strip_controls<text::kStopControl | text::kKeepTab>(clean, scratch);
+    EXPECT_EQ(v.data(), clean.data());
+    EXPECT_TRUE(scratch.empty());
+
+    std::string dirty = "\x01line1\nline2\t\x1f" + std::string(50, 'z') + "\x02";
+    v = text::strip_controls(dirty, scratch);
+    EXPECT_EQ(v, "line1line2" + std::string(50, 'z'));
+    v = text::strip_controls<text::kStopControl | text::kKeepTab>(dirty, scratch);
+    EXPECT_EQ(v, "line1line2\t" + std::string(50, 'z'));
+}
+
+TEST(TextScan, StripControlsInPlace) {
+    std::string s = "ab\x01\x02" "cd\x03" + std::string(40, 'e') + "\x04";
+    text::strip_controls_in_place(s);
+    EXPECT_EQ(s, "abcd" + std::string(40, 'e'));
+    EXPECT_EQ(text::sanitize("Windows.UI.Xaml\x01.Controls\t.Grid\r\n"), "Windows.UI.Xaml.Controls\t.Grid");
+    EXPECT_EQ(text::sanitize(""), "");
+}
+
+// ---- ElementTree ----
+
+TEST(ElementTree, EmptyTree) {
+    ElementTree tree;
+    EXPECT_TRUE(tree.empty());
+    EXPECT_EQ(tree.size(), 0u);
+    EXPECT_EQ(tree.root(), kNoNode);
+}
+
+TEST(ElementTree, LinksAndOrder) {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    NodeId a = tree.append_child(root);
+    NodeId b = tree.append_child(root);
+    NodeId c = tree.append_child(root);
+
+    EXPECT_EQ(tree.parent(root), kNoNode);
+    EXPECT_EQ(tree.parent(a), root);
+    EXPECT_EQ(tree.first_child(root), a);
+    EXPECT_EQ(tree.last_child(root), c);
+    EXPECT_EQ(tree.next_sibling(a), b);
+    EXPECT_EQ(tree.next_sibling(c), kNoNode);
+    EXPECT_EQ(tree.child_count(root), 3u);
+    EXPECT_EQ(tree.child_at(root, 1), b);
+    EXPECT_EQ(tree.child_at(root, 3), kNoNode);
+
+    std::vector<NodeId> seen;
+    for (NodeId child : tree.children(root)) seen.push_back(child);
+    EXPECT_EQ(seen, (std::vector<NodeId>{a, b, c}));
+}
+
+TEST(ElementTree, SecondRootRejected) {
+    ElementTree tree;
+    EXPECT_EQ(tree.add_root(), 0u);
+    EXPECT_EQ(tree.add_root(), kNoNode);
+}
+
+TEST(ElementTree, ReferencesStableAcrossGrowth) {
+    // Grafting appends while holding references to host elements; those must
+    // not move when the arena grows.
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    Element* rootPtr = &tree[root];
+    rootPtr->type = "Root";
+    NodeId first = tree.append_child(root);
+    Element* firstPtr = &tree[first];
+    for (int i = 0; i < 10000; i++) tree.append_child(first);
+    EXPECT_EQ(rootPtr, &tree[root]);
+    EXPECT_EQ(firstPtr, &tree[first]);
+    EXPECT_EQ(rootPtr->type, "Root");
+    EXPECT_EQ(tree.child_count(first), 10000u);
+}
+
+TEST(ElementTree, PreorderWithinScope) {
+    // root -> [a -> [a1], b]; walking from a must not escape into b
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    NodeId a = tree.append_child(root);
+    NodeId b = tree.append_child(root);
+    NodeId a1 = tree.append_child(a);
+
+    std::vector<NodeId> order;
+    for (NodeId n = root; n != kNoNode; n = tree.next_preorder(n, root)) order.push_back(n);
+    EXPECT_EQ(order, (std::vector<NodeId>{root, a, a1, b}));
+
+    order.clear();
+    for (NodeId n = a; n != kNoNode; n = tree.next_preorder(n, a)) order.push_back(n);
+    EXPECT_EQ(order, (std::vector<NodeId>{a, a1}));
+}
+
+TEST(ElementTree, AppendSubtreeCopiesStructure) {
+    ElementTree src;
+    NodeId sr = src.add_root();
+    src[sr].type = "Host";
+    NodeId x = src.append_child(sr);
+    src[x].type = "X";
+    src[src.append_child(x)].type = "X1";
+    src[src.append_child(sr)].type = "Y";
+
+    ElementTree dst;
+    NodeId root = dst.add_root();
+    NodeId copy = dst.append_subtree(root, src, x);
+    EXPECT_EQ(dst.parent(copy), root);
+    EXPECT_EQ(dst[copy].type, "X");
+    ASSERT_EQ(dst.child_count(copy), 1u);
+    EXPECT_EQ(dst[dst.first_child(copy)].type, "X1");
+}
+
+TEST(ElementTree, CopyAndMove) {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root].text = "hello";
+    tree.append_child(root);
+
+    ElementTree copy = tree;
+    EXPECT_EQ(copy.size(), 2u);
+    EXPECT_EQ(copy[copy.root()].text, "hello");
+    EXPECT_EQ(copy.child_count(copy.root()), 1u);
+
+    ElementTree moved = std::move(tree);
+    EXPECT_EQ(moved.size(), 2u);
+    EXPECT_TRUE(tree.empty());
+}
+
+TEST(TrimToDepth, KeepsRequestedLevels) {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    NodeId a = tree.append_child(root);
+    NodeId a1 = tree.append_child(a);
+    tree.append_child(a1);
+
+    trim_to_depth(tree, root, 1);
+    EXPECT_EQ(tree.child_count(root), 1u);
+    EXPECT_FALSE(tree.has_children(a));
+}
+
+TEST(TrimToDepth, RelativeToScopeNode) {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    NodeId a = tree.append_child(root);
+    NodeId a1 = tree.append_child(a);
+    tree.append_child(a1);
+
+    trim_to_depth(tree, a, 1);
+    EXPECT_TRUE(tree.has_children(a));
+    EXPECT_FALSE(tree.has_children(a1));
+}
+
+TEST(TrimToDepth, RehashesWhatItCut) {
+    auto tree = make_twin_tree();
+    NodeId a = tree.child_at(tree.root(), 0), b = tree.child_at(tree.root(), 1);
+    tree[tree.first_child(b)].text = "changed";
+    hash_subtrees(tree);
+    ASSERT_NE(tree[a].hash, tree[b].hash);
+
+    // With the differing children cut, the twins are equal again.
+    trim_to_depth(tree, tree.root(), 1);
+    EXPECT_EQ(tree[a].hash, tree[b].hash);
+    ElementTree shallow = make_twin_tree();
+    shallow.clear_children(shallow.child_at(shallow.root(), 0));
+    shallow.clear_children(shallow.child_at(shallow.root(), 1));
+    hash_subtrees(shallow);
+    EXPECT_EQ(tree[tree.root()].hash, shallow[shallow.root()].hash);
+}
+
+TEST(TrimToDepth, NegativeMeansUnlimited) {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree.append_child(tree.append_child(root));
+    trim_to_depth(tree, root, -1);
+    EXPECT_TRUE(tree.has_children(tree.first_child(root)));
+}
+
+// ---- JSON serialization ----
+
+static ElementTree make_test_tree() {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    Element& r = tree[root];
+    r.type = "Window";
+    r.framework = "win32";
+    r.className = "MyWindow";
+    r.text = "Hello";
+    r.bounds = {100, 200, 800, 600};
+    r.properties.set("visible", "true");
+
+    Element& child = tree[tree.append_child(root)];
+    child.type = "Button";
+    child.framework = "win32";
+    child.className = "Button";
+    child.text = "OK";
+    child.bounds = {110, 210, 80, 30};
+
+    assign_element_ids(tree);
+    return tree;
+}
+
+static ElementTree make_single(const char* type, const char* framework) {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root].type = type;
+    tree[root].framework = framework;
+    return tree;
+}
+
+TEST(JsonSerializer, HashesOnRequest) {
+    auto tree = make_test_tree();
+    auto plain = json::parse(serialize_to_json(tree, tree.root(), nullptr, 0, "t.exe", {}));
+    EXPECT_FALSE(plain["root"].contains("hash"));
+    auto j = json::parse(serialize_to_json(tree, tree.root(), nullptr, 0, "t.exe", {}, true));
+    std::ostringstream hex;
+    hex << std::hex << std::setw(16) << std::setfill('0') << tree[tree.root()].hash;
+    EXPECT_EQ(j["root"]["hash"], hex.str());
+    EXPECT_EQ(j["root"]["children"][0]["hash"].get<std::string>().size(), 16u);
+}
+
+TEST(JsonSerializer, BasicStructure) {
+    auto tree = make_test_tree();
+    auto result = serialize_to_json(tree, tree.root(), (HWND)0x1234, 42, "test.exe", {"win32"});
+    auto j = json::parse(result);
+
+    EXPECT_TRUE(j.contains("target"));
+    EXPECT_TRUE(j.contains("frameworks"));
+    EXPECT_TRUE(j.contains("root"));
+    EXPECT_EQ(j["target"]["pid"], 42);
+    EXPECT_EQ(j["target"]["processName"], "test.exe");
+    EXPECT_EQ(j["frameworks"], json({"win32"}));
+}
+
+TEST(JsonSerializer, ElementFields) {
+    auto tree = make_test_tree();
+    auto result = serialize_to_json(tree, tree.root(), (HWND)0x1234, 42, "test.exe", {"win32"});
+    auto j = json::parse(result);
+
+    auto& r = j["root"];
+    EXPECT_EQ(r["id"], "e0");
+    EXPECT_EQ(r["type"], "Window");
+    EXPECT_EQ(r["framework"], "win32");
+    EXPECT_EQ(r["className"], "MyWindow");
+    EXPECT_EQ(r["text"], "Hello");
+    EXPECT_EQ(r["bounds"]["x"], 100);
+    EXPECT_EQ(r["bounds"]["y"], 200);
+    EXPECT_EQ(r["bounds"]["width"], 800);
+    EXPECT_EQ(r["bounds"]["height"], 600);
+    EXPECT_EQ(r["properties"]["visible"], "true");
+}
+
+TEST(JsonSerializer, ChildElements) {
+    auto tree = make_test_tree();
+    auto result = serialize_to_json(tree, tree.root(), (HWND)0x1234, 42, "test.exe", {"win32"});
+    auto j = json::parse(result);
+
+    EXPECT_TRUE(j["root"].contains("children"));
+    EXPECT_EQ(j["root"]["children"].size(), 1);
+    auto& child = j["root"]["children"][0];
+    EXPECT_EQ(child["id"], "e1");
+    EXPECT_EQ(child["type"], "Button");
+    EXPECT_EQ(child["text"], "OK");
+}
+
+TEST(JsonSerializer, ControlCharsSanitized) {
+    ElementTree tree;
+    Element& root = tree[tree.add_root()];
+    root.type = "Win\x01" "dow";  // embedded control char
+    root.framework = "win32";
+    root.className = "My\x02" "Class";
+    root.text = "He\x03llo";
+    assign_element_ids(tree);
+
+    auto result = serialize_to_json(tree, tree.root(), nullptr, 0, "test.exe", {});
+    auto j = json::parse(result);
+    EXPECT_EQ(j["root"]["type"], "Window");      // \x01 stripped
+    EXPECT_EQ(j["root"]["className"], "MyClass"); // \x02 stripped
+    EXPECT_EQ(j["root"]["text"], "Hello");        // \x03 stripped
+}
+
+TEST(JsonSerializer, NoChildrenKey) {
+    auto tree = make_single("Leaf", "win32");
+    assign_element_ids(tree);
+
+    auto result = serialize_to_json(tree, tree.root(), nullptr, 0, "test.exe", {});
+    auto j = json::parse(result);
+    EXPECT_FALSE(j["root"].contains("children"));
+}
+
+TEST(JsonSerializer, EmptyOptionalFields) {
+    auto tree = make_single("Window", "win32");
+    // className and text are empty
+    assign_element_ids(tree);
+
+    auto result = serialize_to_json(tree, tree.root(), nullptr, 0, "test.exe", {});
+    auto j = json::parse(result);
+    EXPECT_FALSE(j["root"].contains("className"));
+    EXPECT_FALSE(j["root"].contains("text"));
+}
+
+TEST(JsonSerializer, MultipleFrameworks) {
+    auto tree = make_test_tree();
+    auto result = serialize_to_json(tree, tree.root(), nullptr, 0, "test.exe", {"win32", "comctl", "winui3"});
+    auto j = json::parse(result);
+    EXPECT_EQ(j["frameworks"].size(), 3);
+    EXPECT_EQ(j["frameworks"][0], "win32");
+    EXPECT_EQ(j["frameworks"][1], "comctl");
+    EXPECT_EQ(j["frameworks"][2], "winui3");
+}
+
+TEST(JsonSerializer, ScopedToSubtree) {
+    auto tree = make_test_tree();
+    NodeId button = tree.first_child(tree.root());
+    auto result = serialize_to_json(tree, button, nullptr, 0, "test.exe", {});
+    auto j = json::parse(result);
+    EXPECT_EQ(j["root"]["id"], "e1");
+    EXPECT_EQ(j["root"]["type"], "Button");
+}
+
+// The DOM-based serializer write_json replaced, kept as the byte-for-byte reference.
+static json reference_element_json(const ElementTree& tree, NodeId node) {
+    auto sanitize = [](const std::string& s) {
+        std::string r;
+        for (char c : s) if (static_cast<unsigned char>(c) >= 0x20) r += c;
+        return r;
+    };
+    const Element& el = tree[node];
+    json j;
+    j["id"] = el.id;
+    j["type"] = sanitize(el.type.str());
+    j["framework"] = el.framework.str();
+    if (!el.className.empty()) j["className"] = sanitize(el.className.str());
+    if (!el.text.empty()) j["text"] = sanitize(el.text);
+    j["bounds"] = json{{"x", el.bounds.x}, {"y", el.bounds.y},
+                       {"width", el.bounds.width}, {"height", el.bounds.height}};
+    if (!el.properties.empty()) {
+        json props = json::object();
+        for (auto& [k, v] : el.properties) props[k.str()] = v.to_string();
+        j["properties"] = std::move(props);
+    }
+    if (tree.has_children(node)) {
+        json kids = json::array();
+        for (NodeId c : tree.children(node)) kids.push_back(reference_element_json(tree, c));
+        j["children"] = std::move(kids);
+    }
+    return j;
+}
+
+static std::string reference_json(const ElementTree& tree, NodeId root, uintptr_t hwnd, DWORD pid,
+                                  const std::string& processName,
+                                  const std::vector<std::string>& frameworks) {
+    char hwndBuf[32];
+    snprintf(hwndBuf, sizeof(hwndBuf), "0x%08llX", static_cast<unsigned long long>(hwnd));
+    json output;
+    output["target"] = json{{"hwnd", hwndBuf}, {"pid", pid}, {"processName", processName}};
+    output["frameworks"] = frameworks;
+    output["root"] = reference_element_json(tree, root);
+    return output.dump(2);
+}
+
+TEST(JsonSerializer, ByteIdenticalToDomOutput) {
+    auto tree = make_test_tree();
+    EXPECT_EQ(serialize_to_json(tree, tree.root(), (HWND)0x1234, 42, "test.exe", {"win32"}),
+              reference_json(tree, tree.root(), 0x1234, 42, "test.exe", {"win32"}));
+}
+
+TEST(JsonSerializer, ByteIdenticalFrameworkLists) {
+    auto tree = make_single("Window", "win32");
+    EXPECT_EQ(serialize_to_json(tree, tree.root(), nullptr, 0, "a.exe", {}),
+              reference_json(tree, tree.root(), 0, 0, "a.exe", {}));
+    EXPECT_EQ(serialize_to_json(tree, tree.root(), (HWND)0xABCDEF012, 4294967295u, "a.exe",
+                                {"Win32", "WinUI 3 1.5", "ComCtl 6.10"}),
+              reference_json(tree, tree.root(), 0xABCDEF012, 4294967295u, "a.exe",
+                             {"Win32", "WinUI 3 1.5", "ComCtl 6.10"}));
+}
+
+TEST(JsonSerializer, ByteIdenticalEscapes) {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    Element& r = tree[root];
+    r.id = "id\"with\\quote";
+    r.type = "Ty\x01pe\"Q\"";
+    r.framework = "fw\ttab\n";
+    r.className = "Cls\\\x1f" "End";
+    r.text = "line1\nline2\t\x7f caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80";
+    r.bounds = {-5, -10, 0, 0};
+    r.properties.set("k\"ey", "v\\al\x02ue\r\b\f");
+    r.properties.set(prop::kVisible, false);
+    r.properties.set(prop::kHwnd, HandleValue{0x42});
+    r.properties.set("count", 12);
+    NodeId c = tree.append_child(root);
+    tree[c].type = "Child";
+    tree[c].text = "\x01\x02";  // sanitizes to an empty string, key still present
+    assign_element_ids(tree);
+    tree[root].id = "id\"with\\quote";
+
+    EXPECT_EQ(serialize_to_json(tree, root, nullptr, 7, "p\"roc\x05.exe", {"x\\y"}),
+              reference_json(tree, root, 0, 7, "p\"roc\x05.exe", {"x\\y"}));
+}
+
+TEST(JsonSerializer, ByteIdenticalScopedSubtree) {
+    auto tree = lvt::testing::make_synthetic_tree(500, 3);
+    assign_element_ids(tree);
+    NodeId scope = tree.child_at(tree.root(), 0);
+    ASSERT_NE(scope, kNoNode);
+    EXPECT_EQ(serialize_to_json(tree, scope, nullptr, 1, "s.exe", {"winui3"}),
+              reference_json(tree, scope, 0, 1, "s.exe", {"winui3"}));
+}
+
+TEST(JsonSerializer, ByteIdenticalOnLargeSyntheticTree) {
+    auto tree = lvt::testing::make_synthetic_tree(20000, 9);
+    for (size_t i = 0; i < tree.size(); i += 3) {
+        auto& props = tree[static_cast<NodeId>(i)].properties;
+        props.set(prop::kVisible, (i & 1) != 0);
+        props.set(prop::kIndex, static_cast<int64_t>(i));
+    }
+    assign_element_ids(tree);
+    EXPECT_EQ(serialize_to_json(tree, tree.root(), (HWND)0x10, 2, "big.exe", {"winui3"}),
+              reference_json(tree, tree.root(), 0x10, 2, "big.exe", {"winui3"}));
+}
+
+TEST(JsonSerializer, CompactIsDumpWithoutIndent) {
+    auto tree = lvt::testing::make_synthetic_tree(2000, 4);
+    tree[tree.root()].properties.set("a\"b", "x\ny");
+    assign_element_ids(tree);
+    for (auto frameworks : {std::vector<std::string>{}, std::vector<std::string>{"win32", "winui3"}}) {
+        std::string compact;
+        {
+            StringSink sink(compact);
+            write_json(sink, tree, tree.root(), (HWND)0x10, 2, "big.exe", frameworks, true, true);
+        }
+        EXPECT_EQ(compact, json::parse(serialize_to_json(tree, tree.root(), (HWND)0x10, 2, "big.exe", frameworks,
+                                                         true)).dump());
+    }
+}
+
+TEST(JsonSerializer, MalformedUtf8IsReplaced) {
+    auto tree = make_single("Window", "win32");
+    tree[tree.root()].text = "ok\xC3(\xFF";
+    auto result = serialize_to_json(tree, tree.root(), nullptr, 0, "a.exe", {});
+    auto j = json::parse(result);
+    EXPECT_EQ(j["root"]["text"], "ok\xEF\xBF\xBD(\xEF\xBF\xBD");
+}
+
+TEST(JsonSerializer, WritesToFileSink) {
+    auto tree = make_test_tree();
+    std::string path = ::testing::TempDir() + "lvt_core_tests_sink.json";
+    {
+        FileSink sink(path);
+        ASSERT_TRUE(sink.is_open());
+        write_json(sink, tree, tree.root(), nullptr, 1, "f.exe", {"win32"});
+        sink.write("\n");
+        sink.flush();
+        EXPECT_TRUE(sink.ok());
+    }
+    FILE* f = fopen(path.c_str(), "rb");
+    ASSERT_NE(f, nullptr);
+    std::string contents;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) contents.append(buf, n);
+    fclose(f);
+    std::remove(path.c_str());
+    EXPECT_EQ(contents, serialize_to_json(tree, tree.root(), nullptr, 1, "f.exe", {"win32"}) + "\n");
+}
+
+TEST(OutputSink, LargeAndSmallWritesKeepOrder) {
+    std::string out;
+    {
+        StringSink sink(out);
+        std::string big(100000, 'x');
+        sink.write("a");
+        sink.write(big);
+        sink.put('b');
+        for (int i = 0; i < 20000; i++) sink.write("cd");
+    }
+    ASSERT_EQ(out.size(), 1 + 100000 + 1 + 40000u);
+    EXPECT_EQ(out.front(), 'a');
+    EXPECT_EQ(out[100001], 'b');
+    EXPECT_EQ(out.substr(out.size() - 4), "cdcd");
+}
+
+// ---- XML serialization ----
+
+TEST(XmlSerializer, HashesOnRequest) {
+    auto tree = make_test_tree();
+    EXPECT_EQ(serialize_to_xml(tree, tree.root(), nullptr, 0, "t.exe", {}).find(" hash="), std::string::npos);
+    std::ostringstream hex;
+    hex << std::hex << std::setw(16) << std::setfill('0') << tree[tree.root()].hash;
+    auto xml = serialize_to_xml(tree, tree.root(), nullptr, 0, "t.exe", {}, true);
+    EXPECT_NE(xml.find("id=\"e0\" hash=\"" + hex.str() + "\""), std::string::npos);
+}
+
+TEST(XmlSerializer, BasicStructure) {
+    auto tree = make_test_tree();
+    auto result = serialize_to_xml(tree, tree.root(), (HWND)0x1234, 42, "test.exe", {"win32"});
+
+    EXPECT_NE(result.find("<LiveVisualTree"), std::string::npos);
+    EXPECT_NE(result.find("</LiveVisualTree>"), std::string::npos);
+    EXPECT_NE(result.find("pid=\"42\""), std::string::npos);
+    EXPECT_NE(result.find("process=\"test.exe\""), std::string::npos);
+    EXPECT_NE(result.find("frameworks=\"win32\""), std::string::npos);
+}
+
+TEST(XmlSerializer, ElementAttributes) {
+    auto tree = make_test_tree();
+    auto result = serialize_to_xml(tree, tree.root(), nullptr, 0, "test.exe", {});
+
+    EXPECT_NE(result.find("<Window"), std::string::npos);
+    EXPECT_NE(result.find("id=\"e0\""), std::string::npos);
+    EXPECT_NE(result.find("framework=\"win32\""), std::string::npos);
+    EXPECT_NE(result.find("text=\"Hello\""), std::string::npos);
+    EXPECT_NE(result.find("bounds=\"100,200,800,600\""), std::string::npos);
+}
+
+TEST(XmlSerializer, ChildNesting) {
+    auto tree = make_test_tree();
+    auto result = serialize_to_xml(tree, tree.root(), nullptr, 0, "test.exe", {});
+
+    EXPECT_NE(result.find("<Button"), std::string::npos);
+    EXPECT_NE(result.find("</Window>"), std::string::npos);
+}
+
+TEST(XmlSerializer, SelfClosingLeaf) {
+    auto tree = make_single("Leaf", "test");
+    assign_element_ids(tree);
+    auto result = serialize_to_xml(tree, tree.root(), nullptr, 0, "test.exe", {});
+
+    EXPECT_NE(result.find("<Leaf"), std::string::npos);
+    EXPECT_NE(result.find("/>"), std::string::npos);
+    EXPECT_EQ(result.find("</Leaf>"), std::string::npos);
+}
+
+TEST(XmlSerializer, SpecialCharsEscaped) {
+    auto tree = make_single("Window", "win32");
+    tree[tree.root()].text = "File & <Edit>";
+    assign_element_ids(tree);
+    auto result = serialize_to_xml(tree, tree.root(), nullptr, 0, "test.exe", {});
+
+    EXPECT_NE(result.find("&amp;"), std::string::npos);
+    EXPECT_NE(result.find("&lt;"), std::string::npos);
+    EXPECT_NE(result.find("&gt;"), std::string::npos);
+}
+
+TEST(XmlSerializer, InvalidTagNameFallback) {
+    auto tree = make_single("123Invalid", "test");  // starts with digit
+    assign_element_ids(tree);
+    auto result = serialize_to_xml(tree, tree.root(), nullptr, 0, "test.exe", {});
+
+    // Should fall back to "Element" tag
+    EXPECT_NE(result.find("<Element"), std::string::npos);
+}
+
+TEST(XmlSerializer, ControlCharsStripped) {
+    auto tree = make_single("Win\x01" "dow", "test");
+    assign_element_ids(tree);
+    auto result = serialize_to_xml(tree, tree.root(), nullptr, 0, "test.exe", {});
+
+    EXPECT_NE(result.find("<Window"), std::string::npos);
+}
+
+TEST(XmlSerializer, ZeroBoundsOmitted) {
+    auto tree = make_single("Window", "test");
+    tree[tree.root()].bounds = {0, 0, 0, 0};
+    assign_element_ids(tree);
+    auto result = serialize_to_xml(tree, tree.root(), nullptr, 0, "test.exe", {});
+
+    EXPECT_EQ(result.find("bounds="), std::string::npos);
+}
+
+TEST(XmlSerializer, PropertiesAsAttributes) {
+    auto tree = make_single("Window", "test");
+    tree[tree.root()].properties.set("visible", "true");
+    tree[tree.root()].properties.set("style", "WS_OVERLAPPED");
+    assign_element_ids(tree);
+    auto result = serialize_to_xml(tree, tree.root(), nullptr, 0, "test.exe", {});
+
+    EXPECT_NE(result.find("visible=\"true\""), std::string::npos);
+    EXPECT_NE(result.find("style=\"WS_OVERLAPPED\""), std::string::npos);
+}
+
+TEST(XmlSerializer, ClassNameOmittedWhenSameAsType) {
+    auto tree = make_single("Button", "test");
+    tree[tree.root()].className = "Button";  // same as type
+    assign_element_ids(tree);
+    auto result = serialize_to_xml(tree, tree.root(), nullptr, 0, "test.exe", {});
+
+    EXPECT_EQ(result.find("className="), std::string::npos);
+}
+
+TEST(XmlSerializer, ClassNameShownWhenDifferent) {
+    auto tree = make_single("Button", "test");
+    tree[tree.root()].className = "Win32Button";  // different
+    assign_element_ids(tree);
+    auto result = serialize_to_xml(tree, tree.root(), nullptr, 0, "test.exe", {});
+
+    EXPECT_NE(result.find("className=\"Win32Button\""), std::string::npos);
+}
+
+// The ostringstream-based serializer write_xml replaced, kept as the
+// byte-for-byte reference.
+static std::string reference_xml_escape(const std::string& s) {
+    std::string r;
+    for (char c : s) {
+        switch (c) {
+        case '&':  r += "&amp;";  break;
+        case '<':  r += "&lt;";   break;
+        case '>':  r += "&gt;";   break;
+        case '"':  r += "&quot;"; break;
+        case '\'': r += "&apos;"; break;
+        default:
+            if (static_cast<unsigned char>(c) >= 0x20) r += c;
+        }
+    }
+    return r;
+}
+
+static void reference_element_xml(const ElementTree& tree, NodeId node, std::ostringstream& out,
+                                  int indent) {
+    const Element& el = tree[node];
+    std::string pad(indent * 2, ' ');
+    std::string tag;
+    for (char c : el.type.str())
+        if (static_cast<unsigned char>(c) >= 0x20 && c != '<' && c != '>' && c != ' ') tag += c;
+    if (tag.empty() || !(isalpha((unsigned char)tag[0]) || tag[0] == '_')) tag = "Element";
+
+    out << pad << "<" << tag;
+    out << " id=\"" << reference_xml_escape(el.id) << "\"";
+    out << " framework=\"" << reference_xml_escape(el.framework.str()) << "\"";
+    if (!el.className.empty() && el.className != el.type)
+        out << " className=\"" << reference_xml_escape(el.className.str()) << "\"";
+    if (!el.text.empty())
+        out << " text=\"" << reference_xml_escape(el.text) << "\"";
+    if (el.bounds.width > 0 || el.bounds.height > 0)
+        out << " bounds=\"" << el.bounds.x << "," << el.bounds.y
+            << "," << el.bounds.width << "," << el.bounds.height << "\"";
+    for (auto& [k, v] : el.properties)
+        out << " " << reference_xml_escape(k.str()) << "=\"" << reference_xml_escape(v.to_string()) << "\"";
+
+    if (!tree.has_children(node)) {
+        out << " />\n";
+    } else {
+        out << ">\n";
+        for (NodeId c : tree.children(node)) reference_element_xml(tree, c, out, indent + 1);
+        out << pad << "</" << tag << ">\n";
+    }
+}
+
+static std::string reference_xml(const ElementTree& tree, NodeId root, uintptr_t hwnd, DWORD pid,
+                                 const std::string& processName,
+                                 const std::vector<std::string>& frameworks) {
+    std::ostringstream out;
+    out << "<LiveVisualTree hwnd=\"0x" << std::hex << std::uppercase << std::setfill('0')
+        << std::setw(8) << hwnd << std::dec << "\" pid=\"" << pid << "\" process=\""
+        << reference_xml_escape(processName) << "\" frameworks=\"";
+    for (size_t i = 0; i < frameworks.size(); i++) {
+        if (i) out << ",";
+        out << reference_xml_escape(frameworks[i]);
+    }
+    out << "\">\n";
+    reference_element_xml(tree, root, out, 1);
+    out << "</LiveVisualTree>\n";
+    return out.str();
+}
+
+TEST(XmlSerializer, ByteIdenticalToStreamOutput) {
+    auto tree = make_test_tree();
+    EXPECT_EQ(serialize_to_xml(tree, tree.root(), (HWND)0x1234, 42, "test.exe", {"win32"}),
+              reference_xml(tree, tree.root(), 0x1234, 42, "test.exe", {"win32"}));
+    EXPECT_EQ(serialize_to_xml(tree, tree.root(), (HWND)0xABCDEF012, 4294967295u, "a.exe",
+                               {"Win32", "WinUI 3 1.5"}),
+              reference_xml(tree, tree.root(), 0xABCDEF012, 4294967295u, "a.exe",
+                            {"Win32", "WinUI 3 1.5"}));
+}
+
+TEST(XmlSerializer, ByteIdenticalEscapes) {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    Element& r = tree[root];
+    r.type = "9<Bad Tag>";
+    r.framework = "f&w\t";
+    r.className = "Cls'\x1f\"";
+    r.text = "a<b>&c \"q\" 'x'\n\x01 caf\xC3\xA9";
+    r.bounds = {-5, -10, 3, 0};
+    r.properties.set("k<ey", "v&al\x02ue");
+    r.properties.set(prop::kVisible, false);
+    r.properties.set(prop::kHwnd, HandleValue{0x42});
+    NodeId c = tree.append_child(root);
+    tree[c].type = "Child";
+    tree[c].className = "Child";
+    tree.append_child(c);
+    assign_element_ids(tree);
+    tree[root].id = "id\"<&>";
+
+    EXPECT_EQ(serialize_to_xml(tree, root, nullptr, 7, "p&roc\x05.exe", {"x<y"}),
+              reference_xml(tree, root, 0, 7, "p&roc\x05.exe", {"x<y"}));
+}
+
+TEST(XmlSerializer, ByteIdenticalOnLargeSyntheticTree) {
+    auto tree = lvt::testing::make_synthetic_tree(20000, 9);
+    for (size_t i = 0; i < tree.size(); i += 3) {
+        auto& props = tree[static_cast<NodeId>(i)].properties;
+        props.set(prop::kVisible, (i & 1) != 0);
+        props.set(prop::kIndex, static_cast<int64_t>(i));
+    }
+    assign_element_ids(tree);
+    EXPECT_EQ(serialize_to_xml(tree, tree.root(), (HWND)0x10, 2, "big.exe", {"winui3"}),
+              reference_xml(tree, tree.root(), 0x10, 2, "big.exe", {"winui3"}));
+    NodeId scope = tree.child_at(tree.root(), 0);
+    EXPECT_EQ(serialize_to_xml(tree, scope, nullptr, 1, "s.exe", {}),
+              reference_xml(tree, scope, 0, 1, "s.exe", {}));
+}
+
+TEST(XmlSerializer, DeepChainIndentsPastTable) {
+    ElementTree tree;
+    NodeId n = tree.add_root();
+    tree[n].type = "Node";
+    for (int i = 0; i < 1000; i++) {
+        n = tree.append_child(n);
+        tree[n].type = "Node";
+    }
+    assign_element_ids(tree);
+    auto result = serialize_to_xml(tree, tree.root(), nullptr, 0, "deep.exe", {});
+    EXPECT_EQ(result, reference_xml(tree, tree.root(), 0, 0, "deep.exe", {}));
+    EXPECT_NE(result.find("\n" + std::string(2002, ' ') + "<Node id=\"e1000\""), std::string::npos);
+}
+
+// ---- Snapshots ----
+
+// An lvtbin image in 8-byte aligned storage, as a mapping would provide.
+struct SnapshotImage {
+    std::vector<uint64_t> words;
+    size_t size = 0;
+    const void* data() const { return words.data(); }
+    char* bytes() { return reinterpret_cast<char*>(words.data()); }
+};
+
+static SnapshotImage make_snapshot(const ElementTree& tree, NodeId root, HWND hwnd = (HWND)0x1234,
+                                   DWORD pid = 42, const std::string& processName = "test.exe",
+                                   const std::vector<std::string>& frameworks = {"win32"},
+                                   bool hashes = false) {
+    std::string bytes;
+    {
+        StringSink sink(bytes);
+        write_snapshot(sink, tree, root, hwnd, pid, processName, frameworks, hashes);
+    }
+    SnapshotImage image;
+    image.size = bytes.size();
+    image.words.resize((bytes.size() + 7) / 8);
+    std::memcpy(image.words.data(), bytes.data(), bytes.size());
+    return image;
+}
+
+static ElementTree make_typed_property_tree() {
+    auto tree = make_test_tree();
+    auto& props = tree[tree.root()].properties;
+    props.set(prop::kVisible, true);
+    props.set(prop::kIndex, int64_t{-7});
+    props.set("opacity", 0.25);
+    props.set("margin", Bounds{1, -2, 3, 4});
+    props.set(prop::kHwnd, HandleValue{0xABCDEF0123});
+    props.set("name", "caf\xC3\xA9 \"quoted\"");
+    tree[tree.root()].nativeHandle = 0x1234;
+    tree[tree.child_at(tree.root(), 0)].text = "";
+    NodeId label = tree.append_child(tree.root());
+    tree[label].type = "Static";
+    tree[label].framework = "win32";
+    tree[label].text = "Status\tready";
+    assign_element_ids(tree);
+    return tree;
+}
+
+TEST(Snapshot, RoundTripsElementsAndTypes) {
+    auto tree = make_typed_property_tree();
+    auto image = make_snapshot(tree, tree.root());
+
+    SnapshotView view;
+    std::string error;
+    ASSERT_TRUE(view.open(image.data(), image.size, &error)) << error;
+    EXPECT_EQ(view.hwnd(), (HWND)0x1234);
+    EXPECT_EQ(view.pid(), 42u);
+    EXPECT_EQ(view.process_name(), "test.exe");
+    ASSERT_EQ(view.framework_count(), 1u);
+    EXPECT_EQ(view.framework(0), "win32");
+
+    ElementTree loaded = view.to_tree();
+    ASSERT_EQ(loaded.size(), tree.size());
+    for (NodeId n = 0; n < tree.size(); n++) {
+        const Element& a = tree[n];
+        const Element& b = loaded[n];
+        EXPECT_EQ(a.id, b.id);
+        EXPECT_EQ(a.type, b.type);
+        EXPECT_EQ(a.framework, b.framework);
+        EXPECT_EQ(a.className, b.className);
+        EXPECT_EQ(a.text, b.text);
+        EXPECT_EQ(a.bounds.x, b.bounds.x);
+        EXPECT_EQ(a.bounds.height, b.bounds.height);
+        EXPECT_EQ(a.nativeHandle, b.nativeHandle);
+        EXPECT_EQ(tree.parent(n), loaded.parent(n));
+        EXPECT_EQ(tree.child_count(n), loaded.child_count(n));
+        ASSERT_EQ(a.properties.size(), b.properties.size());
+        auto it = b.properties.begin();
+        for (auto& [k, v] : a.properties) {
+            EXPECT_EQ(k, it->key);
+            EXPECT_EQ(v.storage().index(), it->value.storage().index()) << k;
+            EXPECT_EQ(v.to_string(), it->value.to_string()) << k;
+            ++it;
+        }
+    }
+    EXPECT_EQ(serialize_to_json(loaded, loaded.root(), view.hwnd(), view.pid(), "test.exe", {"win32"}),
+              serialize_to_json(tree, tree.root(), (HWND)0x1234, 42, "test.exe", {"win32"}));
+}
+
+TEST(Snapshot, ReaderWalksInPlace) {
+    auto tree = make_typed_property_tree();
+    auto image = make_snapshot(tree, tree.root());
+    SnapshotView view;
+    ASSERT_TRUE(view.open(image.data(), image.size));
+
+    auto root = view.node(view.root());
+    EXPECT_EQ(root.id(), "e0");
+    EXPECT_EQ(root.type(), "Window");
+    EXPECT_EQ(root.child_count(), 2u);
+    ASSERT_EQ(root.property_count(), tree[0].properties.size());
+    bool sawHandle = false;
+    for (size_t i = 0; i < root.property_count(); i++) {
+        auto p = root.property(i);
+        if (p.key() == "hwnd") {
+            EXPECT_EQ(p.kind(), snapshot::PropertyKind::Handle);
+            EXPECT_EQ(p.as_handle(), 0xABCDEF0123u);
+            sawHandle = true;
+        }
+        if (p.key() == "margin") {
+            EXPECT_EQ(p.as_rect().y, -2);
+        }
+        if (p.key() == "opacity") {
+            EXPECT_EQ(p.as_double(), 0.25);
+        }
+    }
+    EXPECT_TRUE(sawHandle);
+
+    std::vector<std::string_view> ids;
+    for (NodeId n = view.root(); n != kNoNode; n = view.next_preorder(n, view.root()))
+        ids.push_back(view.node(n).id());
+    EXPECT_EQ(ids, (std::vector<std::string_view>{"e0", "e1", "e2"}));
+    EXPECT_EQ(view.node(1).next_sibling(), 2u);
+    EXPECT_EQ(view.node(2).parent(), 0u);
+}
+
+TEST(Snapshot, SubtreeIsRenumberedAndDetachedNodesDropped) {
+    auto tree = lvt::testing::make_synthetic_tree(3000, 4);
+    assign_element_ids(tree);
+    NodeId scope = tree.child_at(tree.root(), 1);
+    ASSERT_NE(scope, kNoNode);
+    trim_to_depth(tree, scope, 2);
+
+    auto image = make_snapshot(tree, scope);
+    SnapshotView view;
+    ASSERT_TRUE(view.open(image.data(), image.size));
+    ElementTree loaded = view.to_tree();
+    EXPECT_LT(loaded.size(), tree.size());
+    EXPECT_EQ(serialize_to_xml(loaded, loaded.root(), nullptr, 0, "s.exe", {}),
+              serialize_to_xml(tree, scope, nullptr, 0, "s.exe", {}));
+
+    // IDs survive, so --element lookups work against the loaded tree.
+    ElementIndex index(loaded);
+    EXPECT_EQ(index.find_by_id(tree[scope].id), loaded.root());
+}
+
+TEST(Snapshot, CarriesHashesOnRequest) {
+    auto tree = make_typed_property_tree();
+    SnapshotView view;
+    auto plain = make_snapshot(tree, tree.root());
+    ASSERT_TRUE(view.open(plain.data(), plain.size));
+    EXPECT_FALSE(view.has_hashes());
+    EXPECT_EQ(view.node(1).hash(), 0u);
+
+    auto image = make_snapshot(tree, tree.root(), (HWND)0x1234, 42, "test.exe", {"win32"}, true);
+    ASSERT_TRUE(view.open(image.data(), image.size));
+    ASSERT_TRUE(view.has_hashes());
+    EXPECT_EQ(view.node(1).hash(), tree[tree.first_child(tree.root())].hash);
+    ElementTree loaded = view.to_tree();
+    ASSERT_EQ(loaded.size(), tree.size());
+    for (NodeId n = 0; n < loaded.size(); n++) EXPECT_EQ(loaded[n].hash, tree[n].hash);
+
+    // A hash table that runs past the end is rejected.
+    reinterpret_cast<snapshot::Header*>(image.bytes())->hashOffset = image.size - 8;
+    std::string error;
+    EXPECT_FALSE(view.open(image.data(), image.size, &error));
+    EXPECT_EQ(error, "snapshot section out of bounds");
+}
+
+TEST(Snapshot, ReadsVersion1Images) {
+    // Version 1 headers end before hashOffset; sections are found through
+    // the offsets, so a shortened header reads the same.
+    auto tree = make_typed_property_tree();
+    auto image = make_snapshot(tree, tree.root());
+    auto* header = reinterpret_cast<snapshot::Header*>(image.bytes());
+    header->version = 1;
+    header->headerSize = snapshot::kHeaderSizeV1;
+    header->hashOffset = 12345;  // not part of a version 1 header
+    SnapshotView view;
+    std::string error;
+    ASSERT_TRUE(view.open(image.data(), image.size, &error)) << error;
+    EXPECT_FALSE(view.has_hashes());
+    EXPECT_EQ(view.node_count(), tree.size());
+}
+
+TEST(Snapshot, EmptyTree) {
+    ElementTree tree;
+    auto image = make_snapshot(tree, tree.root(), nullptr, 0, "", {});
+    SnapshotView view;
+    ASSERT_TRUE(view.open(image.data(), image.size));
+    EXPECT_EQ(view.node_count(), 0u);
+    EXPECT_EQ(view.root(), kNoNode);
+    EXPECT_TRUE(view.to_tree().empty());
+}
+
+TEST(Snapshot, RejectsDamagedImages) {
+    auto tree = make_typed_property_tree();
+    auto good = make_snapshot(tree, tree.root());
+    SnapshotView view;
+    std::string error;
+
+    auto image = good;
+    image.bytes()[0] = 'X';
+    EXPECT_FALSE(view.open(image.data(), image.size, &error));
+    EXPECT_EQ(error, "not an lvtbin snapshot");
+
+    image = good;
+    reinterpret_cast<snapshot::Header*>(image.bytes())->version = snapshot::kVersion + 1;
+    EXPECT_FALSE(view.open(image.data(), image.size, &error));
+    EXPECT_EQ(error, "unsupported snapshot version");
+
+    EXPECT_FALSE(view.open(good.data(), good.size - 1, &error));
+    EXPECT_EQ(error, "snapshot is truncated");
+    EXPECT_FALSE(view.open(good.data(), 10, &error));
+
+    auto* header = reinterpret_cast<const snapshot::Header*>(good.bytes());
+    auto nodeAt = [&](SnapshotImage& img, size_t i) {
+        return reinterpret_cast<snapshot::Node*>(img.bytes() + header->nodeOffset) + i;
+    };
+
+    image = good;
+    nodeAt(image, 2)->nextSibling = 1;  // backwards link would loop
+    EXPECT_FALSE(view.open(image.data(), image.size, &error));
+    EXPECT_EQ(error, "snapshot is corrupt");
+
+    image = good;
+    nodeAt(image, 1)->text = {static_cast<uint32_t>(header->stringSize), 1};
+    EXPECT_FALSE(view.open(image.data(), image.size, &error));
+
+    image = good;
+    nodeAt(image, 0)->propertyCount = 1000;
+    EXPECT_FALSE(view.open(image.data(), image.size, &error));
+
+    EXPECT_TRUE(view.open(good.data(), good.size, &error));
+}
+
+TEST(Snapshot, MapsFileWrittenThroughFileSink) {
+    auto tree = lvt::testing::make_synthetic_tree(5000, 11);
+    for (size_t i = 0; i < tree.size(); i += 2)
+        tree[static_cast<NodeId>(i)].properties.set(prop::kHwnd, HandleValue{0x100 + i});
+    assign_element_ids(tree);
+    std::string path = ::testing::TempDir() + "lvt_core_tests_snapshot.lvtbin";
+    {
+        FileSink sink(path, true);
+        ASSERT_TRUE(sink.is_open());
+        write_snapshot(sink, tree, tree.root(), (HWND)0x77, 9, "m.exe", {"Win32", "WinUI 3"});
+        sink.flush();
+        EXPECT_TRUE(sink.ok());
+    }
+    {
+        MappedFile file;
+        std::string error;
+        ASSERT_TRUE(file.open(path, &error)) << error;
+        SnapshotView view;
+        ASSERT_TRUE(view.open(file.data(), file.size(), &error)) << error;
+        EXPECT_EQ(view.node_count(), tree.size());
+        EXPECT_EQ(view.framework(1), "WinUI 3");
+        ElementTree loaded = view.to_tree();
+        EXPECT_EQ(serialize_to_json(loaded, loaded.root(), view.hwnd(), view.pid(), "m.exe", {}),
+                  serialize_to_json(tree, tree.root(), (HWND)0x77, 9, "m.exe", {}));
+    }
+    std::remove(path.c_str());
+
+    MappedFile missing;
+    std::string error;
+    EXPECT_FALSE(missing.open(path, &error));
+    EXPECT_EQ(error, "cannot open file");
+}
+
+// ---- Stable IDs ----
+
+// A window (0x100) holding a panel of named XAML buttons and a child window.
+static ElementTree make_stable_tree(const std::vector<std::string>& buttons, uintptr_t childHandle = 0x200,
+                                    const char* title = "Demo") {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root] = {.type = "Window", .framework = "win32", .className = "DemoWindow", .text = title,
+                  .nativeHandle = 0x100};
+    NodeId panel = tree.append_child(root, {.type = "StackPanel", .framework = "xaml"});
+    for (auto& name : buttons)
+        tree.append_child(panel, {.type = "Button", .framework = "xaml", .text = name});
+    NodeId child = tree.append_child(root, {.type = "Edit", .framework = "win32", .className = "Edit",
+                                            .nativeHandle = childHandle});
+    tree.append_child(child, {.type = "Caret", .framework = "xaml"});
+    return tree;
+}
+
+static std::unordered_map<std::string, std::string> ids_by_path(const ElementTree& tree) {
+    // Keyed by type and text along the path, which these tests keep unique.
+    std::unordered_map<std::string, std::string> ids;
+    std::vector<std::string> paths(tree.size());
+    for (NodeId n = tree.root(); n != kNoNode; n = tree.next_preorder(n, tree.root())) {
+        NodeId p = tree.parent(n);
+        paths[n] = (p == kNoNode ? "" : paths[p] + "/") + tree[n].type.str() + ":" + tree[n].text;
+        ids[paths[n]] = tree[n].id;
+    }
+    return ids;
+}
+
+TEST(StableIds, SurviveInsertedSiblings) {
+    ElementTree before = make_stable_tree({"OK", "Cancel"});
+    assign_stable_ids(before);
+    // A toast ahead of everything, and a new button between the two.
+    ElementTree after = make_stable_tree({"Toast", "OK", "Apply", "Cancel"});
+    NodeId toast = after.append_child(after.root(), {.type = "Toast", .framework = "xaml"});
+    assign_stable_ids(after);
+
+    auto was = ids_by_path(before), is = ids_by_path(after);
+    for (auto& [path, id] : was) {
+        EXPECT_EQ(is[path], id) << path;
+        EXPECT_EQ(id.size(), 13u);
+        EXPECT_EQ(id[0], 's');
+    }
+    EXPECT_EQ(std::count_if(is.begin(), is.end(), [&](auto& e) { return e.second == after[toast].id; }), 1);
+}
+
+TEST(StableIds, LikeSiblingsAndLargeTreesStayUnique) {
+    ElementTree tree = make_stable_tree({"Same", "Same", "Same"});
+    NodeId panel = tree.first_child(tree.root());
+    for (int i = 0; i < 1000; i++) tree.append_child(panel, {.type = "Border", .framework = "xaml"});
+    assign_stable_ids(tree);
+    std::unordered_set<std::string> seen;
+    for (NodeId n = 0; n < tree.size(); n++) EXPECT_TRUE(seen.insert(tree[n].id).second) << tree[n].id;
+
+    ElementTree big = lvt::testing::make_synthetic_tree(200000);
+    ElementIndex index;
+    assign_stable_ids(big, &index);
+    seen.clear();
+    for (NodeId n = 0; n < big.size(); n++) ASSERT_TRUE(seen.insert(big[n].id).second);
+    EXPECT_EQ(index.find_by_id(big[1234].id), 1234u);
+}
+
+TEST(StableIds, WindowsKeyOnHandleNotTitle) {
+    ElementTree a = make_stable_tree({"OK"}, 0x200, "Untitled - Demo");
+    ElementTree b = make_stable_tree({"OK"}, 0x200, "*notes.txt - Demo");
+    ElementTree c = make_stable_tree({"OK"}, 0x300, "Untitled - Demo");
+    assign_stable_ids(a);
+    assign_stable_ids(b);
+    assign_stable_ids(c);
+    NodeId edit = a.child_at(a.root(), 1);
+    NodeId caret = a.first_child(edit);
+    EXPECT_EQ(a[caret].id, b[caret].id);
+    EXPECT_NE(a[caret].id, c[caret].id);  // a new handle is a new window
+}
+
+TEST(StableIds, CarryOverFromAPreviousSnapshot) {
+    // The previous run used e0, e1, ...; since then the app restarted (new
+    // child handle) and the first button was renamed.
+    ElementTree previous = make_stable_tree({"OK", "Cancel"});
+    assign_element_ids(previous);
+    auto image = make_snapshot(previous, previous.root());
+    SnapshotView view;
+    ASSERT_TRUE(view.open(image.data(), image.size));
+    ElementTree loaded = view.to_tree();
+
+    ElementTree tree = make_stable_tree({"Done", "Cancel", "Help"}, 0x300);
+    ElementIndex index;
+    assign_stable_ids(tree, &index, &loaded);
+    // Same shape apart from the new "Help", so every other node carries the
+    // ID of the node at its position ("OK" -> "Done" pairs up by type).
+    for (NodeId n = 0; n < loaded.size(); n++) {
+        NodeId at = n < 4 ? n : n + 1;
+        EXPECT_EQ(tree[at].id, loaded[n].id) << loaded[n].id;
+    }
+    EXPECT_EQ(tree[4].text, "Help");
+    EXPECT_EQ(tree[4].id[0], 's');
+    EXPECT_EQ(loaded[4].id, "w200");
+    EXPECT_EQ(index.find_by_id("w200"), tree.child_at(tree.root(), 1));
+}
+
+TEST(StableIds, CarriedIdsWinCollisionsWithFreshOnes) {
+    // The previous "Cancel" button carried the ID that "OK" hashes to now;
+    // "Cancel" keeps it and "OK" moves to another.
+    ElementTree fresh = make_stable_tree({"OK"});
+    assign_stable_ids(fresh);
+    NodeId freshOk = fresh.first_child(fresh.first_child(fresh.root()));
+
+    ElementTree previous = make_stable_tree({"Cancel"});
+    assign_stable_ids(previous);
+    previous[previous.first_child(previous.first_child(previous.root()))].id = fresh[freshOk].id;
+
+    ElementTree tree = make_stable_tree({"Cancel", "OK"});
+    assign_stable_ids(tree, nullptr, &previous);
+    NodeId panel = tree.first_child(tree.root());
+    EXPECT_EQ(tree[tree.child_at(panel, 0)].id, fresh[freshOk].id);
+    EXPECT_NE(tree[tree.child_at(panel, 1)].id, fresh[freshOk].id);
+    EXPECT_EQ(tree[tree.child_at(panel, 1)].id.size(), 13u);
+}
+
+// ---- Tree diff ----
+
+TEST(JsonReader, RoundTripsWriteJson) {
+    auto tree = make_test_tree();
+    tree[tree.root()].properties.set("count", int64_t{3});
+    std::string text = serialize_to_json(tree, tree.root(), (HWND)0x1234, 42, "test.exe", {"win32", "xaml"});
+    TreeDocument doc;
+    std::string error;
+    ASSERT_TRUE(read_json_document(text, doc, &error)) << error;
+    EXPECT_EQ(doc.hwnd, (HWND)0x1234);
+    EXPECT_EQ(doc.pid, 42u);
+    EXPECT_EQ(doc.processName, "test.exe");
+    EXPECT_EQ(doc.frameworks, (std::vector<std::string>{"win32", "xaml"}));
+    ASSERT_EQ(doc.tree.size(), 2u);
+    EXPECT_EQ(doc.tree[0].properties.find("count")->to_string(), "3");
+    EXPECT_EQ(serialize_to_json(doc.tree, doc.tree.root(), doc.hwnd, doc.pid, doc.processName, doc.frameworks),
+              text);
+
+    auto big = lvt::testing::make_synthetic_tree(3000, 5);
+    assign_element_ids(big);
+    text = serialize_to_json(big, big.root(), nullptr, 0, "big.exe", {"winui3"}, true);
+    ASSERT_TRUE(read_json_document(text, doc, &error)) << error;
+    hash_subtrees(doc.tree);
+    EXPECT_EQ(serialize_to_json(doc.tree, doc.tree.root(), nullptr, 0, "big.exe", {"winui3"}, true), text);
+}
+
+TEST(JsonReader, RejectsOtherDocuments) {
+    TreeDocument doc;
+    std::string error;
+    EXPECT_FALSE(read_json_document("{\"target\":{}}", doc, &error));
+    EXPECT_EQ(error, "not an lvt tree document");
+    EXPECT_FALSE(read_json_document("{\"root\":{\"children\":[", doc, &error));
+    EXPECT_FALSE(error.empty());
+    EXPECT_EQ(doc.tree.size(), 0u);
+    EXPECT_FALSE(read_json_document("{\"root\":{\"type\":\"A\"},\"root\":{\"type\":\"B\"}}", doc, &error));
+    EXPECT_EQ(error, "not an lvt tree document");
+    EXPECT_EQ(doc.tree.size(), 0u);
+    EXPECT_TRUE(read_json_document("{\"root\":null}", doc));
+    EXPECT_EQ(doc.tree.size(), 0u);
+}
+
+// A tree as nested values, for tests to edit freely.
+struct EditableNode {
+    Element el;
+    std::vector<EditableNode> children;
+};
+
+static EditableNode to_editable(const ElementTree& tree, NodeId node) {
+    EditableNode n{tree[node], {}};
+    for (NodeId c : tree.children(node)) n.children.push_back(to_editable(tree, c));
+    return n;
+}
+
+static void append_editable(ElementTree& tree, NodeId parent, const EditableNode& n) {
+    NodeId node = parent == kNoNode ? tree.add_root(n.el) : tree.append_child(parent, n.el);
+    for (auto& c : n.children) append_editable(tree, node, c);
+}
+
+// Random edits of every kind a diff has to describe: removals, insertions,
+// wrapping, reordering, moves across parents and field changes.
+static void edit_randomly(EditableNode& n, lvt::testing::SynthRng& rng, std::vector<EditableNode>& cut,
+                          int& fresh) {
+    auto& kids = n.children;
+    for (size_t i = 0; i < kids.size(); i++) {
+        switch (rng.below(40)) {
+        case 0:
+            kids.erase(kids.begin() + i--);
+            continue;
+        case 1:
+            cut.push_back(std::move(kids[i]));
+            kids.erase(kids.begin() + i--);
+            continue;
+        case 2:
+            kids.insert(kids.begin() + i++, {{.type = "Inserted", .framework = "winui3",
+                                             .text = "new " + std::to_string(fresh++)}});
+            break;
+        case 3: {
+            EditableNode wrapper{{.type = "Wrapper", .framework = "winui3"}, {std::move(kids[i])}};
+            kids[i] = std::move(wrapper);
+            break;
+        }
+        case 4:
+            kids[i].el.text = rng.below(2) ? "" : "edited " + std::to_string(fresh++);
+            break;
+        case 5:
+            kids[i].el.bounds.x += 7;
+            break;
+        case 6:
+            kids[i].el.properties.set(rng.below(2) ? "a/b~c" : "visible", rng.below(2) ? "true" : "false");
+            break;
+        case 7:
+            kids[i].el.className = rng.below(2) ? "" : "Changed";
+            break;
+        case 8:
+            if (!cut.empty()) {
+                kids.insert(kids.begin() + i++, std::move(cut.back()));
+                cut.pop_back();
+            }
+            break;
+        case 9:
+            if (i + 1 < kids.size()) std::swap(kids[i], kids[i + 1]);
+            break;
+        case 10:
+            std::reverse(kids.begin() + i, kids.end());
+            break;
+        }
+        edit_randomly(kids[i], rng, cut, fresh);
+    }
+}
+
+static ElementTree edited_copy(const ElementTree& tree, uint64_t seed) {
+    lvt::testing::SynthRng rng(seed);
+    EditableNode root = to_editable(tree, tree.root());
+    std::vector<EditableNode> cut;
+    int fresh = 0;
+    edit_randomly(root, rng, cut, fresh);
+    for (auto& c : cut) root.children.push_back(std::move(c));
+    ElementTree out;
+    append_editable(out, kNoNode, root);
+    return out;
+}
+
+static TreeDocument make_document(ElementTree tree, DWORD pid = 7) {
+    TreeDocument doc;
+    doc.tree = std::move(tree);
+    doc.hwnd = (HWND)0x100;
+    doc.pid = pid;
+    doc.processName = "app.exe";
+    doc.frameworks = {"winui3"};
+    return doc;
+}
+
+static std::string document_json(const TreeDocument& doc) {
+    return serialize_to_json(doc.tree, doc.tree.root(), doc.hwnd, doc.pid, doc.processName, doc.frameworks);
+}
+
+static std::string json_patch(const TreeDocument& before, const TreeDocument& after, const TreeDiff& diff) {
+    std::string out;
+    {
+        StringSink sink(out);
+        write_json_patch(sink, before, after, diff);
+    }
+    return out;
+}
+
+// The patch, applied to the JSON of `before`, has to give that of `after`.
+static void expect_patch_applies(const TreeDocument& before, const TreeDocument& after) {
+    TreeDiff diff = diff_trees(before.tree, after.tree);
+    std::string patch = json_patch(before, after, diff);
+    json patched;
+    ASSERT_NO_THROW(patched = json::parse(document_json(before)).patch(json::parse(patch))) << patch;
+    EXPECT_EQ(patched, json::parse(document_json(after))) << patch;
+}
+
+TEST(TreeDiff, IdenticalTreesHaveNoOps) {
+    auto before = make_document(lvt::testing::make_synthetic_tree(5000, 3));
+    auto after = make_document(lvt::testing::make_synthetic_tree(5000, 3));
+    assign_element_ids(before.tree);
+    assign_element_ids(after.tree);
+    TreeDiff diff = diff_trees(before.tree, after.tree);
+    EXPECT_TRUE(diff.empty());
+    EXPECT_EQ(diff.identical, 5000u);
+    for (NodeId n = 0; n < 5000; n++) EXPECT_EQ(diff.afterOf[n], n);
+    EXPECT_EQ(json_patch(before, after, diff), "[]");
+}
+
+TEST(TreeDiff, ReportsChangedFieldsOnly) {
+    ElementTree before = make_test_tree();
+    ElementTree after = make_test_tree();
+    NodeId button = after.first_child(after.root());
+    after[button].text = "Cancel";
+    after[button].properties.set("enabled", "false");
+    assign_element_ids(after);
+    TreeDiff diff = diff_trees(before, after);
+    ASSERT_EQ(diff.ops.size(), 1u);
+    EXPECT_EQ(diff.ops[0].kind, DiffOpKind::Update);
+    EXPECT_EQ(diff.ops[0].after, button);
+    EXPECT_EQ(diff.ops[0].fields, uint32_t{kDiffText | kDiffProperties});
+    EXPECT_EQ(json_patch(make_document(std::move(before)), make_document(std::move(after)), diff),
+              "[\n{\"op\":\"replace\",\"path\":\"/root/children/0/text\",\"value\":\"Cancel\"},\n"
+              "{\"op\":\"add\",\"path\":\"/root/children/0/properties\",\"value\":{\"enabled\":\"false\"}}\n]");
+}
+
+TEST(TreeDiff, MovedSubtreeIsOneMove) {
+    // root -> [a -> [x -> [y]], b]; x moves under b.
+    auto build = [](bool moved) {
+        ElementTree tree;
+        NodeId root = tree.add_root({.type = "Root", .framework = "winui3"});
+        NodeId a = tree.append_child(root, {.type = "A", .framework = "winui3"});
+        NodeId b = tree.append_child(root, {.type = "B", .framework = "winui3"});
+        NodeId x = tree.append_child(moved ? b : a, {.type = "X", .framework = "winui3", .text = "x"});
+        tree.append_child(x, {.type = "Y", .framework = "winui3", .text = "y"});
+        assign_element_ids(tree);
+        return tree;
+    };
+    ElementTree before = build(false), after = build(true);
+    TreeDiff diff = diff_trees(before, after);
+    size_t moves = 0;
+    for (auto& op : diff.ops) {
+        EXPECT_NE(op.kind, DiffOpKind::Insert);
+        EXPECT_NE(op.kind, DiffOpKind::Remove);
+        moves += op.kind == DiffOpKind::Move;
+    }
+    EXPECT_EQ(moves, 1u);
+    expect_patch_applies(make_document(std::move(before)), make_document(std::move(after)));
+}
+
+TEST(TreeDiff, EmptyTrees) {
+    auto none = make_document(ElementTree{});
+    auto some = make_document(make_test_tree());
+    EXPECT_TRUE(diff_trees(none.tree, none.tree).empty());
+    EXPECT_EQ(json_patch(none, none, diff_trees(none.tree, none.tree)), "[]");
+    expect_patch_applies(none, some);
+    expect_patch_applies(some, none);
+}
+
+TEST(TreeDiff, PatchAppliesAfterRandomEdits) {
+    for (uint64_t seed = 1; seed <= 40; seed++) {
+        SCOPED_TRACE(seed);
+        ElementTree base = lvt::testing::make_synthetic_tree(400, seed);
+        auto before = make_document(lvt::testing::make_synthetic_tree(400, seed));
+        auto after = make_document(edited_copy(base, seed * 31), seed % 3 ? 7 : 8);
+        assign_element_ids(before.tree);
+        assign_element_ids(after.tree);
+        expect_patch_applies(before, after);
+    }
+}
+
+TEST(TreeDiff, MatchesStableIdsFirst) {
+    for (uint64_t seed = 1; seed <= 20; seed++) {
+        SCOPED_TRACE(seed);
+        auto before = make_document(lvt::testing::make_synthetic_tree(300, seed));
+        auto after = make_document(edited_copy(before.tree, seed * 17));
+        assign_stable_ids(before.tree);
+        assign_stable_ids(after.tree, nullptr, &before.tree);
+        hash_subtrees(before.tree);
+        hash_subtrees(after.tree);
+        TreeDiff diff = diff_trees(before.tree, after.tree);
+        for (NodeId b = 0; b < after.tree.size(); b++) {
+            NodeId a = diff.beforeOf[b];
+            if (a != kNoNode) {
+                EXPECT_EQ(before.tree[a].type, after.tree[b].type);
+            }
+        }
+        expect_patch_applies(before, after);
+    }
+}
+
+TEST(DeltaStream, FirstLineIsTheWholeDocument) {
+    auto doc = make_document(make_test_tree());
+    std::string expected = document_json(doc);
+    std::string out;
+    {
+        StringSink sink(out);
+        DeltaStream stream(sink);
+        EXPECT_TRUE(stream.push(std::move(doc)));
+        EXPECT_EQ(stream.lines(), 1u);
+    }
+    ASSERT_EQ(std::count(out.begin(), out.end(), '\n'), 1);
+    auto line = json::parse(out);
+    EXPECT_EQ(line["seq"], 0);
+    EXPECT_EQ(line["tree"], json::parse(expected));
+}
+
+TEST(DeltaStream, PatchesReplayToTheLatestCapture) {
+    ElementTree base = lvt::testing::make_synthetic_tree(600, 9);
+    std::string out;
+    StringSink sink(out);
+    DeltaStream stream(sink);
+    std::vector<std::string> expected;
+    for (uint64_t tick = 0; tick < 8; tick++) {
+        // Every other capture is unchanged.
+        auto doc = make_document(tick % 2 ? stream.current().tree : edited_copy(base, tick + 1));
+        assign_stable_ids(doc.tree, nullptr, tick ? &stream.current().tree : nullptr);
+        hash_subtrees(doc.tree);
+        std::string json = document_json(doc);
+        bool wrote = stream.push(std::move(doc));
+        EXPECT_EQ(wrote, tick % 2 == 0) << tick;
+        if (wrote) expected.push_back(json);
+    }
+    sink.flush();
+
+    std::istringstream lines(out);
+    std::string text;
+    json state;
+    size_t seq = 0;
+    while (std::getline(lines, text)) {
+        auto line = json::parse(text);
+        ASSERT_EQ(line["seq"], seq);
+        state = seq == 0 ? line["tree"] : state.patch(line["patch"]);
+        ASSERT_LT(seq, expected.size());
+        EXPECT_EQ(state, json::parse(expected[seq])) << seq;
+        seq++;
+    }
+    EXPECT_EQ(seq, 4u);
+    EXPECT_EQ(stream.lines(), 4u);
+}
+
+// --watch builds each tick from a new source: one kept across ticks still
+// has the child windows it enumerated the first time.
+TEST(DeltaStream, WindowAddedBetweenTicksIsPatchedIn) {
+    lvt::testing::FakeWindowSystem ws;
+    HWND frame = ws.add_window(nullptr, 7, "Frame");
+    HWND panel = ws.add_window(frame, 7, "Panel");
+    ws.add_window(panel, 7, "Button", "OK");
+
+    std::string out;
+    StringSink sink(out);
+    DeltaStream stream(sink);
+    std::string latest;
+    auto tick = [&](CaptureSource& source) {
+        auto doc = make_document(build_tree(source, frame, 7, {}));
+        assign_stable_ids(doc.tree, nullptr, stream.lines() ? &stream.current().tree : nullptr);
+        hash_subtrees(doc.tree);
+        latest = document_json(doc);
+        return stream.push(std::move(doc));
+    };
+    WindowSystemSource kept(ws);
+    EXPECT_TRUE(tick(kept));
+    ws.add_window(panel, 7, "Button", "Cancel");
+    EXPECT_FALSE(tick(kept));
+    WindowSystemSource fresh(ws);
+    EXPECT_TRUE(tick(fresh));
+    sink.flush();
+
+    std::istringstream lines(out);
+    std::string first, second;
+    ASSERT_TRUE(std::getline(lines, first));
+    ASSERT_TRUE(std::getline(lines, second));
+    auto patch = json::parse(second)["patch"];
+    ASSERT_EQ(patch.size(), 1u);
+    EXPECT_EQ(patch[0]["op"], "add");
+    EXPECT_EQ(patch[0]["value"]["text"], "Cancel");
+    EXPECT_EQ(json::parse(first)["tree"].patch(patch), json::parse(latest));
+}
+
+// ---- ElementIndex ----
+
+TEST(ElementIndex, FindsByIdAfterAssign) {
+    auto tree = make_test_tree();
+    ElementIndex index;
+    assign_element_ids(tree, &index);
+    for (NodeId n = tree.root(); n != kNoNode; n = tree.next_preorder(n, tree.root())) {
+        EXPECT_EQ(index.find_by_id(tree[n].id), n);
+    }
+    EXPECT_EQ(index.find_by_id("e999"), kNoNode);
+    EXPECT_EQ(index.find_by_id(""), kNoNode);
+}
+
+TEST(ElementIndex, ReassigningIdsRekeysTable) {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root].id = "custom";
+    ElementIndex index(tree);
+    EXPECT_EQ(index.find_by_id("custom"), root);
+    assign_element_ids(tree, &index);
+    EXPECT_EQ(index.find_by_id("custom"), kNoNode);
+    EXPECT_EQ(index.find_by_id("e0"), root);
+}
+
+TEST(ElementIndex, FindsByHandleAndHwndText) {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    NodeId a = tree.append_child(root);
+    NodeId b = tree.append_child(root);
+    NodeId c = tree.append_child(root);
+    tree[a].nativeHandle = 0x1000;
+    tree[a].properties.set(prop::kHwnd, HandleValue{0x1000});
+    tree[b].properties.set(prop::kHwnd, "0x00000000002000AB");
+    tree[c].properties.set(prop::kHwnd, "not-hex");
+    ElementIndex index(tree);
+
+    EXPECT_EQ(index.find_by_handle(0x1000), a);
+    EXPECT_EQ(index.find_by_hwnd("0x1000"), a);
+    EXPECT_EQ(index.find_by_hwnd("0x0000000000001000"), a);
+    EXPECT_EQ(index.find_by_hwnd("0x2000ab"), b);
+    EXPECT_EQ(index.find_by_hwnd("not-hex"), c);
+    EXPECT_EQ(index.find_by_hwnd("0x3000"), kNoNode);
+}
+
+TEST(ElementIndex, FirstAllocatedNodeWinsSharedHandle) {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    NodeId a = tree.append_child(root);
+    NodeId b = tree.append_child(root);
+    tree[a].properties.set(prop::kHwnd, "0x10");
+    tree[b].properties.set(prop::kHwnd, "0x10");
+    ElementIndex index(tree);
+    EXPECT_EQ(index.find_by_hwnd("0x10"), a);
+}
+
+TEST(ElementIndex, SyncPicksUpAppendedNodes) {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    ElementIndex index(tree);
+    EXPECT_EQ(index.indexed_count(), 1u);
+
+    NodeId late = tree.append_child(root);
+    tree[late].properties.set(prop::kHwnd, "0xABC");
+    EXPECT_EQ(index.find_by_hwnd("0xABC"), kNoNode);
+    index.sync(tree);
+    EXPECT_EQ(index.indexed_count(), 2u);
+    EXPECT_EQ(index.find_by_hwnd("0xABC"), late);
+}
+
+TEST(ElementIndex, ParseHandle) {
+    EXPECT_EQ(ElementIndex::parse_handle("0x1F"), 0x1Fu);
+    EXPECT_EQ(ElementIndex::parse_handle("0X1f"), 0x1Fu);
+    EXPECT_EQ(ElementIndex::parse_handle("ff"), 0xFFu);
+    EXPECT_EQ(ElementIndex::parse_handle("0xFFFFFFFFFFFFFFFF"), UINT64_MAX);
+    EXPECT_FALSE(ElementIndex::parse_handle("0x"));
+    EXPECT_FALSE(ElementIndex::parse_handle(""));
+    EXPECT_FALSE(ElementIndex::parse_handle("0xDEEP"));
+    EXPECT_FALSE(ElementIndex::parse_handle("0x10000000000000000"));
+}
+
+// ---- Plugin grafting ----
+
+TEST(PluginGraft, FallsBackToRootForHostOutsideScope) {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    NodeId scope = tree.append_child(root);
+    NodeId outside = tree.append_child(root);
+    tree[outside].properties.set(prop::kHwnd, "0x77");
+    ElementIndex index;
+
+    auto j = json::parse(R"([{"target_hwnd":"0x77","type":"Plugin.Node"}])");
+    graft_plugin_tree(tree, scope, j, "mock", index);
+    EXPECT_FALSE(tree.has_children(outside));
+    ASSERT_EQ(tree.child_count(scope), 1u);
+    EXPECT_EQ(tree[tree.first_child(scope)].type, "Node");
+}
+
+TEST(PluginGraft, GraftedNodesCanHostLaterRoots) {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    ElementIndex index;
+    auto j = json::parse(R"([
+        {"type":"A","properties":{"hwnd":"0x500"}},
+        {"target_hwnd":"0x500","type":"B"}
+    ])");
+    graft_plugin_tree(tree, root, j, "mock", index);
+    ASSERT_EQ(tree.child_count(root), 1u);
+    NodeId a = tree.first_child(root);
+    ASSERT_EQ(tree.child_count(a), 1u);
+    EXPECT_EQ(tree[tree.first_child(a)].type, "B");
+    EXPECT_EQ(index.indexed_count(), tree.size());
+}
+
+// Hosts used to be found with a full DFS per plugin root, which is
+// O(roots x nodes): 10k roots over 100k nodes is ~1e9 node visits. With the
+// index each root is an O(1) lookup, so this finishes in well under a second.
+TEST(PluginGraft, TenThousandRootsIntoLargeTreeIsLinear) {
+    constexpr size_t kNodes = 100000;
+    constexpr size_t kRoots = 10000;
+    ElementTree tree = lvt::testing::make_synthetic_tree(kNodes);
+    for (size_t i = 0; i < tree.size(); i++) {
+        NodeId n = static_cast<NodeId>(i);
+        tree[n].nativeHandle = 0x10000 + i * 4;
+        tree[n].properties.set(prop::kHwnd, HandleValue{0x10000 + i * 4});
+    }
+
+    json roots = json::array();
+    std::vector<NodeId> expectedHosts;
+    for (size_t r = 0; r < kRoots; r++) {
+        NodeId host = static_cast<NodeId>((r * 7919) % kNodes);
+        char buf[32];
+        snprintf(buf, sizeof(buf), "0x%016llX", static_cast<unsigned long long>(0x10000 + host * 4));
+        roots.push_back({{"target_hwnd", buf}, {"type", "Plugin.Root"},
+                         {"children", json::array({{{"type", "Plugin.Leaf"}}})}});
+        expectedHosts.push_back(host);
+    }
+
+    ElementIndex index;
+    auto t0 = std::chrono::steady_clock::now();
+    graft_plugin_tree(tree, tree.root(), roots, "mock", index);
+    auto elapsed = std::chrono::steady_clock::now() - t0;
+
+    EXPECT_EQ(tree.size(), kNodes + kRoots);
+    EXPECT_EQ(index.indexed_count(), tree.size());
+    // Grafted children are appended in root order; check each lands on its host.
+    for (size_t r = 0; r < kRoots; r++) {
+        NodeId grafted = static_cast<NodeId>(kNodes + r);
+        ASSERT_EQ(tree[grafted].type, "Leaf");
+        ASSERT_EQ(tree.parent(grafted), expectedHosts[r]) << "root " << r;
+    }
+    EXPECT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), 2000);
+}
+
+// ---- Recording and replay ----
+
+// A WinUI 3 window hosting a list view, a XAML island and a plugin panel.
+static Recording make_test_recording() {
+    Recording rec;
+    rec.hwnd = 0x100;
+    rec.pid = 77;
+    rec.processName = "Demo.exe";
+    rec.frameworks = {{Framework::ComCtl, "6.10", ""},
+                      {Framework::WinUI3, "1.6", ""},
+                      {Framework::Plugin, "1.0", "dui"}};
+
+    auto window = [&](uint64_t hwnd, const char* cls, const char* text, Bounds rect,
+                      std::vector<uint64_t> children) {
+        Recording::Window& w = rec.windows.emplace_back();
+        w.hwnd = hwnd;
+        w.info = {cls, text, rect, 0x50000000, true, true};
+        w.enumerated = true;
+        w.children = std::move(children);
+    };
+    window(0x100, "WinUIDesktopWin32WindowClass", "Demo", {10, 20, 800, 600}, {0x110, 0x120, 0x130});
+    window(0x110, "SysListView32", "", {10, 40, 300, 200}, {});
+    window(0x120, "Microsoft.UI.Content.DesktopChildSiteBridge", "", {100, 200, 400, 300}, {});
+    window(0x130, "Button", "OK", {700, 560, 80, 24}, {});
+    rec.windows.back().info.enabled = false;
+
+    ComCtlReply list;
+    list.count = 120;
+    list.viewMode = 1;  // LV_VIEW_DETAILS
+    list.columnCount = 3;
+    list.items = {{"first", 0, 0}, {"second", 0, ComCtlItem::kSelected}};
+    rec.comctl.push_back({0x110, list});
+
+    rec.payloads.push_back({Framework::WinUI3, {}, 0x100, 77,
+        R"([{"type":"Microsoft.UI.Xaml.Hosting.DesktopWindowXamlSource","children":[)"
+        R"({"type":"Microsoft.UI.Xaml.Controls.Button","name":"Go","offsetX":5,"offsetY":6,"width":50,"height":20}]}])"});
+    rec.payloads.push_back({Framework::Plugin, "dui", 0x100, 77, R"({"type":"Dui.Panel","text":"panel"})"});
+    return rec;
+}
+
+static std::string replay_json(const Recording& rec) {
+    ReplayProvider replay(rec);
+    ElementTree tree = replay.build();
+    return serialize_to_json(tree, tree.root(), reinterpret_cast<HWND>(static_cast<uintptr_t>(rec.hwnd)),
+                             rec.pid, rec.processName, {});
+}
+
+static std::string recording_text(const Recording& rec) {
+    std::string text;
+    StringSink sink(text);
+    write_recording(sink, rec);
+    sink.flush();
+    return text;
+}
+
+TEST(Replay, BuildsTreeFromRecordedInputs) {
+    Recording rec = make_test_recording();
+    ReplayProvider replay(rec);
+    ElementIndex index;
+    ElementTree tree = replay.build({}, &index);
+
+    NodeId root = tree.root();
+    EXPECT_EQ(tree[root].className, "WinUIDesktopWin32WindowClass");
+    EXPECT_EQ(tree[root].type, "Window");
+    EXPECT_EQ(tree[root].text, "Demo");
+    EXPECT_EQ(tree[root].properties.text(prop::kStyle), "WS_CHILD WS_VISIBLE");
+    EXPECT_EQ(tree[root].nativeHandle, 0x100u);
+    ASSERT_EQ(tree.child_count(root), 4u);  // three windows and the plugin panel
+
+    NodeId list = tree.child_at(root, 0);
+    EXPECT_EQ(tree[list].type, "ListView");
+    EXPECT_EQ(tree[list].framework, "comctl");
+    EXPECT_EQ(tree[list].properties.text("itemCount"), "120");
+    EXPECT_EQ(tree[list].properties.text("viewMode"), "details");
+    EXPECT_EQ(tree[list].properties.text("columnCount"), "3");
+    EXPECT_EQ(tree[list].properties.text(prop::kTruncated), "true");
+    ASSERT_EQ(tree.child_count(list), 2u);
+    NodeId second = tree.child_at(list, 1);
+    EXPECT_EQ(tree[second].text, "second");
+    EXPECT_EQ(tree[second].properties.text(prop::kIndex), "1");
+    EXPECT_EQ(tree[second].properties.text(prop::kSelected), "true");
+
+    NodeId bridge = tree.child_at(root, 1);
+    EXPECT_EQ(tree[bridge].framework, "winui3");
+    EXPECT_EQ(tree[bridge].type, "DesktopChildSiteBridge");
+    ASSERT_EQ(tree.child_count(bridge), 1u);
+    NodeId source = tree.first_child(bridge);
+    EXPECT_EQ(tree[source].type, "DesktopWindowXamlSource");
+    NodeId go = tree.first_child(source);
+    EXPECT_EQ(tree[go].text, "Go");
+    EXPECT_EQ(tree[go].bounds.x, 105);
+    EXPECT_EQ(tree[go].bounds.y, 206);
+
+    NodeId ok = tree.child_at(root, 2);
+    EXPECT_EQ(tree[ok].type, "Button");
+    EXPECT_EQ(tree[ok].properties.text(prop::kEnabled), "false");
+
+    NodeId panel = tree.child_at(root, 3);
+    EXPECT_EQ(tree[panel].framework, "dui");
+    EXPECT_EQ(tree[panel].text, "panel");
+
+    EXPECT_EQ(tree[root].id, "e0");
+    EXPECT_EQ(index.find_by_id(tree[panel].id), panel);
+    EXPECT_EQ(index.find_by_handle(0x120), bridge);
+}
+
+TEST(Replay, RecordingRoundTripsThroughText) {
+    Recording rec = make_test_recording();
+    std::string text = recording_text(rec);
+
+    Recording loaded;
+    std::string error;
+    ASSERT_TRUE(read_recording(text, loaded, &error)) << error;
+    EXPECT_EQ(loaded.processName, "Demo.exe");
+    ASSERT_EQ(loaded.frameworks.size(), 3u);
+    EXPECT_EQ(loaded.frameworks[2].name, "dui");
+    EXPECT_EQ(loaded.payloads[0].data, rec.payloads[0].data);
+    ASSERT_TRUE(loaded.comctl[0].reply.columnCount.has_value());
+    EXPECT_EQ(recording_text(loaded), text);
+    EXPECT_EQ(replay_json(loaded), replay_json(rec));
+}
+
+TEST(Replay, RecordingSourceCapturesWhatItForwards) {
+    Recording rec = make_test_recording();
+    ReplayProvider inner(rec);
+
+    Recording captured;
+    captured.hwnd = rec.hwnd;
+    captured.pid = rec.pid;
+    captured.processName = rec.processName;
+    captured.frameworks = rec.frameworks;
+    RecordingSource recorder(inner, captured);
+    ElementTree live = build_tree(recorder, reinterpret_cast<HWND>(uintptr_t{0x100}), rec.pid,
+                                  rec.frameworks);
+
+    EXPECT_EQ(captured.windows.size(), rec.windows.size());
+    EXPECT_EQ(captured.comctl.size(), 1u);
+    EXPECT_EQ(captured.payloads.size(), 2u);
+    EXPECT_EQ(replay_json(captured), replay_json(rec));
+    EXPECT_EQ(serialize_to_json(live, live.root(), reinterpret_cast<HWND>(uintptr_t{0x100}), rec.pid,
+                                rec.processName, {}),
+              replay_json(rec));
+}
+
+TEST(Replay, DepthLimitLeavesChildrenUnenumerated) {
+    Recording rec = make_test_recording();
+    ReplayProvider inner(rec);
+    Recording captured;
+    RecordingSource recorder(inner, captured);
+    build_tree(recorder, reinterpret_cast<HWND>(uintptr_t{0x100}), rec.pid, {}, {.depth = 0});
+
+    ASSERT_EQ(captured.windows.size(), 1u);
+    EXPECT_FALSE(captured.windows[0].enumerated);
+    std::string text = recording_text(captured);
+    EXPECT_EQ(text.find("\"children\""), std::string::npos);
+
+    Recording loaded;
+    ASSERT_TRUE(read_recording(text, loaded));
+    EXPECT_FALSE(loaded.windows[0].enumerated);
+}
+
+TEST(Replay, UnrecordedInputsReadAsEmpty) {
+    Recording rec;
+    ReplayProvider replay(rec);
+    HWND hwnd = reinterpret_cast<HWND>(uintptr_t{0x999});
+    EXPECT_TRUE(replay.window(hwnd).className.empty());
+    EXPECT_TRUE(replay.children(hwnd).empty());
+    ComCtlReply reply;
+    EXPECT_FALSE(replay.comctl(hwnd, "SysListView32", reply));
+    EXPECT_TRUE(replay.tap_payload(Framework::Xaml, hwnd, 1).empty());
+    EXPECT_TRUE(replay.plugin_payload("dui", hwnd, 1, nullptr).empty());
+
+    ElementTree tree = replay.build();
+    EXPECT_EQ(tree.size(), 1u);
+}
+
+TEST(Replay, RejectsBadRecordings) {
+    Recording rec;
+    std::string error;
+    EXPECT_FALSE(read_recording("not json", rec, &error));
+    EXPECT_EQ(error, "recording is not valid JSON");
+    EXPECT_FALSE(read_recording(R"({"format":"lvtbin","version":1})", rec, &error));
+    EXPECT_EQ(error, "not an lvt recording");
+    EXPECT_FALSE(read_recording(R"({"format":"lvt-recording","version":99})", rec, &error));
+    EXPECT_EQ(error, "unsupported recording version");
+    EXPECT_FALSE(read_recording(R"({"format":"lvt-recording","version":1,"hwnd":1,"pid":2})", rec, &error));
+    EXPECT_EQ(error.rfind("recording is corrupt", 0), 0u) << error;
+
+    std::string text = recording_text(make_test_recording());
+    auto pos = text.find("\"winui3\"");
+    ASSERT_NE(pos, std::string::npos);
+    text.replace(pos, 8, "\"qt6\"");
+    EXPECT_FALSE(read_recording(text, rec, &error));
+    EXPECT_NE(error.find("unknown framework"), std::string::npos) << error;
+}
+
+TEST(Replay, InjectedLatencyIsApplied) {
+    Recording rec = make_test_recording();
+    ReplayLatency latency;
+    latency.window = std::chrono::microseconds(500);
+    ReplayProvider replay(rec, latency);
+
+    auto t0 = std::chrono::steady_clock::now();
+    replay.build();
+    auto elapsed = std::chrono::steady_clock::now() - t0;
+    // Four windows, each read once and enumerated once.
+    EXPECT_GE(elapsed, std::chrono::microseconds(8 * 500));
+}
+
+TEST(Replay, SyntheticWinUIRecordingGraftsEveryXamlNode) {
+    constexpr size_t kWindows = 300;
+    constexpr size_t kXaml = 5000;
+    constexpr size_t kBridges = 4;
+    Recording rec = lvt::testing::make_synthetic_recording(kWindows, kXaml, kBridges);
+    ASSERT_EQ(rec.windows.size(), kWindows);
+
+    ReplayProvider replay(rec);
+    ElementTree tree = replay.build();
+    // Every window, every XAML node, and one DesktopWindowXamlSource per bridge.
+    EXPECT_EQ(tree.size(), kWindows + kXaml + kBridges);
+
+    size_t bridges = 0;
+    for (NodeId n = tree.root(); n != kNoNode; n = tree.next_preorder(n, tree.root())) {
+        if (tree[n].type == "DesktopChildSiteBridge") {
+            bridges++;
+            ASSERT_EQ(tree.child_count(n), 1u);
+            EXPECT_EQ(tree[tree.first_child(n)].type, "DesktopWindowXamlSource");
+        }
+    }
+    EXPECT_EQ(bridges, kBridges);
+    EXPECT_EQ(replay_json(rec), replay_json(rec));
+}
+
+// ---- Provider scheduling ----
+
+TEST(ThreadPool, RunsTasksAndDeliversResults) {
+    ThreadPool pool(3);
+    EXPECT_EQ(pool.size(), 3u);
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < 20; i++) results.push_back(pool.submit([i] { return i * i; }));
+    for (int i = 0; i < 20; i++) EXPECT_EQ(results[i].get(), i * i);
+
+    auto failed = pool.submit([]() -> int { throw std::runtime_error("boom"); });
+    EXPECT_THROW(failed.get(), std::runtime_error);
+}
+
+TEST(ProviderScheduler, AppliesInOrderWhateverOrderCollectsFinish) {
+    ThreadPool pool(4);
+    ProviderScheduler scheduler(&pool);
+    std::mutex mutex;
+    std::vector<int> collected, applied;
+    for (int i = 0; i < 4; i++) {
+        scheduler.add({
+            .collect =
+                [&, i] {
+                    // Later stages finish collecting first.
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5 * (4 - i)));
+                    std::lock_guard<std::mutex> lock(mutex);
+                    collected.push_back(i);
+                },
+            .apply = [&, i] { applied.push_back(i); },
+        });
+    }
+    scheduler.run();
+    EXPECT_EQ(applied, (std::vector<int>{0, 1, 2, 3}));
+    EXPECT_EQ(collected.size(), 4u);
+}
+
+TEST(ProviderScheduler, RethrowsAfterEveryCollectFinishes) {
+    ThreadPool pool(2);
+    ProviderScheduler scheduler(&pool);
+    bool slowFinished = false;
+    std::vector<int> applied;
+    scheduler.add({
+        .collect = [] { throw std::runtime_error("collect failed"); },
+        .apply = [&] { applied.push_back(0); },
+    });
+    scheduler.add({
+        .fetch =
+            [&] {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                slowFinished = true;
+            },
+        .apply = [&] { applied.push_back(1); },
+    });
+    EXPECT_THROW(scheduler.run(), std::runtime_error);
+    EXPECT_TRUE(slowFinished);
+    EXPECT_TRUE(applied.empty());
+}
+
+TEST(ProviderScheduler, FetchStartsBeforeRun) {
+    ThreadPool pool(2);
+    ProviderScheduler scheduler(&pool);
+    std::promise<void> fetching;
+    std::future<void> started = fetching.get_future();
+    std::vector<std::string> steps;
+    scheduler.add({
+        .fetch = [&] { fetching.set_value(); },
+        .prepare = [&] { steps.push_back("prepare"); },
+        .collect = [&] { steps.push_back("collect"); },
+        .apply = [&] { steps.push_back("apply"); },
+    });
+    // The fetch runs while the caller is still busy, e.g. walking windows.
+    EXPECT_EQ(started.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_TRUE(steps.empty());
+    scheduler.run();
+    EXPECT_EQ(steps, (std::vector<std::string>{"prepare", "collect", "apply"}));
+}
+
+TEST(ProviderScheduler, EveryPrepareRunsBeforeAnyApply) {
+    auto steps_with = [](ThreadPool* pool) {
+        ProviderScheduler scheduler(pool);
+        std::vector<std::string> steps;
+        for (int i = 0; i < 2; i++) {
+            scheduler.add({
+                .prepare = [&, i] { steps.push_back("prepare" + std::to_string(i)); },
+                .apply = [&, i] { steps.push_back("apply" + std::to_string(i)); },
+            });
+        }
+        scheduler.run();
+        return steps;
+    };
+    std::vector<std::string> expected{"prepare0", "prepare1", "apply0", "apply1"};
+    EXPECT_EQ(steps_with(nullptr), expected);
+    ThreadPool pool(2);
+    EXPECT_EQ(steps_with(&pool), expected);
+}
+
+TEST(ProviderScheduler, UnwantedStagesOnlyApply) {
+    auto steps_with = [](ThreadPool* pool) {
+        ProviderScheduler scheduler(pool);
+        std::mutex mutex;
+        std::vector<std::string> steps;
+        auto step = [&](std::string name) {
+            std::lock_guard<std::mutex> lock(mutex);
+            steps.push_back(std::move(name));
+        };
+        for (int i = 0; i < 2; i++) {
+            scheduler.add({
+                .fetch = [&, i] { step("fetch" + std::to_string(i)); },
+                .prepare = [&, i] { step("prepare" + std::to_string(i)); },
+                .wanted = [i] { return i == 1; },
+                .collect = [&, i] { step("collect" + std::to_string(i)); },
+                .apply = [&, i] { step("apply" + std::to_string(i)); },
+            });
+        }
+        // Nothing is fetched before the wanted checks ran.
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        step("run");
+        scheduler.run();
+        return steps;
+    };
+    std::vector<std::string> expected{"run", "prepare0", "prepare1", "apply0", "fetch1", "collect1",
+                                      "apply1"};
+    EXPECT_EQ(steps_with(nullptr), expected);
+    ThreadPool pool(2);
+    std::vector<std::string> pooled = steps_with(&pool);
+    // apply0 may land anywhere after the prepares.
+    std::erase(pooled, "apply0");
+    std::erase(expected, "apply0");
+    EXPECT_EQ(pooled, expected);
+}
+
+static std::string replay_json(const Recording& rec, ThreadPool* pool) {
+    ReplayProvider replay(rec);
+    ElementTree tree = replay.build({}, nullptr, pool);
+    return serialize_to_json(tree, tree.root(), reinterpret_cast<HWND>(static_cast<uintptr_t>(rec.hwnd)),
+                             rec.pid, rec.processName, {});
+}
+
+TEST(ProviderScheduler, ConcurrentBuildMatchesSequentialBuild) {
+    ThreadPool pool(4);
+    Recording rec = make_test_recording();
+    EXPECT_EQ(replay_json(rec, &pool), replay_json(rec, nullptr));
+
+    // Several XAML bridges and a second framework grafting beside them.
+    Recording synth = lvt::testing::make_synthetic_recording(400, 3000, 4);
+    synth.frameworks.insert(synth.frameworks.begin(), {Framework::ComCtl, "6.10", ""});
+    synth.frameworks.push_back({Framework::Plugin, "1.0", "dui"});
+    synth.payloads.push_back({Framework::Plugin, "dui", synth.hwnd, synth.pid,
+                              R"({"type":"Dui.Panel","text":"panel"})"});
+    for (int i = 0; i < 5; i++) EXPECT_EQ(replay_json(synth, &pool), replay_json(synth, nullptr));
+}
+
+TEST(ProviderScheduler, OverlapsProviderLatency) {
+    // ComCtl, WinUI 3 and a plugin each wait 40 ms on the target.
+    Recording rec = make_test_recording();
+    ReplayLatency latency;
+    latency.comctl = std::chrono::milliseconds(40);
+    latency.payload = std::chrono::milliseconds(40);
+    ReplayProvider replay(rec, latency);
+
+    auto t0 = std::chrono::steady_clock::now();
+    replay.build();
+    auto sequential = std::chrono::steady_clock::now() - t0;
+
+    ThreadPool pool(3);
+    t0 = std::chrono::steady_clock::now();
+    replay.build({}, nullptr, &pool);
+    auto concurrent = std::chrono::steady_clock::now() - t0;
+
+    EXPECT_GE(sequential, std::chrono::milliseconds(120));
+    EXPECT_LT(concurrent, std::chrono::milliseconds(120));
+}
+
+TEST(ProviderScheduler, PayloadWaitsOverlapTheWindowWalk) {
+    // Walking the four windows takes 8 x 10 ms; the WinUI 3 TAP and the
+    // plugin answer after 80 ms each. Both can be fetched before the walk.
+    Recording rec = make_test_recording();
+    ReplayLatency latency;
+    latency.window = std::chrono::milliseconds(10);
+    latency.payload = std::chrono::milliseconds(80);
+    ReplayProvider replay(rec, latency);
+
+    auto t0 = std::chrono::steady_clock::now();
+    ElementTree sequential = replay.build();
+    auto sequentialTime = std::chrono::steady_clock::now() - t0;
+
+    ThreadPool pool(3);
+    t0 = std::chrono::steady_clock::now();
+    ElementTree pipelined = replay.build({}, nullptr, &pool);
+    auto pipelinedTime = std::chrono::steady_clock::now() - t0;
+
+    EXPECT_EQ(serialize_to_json(pipelined, pipelined.root(), nullptr, rec.pid, rec.processName, {}),
+              serialize_to_json(sequential, sequential.root(), nullptr, rec.pid, rec.processName, {}));
+    EXPECT_GE(sequentialTime, std::chrono::milliseconds(240));
+    EXPECT_LT(pipelinedTime, std::chrono::milliseconds(160));  // less than walk + one payload
+}
+
+// ---- Window system ----
+
+using lvt::testing::FakeWindowSystem;
+
+TEST(WindowSystem, BuildTreeReadsThroughWindowSystem) {
+    FakeWindowSystem ws;
+    HWND frame = ws.add_window(nullptr, 7, "Notepad", "Untitled - Notepad");
+    HWND edit = ws.add_window(frame, 7, "Edit", "hello");
+    HWND status = ws.add_window(frame, 7, "msctls_statusbar32");
+    ws.at(edit).info.rect = {0, 30, 640, 400};
+    ws.at(status).info.enabled = false;
+    ComCtlReply parts;
+    parts.count = 2;
+    parts.items = {{"Ln 1, Col 1", 0, 0}, {"UTF-8", 0, 0}};
+    ws.at(status).comctl = parts;
+
+    WindowSystemSource source(ws);
+    ElementTree tree = build_tree(source, frame, 7, {{Framework::Win32, ""}, {Framework::ComCtl, "6.10", ""}});
+    NodeId root = tree.root();
+    EXPECT_EQ(tree[root].className, "Notepad");
+    EXPECT_EQ(tree[root].text, "Untitled - Notepad");
+    EXPECT_EQ(tree[root].properties.text(prop::kStyle), "WS_OVERLAPPEDWINDOW WS_VISIBLE");
+    ASSERT_EQ(tree.child_count(root), 2u);
+    NodeId e = tree.child_at(root, 0);
+    EXPECT_EQ(tree[e].type, "Edit");
+    EXPECT_EQ(tree[e].bounds.width, 640);
+    NodeId s = tree.child_at(root, 1);
+    EXPECT_EQ(tree[s].type, "StatusBar");
+    EXPECT_EQ(tree[s].properties.text(prop::kEnabled), "false");
+    ASSERT_EQ(tree.child_count(s), 2u);
+    EXPECT_EQ(tree[tree.child_at(s, 1)].text, "UTF-8");
+    EXPECT_EQ(ws.calls.comctl, 1u);
+}
+
+TEST(WindowSystem, ChildrenComeFromOneEnumeration) {
+    // A chain of windows: enumerating from each one would walk its whole
+    // subtree again, O(depth^2) windows and GetParent calls in total.
+    constexpr size_t kDepth = 200;
+    FakeWindowSystem ws;
+    HWND hwnd = ws.add_window(nullptr, 1, "Chain");
+    HWND top = hwnd;
+    for (size_t i = 1; i < kDepth; i++) hwnd = ws.add_window(hwnd, 1, "Chain");
+
+    WindowSystemSource source(ws);
+    ElementTree tree = build_tree(source, top, 1, {});
+    EXPECT_EQ(tree.size(), kDepth);
+    EXPECT_EQ(ws.calls.descendants, 1u);
+    EXPECT_EQ(ws.calls.enumerated, kDepth - 1);
+    EXPECT_EQ(ws.calls.parent, kDepth - 1);
+    EXPECT_EQ(ws.calls.className, kDepth);
+    EXPECT_EQ(ws.calls.comctl, 0u);
+}
+
+// Children of every window the old way: enumerate its subtree and keep the
+// windows whose parent it is.
+class PerNodeEnumerationSource : public WindowSystemSource {
+public:
+    using WindowSystemSource::WindowSystemSource;
+    std::vector<HWND> children(HWND hwnd) override {
+        std::vector<HWND> children;
+        for (HWND h : m_ws.descendants(hwnd)) {
+            if (m_ws.parent(h) == hwnd) children.push_back(h);
+        }
+        return children;
+    }
+};
+
+TEST(WindowSystem, SinglePassKeepsZOrder) {
+    FakeWindowSystem ws;
+    auto roots = lvt::testing::make_window_forest(ws, 1, 3000);
+    HWND root = roots[0];
+
+    PerNodeEnumerationSource perNode(ws);
+    ElementTree expected = build_tree(perNode, root, 1, {});
+    WindowSystemSource source(ws);
+    ElementTree tree = build_tree(source, root, 1, {});
+    EXPECT_EQ(serialize_to_json(tree, tree.root(), root, 1, "", {}),
+              serialize_to_json(expected, expected.root(), root, 1, "", {}));
+}
+
+TEST(WindowSystem, OverlappingEnumerationsDoNotDuplicateChildren) {
+    FakeWindowSystem ws;
+    HWND frame = ws.add_window(nullptr, 1, "Frame");
+    HWND panel = ws.add_window(frame, 1, "Panel");
+    ws.add_window(panel, 1, "Button", "a");
+    ws.add_window(panel, 1, "Button", "b");
+
+    WindowSystemSource source(ws);
+    EXPECT_EQ(source.children(panel).size(), 2u);
+    EXPECT_EQ(source.children(frame).size(), 1u);
+    EXPECT_EQ(source.children(panel).size(), 2u);
+    EXPECT_EQ(ws.calls.descendants, 2u);
+}
+
+TEST(WindowSystem, DepthLimitStopsEnumeration) {
+    FakeWindowSystem ws;
+    auto roots = lvt::testing::make_window_forest(ws, 1, 500);
+    WindowSystemSource source(ws);
+    ElementTree tree = build_tree(source, roots[0], 1, {}, {.depth = 0});
+    EXPECT_EQ(tree.size(), 1u);
+    EXPECT_EQ(ws.calls.descendants, 0u);
+    EXPECT_EQ(ws.calls.className, 1u);
+}
+
+TEST(WindowSystem, DetectsFrameworksFromClassesAndModules) {
+    FakeWindowSystem ws;
+    HWND frame = ws.add_window(nullptr, 5, "WinUIDesktopWin32WindowClass");
+    HWND panel = ws.add_window(frame, 5, "Static");
+    ws.add_window(panel, 5, "systreeview32");  // class names compare case-insensitively
+    ws.add_window(frame, 5, "Microsoft.UI.Content.DesktopChildSiteBridge");
+    ws.add_module(5, "COMCTL32.DLL", "6.10.26100.1");
+    ws.add_module(5, "Microsoft.UI.Xaml.dll", "3.1.6.0");
+
+    auto fws = detect_frameworks(ws, frame, 5);
+    ASSERT_EQ(fws.size(), 3u);
+    EXPECT_EQ(fws[0].type, Framework::Win32);
+    EXPECT_EQ(fws[1].type, Framework::ComCtl);
+    EXPECT_EQ(fws[1].version, "6.10");
+    EXPECT_EQ(fws[2].type, Framework::WinUI3);
+    EXPECT_EQ(fws[2].version, "3.1.6.0");
+
+    // One enumeration of the whole subtree and one class name per window.
+    EXPECT_EQ(ws.calls.descendants, 1u);
+    EXPECT_EQ(ws.calls.enumerated, 3u);
+    EXPECT_EQ(ws.calls.className, 4u);
+}
+
+TEST(WindowSystem, FallsBackToClassNamesWithoutModules) {
+    FakeWindowSystem ws;
+    HWND wpf = ws.add_window(nullptr, 9, "HwndWrapper[App;;1234]");
+    ws.add_window(wpf, 9, "Windows.UI.Core.CoreWindow");
+
+    auto fws = detect_frameworks(ws, wpf, 9);
+    ASSERT_EQ(fws.size(), 3u);
+    EXPECT_EQ(fws[1].type, Framework::Xaml);
+    EXPECT_TRUE(fws[1].version.empty());
+    EXPECT_EQ(fws[2].type, Framework::Wpf);
+    EXPECT_EQ(ws.calls.moduleVersion, 5u);  // WinUI 3, XAML and three WPF DLLs
+}
+
+TEST(WindowSystem, FindsVisibleWindowsByProcessNameAndTitle) {
+    FakeWindowSystem ws;
+    ws.set_process(10, "Notepad.exe");
+    ws.set_process(20, "calc.exe");
+    HWND a = ws.add_window(nullptr, 10, "Notepad", "notes.txt - Notepad");
+    HWND hidden = ws.add_window(nullptr, 10, "Notepad", "hidden - Notepad");
+    ws.at(hidden).info.visible = false;
+    HWND c = ws.add_window(nullptr, 20, "CalcFrame", "Calculator");
+    ws.add_window(c, 20, "Button", "Notepad");  // child windows are never matched
+
+    auto byName = find_by_process_name(ws, "notepad");
+    ASSERT_EQ(byName.size(), 1u);
+    EXPECT_EQ(byName[0].hwnd, a);
+    EXPECT_EQ(byName[0].pid, 10u);
+    EXPECT_EQ(byName[0].processName, "Notepad.exe");
+    EXPECT_EQ(byName[0].windowTitle, "notes.txt - Notepad");
+    EXPECT_EQ(ws.calls.topLevel, 1u);
+    EXPECT_EQ(ws.calls.processName, 2u);  // once per visible top-level window
+
+    auto byTitle = find_by_title(ws, "CALC");
+    ASSERT_EQ(byTitle.size(), 1u);
+    EXPECT_EQ(byTitle[0].hwnd, c);
+    EXPECT_TRUE(find_by_title(ws, "missing").empty());
+}
+
+TEST(WindowSystem, MainWindowIsLargestVisibleTopLevel) {
+    FakeWindowSystem ws;
+    HWND small = ws.add_window(nullptr, 3, "Tool");
+    HWND big = ws.add_window(nullptr, 3, "Main");
+    HWND hidden = ws.add_window(nullptr, 3, "Huge");
+    HWND other = ws.add_window(nullptr, 4, "Other");
+    ws.at(small).info.rect = {0, 0, 100, 100};
+    ws.at(big).info.rect = {0, 0, 800, 600};
+    ws.at(hidden).info.rect = {0, 0, 4000, 4000};
+    ws.at(hidden).info.visible = false;
+    ws.at(other).info.rect = {0, 0, 1000, 1000};
+
+    EXPECT_EQ(find_main_window(ws, 3), big);
+    EXPECT_EQ(find_main_window(ws, 99), nullptr);
+}
+
+TEST(WindowSystem, SyntheticForestBuildsEveryWindow) {
+    constexpr size_t kWindows = 20000;
+    constexpr size_t kTopLevel = 8;
+    FakeWindowSystem ws;
+    auto roots = lvt::testing::make_window_forest(ws, 1, kWindows, kTopLevel);
+    ASSERT_EQ(roots.size(), kTopLevel);
+    EXPECT_EQ(ws.size(), kWindows);
+
+    WindowSystemSource source(ws);
+    size_t total = 0;
+    for (HWND root : roots) total += build_tree(source, root, 1, {}).size();
+    EXPECT_EQ(total, kWindows);
+    // Every window is read once and enumerated once, in one pass per root.
+    EXPECT_EQ(ws.calls.className, kWindows);
+    EXPECT_EQ(ws.calls.descendants, kTopLevel);
+    EXPECT_EQ(ws.calls.enumerated, kWindows - kTopLevel);
+    EXPECT_EQ(ws.calls.parent, kWindows - kTopLevel);
+}
+
+TEST(WindowSystem, InjectedLatencyIsApplied) {
+    FakeWindowSystem ws;
+    HWND frame = ws.add_window(nullptr, 1, "Frame");
+    ws.add_window(frame, 1, "Button");
+    ws.latency = std::chrono::microseconds(100);
+
+    WindowSystemSource source(ws);
+    auto t0 = std::chrono::steady_clock::now();
+    build_tree(source, frame, 1, {});
+    auto elapsed = std::chrono::steady_clock::now() - t0;
+    EXPECT_GE(elapsed, std::chrono::microseconds(100) * ws.calls.total());
+}
+
+// ---- Scoped builds ----
+
+// JSON of the element `scope` names, trimmed to the scope's depth, from a
+// build limited to `build`.
+static std::string scoped_json(ReplayProvider& replay, const TreeScope& scope, const TreeScope& build) {
+    ElementIndex index;
+    ElementTree tree = replay.build(build, &index);
+    NodeId node = index.find_by_id(scope.element);
+    if (node == kNoNode) return "not found";
+    trim_to_depth(tree, node, scope.depth);
+    return serialize_to_json(tree, node, nullptr, 1, "", {});
+}
+
+TEST(ScopedBuild, MatchesFullBuildForEveryElement) {
+    Recording synth = lvt::testing::make_synthetic_recording(200, 2000, 4);
+    synth.frameworks.insert(synth.frameworks.begin(), {Framework::ComCtl, "6.10", ""});
+    ComCtlReply list;
+    list.count = 2;
+    list.items = {{"a", 0, 0}, {"b", 0, 0}};
+    for (size_t i = 3; i < synth.windows.size(); i += 17) {
+        if (synth.windows[i].info.className == "Microsoft.UI.Content.DesktopChildSiteBridge") continue;
+        synth.windows[i].info.className = "SysListView32";
+        synth.comctl.push_back({synth.windows[i].hwnd, list});
+    }
+    // The same target without XAML or plugins, so the window walk is scoped too.
+    Recording plain = synth;
+    plain.frameworks = {{Framework::ComCtl, "6.10", ""}};
+
+    Recording demo = make_test_recording();
+    for (const Recording* rec : {&demo, &synth, &plain}) {
+        ReplayProvider replay(*rec);
+        ElementTree full = replay.build();
+        size_t step = std::max<size_t>(1, full.size() / 40);
+        for (NodeId n = 0; n < full.size(); n += static_cast<NodeId>(step)) {
+            for (int depth : {-1, 0, 1, 2}) {
+                TreeScope scope{full[n].id, depth};
+                ASSERT_EQ(scoped_json(replay, scope, scope), scoped_json(replay, scope, {}))
+                    << scope.element << " depth " << depth;
+            }
+        }
+    }
+}
+
+TEST(ScopedBuild, SkipsProvidersWithNothingInScope) {
+    Recording rec = make_test_recording();
+    auto captured_with = [&](const TreeScope& scope) {
+        ReplayProvider inner(rec);
+        Recording captured;
+        RecordingSource recorder(inner, captured);
+        build_tree(recorder, reinterpret_cast<HWND>(uintptr_t{0x100}), rec.pid, rec.frameworks, scope);
+        return captured;
+    };
+
+    Recording full = captured_with({});
+    EXPECT_EQ(full.comctl.size(), 1u);
+    EXPECT_EQ(full.payloads.size(), 2u);
+
+    // The OK button: no list view, no XAML bridge. The plugin still runs,
+    // since its roots may name any window.
+    Recording button = captured_with({"w130", -1});
+    EXPECT_TRUE(button.comctl.empty());
+    ASSERT_EQ(button.payloads.size(), 1u);
+    EXPECT_EQ(button.payloads[0].framework, Framework::Plugin);
+
+    // The root alone: everything providers graft goes one level down.
+    Recording root = captured_with({"e0", 0});
+    EXPECT_TRUE(root.comctl.empty());
+    EXPECT_EQ(root.payloads.size(), 1u);
+
+    Recording bridge = captured_with({"w120", 1});
+    EXPECT_TRUE(bridge.comctl.empty());
+    EXPECT_EQ(bridge.payloads.size(), 2u);
+}
+
+TEST(ScopedBuild, PassesTheScopeWindowToPlugins) {
+    class ScopeSpy : public ReplayProvider {
+    public:
+        using ReplayProvider::ReplayProvider;
+        std::string plugin_payload(const std::string& name, HWND hwnd, DWORD pid, HWND scope) override {
+            scopes.push_back(scope);
+            return ReplayProvider::plugin_payload(name, hwnd, pid, scope);
+        }
+        std::vector<HWND> scopes;
+    };
+    Recording rec = make_test_recording();
+    ScopeSpy spy(rec);
+    spy.build();
+    spy.build({"e0", 1});
+    spy.build({"w120.1", -1});
+    EXPECT_EQ(spy.scopes, (std::vector<HWND>{nullptr, nullptr, reinterpret_cast<HWND>(uintptr_t{0x120})}));
+}
+
+TEST(ScopedBuild, WalksOnlyTheScopeWindows) {
+    FakeWindowSystem ws;
+    HWND root = lvt::testing::make_window_forest(ws, 1, 2000)[0];
+    WindowSystemSource source(ws);
+    ElementTree full = build_tree(source, root, 1, {});
+    size_t fullCalls = ws.calls.className;
+
+    NodeId child = full.first_child(full.root());
+    ASSERT_NE(child, kNoNode);
+    ws.calls = {};
+    ElementTree scoped = build_tree(source, root, 1, {}, {full[child].id, 1});
+    EXPECT_EQ(scoped[scoped.root()].id, full[child].id);
+    EXPECT_EQ(scoped.size(), 1 + full.child_count(child));
+    EXPECT_EQ(ws.calls.className, scoped.size());
+    EXPECT_LT(ws.calls.className, fullCalls / 10);
+
+    ws.calls = {};
+    ElementTree shallow = build_tree(source, root, 1, {}, {"", 1});
+    EXPECT_EQ(shallow.size(), 1 + full.child_count(full.root()));
+    EXPECT_EQ(ws.calls.className, shallow.size());
+}
+
+// ---- RPC server ----
+
+using lvt::testing::FakeServerBackend;
+
+// A notepad-like target: pid 7, "notepad.exe", a frame with an edit and a
+// status bar.
+struct RpcFixture {
+    FakeWindowSystem ws;
+    FakeServerBackend backend{ws};
+    RpcServer server{backend};
+    HWND frame, edit, status;
+
+    RpcFixture() {
+        ws.set_process(7, "notepad.exe");
+        ws.add_module(7, "COMCTL32.DLL", "6.10.26100.1");
+        frame = ws.add_window(nullptr, 7, "Notepad", "Untitled - Notepad");
+        edit = ws.add_window(frame, 7, "Edit", "hello");
+        status = ws.add_window(frame, 7, "msctls_statusbar32");
+        ws.at(frame).info.rect = {0, 0, 800, 600};
+    }
+
+    json call(const std::string& method, json params = json::object()) {
+        json request = {{"jsonrpc", "2.0"}, {"id", 1}, {"method", method}, {"params", std::move(params)}};
+        return json::parse(server.handle(request.dump()));
+    }
+};
+
+TEST(RpcServer, DumpIsTheCommandLineDocument) {
+    RpcFixture f;
+    auto frameworks = detect_frameworks(f.ws, f.frame, 7);
+    std::vector<std::string> names;
+    for (auto& fi : frameworks)
+        names.push_back(framework_display_name(fi) + (fi.version.empty() ? "" : " " + fi.version));
+    WindowSystemSource source(f.ws);
+    ElementTree tree = build_tree(source, f.frame, 7, frameworks);
+    std::string expected = serialize_to_json(tree, tree.root(), f.frame, 7, "notepad.exe", names);
+
+    json response = f.call("dump", {{"name", "notepad"}});
+    EXPECT_EQ(response["jsonrpc"], "2.0");
+    EXPECT_EQ(response["id"], 1);
+    EXPECT_EQ(response["result"], json::parse(expected));
+    // The document is embedded as written: compact.
+    std::string text = f.server.handle(R"({"jsonrpc":"2.0","id":2,"method":"dump","params":{"pid":7}})");
+    EXPECT_EQ(text, R"({"jsonrpc":"2.0","id":2,"result":)" + json::parse(expected).dump() + "}");
+
+    json xml = f.call("dump", {{"hwnd", reinterpret_cast<uintptr_t>(f.frame)},
+                               {"format", "xml"}});
+    EXPECT_EQ(xml["result"], serialize_to_xml(tree, tree.root(), f.frame, 7, "notepad.exe", names));
+
+    json scoped = f.call("dump", {{"pid", 7}, {"element", tree[tree.child_at(tree.root(), 0)].id}, {"depth", 0}});
+    EXPECT_EQ(scoped["result"]["root"]["type"], "Edit");
+    EXPECT_FALSE(scoped["result"]["root"].contains("children"));
+}
+
+TEST(RpcServer, KeepsDetectionAndSnapshotBetweenRequests) {
+    RpcFixture f;
+    f.call("dump", {{"pid", 7}});
+    size_t moduleScans = f.ws.calls.moduleVersion;
+    size_t searches = f.ws.calls.topLevel;
+    EXPECT_GT(moduleScans, 0u);
+    f.call("dump", {{"pid", 7}, {"stableIds", true}});
+    for (int i = 0; i < 3; i++) EXPECT_EQ(f.call("query", {{"pid", 7}, {"type", "Edit"}})["result"]["count"], 1);
+    EXPECT_EQ(f.server.stats().requests, 5u);
+    EXPECT_EQ(f.server.stats().detections, 1u);
+    EXPECT_EQ(f.server.stats().captures, 2u);  // queries read the last dump
+    EXPECT_EQ(f.ws.calls.moduleVersion, moduleScans);
+    EXPECT_EQ(f.ws.calls.topLevel, searches);  // the window found for pid 7 is reused
+
+    f.call("query", {{"pid", 7}, {"refresh", true}});
+    EXPECT_EQ(f.server.stats().detections, 2u);
+    EXPECT_EQ(f.server.stats().captures, 3u);
+
+    // The same handle in another process is another target.
+    f.ws.set_process(8, "other.exe");
+    for (HWND hwnd : {f.frame, f.edit, f.status}) f.ws.at(hwnd).pid = 8;
+    json dump = f.call("dump", {{"hwnd", reinterpret_cast<uintptr_t>(f.frame)}});
+    EXPECT_EQ(dump["result"]["target"]["processName"], "other.exe");
+    EXPECT_EQ(f.server.stats().detections, 3u);
+}
+
+TEST(RpcServer, QueryFiltersTheLastSnapshot) {
+    RpcFixture f;
+    for (int i = 0; i < 5; i++) f.ws.add_window(f.frame, 7, "Button", "Button " + std::to_string(i));
+    HWND group = f.ws.add_window(f.frame, 7, "Button", "Group");
+    f.ws.add_window(group, 7, "Button", "Inner");
+
+    json all = f.call("query", {{"pid", 7}, {"type", "Button"}, {"limit", 3}});
+    EXPECT_EQ(all["result"]["count"], 7);
+    ASSERT_EQ(all["result"]["elements"].size(), 3u);
+    EXPECT_EQ(all["result"]["elements"][0]["text"], "Button 0");
+
+    json text = f.call("query", {{"pid", 7}, {"text", "GROUP"}, {"depth", 1}});
+    ASSERT_EQ(text["result"]["count"], 1);
+    json element = text["result"]["elements"][0];
+    EXPECT_EQ(element["text"], "Group");
+    ASSERT_EQ(element["children"].size(), 1u);
+    EXPECT_EQ(element["children"][0]["text"], "Inner");
+
+    json shallow = f.call("query", {{"pid", 7}, {"text", "Group"}});
+    EXPECT_FALSE(shallow["result"]["elements"][0].contains("children"));
+
+    std::string id = element["id"];
+    EXPECT_EQ(id[0], 's');  // the snapshot has stable IDs
+    json byId = f.call("query", {{"pid", 7}, {"id", id}});
+    ASSERT_EQ(byId["result"]["count"], 1);
+    EXPECT_EQ(byId["result"]["elements"][0]["id"], id);
+    EXPECT_EQ(f.call("query", {{"pid", 7}, {"id", id}, {"type", "Edit"}})["result"]["count"], 0);
+    EXPECT_EQ(f.server.stats().captures, 1u);
+}
+
+TEST(RpcServer, DiffPatchesTheLastSnapshot) {
+    RpcFixture f;
+    json first = f.call("diff", {{"pid", 7}});
+    EXPECT_TRUE(first["result"]["changed"]);
+    json state = first["result"]["tree"];
+    EXPECT_EQ(state, f.call("dump", {{"pid", 7}, {"stableIds", true}})["result"]);
+
+    f.ws.at(f.edit).info.text = "hello, world";
+    f.ws.add_window(f.frame, 7, "Button", "OK");
+    json second = f.call("diff", {{"pid", 7}});
+    EXPECT_TRUE(second["result"]["changed"]);
+    state = state.patch(second["result"]["patch"]);
+    EXPECT_EQ(state, f.call("dump", {{"pid", 7}, {"stableIds", true}})["result"]);
+
+    json third = f.call("diff", {{"pid", 7}});
+    EXPECT_FALSE(third["result"]["changed"]);
+    EXPECT_EQ(third["result"]["patch"], json::array());
+}
+
+TEST(RpcServer, KeepsStableIdsAfterAnOrdinalDump) {
+    RpcFixture f;
+    json dump = f.call("dump", {{"pid", 7}});
+    std::string rootId = dump["result"]["root"]["id"];
+    EXPECT_EQ(rootId, "e0");
+    std::string statusId = dump["result"]["root"]["children"][1]["id"];
+
+    // The IDs the dump returned still find their elements.
+    json root = f.call("query", {{"pid", 7}, {"id", rootId}});
+    ASSERT_EQ(root["result"]["count"], 1);
+    EXPECT_EQ(root["result"]["elements"][0]["type"], dump["result"]["root"]["type"]);
+    EXPECT_EQ(root["result"]["elements"][0]["id"].get<std::string>()[0], 's');
+    json status = f.call("query", {{"pid", 7}, {"id", statusId}});
+    ASSERT_EQ(status["result"]["count"], 1);
+    EXPECT_EQ(status["result"]["elements"][0]["className"], "msctls_statusbar32");
+
+    json edit = f.call("query", {{"pid", 7}, {"type", "Edit"}});
+    ASSERT_EQ(edit["result"]["count"], 1);
+    std::string id = edit["result"]["elements"][0]["id"];
+    EXPECT_EQ(id[0], 's');
+    EXPECT_EQ(f.server.stats().captures, 1u);  // the query read the dump
+
+    json state = f.call("dump", {{"pid", 7}, {"stableIds", true}})["result"];
+    f.ws.at(f.edit).info.text = "hello, world";
+    json changes = f.call("diff", {{"pid", 7}});
+    EXPECT_TRUE(changes["result"]["changed"]);
+    for (auto& op : changes["result"]["patch"]) EXPECT_EQ(op["op"], "replace");  // matched by ID
+    EXPECT_EQ(state.patch(changes["result"]["patch"]), f.call("dump", {{"pid", 7}, {"stableIds", true}})["result"]);
+    EXPECT_EQ(f.call("query", {{"pid", 7}, {"id", id}})["result"]["elements"][0]["text"], "hello, world");
+}
+
+TEST(RpcServer, ReportsErrors) {
+    RpcFixture f;
+    f.ws.set_process(9, "notepad2.exe");
+    f.ws.add_window(nullptr, 9, "Notepad", "Other - Notepad");
+    auto code = [&](std::string_view request) { return json::parse(f.server.handle(request))["error"]["code"]; };
+
+    EXPECT_EQ(code("{"), -32700);
+    EXPECT_EQ(code(R"([{"jsonrpc":"2.0","id":1,"method":"dump"}])"), -32600);
+    EXPECT_EQ(code(R"({"jsonrpc":"2.0","id":1})"), -32600);
+    EXPECT_EQ(code(R"({"jsonrpc":"2.0","id":1,"method":"dump","params":[7]})"), -32602);
+    EXPECT_EQ(f.call("explode")["error"]["code"], -32601);
+    EXPECT_EQ(f.call("dump")["error"]["code"], -32602);
+    EXPECT_EQ(f.call("dump", {{"pid", "7"}})["error"]["code"], -32602);
+    EXPECT_EQ(f.call("dump", {{"pid", 7}, {"format", "lvtbin"}})["error"]["code"], -32602);
+    EXPECT_EQ(f.call("dump", {{"pid", 7}, {"depth", 4294967295u}})["error"]["code"], -32602);
+    EXPECT_EQ(f.call("dump", {{"pid", 7}, {"depth", -2}})["error"]["code"], -32602);
+    EXPECT_EQ(f.call("query", {{"pid", 7}, {"limit", 4294967296ull}})["error"]["code"], -32602);
+    EXPECT_EQ(f.call("query", {{"pid", 7}, {"limit", -4294967296ll}})["error"]["code"], -32602);
+    EXPECT_EQ(f.call("dump", {{"pid", -1}})["error"]["code"], -32602);
+
+    json ambiguous = f.call("dump", {{"name", "notepad"}});
+    EXPECT_EQ(ambiguous["error"]["code"], -32000);
+    EXPECT_NE(ambiguous["error"]["message"].get<std::string>().find("multiple windows"), std::string::npos);
+    EXPECT_EQ(f.call("dump", {{"hwnd", "0x12345"}})["error"]["code"], -32000);
+    EXPECT_EQ(f.call("dump", {{"pid", 7}, {"element", "e99"}})["error"]["code"], -32000);
+    EXPECT_EQ(f.call("screenshot", {{"pid", 7}, {"path", "out.png"}})["error"]["code"], -32000);
+
+    // Notifications get no response, even when they fail.
+    EXPECT_EQ(f.server.handle(R"({"jsonrpc":"2.0","method":"dump","params":{"pid":7}})"), "");
+    EXPECT_EQ(f.server.handle(R"({"jsonrpc":"2.0","method":"explode"})"), "");
+    EXPECT_FALSE(f.server.stopping());
+    EXPECT_EQ(f.call("shutdown")["result"], nullptr);
+    EXPECT_TRUE(f.server.stopping());
+}
+
+TEST(RpcServer, ServesClientsOverIpc) {
+    RpcFixture f;
+    lvt::testing::make_window_forest(f.ws, 7, 3000);  // a dump well past one read
+    std::string name = "lvt-core-tests-" +
+                       std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    std::string error;
+    auto listener = ipc_listen(name, &error);
+    ASSERT_TRUE(listener) << error;
+    EXPECT_FALSE(ipc_listen(name, &error));
+    EXPECT_NE(error.find("another server"), std::string::npos) << error;
+    std::thread server([&] { serve(*listener, f.server); });
+
+    auto a = ipc_connect(name, &error);
+    auto b = ipc_connect(name, &error);
+    ASSERT_TRUE(a && b) << error;
+    std::string line;
+    ASSERT_TRUE(a->write(R"({"jsonrpc":"2.0","id":1,"method":"dump","params":{"title":"Synthetic"}})" "\n"
+                         R"({"jsonrpc":"2.0","id":2,"method":"query","params":{"title":"Synthetic"}})" "\r\n"));
+    ASSERT_TRUE(a->read_line(line));
+    json dump = json::parse(line);
+    EXPECT_EQ(dump["id"], 1);
+    EXPECT_GT(line.size(), 256u * 1024);
+    ASSERT_TRUE(a->read_line(line));
+    EXPECT_EQ(json::parse(line)["result"]["count"], 3000);
+
+    ASSERT_TRUE(b->write(R"({"jsonrpc":"2.0","id":"x","method":"shutdown"})" "\n"));
+    ASSERT_TRUE(b->read_line(line));
+    EXPECT_EQ(json::parse(line)["id"], "x");
+    server.join();  // `a` is still connected: serve() hangs it up
+    EXPECT_FALSE(a->read_line(line));
+    EXPECT_EQ(f.server.stats().captures, 1u);
+    listener.reset();
+    EXPECT_FALSE(ipc_connect(name, &error));
+}
+
+// ---- XAML TAP tree model ----
+
+namespace {
+
+// The tree as a client holding it sees it: the TAP's JSON.
+json tap_tree(const tap::TreeModel& model) {
+    std::string out;
+    tap::write_tree(out, model);
+    return json::parse(out);
+}
+
+json* find_tap_node(json& nodes, uint64_t handle) {
+    for (auto& n : nodes) {
+        if (n["handle"] == handle) return &n;
+        if (n.contains("children"))
+            if (json* found = find_tap_node(n["children"], handle)) return found;
+    }
+    return nullptr;
+}
+
+// Apply a CHANGES response to a client's copy of the tree.
+void apply_tap_changes(json& tree, const json& response) {
+    for (uint64_t h : response["removed"]) {
+        std::function<bool(json&)> erase = [&](json& nodes) {
+            for (size_t i = 0; i < nodes.size(); i++) {
+                if (nodes[i]["handle"] == h) {
+                    nodes.erase(i);
+                    return true;
+                }
+                if (nodes[i].contains("children") && erase(nodes[i]["children"])) {
+                    if (nodes[i]["children"].empty()) nodes[i].erase("children");
+                    return true;
+                }
+            }
+            return false;
+        };
+        erase(tree);
+    }
+    for (auto& a : response["added"]) {
+        json* siblings = &tree;
+        if (a["parent"] != 0) {
+            json* parent = find_tap_node(tree, a["parent"]);
+            ASSERT_NE(parent, nullptr);
+            if (!parent->contains("children")) (*parent)["children"] = json::array();
+            siblings = &(*parent)["children"];
+        }
+        size_t index = a["index"];
+        ASSERT_LE(index, siblings->size());
+        siblings->insert(siblings->begin() + index, a["node"]);
+    }
+}
+
+} // namespace
+
+TEST(TapTree, PlacesChildrenAtTheirIndex) {
+    tap::TreeModel model;
+    model.add(1, 0, 0, "Window", "", 3);
+    model.add(12, 1, 0, "Button", "ok", 0);
+    model.add(10, 1, 0, "Grid", "", 0);
+    model.add(11, 1, 1, "TextBlock", "", 0);
+    EXPECT_EQ(model.version(), 4u);
+    EXPECT_EQ(model.find(1)->children, (std::vector<tap::Handle>{10, 11, 12}));
+
+    model.find(12)->hasBounds = true;
+    model.find(12)->width = 80;
+    model.find(12)->height = 24;
+    std::string out;
+    tap::write_tree(out, model);
+    EXPECT_EQ(out, "[{\"type\":\"Window\",\"handle\":1,\"children\":[{\"type\":\"Grid\",\"handle\":10},"
+                   "{\"type\":\"TextBlock\",\"handle\":11},{\"type\":\"Button\",\"name\":\"ok\",\"handle\":12,"
+                   "\"width\":80.0,\"height\":24.0,\"offsetX\":0.0,\"offsetY\":0.0}]}]");
+}
+
+TEST(TapTree, AdoptsChildrenAnnouncedBeforeTheirParent) {
+    tap::TreeModel model;
+    model.add(1, 0, 0, "Window", "", 1);
+    model.add(21, 2, 1, "B", "", 0);
+    model.add(20, 2, 0, "A", "", 0);
+    EXPECT_FALSE(model.find(20)->attached);
+    EXPECT_EQ(tap_tree(model), json::parse(R"([{"type":"Window","handle":1}])"));
+
+    model.add(2, 1, 0, "Panel", "", 2);
+    EXPECT_TRUE(model.find(20)->attached);
+    EXPECT_EQ(model.find(2)->children, (std::vector<tap::Handle>{20, 21}));
+}
+
+TEST(TapTree, RemoveDropsTheSubtreeAndMoveKeepsIt) {
+    tap::TreeModel model;
+    model.add(1, 0, 0, "Window", "", 2);
+    model.add(2, 1, 0, "Panel", "", 1);
+    model.add(3, 2, 0, "Button", "", 0);
+    model.add(4, 1, 1, "Panel", "", 0);
+
+    // Added again under another parent: moved, with its children.
+    model.add(2, 4, 0, "Panel", "", 1);
+    EXPECT_EQ(model.find(1)->children, (std::vector<tap::Handle>{4}));
+    EXPECT_EQ(model.find(4)->children, (std::vector<tap::Handle>{2}));
+    EXPECT_EQ(model.find(2)->children, (std::vector<tap::Handle>{3}));
+
+    uint64_t before = model.version();
+    model.remove(4);
+    EXPECT_EQ(model.size(), 1u);
+    EXPECT_EQ(model.find(3), nullptr);
+    model.remove(4);
+    EXPECT_EQ(model.version(), before + 1);  // nothing left to remove
+}
+
+TEST(TapTree, ChangesReplayOntoEveryEarlierTree) {
+    // A random stream of adds, moves and removes; the changes since each
+    // version, applied to the tree as of that version, give the current one.
+    std::mt19937 rng(21);
+    tap::TreeModel model;
+    std::vector<std::pair<uint64_t, json>> seen;
+    tap::Handle next = 1;
+    for (int step = 0; step < 400; step++) {
+        std::vector<tap::Handle> live;
+        for (tap::Handle h = 1; h < next; h++)
+            if (model.find(h)) live.push_back(h);
+        unsigned op = rng() % 10;
+        if (live.empty() || op < 6) {
+            tap::Handle parent = live.empty() || rng() % 8 == 0 ? 0 : live[rng() % live.size()];
+            tap::Handle h = next++;
+            model.add(h, parent, rng() % 4, "T" + std::to_string(h), "", 0);
+        } else if (op < 8) {
+            // A move, as Remove then Add or as a bare Add.
+            tap::Handle h = live[rng() % live.size()];
+            tap::Handle parent = live[rng() % live.size()];
+            for (tap::Handle p = parent; p; p = model.find(p)->parent)
+                if (p == h) parent = 0;
+            if (rng() % 2) model.remove(h);
+            if (!model.find(h) || parent) model.add(h, parent, rng() % 4, "T" + std::to_string(h), "", 0);
+        } else {
+            model.remove(live[rng() % live.size()]);
+        }
+        if (step % 7 == 0) seen.push_back({model.version(), tap_tree(model)});
+    }
+
+    json now = tap_tree(model);
+    for (auto& [version, tree] : seen) {
+        std::string line;
+        tap::respond(model, {tap::Request::Changes, version}, line);
+        json response = json::parse(line);
+        ASSERT_FALSE(response.contains("reset"));
+        EXPECT_EQ(response["version"], model.version());
+        json replayed = tree;
+        apply_tap_changes(replayed, response);
+        EXPECT_EQ(replayed, now) << "since version " << version;
+    }
+}
+
+TEST(TapTree, ChangesResetWhenTooOld) {
+    tap::TreeModel model;
+    model.add(1, 0, 0, "Window", "", 0);
+    uint64_t start = model.version();
+    for (size_t i = 0; i <= tap::TreeModel::kMaxRemovals; i++) {
+        model.add(2 + i, 1, 0, "Child", "", 0);
+        model.remove(2 + i);
+    }
+    EXPECT_TRUE(model.changes_since(start).reset);
+    EXPECT_TRUE(model.changes_since(model.version() + 1).reset);
+    auto recent = model.changes_since(model.version() - 2);
+    EXPECT_FALSE(recent.reset);
+    EXPECT_TRUE(recent.removed.empty());  // added and removed since: never seen
+    EXPECT_TRUE(recent.added.empty());
+}
+
+TEST(TapTree, ParsesRequestsAndAnswersThem) {
+    tap::TreeModel model;
+    model.add(1, 0, 0, "Window", "", 1);
+    model.add(2, 1, 0, "Button", "", 0);
+
+    auto tree = tap::parse_request("TREE\r");
+    EXPECT_EQ(tree.kind, tap::Request::Tree);
+    auto sub = tap::parse_request("SUBTREE 2");
+    EXPECT_EQ(sub.kind, tap::Request::Subtree);
+    EXPECT_EQ(sub.argument, 2u);
+    EXPECT_EQ(tap::parse_request("CHANGES 18446744073709551615").argument, UINT64_MAX);
+    for (const char* bad : {"", "tree", "SUBTREE", "SUBTREE x", "SUBTREE 2x", "CHANGES -1", "TREES"})
+        EXPECT_EQ(tap::parse_request(bad).kind, tap::Request::Invalid) << bad;
+
+    std::string line;
+    tap::respond(model, tree, line);
+    EXPECT_EQ(line, "{\"version\":2,\"tree\":[{\"type\":\"Window\",\"handle\":1,\"children\":"
+                    "[{\"type\":\"Button\",\"handle\":2}]}]}");
+    EXPECT_EQ(tap::tree_payload(line), line.substr(20, line.size() - 21));
+    line.clear();
+    tap::respond(model, sub, line);
+    EXPECT_EQ(tap::tree_payload(line), "[{\"type\":\"Button\",\"handle\":2}]");
+    line.clear();
+    tap::respond(model, {tap::Request::Subtree, 99}, line);
+    EXPECT_EQ(tap::tree_payload(line), "[]");
+    line.clear();
+    tap::respond(model, {}, line);
+    EXPECT_TRUE(json::parse(line).contains("error"));
+    EXPECT_TRUE(tap::tree_payload(line).empty());
+    EXPECT_TRUE(tap::tree_payload("{\"version\":3,\"reset\":true}").empty());
+}
+
+TEST(TapTree, ParsesInitData) {
+    auto plain = tap::parse_init_data(L"\\\\.\\pipe\\lvt_1");
+    EXPECT_EQ(plain.pipe, L"\\\\.\\pipe\\lvt_1");
+    EXPECT_FALSE(plain.collectProps);
+    EXPECT_TRUE(plain.servePipe.empty());
+
+    auto full = tap::parse_init_data(L"\\\\.\\pipe\\lvt_1|PROPS|SERVE=\\\\.\\pipe\\lvt_tap_7_X");
+    EXPECT_EQ(full.pipe, L"\\\\.\\pipe\\lvt_1");
+    EXPECT_TRUE(full.collectProps);
+    EXPECT_EQ(full.servePipe, L"\\\\.\\pipe\\lvt_tap_7_X");
+    EXPECT_EQ(full.properties, tap::default_properties());
+    EXPECT_EQ(tap::parse_init_data(L"p|SERVE=s").servePipe, L"s");
+    auto some = tap::parse_init_data(L"p|PROPS= Text,,Tag ,Text|SERVE=s");
+    EXPECT_TRUE(some.collectProps);
+    EXPECT_EQ(some.properties, (std::vector<std::string>{"Text", "Tag"}));
+    EXPECT_EQ(some.servePipe, L"s");
+    EXPECT_TRUE(tap::parse_init_data(L"p|PROPS=").properties.empty());
+    EXPECT_EQ(tap::parse_property_list(std::wstring_view(L"AutomationProperties.Name,T\u00e9xt")),
+              (std::vector<std::string>{"AutomationProperties.Name", "T\xC3\xA9xt"}));
+    EXPECT_EQ(tap::resident_pipe_name(42, L"WinUIVisualDiagConnection"),
+              L"\\\\.\\pipe\\lvt_tap_42_WinUIVisualDiagConnection");
+}
+
+TEST(TapTree, WritesUtf8AndEscapes) {
+    std::u16string wide = u"aé中";
+    wide += char16_t(0xD83D);  // U+1F600 as a surrogate pair
+    wide += char16_t(0xDE00);
+    wide += char16_t(0xDC00);  // unpaired
+    std::string out;
+    tap::append_utf8(out, wide.data(), wide.size());
+    EXPECT_EQ(out, "a\xC3\xA9\xE4\xB8\xAD\xF0\x9F\x98\x80\xEF\xBF\xBD");
+    EXPECT_EQ(tap::to_utf8(U"\U0001F600"), "\xF0\x9F\x98\x80");
+    EXPECT_EQ(tap::to_utf8(static_cast<const char16_t*>(nullptr)), "");
+
+    out.clear();
+    tap::append_json_string(out, "say \"hi\"\\\n" + std::string(40, 'x'));
+    EXPECT_EQ(out, "\"say \\\"hi\\\"\\\\\\u000A" + std::string(40, 'x') + "\"");
+    EXPECT_EQ(json::parse(out), "say \"hi\"\\\n" + std::string(40, 'x'));
+}
+
+namespace {
+
+// The recursive writer the TAP had, for comparison.
+void reference_tap_node(std::string& out, const tap::TreeModel& model, const tap::Node& n) {
+    out += "{\"type\":";
+    tap::append_json_string(out, n.type);
+    if (!n.name.empty()) {
+        out += ",\"name\":";
+        tap::append_json_string(out, n.name);
+    }
+    out += ",\"handle\":" + std::to_string(n.handle);
+    if (n.hasBounds) {
+        char buf[1400];
+        snprintf(buf, sizeof(buf), ",\"width\":%.1f,\"height\":%.1f,\"offsetX\":%.1f,\"offsetY\":%.1f", n.width,
+                 n.height, n.offsetX, n.offsetY);
+        out += buf;
+    }
+    for (size_t i = 0; i < n.children.size(); i++) {
+        out += i ? "," : ",\"children\":[";
+        reference_tap_node(out, model, *model.find(n.children[i]));
+    }
+    if (!n.children.empty()) out += "]";
+    out += "}";
+}
+
+tap::TreeModel random_tap_tree(size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> coord(-5000.0, 5000.0);
+    tap::TreeModel model;
+    for (tap::Handle h = 1; h <= count; h++) {
+        tap::Handle parent = h == 1 || rng() % 50 == 0 ? 0 : 1 + rng() % (h - 1);
+        std::string name = rng() % 3 ? "" : "name \"" + std::to_string(h) + "\"\t\xC3\xA9";
+        model.add(h, parent, rng() % 5, "Microsoft.UI.Xaml.Controls.T" + std::to_string(rng() % 40), name, 0);
+        if (rng() % 4) {
+            tap::Node& n = *model.find(h);
+            n.hasBounds = true;
+            n.width = coord(rng);
+            n.height = rng() % 2 ? coord(rng) : 0.05 * (rng() % 100);
+            n.offsetX = coord(rng) * 1e6;
+            n.offsetY = -0.0;
+        }
+    }
+    return model;
+}
+
+} // namespace
+
+TEST(TapTree, WriterMatchesTheRecursiveWriter) {
+    tap::TreeModel model = random_tap_tree(3000, 23);
+    std::string expected = "[";
+    for (size_t i = 0; i < model.roots().size(); i++) {
+        if (i) expected += ",";
+        reference_tap_node(expected, model, *model.find(model.roots()[i]));
+    }
+    expected += "]";
+    std::string out;
+    tap::write_tree(out, model);
+    EXPECT_EQ(out, expected);
+    EXPECT_NO_THROW(json::parse(out));
+
+    tap::TreeModel none;
+    out.clear();
+    tap::write_tree(out, none);
+    EXPECT_EQ(out, "[]");
+}
+
+TEST(TapTree, WriterStreamsChunksAndHandlesDeepTrees) {
+    // A 100k-deep chain would overflow a recursive writer's stack.
+    tap::TreeModel model;
+    constexpr tap::Handle kDepth = 100000;
+    for (tap::Handle h = 1; h <= kDepth; h++) model.add(h, h - 1, 0, "Border", "", 1);
+    std::string whole;
+    tap::write_tree(whole, model);
+    EXPECT_EQ(static_cast<size_t>(std::count(whole.begin(), whole.end(), '{')), kDepth);
+    EXPECT_TRUE(whole.starts_with("[{\"type\":\"Border\",\"handle\":1,\"children\":[{\"type\":"));
+    std::string tail = "\"handle\":100000}";
+    for (tap::Handle h = 1; h < kDepth; h++) tail += "]}";
+    EXPECT_TRUE(whole.ends_with(tail + "]"));
+
+    std::string buffer, streamed;
+    size_t chunks = 0, largest = 0;
+    tap::JsonBuffer out(buffer, [&](std::string_view piece) {
+        chunks++;
+        largest = std::max(largest, piece.size());
+        streamed += piece;
+        return true;
+    }, 4096);
+    tap::write_tree(out, model);
+    EXPECT_TRUE(out.finish());
+    EXPECT_EQ(streamed, whole);
+    EXPECT_GT(chunks, whole.size() / 8192);
+    EXPECT_LT(largest, 4096u + 100);  // a chunk ends at the first node past the limit
+    EXPECT_TRUE(buffer.empty());
+
+    // A failed flush ends the output.
+    size_t calls = 0;
+    tap::JsonBuffer failing(buffer, [&](std::string_view) { return ++calls < 3; }, 4096);
+    tap::write_tree(failing, model);
+    EXPECT_FALSE(failing.finish());
+    EXPECT_EQ(calls, 3u);
+}
+
+TEST(TapTree, CompleteOnceEveryAnnouncedChildArrives) {
+    tap::TreeModel model;
+    EXPECT_FALSE(model.complete());
+    model.add(1, 0, 0, "Window", "", 2);
+    EXPECT_FALSE(model.complete());
+    model.add(3, 2, 0, "Button", "", 0);  // before its parent
+    model.add(4, 1, 1, "Panel", "", 0);
+    EXPECT_FALSE(model.complete());
+    model.add(2, 1, 0, "Panel", "", 1);
+    EXPECT_TRUE(model.complete());
+
+    // A removed child is no longer expected; a new one announces its own.
+    model.remove(3);
+    EXPECT_TRUE(model.complete());
+    model.add(5, 4, 0, "List", "", 2);
+    model.add(6, 5, 0, "Item", "", 0);
+    EXPECT_FALSE(model.complete());
+    model.add(7, 5, 1, "Item", "", 0);
+    EXPECT_TRUE(model.complete());
+}
+
+TEST(TapTree, CompletenessMatchesAFullScan) {
+    std::mt19937 rng(22);
+    tap::TreeModel model;
+    tap::Handle next = 1;
+    int completeSteps = 0;
+    auto scan = [&] {
+        std::vector<const tap::Node*> nodes;
+        for (tap::Handle h = 1; h < next; h++)
+            if (const tap::Node* n = model.find(h)) nodes.push_back(n);
+        return !nodes.empty() && std::all_of(nodes.begin(), nodes.end(), [](const tap::Node* n) {
+            return n->attached && n->children.size() >= n->numChildren;
+        });
+    };
+    for (int step = 0; step < 2000; step++) {
+        unsigned op = rng() % 10;
+        tap::Handle h = 1 + rng() % next;
+        tap::Handle parent = rng() % 5 == 0 ? 0 : 1 + rng() % (next + 2);  // may not exist yet
+        if (op < 7) {
+            if (h == next) next++;
+            model.add(h, parent, rng() % 3, "T", "", rng() % 3);
+        } else if (op >= 7) {
+            model.remove(h);
+        }
+        ASSERT_EQ(model.complete(), scan()) << "step " << step;
+        completeSteps += model.complete();
+    }
+    EXPECT_GT(completeSteps, 0);
+}
+
+// ---- XAML TAP quiescence ----
+
+namespace {
+
+using tap::Quiescence;
+constexpr Quiescence::Clock::time_point kT0{};
+Quiescence::Clock::time_point at_ms(int ms) { return kT0 + std::chrono::milliseconds(ms); }
+
+} // namespace
+
+TEST(Quiescence, CompletesWithTheLastAnnouncedChild) {
+    // A replay that takes a second in all: no fixed wait, no idle gap.
+    tap::TreeModel model;
+    Quiescence settle(kT0);
+    EXPECT_EQ(settle.observe(at_ms(0), model), Quiescence::State::Waiting);
+    model.add(1, 0, 0, "Window", "", 3);
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(settle.observe(at_ms(300 * i + 50), model), Quiescence::State::Waiting);
+        model.add(10 + i, 1, i, "Child", "", 0);
+    }
+    EXPECT_EQ(settle.observe(at_ms(1000), model), Quiescence::State::Complete);
+}
+
+TEST(Quiescence, FallsBackToAnIdleGap) {
+    // NumChildren counts a child that is never announced.
+    tap::TreeModel model;
+    Quiescence settle(kT0, {std::chrono::milliseconds(500), std::chrono::milliseconds(100),
+                            std::chrono::milliseconds(5000)});
+    model.add(1, 0, 0, "Window", "", 2);
+    model.add(2, 1, 0, "Child", "", 0);
+    EXPECT_EQ(settle.observe(at_ms(20), model), Quiescence::State::Waiting);
+    EXPECT_EQ(settle.deadline(model), at_ms(120));
+    EXPECT_EQ(settle.observe(at_ms(119), model), Quiescence::State::Waiting);
+    model.add(3, 2, 0, "Grandchild", "", 0);  // activity restarts the gap
+    EXPECT_EQ(settle.observe(at_ms(119), model), Quiescence::State::Waiting);
+    EXPECT_EQ(settle.observe(at_ms(200), model), Quiescence::State::Waiting);
+    EXPECT_EQ(settle.observe(at_ms(219), model), Quiescence::State::Idle);
+}
+
+TEST(Quiescence, GivesUpWithoutXamlAndUnderChurn) {
+    tap::TreeModel model;
+    Quiescence settle(kT0);
+    EXPECT_EQ(settle.deadline(model), at_ms(500));
+    EXPECT_EQ(settle.observe(at_ms(499), model), Quiescence::State::Waiting);
+    EXPECT_EQ(settle.observe(at_ms(500), model), Quiescence::State::Empty);
+
+    // A child announced every 50 ms, each with one more to come.
+    Quiescence churn(kT0);
+    model.add(1, 0, 0, "Window", "", 1);
+    int t = 0;
+    for (tap::Handle h = 2; t < 5000; h++, t += 50) {
+        ASSERT_EQ(churn.observe(at_ms(t), model), Quiescence::State::Waiting) << t;
+        EXPECT_LE(churn.deadline(model), at_ms(5000));
+        model.add(h, h - 1, 0, "Nested", "", 1);
+    }
+    EXPECT_EQ(churn.observe(at_ms(t), model), Quiescence::State::TimedOut);
+}
+
+// ---- XAML TAP bounds collection ----
+
+namespace {
+
+// GetPropertyValuesChain on a fake clock: each read takes `cost(handle)`.
+struct FakePropertyService {
+    using Clock = tap::BoundsCollector::Clock;
+
+    Clock::time_point now = kT0;
+    std::function<Clock::duration(tap::Handle)> cost;
+    std::unordered_map<tap::Handle, int> reads;
+    Clock::duration slowest{};  // the slowest read since reset
+
+    void read(tap::Handle handle, tap::NodeData& bounds) {
+        Clock::duration took = cost(handle);
+        now += took;
+        slowest = std::max(slowest, took);
+        reads[handle]++;
+        bounds.hasBounds = handle % 3 != 0;
+        bounds.width = static_cast<double>(handle);
+        bounds.height = 2.0 * handle;
+    }
+};
+
+} // namespace
+
+TEST(BoundsCollector, SlicesStayWithinTheBudget) {
+    using std::chrono::microseconds;
+    tap::TreeModel model = random_tap_tree(20000, 5);
+    size_t attached = 0;
+    model.for_each([&](const tap::Node& n) { attached += n.attached; });
+
+    // Reads of 20-400 us, and every 997th element takes 12 ms. Read in one
+    // go, as the TAP used to, this froze the UI thread for seconds.
+    FakePropertyService service;
+    std::mt19937 rng(11);
+    service.cost = [&](tap::Handle h) {
+        return h % 997 == 0 ? microseconds(12000) : microseconds(20 + rng() % 381);
+    };
+    constexpr auto kBudget = std::chrono::milliseconds(8);
+    tap::BoundsCollector collector(kBudget);
+    ASSERT_TRUE(collector.start(model));
+    EXPECT_EQ(collector.size(), attached);
+
+    auto read = [&](tap::Handle h, std::string_view, tap::NodeData& b) { service.read(h, b); };
+    auto now = [&] { return service.now; };
+    FakePropertyService::Clock::duration total{}, longest{};
+    size_t slices = 0;
+    bool done = false;
+    while (!done) {
+        ASSERT_LT(slices, attached);
+        service.slowest = {};
+        auto start = service.now;
+        done = collector.step(read, now);
+        auto stall = service.now - start;
+        // The worst case: the budget, plus the read that crossed it.
+        EXPECT_LE(stall, kBudget + service.slowest) << slices;
+        if (!done) {
+            EXPECT_GE(stall, kBudget) << slices;  // no slice cut short
+        }
+        total += stall;
+        longest = std::max(longest, stall);
+        slices++;
+        collector.store(model);
+    }
+    EXPECT_EQ(collector.slices(), slices);
+    EXPECT_EQ(collector.longest(), longest);
+    EXPECT_LE(longest, kBudget + microseconds(12000));
+    EXPECT_GT(total, std::chrono::seconds(2));
+    EXPECT_LE(slices, static_cast<size_t>(total / kBudget) + 1);
+
+    // Every listed element read once, and its bounds stored.
+    EXPECT_EQ(service.reads.size(), attached);
+    size_t withBounds = 0;
+    model.for_each([&](const tap::Node& n) {
+        if (!n.attached) return;
+        EXPECT_EQ(service.reads[n.handle], 1) << n.handle;
+        EXPECT_EQ(n.hasBounds, n.handle % 3 != 0) << n.handle;
+        EXPECT_EQ(n.height, 2.0 * n.handle);
+        withBounds += n.hasBounds;
+    });
+    EXPECT_EQ(collector.collected(), withBounds);
+}
+
+TEST(BoundsCollector, CollectsASubtreeToADepth) {
+    tap::TreeModel model;
+    model.add(1, 0, 0, "Window", "", 2);
+    model.add(2, 1, 0, "Grid", "", 1);
+    model.add(3, 2, 0, "Border", "", 1);
+    model.add(4, 3, 0, "Button", "", 0);
+    model.add(5, 1, 1, "Grid", "", 0);
+    model.add(7, 6, 0, "Orphan", "", 0);
+
+    auto plan = [&](tap::Handle scope, int depth) {
+        tap::BoundsCollector collector(std::chrono::hours(1));
+        std::vector<tap::Handle> order;
+        if (!collector.start(model, scope, depth)) return std::vector<tap::Handle>{99};
+        EXPECT_TRUE(collector.step([&](tap::Handle h, std::string_view, tap::NodeData&) { order.push_back(h); }));
+        EXPECT_EQ(collector.slices(), 1u);
+        return order;
+    };
+    EXPECT_EQ(plan(0, -1), (std::vector<tap::Handle>{1, 2, 3, 4, 5}));
+    EXPECT_EQ(plan(0, 0), (std::vector<tap::Handle>{1}));
+    EXPECT_EQ(plan(0, 1), (std::vector<tap::Handle>{1, 2, 5}));
+    EXPECT_EQ(plan(2, -1), (std::vector<tap::Handle>{2, 3, 4}));
+    EXPECT_EQ(plan(2, 1), (std::vector<tap::Handle>{2, 3}));
+    EXPECT_EQ(plan(42, -1), (std::vector<tap::Handle>{99}));  // unknown
+    EXPECT_EQ(plan(7, -1), (std::vector<tap::Handle>{99}));   // not in the tree
+
+    // Elements removed between reading and storing are skipped.
+    tap::BoundsCollector collector;
+    ASSERT_TRUE(collector.start(model));
+    collector.step([](tap::Handle, std::string_view, tap::NodeData& b) { b.hasBounds = true; });
+    model.remove(3);
+    EXPECT_EQ(collector.store(model), 3u);
+    EXPECT_TRUE(model.find(2)->hasBounds);
+    EXPECT_EQ(collector.store(model), 0u);  // nothing new read
+}
+
+TEST(TapTree, AnswersToADepth) {
+    tap::TreeModel model;
+    model.add(1, 0, 0, "Window", "", 1);
+    model.add(2, 1, 0, "Grid", "", 1);
+    model.add(3, 2, 0, "Button", "", 0);
+
+    auto tree = tap::parse_request("TREE 0");
+    EXPECT_EQ(tree.kind, tap::Request::Tree);
+    EXPECT_EQ(tree.depth, 0);
+    auto sub = tap::parse_request("SUBTREE 2 1\r");
+    EXPECT_EQ(sub.kind, tap::Request::Subtree);
+    EXPECT_EQ(sub.argument, 2u);
+    EXPECT_EQ(sub.depth, 1);
+    EXPECT_EQ(tap::parse_request("TREE").depth, -1);
+    for (const char* bad : {"TREE x", "TREE -1", "TREE 1 2", "TREE  1", "SUBTREE 2 x", "SUBTREE 2 1 1",
+                            "CHANGES 1 2", "SUBTREE CHANGES 1"})
+        EXPECT_EQ(tap::parse_request(bad).kind, tap::Request::Invalid) << bad;
+
+    std::string line;
+    tap::respond(model, tree, line);
+    EXPECT_EQ(tap::tree_payload(line), "[{\"type\":\"Window\",\"handle\":1}]");
+    line.clear();
+    tap::respond(model, sub, line);
+    EXPECT_EQ(tap::tree_payload(line),
+              "[{\"type\":\"Grid\",\"handle\":2,\"children\":[{\"type\":\"Button\",\"handle\":3}]}]");
+    line.clear();
+    tap::respond(model, {tap::Request::Subtree, 2, 0}, line);
+    EXPECT_EQ(tap::tree_payload(line), "[{\"type\":\"Grid\",\"handle\":2}]");
+}
+
+namespace {
+
+// One entry of a fake GetPropertyValuesChain result.
+struct ChainEntry {
+    uint32_t index;
+    const char16_t* name;
+    const char16_t* declaringType;
+    const char16_t* value;
+    bool overridden = false;
+};
+
+tap::NodeData read_chain(tap::PropertySelection& selection, std::string_view type,
+                         const std::vector<ChainEntry>& chain) {
+    tap::NodeData data;
+    auto reader = selection.read(type, data);
+    for (const ChainEntry& e : chain) reader.add(e.index, e.name, e.declaringType, e.value, e.overridden);
+    reader.finish();
+    return data;
+}
+
+const std::vector<ChainEntry> kTextBoxChain = {
+    {7, u"Text", u"Microsoft.UI.Xaml.Controls.TextBox", u"old", true},
+    {7, u"Text", u"Microsoft.UI.Xaml.Controls.TextBox", u"héllo \"you\""},
+    {9, u"Name", u"Microsoft.UI.Xaml.Automation.AutomationProperties", u"Search box"},
+    {11, u"Name", u"Microsoft.UI.Xaml.FrameworkElement", nullptr},
+    {20, u"ActualWidth", u"Microsoft.UI.Xaml.FrameworkElement", u"200.5"},
+    {21, u"ActualHeight", u"Microsoft.UI.Xaml.FrameworkElement", u"32"},
+    {22, u"ActualOffset", u"Microsoft.UI.Xaml.UIElement", u"<12.25, -4, 0>"},
+    {30, u"IsEnabled", u"Microsoft.UI.Xaml.Controls.Control", u"True"},
+    {31, u"Tag", u"Microsoft.UI.Xaml.FrameworkElement", u""},
+};
+
+} // namespace
+
+TEST(PropertySelection, KeepsLayoutAndTheNamesAskedFor) {
+    tap::PropertySelection selection({"IsEnabled", "Text", "AutomationProperties.Name", "Tag", "Missing"});
+    tap::NodeData data = read_chain(selection, "Microsoft.UI.Xaml.Controls.TextBox", kTextBoxChain);
+    EXPECT_TRUE(data.hasBounds);
+    EXPECT_EQ(data.width, 200.5);
+    EXPECT_EQ(data.height, 32.0);
+    EXPECT_EQ(data.offsetX, 12.25);
+    EXPECT_EQ(data.offsetY, -4.0);
+    // In the order asked for; overridden values and nulls skipped.
+    using Props = std::vector<std::pair<std::string, std::string>>;
+    EXPECT_EQ(data.properties, (Props{{"IsEnabled", "True"},
+                                      {"Text", "h\xC3\xA9llo \"you\""},
+                                      {"AutomationProperties.Name", "Search box"},
+                                      {"Tag", ""}}));
+
+    // Nothing asked for: layout only. A bare "Name" is FrameworkElement's
+    // and the attached one's alike.
+    tap::PropertySelection none;
+    data = read_chain(none, "TextBox", kTextBoxChain);
+    EXPECT_TRUE(data.hasBounds);
+    EXPECT_TRUE(data.properties.empty());
+    tap::PropertySelection names({"Name"});
+    EXPECT_EQ(read_chain(names, "TextBox", kTextBoxChain).properties,
+              (Props{{"Name", "Search box"}}));
+
+    // Width without height is no bounds; bad numbers are not read.
+    data = read_chain(none, "TextBox", {{20, u"ActualWidth", u"", u"10"}, {21, u"ActualHeight", u"", u"auto"}});
+    EXPECT_FALSE(data.hasBounds);
+    EXPECT_EQ(data.width, 10.0);
+    data = read_chain(none, "Grid", {{20, u"ActualWidth", u"", u"+1e2"}, {21, u"ActualHeight", u"", u"3"}});
+    EXPECT_TRUE(data.hasBounds);
+    EXPECT_EQ(data.width, 100.0);
+}
+
+TEST(PropertySelection, MatchesNamesOncePerTypeAndIndex) {
+    tap::PropertySelection selection(tap::default_properties());
+    for (int i = 0; i < 100; i++) read_chain(selection, "Microsoft.UI.Xaml.Controls.TextBox", kTextBoxChain);
+    // Eight distinct indexes in the chain, each matched by name once.
+    EXPECT_EQ(selection.lookups(), 8u);
+    EXPECT_EQ(selection.types(), 1u);
+
+    // Another type works its indexes out afresh and gets the same answer.
+    tap::NodeData data = read_chain(selection, "Microsoft.UI.Xaml.Controls.AutoSuggestBox", kTextBoxChain);
+    EXPECT_EQ(selection.lookups(), 16u);
+    EXPECT_EQ(selection.types(), 2u);
+    ASSERT_EQ(data.properties.size(), 3u);
+    EXPECT_EQ(data.properties[0].first, "Text");
+    EXPECT_EQ(data.properties[1].first, "IsEnabled");
+    EXPECT_EQ(data.properties[2].first, "AutomationProperties.Name");
+}
+
+TEST(PropertySelection, PropertiesReachTheJson) {
+    tap::TreeModel model;
+    model.add(1, 0, 0, "Microsoft.UI.Xaml.Controls.TextBox", "search", 0);
+    tap::PropertySelection selection({"Text", "IsEnabled"});
+    tap::BoundsCollector collector;
+    ASSERT_TRUE(collector.start(model));
+    collector.step([&](tap::Handle, std::string_view type, tap::NodeData& data) {
+        EXPECT_EQ(type, "Microsoft.UI.Xaml.Controls.TextBox");
+        data = read_chain(selection, type, kTextBoxChain);
+    });
+    EXPECT_EQ(collector.store(model), 1u);
+
+    std::string out;
+    tap::write_tree(out, model);
+    json tree = json::parse(out);
+    EXPECT_EQ(tree[0]["width"], 200.5);
+    EXPECT_EQ(tree[0]["properties"], json::parse(R"({"Text":"héllo \"you\"","IsEnabled":"True"})"));
+    EXPECT_EQ(out.find(",\"properties\":{\"Text\""), out.find("\"offsetY\":-4.0") + 14);
+
+    auto props = tap::parse_request("PROPS Text, IsEnabled");
+    EXPECT_EQ(props.kind, tap::Request::Props);
+    EXPECT_EQ(props.properties, (std::vector<std::string>{"Text", "IsEnabled"}));
+    EXPECT_EQ(tap::parse_request("PROPS").kind, tap::Request::Props);
+    EXPECT_TRUE(tap::parse_request("PROPS").properties.empty());
+    EXPECT_EQ(tap::parse_request("PROPSX").kind, tap::Request::Invalid);
+    std::string line;
+    tap::respond(model, props, line);
+    EXPECT_EQ(line, "{\"version\":1,\"properties\":[\"Text\",\"IsEnabled\"]}");
+
+    // lvt keeps them as element properties.
+    ElementTree grafted;
+    NodeId root = grafted.add_root({.type = "Window"});
+    ASSERT_TRUE(graft_xaml_tree(grafted, root, out, "winui3"));
+    NodeId box = grafted.first_child(root);
+    ASSERT_NE(box, kNoNode);
+    EXPECT_EQ(grafted[box].type, "TextBox");
+    EXPECT_EQ(grafted[box].properties.text("Text"), "h\xC3\xA9llo \"you\"");
+    EXPECT_EQ(grafted[box].properties.text("IsEnabled"), "True");
+    EXPECT_EQ(grafted[box].properties.size(), 2u);
+}
+
+// ---- Screenshot images ----
+
+using lvt::testing::read_png;
+
+static uint32_t bgra_at(const Image& image, int x, int y) {
+    const uint8_t* p = image.pixel(x, y);
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static std::string png_of(const Image& image, const Bounds* crop = nullptr) {
+    std::string out;
+    StringSink sink(out);
+    write_png(sink, image, crop);
+    sink.flush();
+    return out;
+}
+
+TEST(Image, PngRoundTripsPixels) {
+    Image image;
+    image.width = 37;
+    image.height = 23;
+    lvt::testing::SynthRng rng(5);
+    for (int i = 0; i < image.width * image.height * 4; i++)
+        image.pixels.push_back(static_cast<uint8_t>(rng.below(4) == 0 ? rng.next() : i / 64));
+
+    Image decoded;
+    std::string error;
+    ASSERT_TRUE(read_png(png_of(image), decoded, &error)) << error;
+    EXPECT_EQ(decoded.width, 37);
+    EXPECT_EQ(decoded.height, 23);
+    EXPECT_EQ(decoded.pixels, image.pixels);
+}
+
+TEST(Image, PngCompressesFlatFrames) {
+    Image frame = lvt::testing::make_synthetic_frame(640, 480);
+    std::string png = png_of(frame);
+    EXPECT_LT(png.size(), frame.pixels.size() / 10);
+
+    Image decoded;
+    std::string error;
+    ASSERT_TRUE(read_png(png, decoded, &error)) << error;
+    EXPECT_EQ(decoded.pixels, frame.pixels);
+}
+
+TEST(Image, PngWritesCropRectangle) {
+    Image frame = lvt::testing::make_synthetic_frame(120, 80, 3);
+    Bounds crop{30, 10, 50, 40};
+    Image decoded;
+    std::string error;
+    ASSERT_TRUE(read_png(png_of(frame, &crop), decoded, &error)) << error;
+    ASSERT_EQ(decoded.width, 50);
+    ASSERT_EQ(decoded.height, 40);
+    for (int y = 0; y < 40; y++)
+        for (int x = 0; x < 50; x++) ASSERT_EQ(bgra_at(decoded, x, y), bgra_at(frame, 30 + x, 10 + y));
+}
+
+// A 200x120 window at screen (100, 50) with one button inside it and two
+// elements that must not be drawn.
+static ElementTree make_annotation_tree() {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root].id = "e0";
+    tree[root].bounds = {100, 50, 200, 120};
+    NodeId button = tree.append_child(root);
+    tree[button].id = "e1";
+    tree[button].bounds = {140, 90, 40, 20};
+    NodeId offscreen = tree.append_child(root);
+    tree[offscreen].id = "e2";
+    tree[offscreen].bounds = {1000, 1000, 50, 50};
+    NodeId empty = tree.append_child(root);
+    tree[empty].id = "e3";
+    tree[empty].bounds = {120, 60, 0, 10};
+    return tree;
+}
+
+static Image make_gray_frame(int width, int height, int originX, int originY) {
+    Image frame;
+    frame.width = width;
+    frame.height = height;
+    frame.originX = originX;
+    frame.originY = originY;
+    frame.pixels.assign(static_cast<size_t>(width) * height * 4, 0x80);
+    for (size_t i = 3; i < frame.pixels.size(); i += 4) frame.pixels[i] = 0;  // transparent
+    return frame;
+}
+
+TEST(Image, AnnotateDrawsBoxesAndLabels) {
+    ElementTree tree = make_annotation_tree();
+    Image frame = make_gray_frame(200, 120, 100, 50);
+    annotate_image(frame, tree);
+
+    const uint32_t gray = 0xFF808080;
+    // The button's 2px box, at (40, 40) in the image.
+    EXPECT_EQ(bgra_at(frame, 40, 40), kAnnotationColor);
+    EXPECT_EQ(bgra_at(frame, 41, 59), kAnnotationColor);
+    EXPECT_EQ(bgra_at(frame, 79, 50), kAnnotationColor);
+    EXPECT_EQ(bgra_at(frame, 60, 50), gray);
+    EXPECT_EQ(bgra_at(frame, 42, 42), gray);
+
+    // "e1" sits in an 11px label right above the box: padding, then the
+    // glyphs. Row 2 of 'e' is .###.
+    int top = 40 - 11;
+    EXPECT_EQ(bgra_at(frame, 41, top + 1), kLabelBackground);
+    EXPECT_EQ(bgra_at(frame, 42, top + 4), kLabelBackground);
+    EXPECT_EQ(bgra_at(frame, 43, top + 4), kAnnotationColor);
+    EXPECT_EQ(bgra_at(frame, 45, top + 4), kAnnotationColor);
+    EXPECT_EQ(bgra_at(frame, 46, top + 4), kLabelBackground);
+    EXPECT_EQ(bgra_at(frame, 60, top + 4), gray);  // past the label
+
+    // No room above the window's own box, so its label goes inside.
+    EXPECT_EQ(bgra_at(frame, 1, 1), kLabelBackground);
+
+    // Nothing was drawn for the zero-width element, and every pixel is opaque.
+    EXPECT_EQ(bgra_at(frame, 20, 30), gray);
+    for (size_t i = 3; i < frame.pixels.size(); i += 4) ASSERT_EQ(frame.pixels[i], 255);
+
+    // A window ID keeps its upper-case hex, so the label can be typed back
+    // in. Row 0 of 'A' is .###. and of 'F' #####; 'a' and 'f' differ there.
+    tree[tree.child_at(tree.root(), 0)].id = "wAF";
+    Image window = make_gray_frame(200, 120, 100, 50);
+    annotate_image(window, tree);
+    EXPECT_EQ(bgra_at(window, 48, top + 2), kLabelBackground);
+    EXPECT_EQ(bgra_at(window, 49, top + 2), kAnnotationColor);
+    EXPECT_EQ(bgra_at(window, 51, top + 2), kAnnotationColor);
+    EXPECT_EQ(bgra_at(window, 52, top + 2), kLabelBackground);
+    EXPECT_EQ(bgra_at(window, 54, top + 2), kAnnotationColor);
+    EXPECT_EQ(bgra_at(window, 58, top + 2), kAnnotationColor);
+}
+
+TEST(Image, WriteScreenshotCropsToElement) {
+    ElementTree tree = make_annotation_tree();
+    NodeId button = tree.child_at(tree.root(), 0);
+
+    std::string png;
+    StringSink sink(png);
+    ASSERT_TRUE(write_screenshot(sink, make_gray_frame(200, 120, 100, 50), &tree, button));
+    sink.flush();
+    Image decoded;
+    std::string error;
+    ASSERT_TRUE(read_png(png, decoded, &error)) << error;
+    EXPECT_EQ(decoded.width, 40);
+    EXPECT_EQ(decoded.height, 20);
+    EXPECT_EQ(bgra_at(decoded, 0, 0), kAnnotationColor);
+
+    // An element entirely outside the frame leaves nothing to write.
+    std::string none;
+    StringSink noneSink(none);
+    EXPECT_FALSE(write_screenshot(noneSink, make_gray_frame(200, 120, 100, 50), &tree,
+                                  tree.child_at(tree.root(), 1)));
+    EXPECT_FALSE(write_screenshot(noneSink, Image(), &tree));
+}
+
+TEST(Image, FrameCapturedWhileTreeBuilds) {
+    // The frame grab runs beside build_tree and is joined for annotation.
+    Recording rec = make_test_recording();
+    auto frame = std::async(std::launch::async, [] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        Image image = lvt::testing::make_synthetic_frame(800, 600);
+        image.originX = 10;  // the recorded window's position
+        image.originY = 20;
+        return image;
+    });
+    ReplayProvider replay(rec);
+    ElementTree tree = replay.build();
+
+    std::string png;
+    StringSink sink(png);
+    ASSERT_TRUE(write_screenshot(sink, frame.get(), &tree));
+    sink.flush();
+    Image decoded;
+    std::string error;
+    ASSERT_TRUE(read_png(png, decoded, &error)) << error;
+    EXPECT_EQ(decoded.width, 800);
+    // The OK button at screen (700, 560) is boxed.
+    EXPECT_EQ(bgra_at(decoded, 690, 540), kAnnotationColor);
+    EXPECT_EQ(bgra_at(decoded, 769, 563), kAnnotationColor);
+}
+
+// ---- Bounds struct ----
+
+TEST(Bounds, DefaultZero) {
+    Bounds b;
+    EXPECT_EQ(b.x, 0);
+    EXPECT_EQ(b.y, 0);
+    EXPECT_EQ(b.width, 0);
+    EXPECT_EQ(b.height, 0);
+}
+
+// ---- Element struct ----
+
+TEST(Element, DefaultValues) {
+    Element el;
+    EXPECT_TRUE(el.id.empty());
+    EXPECT_TRUE(el.type.empty());
+    EXPECT_TRUE(el.framework.empty());
+    EXPECT_TRUE(el.className.empty());
+    EXPECT_TRUE(el.text.empty());
+    EXPECT_TRUE(el.properties.empty());
+    EXPECT_EQ(el.nativeHandle, 0u);
+}
+
+TEST(Element, TreeConstruction) {
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root].type = "Root";
+    tree[tree.append_child(root)].type = "Child1";
+    tree[tree.append_child(root)].type = "Child2";
+
+    EXPECT_EQ(tree.child_count(root), 2);
+    EXPECT_EQ(tree[tree.child_at(root, 0)].type, "Child1");
+    EXPECT_EQ(tree[tree.child_at(root, 1)].type, "Child2");
+}
+
+// ---- Large tree serialization ----
+
+TEST(JsonSerializer, LargeTree) {
+    auto tree = make_single("Root", "win32");
+    for (int i = 0; i < 100; i++) {
+        Element& child = tree[tree.append_child(tree.root())];
+        child.type = "Item" + std::to_string(i);
+        child.framework = "win32";
+        child.text = "text" + std::to_string(i);
+    }
+    assign_element_ids(tree);
+    auto result = serialize_to_json(tree, tree.root(), nullptr, 0, "test.exe", {"win32"});
+    auto j = json::parse(result);
+    EXPECT_EQ(j["root"]["children"].size(), 100);
+    EXPECT_EQ(j["root"]["children"][99]["id"], "e100");
+}
+
+TEST(XmlSerializer, LargeTree) {
+    auto tree = make_single("Root", "win32");
+    for (int i = 0; i < 100; i++) {
+        Element& child = tree[tree.append_child(tree.root())];
+        child.type = "Item";
+        child.framework = "win32";
+    }
+    assign_element_ids(tree);
+    auto result = serialize_to_xml(tree, tree.root(), nullptr, 0, "test.exe", {"win32"});
+    // Count occurrences of "<Item"
+    size_t count = 0;
+    size_t pos = 0;
+    while ((pos = result.find("<Item", pos)) != std::string::npos) {
+        count++;
+        pos++;
+    }
+    EXPECT_EQ(count, 100);
+}
+
+TEST(XmlSerializer, MultipleFrameworksList) {
+    auto tree = make_test_tree();
+    auto result = serialize_to_xml(tree, tree.root(), nullptr, 0, "test.exe", {"win32", "comctl"});
+    EXPECT_NE(result.find("frameworks=\"win32,comctl\""), std::string::npos);
+}
@@ -0,0 +1,241 @@
+#pragma once
+// Scriptable in-memory IWindowSystem shared by core tests and benchmarks.
+// Windows are added one at a time or generated as large synthetic forests;
+// every primitive is counted and can be charged a simulated latency, so the
+// traversal code's call pattern can be asserted and profiled off-Windows.
+// FakeServerBackend serves an RpcServer from one.
+
+#include "rpc_server.h"
+#include "synthetic_tree.h"
+#include "window_system.h"
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace lvt::testing {
+
+class FakeWindowSystem : public IWindowSystem {
+public:
+    struct Window {
+        HWND parent = nullptr;
+        DWORD pid = 0;
+        WindowInfo info;
+        std::optional<ComCtlReply> comctl;  // answer to comctl(); none = not queryable
+        std::vector<HWND> children;         // z-order
+    };
+
+    // How often each primitive was called. `enumerated` is the number of
+    // windows returned by top_level_windows() and descendants() together.
+    struct Calls {
+        size_t topLevel = 0, descendants = 0, enumerated = 0;
+        size_t parent = 0, className = 0, text = 0, rect = 0, style = 0, visible = 0,
+               enabled = 0, processId = 0, processName = 0, moduleVersion = 0, comctl = 0;
+
+        size_t total() const {
+            return topLevel + descendants + parent + className + text + rect + style + visible +
+                   enabled + processId + processName + moduleVersion + comctl;
+        }
+    };
+
+    Calls calls;
+    std::chrono::nanoseconds latency{0};      // charged per primitive call
+    std::chrono::nanoseconds enumLatency{0};  // charged per enumerated window
+
+    // Add a visible, enabled window. A null `parent` makes it top-level.
+    HWND add_window(HWND parent, DWORD pid, std::string_view className, std::string text = {}) {
+        HWND hwnd = reinterpret_cast<HWND>(static_cast<uintptr_t>((m_windows.size() + 1) * 4));
+        Window& w = m_windows.emplace_back();
+        w.parent = parent;
+        w.pid = pid;
+        w.info.className = className;
+        w.info.text = std::move(text);
+        w.info.style = parent ? 0x50000000 : 0x10CF0000;  // WS_CHILD|WS_VISIBLE, WS_OVERLAPPEDWINDOW|WS_VISIBLE
+        w.info.visible = true;
+        w.info.enabled = true;
+        if (parent)
+            at(parent).children.push_back(hwnd);
+        else
+            m_topLevel.push_back(hwnd);
+        return hwnd;
+    }
+
+    Window& at(HWND hwnd) { return m_windows[index_of(hwnd)]; }
+    size_t size() const { return m_windows.size(); }
+
+    void set_process(DWORD pid, std::string name) { m_processes[pid].name = std::move(name); }
+    void add_module(DWORD pid, std::string name, std::string version) {
+        m_processes[pid].modules.emplace_back(std::move(name), std::move(version));
+    }
+
+    // ---- IWindowSystem ----
+
+    std::vector<HWND> top_level_windows() override {
+        charge(calls.topLevel);
+        charge_enumerated(m_topLevel.size());
+        return m_topLevel;
+    }
+
+    std::vector<HWND> descendants(HWND hwnd) override {
+        charge(calls.descendants);
+        std::vector<HWND> out;
+        if (!valid(hwnd)) return out;
+        // Pre-order, like EnumChildWindows.
+        std::vector<std::pair<HWND, size_t>> stack{{hwnd, 0}};
+        while (!stack.empty()) {
+            auto& [h, next] = stack.back();
+            const auto& kids = at(h).children;
+            if (next == kids.size()) {
+                stack.pop_back();
+                continue;
+            }
+            HWND child = kids[next++];
+            out.push_back(child);
+            stack.push_back({child, 0});
+        }
+        charge_enumerated(out.size());
+        return out;
+    }
+
+    HWND parent(HWND hwnd) override {
+        charge(calls.parent);
+        return valid(hwnd) ? at(hwnd).parent : nullptr;
+    }
+    Symbol class_name(HWND hwnd) override {
+        charge(calls.className);
+        return valid(hwnd) ? at(hwnd).info.className : Symbol();
+    }
+    std::string text(HWND hwnd) override {
+        charge(calls.text);
+        return valid(hwnd) ? at(hwnd).info.text : std::string();
+    }
+    Bounds rect(HWND hwnd) override {
+        charge(calls.rect);
+        return valid(hwnd) ? at(hwnd).info.rect : Bounds{};
+    }
+    uint32_t style(HWND hwnd) override {
+        charge(calls.style);
+        return valid(hwnd) ? at(hwnd).info.style : 0;
+    }
+    bool visible(HWND hwnd) override {
+        charge(calls.visible);
+        return valid(hwnd) && at(hwnd).info.visible;
+    }
+    bool enabled(HWND hwnd) override {
+        charge(calls.enabled);
+        return valid(hwnd) && at(hwnd).info.enabled;
+    }
+    DWORD process_id(HWND hwnd) override {
+        charge(calls.processId);
+        return valid(hwnd) ? at(hwnd).pid : 0;
+    }
+
+    std::string process_name(DWORD pid) override {
+        charge(calls.processName);
+        auto it = m_processes.find(pid);
+        return it != m_processes.end() ? it->second.name : std::string();
+    }
+
+    bool module_version(DWORD pid, std::string_view module, bool, std::string& version) override {
+        charge(calls.moduleVersion);
+        auto it = m_processes.find(pid);
+        if (it == m_processes.end()) return false;
+        for (const auto& [name, ver] : it->second.modules) {
+            if (iequals(name, module)) {
+                version = ver;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool comctl(HWND hwnd, Symbol, ComCtlReply& reply) override {
+        charge(calls.comctl);
+        if (!valid(hwnd) || !at(hwnd).comctl) return false;
+        reply = *at(hwnd).comctl;
+        return true;
+    }
+
+private:
+    struct Process {
+        std::string name;
+        std::vector<std::pair<std::string, std::string>> modules;  // base name, version
+    };
+
+    static size_t index_of(HWND hwnd) { return reinterpret_cast<uintptr_t>(hwnd) / 4 - 1; }
+    bool valid(HWND hwnd) const {
+        auto v = reinterpret_cast<uintptr_t>(hwnd);
+        return v && v % 4 == 0 && v / 4 <= m_windows.size();
+    }
+
+    // Spin rather than sleep: modeled latencies are far below the scheduler tick.
+    static void spin(std::chrono::nanoseconds d) {
+        if (d.count() <= 0) return;
+        auto until = std::chrono::steady_clock::now() + d;
+        while (std::chrono::steady_clock::now() < until) {
+        }
+    }
+    void charge(size_t& counter) {
+        counter++;
+        spin(latency);
+    }
+    void charge_enumerated(size_t n) {
+        calls.enumerated += n;
+        spin(enumLatency * static_cast<int64_t>(n));
+    }
+
+    std::vector<Window> m_windows;  // HWND value is (index + 1) * 4
+    std::vector<HWND> m_topLevel;
+    std::map<DWORD, Process> m_processes;
+};
+
+// RpcServer backend capturing from a FakeWindowSystem, as `lvt serve` does
+// from the desktop.
+class FakeServerBackend : public ServerBackend {
+public:
+    explicit FakeServerBackend(FakeWindowSystem& ws) : m_ws(ws) {}
+    IWindowSystem& window_system() override { return m_ws; }
+    std::unique_ptr<CaptureSource> make_source() override { return std::make_unique<WindowSystemSource>(m_ws); }
+
+private:
+    FakeWindowSystem& m_ws;
+};
+
+// Populate `ws` with `topLevelCount` top-level windows of process `pid`, each
+// the root of a synthetic child tree (shaped like make_synthetic_shape), for
+// `windowCount` windows in total. Returns the top-level windows.
+inline std::vector<HWND> make_window_forest(FakeWindowSystem& ws, DWORD pid, size_t windowCount,
+                                            size_t topLevelCount = 1, uint64_t seed = 1) {
+    std::vector<HWND> roots;
+    if (topLevelCount == 0) return roots;
+    SynthRng rng(seed ^ 0xC2B2AE3D27D4EB4Full);
+    for (size_t t = 0; t < topLevelCount; t++) {
+        size_t count = windowCount / topLevelCount + (t < windowCount % topLevelCount ? 1 : 0);
+        auto shape = make_synthetic_shape(count, seed + t);
+        if (shape.empty()) continue;
+
+        HWND root = ws.add_window(nullptr, pid, "SynthFrameWindow", "Synthetic " + std::to_string(t));
+        roots.push_back(root);
+        std::vector<std::pair<HWND, uint32_t>> stack{{root, shape[0]}};
+        for (size_t i = 1; i < shape.size(); i++) {
+            while (stack.back().second == 0) stack.pop_back();
+            stack.back().second--;
+            HWND parent = stack.back().first;
+            std::string text = rng.below(3) == 0 ? "Window " + std::to_string(i) : std::string();
+            HWND hwnd = ws.add_window(parent, pid, kSynthWindowClasses[rng.below(6)], std::move(text));
+            FakeWindowSystem::Window& w = ws.at(hwnd);
+            w.info.rect = {static_cast<int>(rng.below(1920)), static_cast<int>(rng.below(1080)),
+                           static_cast<int>(rng.below(800)) + 1, static_cast<int>(rng.below(600)) + 1};
+            w.info.enabled = rng.below(10) != 0;
+            stack.push_back({hwnd, shape[i]});
+        }
+    }
+    return roots;
+}
+
+} // namespace lvt::testing
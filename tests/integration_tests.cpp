@@ -196,14 +196,16 @@ TEST_F(NotepadFixture, DepthLimit) {
 
 TEST_F(NotepadFixture, ElementSubtree) {
     auto lvt = get_lvt_path();
-    auto output = run_command(make_cmd(lvt, get_pid_arg() + " --element e1"));
-    if (output.empty()) {
-        GTEST_SKIP() << "No output for --element e1 (element may not exist)";
-    }
+    auto full = json::parse(run_command(make_cmd(lvt, get_pid_arg())), nullptr, false);
+    ASSERT_FALSE(full.is_discarded());
+    if (!full["root"].contains("children")) GTEST_SKIP() << "Root has no children";
+    // Child windows have IDs like "w1A2B"; scoped builds give them the same ID.
+    std::string id = full["root"]["children"][0]["id"];
+
+    auto output = run_command(make_cmd(lvt, get_pid_arg() + " --element " + id + " --depth 1"));
     auto j = json::parse(output, nullptr, false);
     ASSERT_FALSE(j.is_discarded());
-    // Root of output should be e1
-    EXPECT_EQ(j["root"]["id"], "e1");
+    EXPECT_EQ(j["root"]["id"], id);
 }
 
 TEST_F(NotepadFixture, ScreenshotCapture) {
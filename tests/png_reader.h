@@ -0,0 +1,221 @@
+#pragma once
+// Minimal PNG decoder for checking what write_png produces: 8-bit RGBA,
+// non-interlaced, filters None/Sub/Up/Average/Paeth, zlib streams of stored
+// or fixed-Huffman deflate blocks. Chunk CRCs and the Adler-32 are verified.
+
+#include "image.h"
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lvt::testing {
+
+namespace png_detail {
+
+inline uint32_t be32(const unsigned char* p) {
+    return (uint32_t{p[0]} << 24) | (uint32_t{p[1]} << 16) | (uint32_t{p[2]} << 8) | p[3];
+}
+
+inline uint32_t crc32(std::string_view data) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (unsigned char c : data) {
+        crc ^= c;
+        for (int k = 0; k < 8; k++) crc = (crc & 1) ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+    }
+    return ~crc;
+}
+
+class BitReader {
+public:
+    explicit BitReader(std::string_view data) : m_data(data) {}
+    bool bits(int count, uint32_t& v) {
+        v = 0;
+        for (int i = 0; i < count; i++) {
+            if (m_pos / 8 >= m_data.size()) return false;
+            v |= ((static_cast<unsigned char>(m_data[m_pos / 8]) >> (m_pos % 8)) & 1u) << i;
+            m_pos++;
+        }
+        return true;
+    }
+    void align() { m_pos = (m_pos + 7) / 8 * 8; }
+    size_t byte_pos() const { return m_pos / 8; }
+    void skip_bytes(size_t n) { m_pos += n * 8; }
+
+private:
+    std::string_view m_data;
+    size_t m_pos = 0;
+};
+
+// Fixed literal/length code (RFC 1951 3.2.6), read one bit at a time.
+inline bool fixed_literal(BitReader& r, uint32_t& sym) {
+    uint32_t code = 0, bit;
+    for (int len = 1; len <= 9; len++) {
+        if (!r.bits(1, bit)) return false;
+        code = (code << 1) | bit;
+        if (len == 7 && code <= 0x17) {
+            sym = 256 + code;
+            return true;
+        }
+        if (len == 8 && code >= 0x30 && code <= 0xBF) {
+            sym = code - 0x30;
+            return true;
+        }
+        if (len == 8 && code >= 0xC0 && code <= 0xC7) {
+            sym = 280 + code - 0xC0;
+            return true;
+        }
+        if (len == 9 && code >= 0x190) {
+            sym = 144 + code - 0x190;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool inflate(std::string_view in, std::string& out) {
+    static const uint16_t lenBase[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                         31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const uint8_t lenExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                         2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const uint16_t distBase[30] = {1,    2,    3,    4,    5,    7,    9,    13,    17,    25,
+                                          33,   49,   65,   97,   129,  193,  257,  385,   513,   769,
+                                          1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    static const uint8_t distExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                          6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    BitReader r(in);
+    uint32_t final = 0, type = 0;
+    do {
+        if (!r.bits(1, final) || !r.bits(2, type)) return false;
+        if (type == 0) {
+            r.align();
+            size_t p = r.byte_pos();
+            if (p + 4 > in.size()) return false;
+            size_t len = static_cast<unsigned char>(in[p]) | (static_cast<unsigned char>(in[p + 1]) << 8);
+            if (p + 4 + len > in.size()) return false;
+            out.append(in.substr(p + 4, len));
+            r.skip_bytes(4 + len);
+        } else if (type == 1) {
+            for (;;) {
+                uint32_t sym, extra, dcode;
+                if (!fixed_literal(r, sym)) return false;
+                if (sym < 256) {
+                    out.push_back(static_cast<char>(sym));
+                    continue;
+                }
+                if (sym == 256) break;
+                if (sym > 285) return false;
+                if (!r.bits(lenExtra[sym - 257], extra)) return false;
+                size_t len = lenBase[sym - 257] + extra;
+                // Fixed distance codes are 5 bits, most significant first.
+                uint32_t bit;
+                dcode = 0;
+                for (int i = 0; i < 5; i++) {
+                    if (!r.bits(1, bit)) return false;
+                    dcode = (dcode << 1) | bit;
+                }
+                if (dcode >= 30 || !r.bits(distExtra[dcode], extra)) return false;
+                size_t dist = distBase[dcode] + extra;
+                if (dist > out.size()) return false;
+                for (size_t i = 0; i < len; i++) out.push_back(out[out.size() - dist]);
+            }
+        } else {
+            return false;  // dynamic Huffman: write_png does not produce it
+        }
+    } while (!final);
+    return true;
+}
+
+inline int paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+} // namespace png_detail
+
+// Decode `data` into `out` (BGRA, origin 0,0). On failure returns false and,
+// if given, sets `error`.
+inline bool read_png(std::string_view data, Image& out, std::string* error = nullptr) {
+    using namespace png_detail;
+    auto fail = [error](const char* why) {
+        if (error) *error = why;
+        return false;
+    };
+    const auto* p = reinterpret_cast<const unsigned char*>(data.data());
+    if (data.size() < 8 || data.substr(0, 8) != std::string_view("\x89PNG\r\n\x1a\n", 8))
+        return fail("bad signature");
+
+    std::string idat;
+    bool sawHeader = false, sawEnd = false;
+    for (size_t pos = 8; pos < data.size() && !sawEnd;) {
+        if (pos + 12 > data.size()) return fail("truncated chunk");
+        uint32_t len = be32(p + pos);
+        if (pos + 12 + len > data.size()) return fail("truncated chunk");
+        std::string_view type = data.substr(pos + 4, 4);
+        std::string_view body = data.substr(pos + 8, len);
+        if (crc32(data.substr(pos + 4, 4 + len)) != be32(p + pos + 8 + len)) return fail("bad CRC");
+        if (type == "IHDR") {
+            if (len != 13) return fail("bad IHDR");
+            out.width = static_cast<int>(be32(p + pos + 8));
+            out.height = static_cast<int>(be32(p + pos + 12));
+            if (body.substr(8) != std::string_view("\x08\x06\x00\x00\x00", 5)) return fail("not 8-bit RGBA");
+            sawHeader = true;
+        } else if (type == "IDAT") {
+            idat.append(body);
+        } else if (type == "IEND") {
+            sawEnd = true;
+        }
+        pos += 12 + len;
+    }
+    if (!sawHeader || !sawEnd) return fail("missing IHDR or IEND");
+    if (idat.size() < 6 || (static_cast<unsigned char>(idat[0]) & 0x0F) != 8) return fail("bad zlib header");
+
+    std::string raw;
+    if (!inflate(std::string_view(idat).substr(2, idat.size() - 6), raw)) return fail("bad deflate data");
+    uint32_t a = 1, b = 0;
+    for (unsigned char c : raw) {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    if (((b << 16) | a) != be32(reinterpret_cast<const unsigned char*>(idat.data()) + idat.size() - 4))
+        return fail("bad Adler-32");
+
+    size_t stride = static_cast<size_t>(out.width) * 4;
+    if (raw.size() != (stride + 1) * out.height) return fail("wrong image data size");
+    out.originX = out.originY = 0;
+    out.pixels.assign(stride * out.height, 0);
+    std::vector<uint8_t> prev(stride, 0), cur(stride);
+    for (int y = 0; y < out.height; y++) {
+        const auto* row = reinterpret_cast<const uint8_t*>(raw.data()) + y * (stride + 1);
+        uint8_t filter = row[0];
+        for (size_t i = 0; i < stride; i++) {
+            int left = i >= 4 ? cur[i - 4] : 0;
+            int up = prev[i];
+            int upLeft = i >= 4 ? prev[i - 4] : 0;
+            int pred = 0;
+            switch (filter) {
+            case 0: pred = 0; break;
+            case 1: pred = left; break;
+            case 2: pred = up; break;
+            case 3: pred = (left + up) / 2; break;
+            case 4: pred = paeth(left, up, upLeft); break;
+            default: return fail("bad filter");
+            }
+            cur[i] = static_cast<uint8_t>(row[1 + i] + pred);
+        }
+        for (size_t i = 0; i < stride; i += 4) {
+            uint8_t* px = out.pixel(static_cast<int>(i / 4), y);
+            px[0] = cur[i + 2];
+            px[1] = cur[i + 1];
+            px[2] = cur[i];
+            px[3] = cur[i + 3];
+        }
+        std::swap(prev, cur);
+    }
+    return true;
+}
+
+} // namespace lvt::testing
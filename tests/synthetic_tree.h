@@ -0,0 +1,212 @@
+#pragma once
+// Deterministic synthetic UI trees shared by core tests and benchmarks.
+// Shapes and field values mimic a large XAML/DOM tree: a handful of
+// repeated type names, deep nesting, and short text on some leaves.
+
+#include "element.h"
+#include "image.h"
+#include "recording.h"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace lvt::testing {
+
+// Small LCG so shapes are identical across platforms and runs.
+struct SynthRng {
+    uint64_t state;
+    explicit SynthRng(uint64_t seed) : state(seed * 6364136223846793005ull + 1442695040888963407ull) {}
+    uint32_t next() {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        return static_cast<uint32_t>(state >> 33);
+    }
+    uint32_t below(uint32_t n) { return next() % n; }
+};
+
+inline const char* const kSynthTypes[] = {
+    "Border", "Grid", "StackPanel", "TextBlock", "Button", "ContentPresenter",
+    "Rectangle", "Image", "ScrollViewer", "ListViewItem", "DIV", "SPAN",
+};
+inline constexpr size_t kSynthTypeCount = sizeof(kSynthTypes) / sizeof(kSynthTypes[0]);
+
+// Child counts in depth-first pre-order. Consumers walk it with a cursor to
+// reproduce the same shape in any layout.
+inline std::vector<uint32_t> make_synthetic_shape(size_t nodeCount, uint64_t seed = 1) {
+    SynthRng rng(seed);
+    std::vector<uint32_t> shape;
+    if (nodeCount == 0) return shape;
+    shape.reserve(nodeCount);
+    // Pre-order generation with an explicit stack of remaining sibling budgets.
+    size_t allocated = 1;   // nodes promised so far, including the root
+    size_t open = 1;        // promised nodes not yet generated
+    std::vector<uint32_t> pending{1};
+    while (!pending.empty()) {
+        if (pending.back() == 0) { pending.pop_back(); continue; }
+        pending.back()--;
+        open--;
+        uint32_t want = (pending.size() < 24) ? rng.below(7) : 0;
+        if (allocated + want > nodeCount) want = static_cast<uint32_t>(nodeCount - allocated);
+        // Keep the tree growing when the frontier would otherwise die out.
+        if (want == 0 && open == 0 && allocated < nodeCount) want = 1;
+        allocated += want;
+        open += want;
+        shape.push_back(want);
+        pending.push_back(want);
+    }
+    return shape;
+}
+
+inline const std::string& synthetic_class_name(size_t typeIndex) {
+    static const auto names = [] {
+        std::vector<std::string> v;
+        for (auto type : kSynthTypes) v.push_back(std::string("Microsoft.UI.Xaml.Controls.") + type);
+        return v;
+    }();
+    return names[typeIndex];
+}
+
+inline void fill_synthetic_element(Element& el, SynthRng& rng, size_t ordinal) {
+    uint32_t typeIndex = rng.below(static_cast<uint32_t>(kSynthTypeCount));
+    el.type = kSynthTypes[typeIndex];
+    el.framework = "winui3";
+    el.className = synthetic_class_name(typeIndex);
+    if (rng.below(4) == 0) el.text = "Item " + std::to_string(ordinal);
+    el.bounds = {static_cast<int>(rng.below(1920)), static_cast<int>(rng.below(1080)),
+                 static_cast<int>(rng.below(400)) + 1, static_cast<int>(rng.below(200)) + 1};
+}
+
+inline ElementTree make_synthetic_tree(size_t nodeCount, uint64_t seed = 1) {
+    auto shape = make_synthetic_shape(nodeCount, seed);
+    SynthRng rng(seed ^ 0x9E3779B97F4A7C15ull);
+    ElementTree tree;
+    if (shape.empty()) return tree;
+
+    NodeId root = tree.add_root();
+    fill_synthetic_element(tree[root], rng, 0);
+    std::vector<std::pair<NodeId, uint32_t>> stack{{root, shape[0]}};
+    size_t cursor = 1;
+    while (!stack.empty()) {
+        auto& [parent, remaining] = stack.back();
+        if (remaining == 0) { stack.pop_back(); continue; }
+        remaining--;
+        NodeId n = tree.append_child(parent);
+        fill_synthetic_element(tree[n], rng, cursor);
+        stack.push_back({n, shape[cursor++]});
+    }
+    return tree;
+}
+
+// A `width` x `height` BGRA frame that looks like a window: a flat
+// background, flat-colored panels, and rows of noisy "text" in some of them.
+inline Image make_synthetic_frame(int width, int height, uint64_t seed = 1) {
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.pixels.assign(static_cast<size_t>(width) * height * 4, 0);
+    auto fill = [&](int x0, int y0, int x1, int y1, uint32_t bgra) {
+        for (int y = std::max(y0, 0); y < std::min(y1, height); y++)
+            for (int x = std::max(x0, 0); x < std::min(x1, width); x++)
+                for (int c = 0; c < 4; c++) image.pixel(x, y)[c] = static_cast<uint8_t>(bgra >> (8 * c));
+    };
+    fill(0, 0, width, height, 0xFFF3F3F3);
+    SynthRng rng(seed ^ 0x2545F4914F6CDD1Dull);
+    for (int i = 0; i < 40; i++) {
+        int x = static_cast<int>(rng.below(static_cast<uint32_t>(width)));
+        int y = static_cast<int>(rng.below(static_cast<uint32_t>(height)));
+        int w = static_cast<int>(rng.below(400)) + 20, h = static_cast<int>(rng.below(200)) + 20;
+        fill(x, y, x + w, y + h, 0xFF000000 | (rng.next() & 0x3F3F3F) | 0xC0C0C0);
+        if (rng.below(2) == 0) continue;
+        for (int ty = y + 6; ty + 8 < y + h; ty += 14)
+            for (int tx = x + 6; tx < x + w - 6; tx++)
+                for (int k = 0; k < 8; k++)
+                    if (rng.below(3) == 0) fill(tx, ty + k, tx + 1, ty + k + 1, 0xFF202020);
+    }
+    return image;
+}
+
+inline const char* const kSynthWindowClasses[] = {
+    "Button", "Edit", "Static", "ComboBox", "ScrollBar", "InputSiteWindowClass",
+};
+
+// Recording of a WinUI 3 app: a `windowCount`-window HWND tree (shaped like
+// make_synthetic_shape) in which `bridgeCount` windows are
+// DesktopChildSiteBridges, plus a TAP payload of `xamlCount` XAML nodes split
+// across one DesktopWindowXamlSource root per bridge.
+inline Recording make_synthetic_recording(size_t windowCount, size_t xamlCount,
+                                          size_t bridgeCount = 4, uint64_t seed = 1) {
+    Recording rec;
+    rec.hwnd = 0x10000;
+    rec.pid = 4242;
+    rec.processName = "SynthApp.exe";
+    rec.frameworks = {{Framework::WinUI3, "1.6", ""}};
+
+    auto shape = make_synthetic_shape(windowCount, seed);
+    SynthRng rng(seed ^ 0x51ED270B27A8F3D1ull);
+    size_t bridgeEvery = bridgeCount ? (windowCount + bridgeCount - 1) / bridgeCount : 0;
+    std::vector<size_t> stack;  // indices of windows still taking children
+    rec.windows.reserve(shape.size());
+    for (size_t i = 0; i < shape.size(); i++) {
+        Recording::Window& w = rec.windows.emplace_back();
+        w.hwnd = 0x10000 + 4 * i;
+        if (i == 0) {
+            w.info.className = "WinUIDesktopWin32WindowClass";
+            w.info.text = "Synthetic App";
+        } else if (bridgeEvery && i % bridgeEvery == bridgeEvery / 2) {
+            w.info.className = "Microsoft.UI.Content.DesktopChildSiteBridge";
+        } else {
+            w.info.className = kSynthWindowClasses[rng.below(6)];
+            if (rng.below(3) == 0) w.info.text = "Window " + std::to_string(i);
+        }
+        w.info.rect = {static_cast<int>(rng.below(1920)), static_cast<int>(rng.below(1080)),
+                       static_cast<int>(rng.below(800)) + 1, static_cast<int>(rng.below(600)) + 1};
+        w.info.style = 0x50000000;  // WS_CHILD | WS_VISIBLE
+        w.info.visible = true;
+        w.info.enabled = rng.below(10) != 0;
+        w.enumerated = true;
+
+        if (!stack.empty()) rec.windows[stack.back()].children.push_back(w.hwnd);
+        // Drop parents whose children are all placed, then open this one.
+        while (!stack.empty() && rec.windows[stack.back()].children.size() == shape[stack.back()])
+            stack.pop_back();
+        if (shape[i]) stack.push_back(i);
+    }
+
+    // One DesktopWindowXamlSource root per bridge, each a synthetic subtree.
+    std::string data = "[";
+    size_t roots = bridgeCount ? bridgeCount : 1;
+    for (size_t r = 0; r < roots; r++) {
+        size_t count = xamlCount / roots + (r < xamlCount % roots ? 1 : 0);
+        if (r) data += ',';
+        data += R"({"type":"Microsoft.UI.Xaml.Hosting.DesktopWindowXamlSource","children":[)";
+        auto xshape = make_synthetic_shape(count, seed + r + 1);
+        std::vector<uint32_t> open;  // children left per open object
+        for (size_t i = 0; i < xshape.size(); i++) {
+            uint32_t t = rng.below(static_cast<uint32_t>(kSynthTypeCount));
+            data += R"({"type":")" + synthetic_class_name(t) + '"';
+            if (rng.below(4) == 0) data += R"(,"name":"Item )" + std::to_string(i) + '"';
+            data += R"(,"offsetX":)" + std::to_string(rng.below(200)) +
+                    R"(,"offsetY":)" + std::to_string(rng.below(200)) +
+                    R"(,"width":)" + std::to_string(rng.below(400) + 1) +
+                    R"(,"height":)" + std::to_string(rng.below(200) + 1);
+            if (xshape[i]) {
+                data += R"(,"children":[)";
+                open.push_back(xshape[i]);
+                continue;
+            }
+            data += '}';
+            // Close every object whose last child was just written.
+            while (!open.empty() && --open.back() == 0) {
+                open.pop_back();
+                data += "]}";
+            }
+            if (!open.empty()) data += ',';
+        }
+        data += "]}";
+    }
+    data += ']';
+    rec.payloads.push_back({Framework::WinUI3, {}, rec.hwnd, rec.pid, std::move(data)});
+    return rec;
+}
+
+} // namespace lvt::testing
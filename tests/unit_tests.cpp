@@ -1,9 +1,9 @@
-// Unit tests for LVT — pure logic, no live windows required
+// Unit tests for LVT — pure logic, no live windows required.
+// Portable element-model and serializer tests live in core_tests.cpp.
 
 #include <gtest/gtest.h>
 #include "element.h"
 #include "tree_builder.h"
-#include "json_serializer.h"
 #include "framework_detector.h"
 #include "target.h"
 #include <nlohmann/json.hpp>
@@ -12,55 +12,6 @@
 using json = nlohmann::json;
 using namespace lvt;
 
-// ---- Element ID assignment ----
-
-TEST(AssignElementIds, SingleElement) {
-    Element root;
-    root.type = "Window";
-    assign_element_ids(root);
-    EXPECT_EQ(root.id, "e0");
-}
-
-TEST(AssignElementIds, DepthFirstOrder) {
-    // root -> [a -> [a1, a2], b]
-    Element root;
-    root.type = "Root";
-    Element a, a1, a2, b;
-    a.type = "A"; a1.type = "A1"; a2.type = "A2"; b.type = "B";
-    a.children = {a1, a2};
-    root.children = {a, b};
-
-    assign_element_ids(root);
-    EXPECT_EQ(root.id, "e0");
-    EXPECT_EQ(root.children[0].id, "e1");       // a
-    EXPECT_EQ(root.children[0].children[0].id, "e2"); // a1
-    EXPECT_EQ(root.children[0].children[1].id, "e3"); // a2
-    EXPECT_EQ(root.children[1].id, "e4");       // b
-}
-
-TEST(AssignElementIds, EmptyChildren) {
-    Element root;
-    root.type = "Root";
-    root.children = {};
-    assign_element_ids(root);
-    EXPECT_EQ(root.id, "e0");
-    EXPECT_TRUE(root.children.empty());
-}
-
-TEST(AssignElementIds, DeepTree) {
-    // Chain: root -> c1 -> c2 -> c3
-    Element root, c1, c2, c3;
-    c3.type = "Leaf";
-    c2.type = "Mid"; c2.children = {c3};
-    c1.type = "Mid"; c1.children = {c2};
-    root.type = "Root"; root.children = {c1};
-    assign_element_ids(root);
-    EXPECT_EQ(root.id, "e0");
-    EXPECT_EQ(root.children[0].id, "e1");
-    EXPECT_EQ(root.children[0].children[0].id, "e2");
-    EXPECT_EQ(root.children[0].children[0].children[0].id, "e3");
-}
-
 // ---- framework_to_string ----
 
 TEST(FrameworkToString, AllFrameworks) {
@@ -87,331 +38,6 @@ TEST(FrameworkDisplayName, BuiltInWithName) {
     EXPECT_EQ(framework_display_name(fi), "comctl");
 }
 
-// ---- JSON serialization ----
-
-static Element make_test_tree() {
-    Element root;
-    root.type = "Window";
-    root.framework = "win32";
-    root.className = "MyWindow";
-    root.text = "Hello";
-    root.bounds = {100, 200, 800, 600};
-    root.properties["visible"] = "true";
-
-    Element child;
-    child.type = "Button";
-    child.framework = "win32";
-    child.className = "Button";
-    child.text = "OK";
-    child.bounds = {110, 210, 80, 30};
-    root.children.push_back(child);
-
-    assign_element_ids(root);
-    return root;
-}
-
-TEST(JsonSerializer, BasicStructure) {
-    auto root = make_test_tree();
-    auto result = serialize_to_json(root, (HWND)0x1234, 42, "test.exe", {"win32"});
-    auto j = json::parse(result);
-
-    EXPECT_TRUE(j.contains("target"));
-    EXPECT_TRUE(j.contains("frameworks"));
-    EXPECT_TRUE(j.contains("root"));
-    EXPECT_EQ(j["target"]["pid"], 42);
-    EXPECT_EQ(j["target"]["processName"], "test.exe");
-    EXPECT_EQ(j["frameworks"], json({"win32"}));
-}
-
-TEST(JsonSerializer, ElementFields) {
-    auto root = make_test_tree();
-    auto result = serialize_to_json(root, (HWND)0x1234, 42, "test.exe", {"win32"});
-    auto j = json::parse(result);
-
-    auto& r = j["root"];
-    EXPECT_EQ(r["id"], "e0");
-    EXPECT_EQ(r["type"], "Window");
-    EXPECT_EQ(r["framework"], "win32");
-    EXPECT_EQ(r["className"], "MyWindow");
-    EXPECT_EQ(r["text"], "Hello");
-    EXPECT_EQ(r["bounds"]["x"], 100);
-    EXPECT_EQ(r["bounds"]["y"], 200);
-    EXPECT_EQ(r["bounds"]["width"], 800);
-    EXPECT_EQ(r["bounds"]["height"], 600);
-    EXPECT_EQ(r["properties"]["visible"], "true");
-}
-
-TEST(JsonSerializer, ChildElements) {
-    auto root = make_test_tree();
-    auto result = serialize_to_json(root, (HWND)0x1234, 42, "test.exe", {"win32"});
-    auto j = json::parse(result);
-
-    EXPECT_TRUE(j["root"].contains("children"));
-    EXPECT_EQ(j["root"]["children"].size(), 1);
-    auto& child = j["root"]["children"][0];
-    EXPECT_EQ(child["id"], "e1");
-    EXPECT_EQ(child["type"], "Button");
-    EXPECT_EQ(child["text"], "OK");
-}
-
-TEST(JsonSerializer, ControlCharsSanitized) {
-    Element root;
-    root.type = "Win\x01" "dow";  // embedded control char
-    root.framework = "win32";
-    root.className = "My\x02" "Class";
-    root.text = "He\x03llo";
-    assign_element_ids(root);
-
-    auto result = serialize_to_json(root, nullptr, 0, "test.exe", {});
-    auto j = json::parse(result);
-    EXPECT_EQ(j["root"]["type"], "Window");      // \x01 stripped
-    EXPECT_EQ(j["root"]["className"], "MyClass"); // \x02 stripped
-    EXPECT_EQ(j["root"]["text"], "Hello");        // \x03 stripped
-}
-
-TEST(JsonSerializer, NoChildrenKey) {
-    Element root;
-    root.type = "Leaf";
-    root.framework = "win32";
-    assign_element_ids(root);
-
-    auto result = serialize_to_json(root, nullptr, 0, "test.exe", {});
-    auto j = json::parse(result);
-    EXPECT_FALSE(j["root"].contains("children"));
-}
-
-TEST(JsonSerializer, EmptyOptionalFields) {
-    Element root;
-    root.type = "Window";
-    root.framework = "win32";
-    // className and text are empty
-    assign_element_ids(root);
-
-    auto result = serialize_to_json(root, nullptr, 0, "test.exe", {});
-    auto j = json::parse(result);
-    EXPECT_FALSE(j["root"].contains("className"));
-    EXPECT_FALSE(j["root"].contains("text"));
-}
-
-TEST(JsonSerializer, MultipleFrameworks) {
-    auto root = make_test_tree();
-    auto result = serialize_to_json(root, nullptr, 0, "test.exe", {"win32", "comctl", "winui3"});
-    auto j = json::parse(result);
-    EXPECT_EQ(j["frameworks"].size(), 3);
-    EXPECT_EQ(j["frameworks"][0], "win32");
-    EXPECT_EQ(j["frameworks"][1], "comctl");
-    EXPECT_EQ(j["frameworks"][2], "winui3");
-}
-
-// ---- XML serialization ----
-
-TEST(XmlSerializer, BasicStructure) {
-    auto root = make_test_tree();
-    auto result = serialize_to_xml(root, (HWND)0x1234, 42, "test.exe", {"win32"});
-
-    EXPECT_NE(result.find("<LiveVisualTree"), std::string::npos);
-    EXPECT_NE(result.find("</LiveVisualTree>"), std::string::npos);
-    EXPECT_NE(result.find("pid=\"42\""), std::string::npos);
-    EXPECT_NE(result.find("process=\"test.exe\""), std::string::npos);
-    EXPECT_NE(result.find("frameworks=\"win32\""), std::string::npos);
-}
-
-TEST(XmlSerializer, ElementAttributes) {
-    auto root = make_test_tree();
-    auto result = serialize_to_xml(root, nullptr, 0, "test.exe", {});
-
-    EXPECT_NE(result.find("<Window"), std::string::npos);
-    EXPECT_NE(result.find("id=\"e0\""), std::string::npos);
-    EXPECT_NE(result.find("framework=\"win32\""), std::string::npos);
-    EXPECT_NE(result.find("text=\"Hello\""), std::string::npos);
-    EXPECT_NE(result.find("bounds=\"100,200,800,600\""), std::string::npos);
-}
-
-TEST(XmlSerializer, ChildNesting) {
-    auto root = make_test_tree();
-    auto result = serialize_to_xml(root, nullptr, 0, "test.exe", {});
-
-    EXPECT_NE(result.find("<Button"), std::string::npos);
-    EXPECT_NE(result.find("</Window>"), std::string::npos);
-}
-
-TEST(XmlSerializer, SelfClosingLeaf) {
-    Element root;
-    root.type = "Leaf";
-    root.framework = "test";
-    assign_element_ids(root);
-    auto result = serialize_to_xml(root, nullptr, 0, "test.exe", {});
-
-    EXPECT_NE(result.find("<Leaf"), std::string::npos);
-    EXPECT_NE(result.find("/>"), std::string::npos);
-    EXPECT_EQ(result.find("</Leaf>"), std::string::npos);
-}
-
-TEST(XmlSerializer, SpecialCharsEscaped) {
-    Element root;
-    root.type = "Window";
-    root.framework = "win32";
-    root.text = "File & <Edit>";
-    assign_element_ids(root);
-    auto result = serialize_to_xml(root, nullptr, 0, "test.exe", {});
-
-    EXPECT_NE(result.find("&amp;"), std::string::npos);
-    EXPECT_NE(result.find("&lt;"), std::string::npos);
-    EXPECT_NE(result.find("&gt;"), std::string::npos);
-}
-
-TEST(XmlSerializer, InvalidTagNameFallback) {
-    Element root;
-    root.type = "123Invalid";  // starts with digit
-    root.framework = "test";
-    assign_element_ids(root);
-    auto result = serialize_to_xml(root, nullptr, 0, "test.exe", {});
-
-    // Should fall back to "Element" tag
-    EXPECT_NE(result.find("<Element"), std::string::npos);
-}
-
-TEST(XmlSerializer, ControlCharsStripped) {
-    Element root;
-    root.type = "Win\x01" "dow";
-    root.framework = "test";
-    assign_element_ids(root);
-    auto result = serialize_to_xml(root, nullptr, 0, "test.exe", {});
-
-    EXPECT_NE(result.find("<Window"), std::string::npos);
-}
-
-TEST(XmlSerializer, ZeroBoundsOmitted) {
-    Element root;
-    root.type = "Window";
-    root.framework = "test";
-    root.bounds = {0, 0, 0, 0};
-    assign_element_ids(root);
-    auto result = serialize_to_xml(root, nullptr, 0, "test.exe", {});
-
-    EXPECT_EQ(result.find("bounds="), std::string::npos);
-}
-
-TEST(XmlSerializer, PropertiesAsAttributes) {
-    Element root;
-    root.type = "Window";
-    root.framework = "test";
-    root.properties["visible"] = "true";
-    root.properties["style"] = "WS_OVERLAPPED";
-    assign_element_ids(root);
-    auto result = serialize_to_xml(root, nullptr, 0, "test.exe", {});
-
-    EXPECT_NE(result.find("visible=\"true\""), std::string::npos);
-    EXPECT_NE(result.find("style=\"WS_OVERLAPPED\""), std::string::npos);
-}
-
-TEST(XmlSerializer, ClassNameOmittedWhenSameAsType) {
-    Element root;
-    root.type = "Button";
-    root.className = "Button";  // same as type
-    root.framework = "test";
-    assign_element_ids(root);
-    auto result = serialize_to_xml(root, nullptr, 0, "test.exe", {});
-
-    EXPECT_EQ(result.find("className="), std::string::npos);
-}
-
-TEST(XmlSerializer, ClassNameShownWhenDifferent) {
-    Element root;
-    root.type = "Button";
-    root.className = "Win32Button";  // different
-    root.framework = "test";
-    assign_element_ids(root);
-    auto result = serialize_to_xml(root, nullptr, 0, "test.exe", {});
-
-    EXPECT_NE(result.find("className=\"Win32Button\""), std::string::npos);
-}
-
-// ---- Bounds struct ----
-
-TEST(Bounds, DefaultZero) {
-    Bounds b;
-    EXPECT_EQ(b.x, 0);
-    EXPECT_EQ(b.y, 0);
-    EXPECT_EQ(b.width, 0);
-    EXPECT_EQ(b.height, 0);
-}
-
-// ---- Element struct ----
-
-TEST(Element, DefaultValues) {
-    Element el;
-    EXPECT_TRUE(el.id.empty());
-    EXPECT_TRUE(el.type.empty());
-    EXPECT_TRUE(el.framework.empty());
-    EXPECT_TRUE(el.className.empty());
-    EXPECT_TRUE(el.text.empty());
-    EXPECT_TRUE(el.properties.empty());
-    EXPECT_TRUE(el.children.empty());
-    EXPECT_EQ(el.nativeHandle, 0u);
-}
-
-TEST(Element, TreeConstruction) {
-    Element root;
-    root.type = "Root";
-    Element child1, child2;
-    child1.type = "Child1";
-    child2.type = "Child2";
-    root.children = {child1, child2};
-
-    EXPECT_EQ(root.children.size(), 2);
-    EXPECT_EQ(root.children[0].type, "Child1");
-    EXPECT_EQ(root.children[1].type, "Child2");
-}
-
-// ---- Large tree serialization ----
-
-TEST(JsonSerializer, LargeTree) {
-    Element root;
-    root.type = "Root";
-    root.framework = "win32";
-    for (int i = 0; i < 100; i++) {
-        Element child;
-        child.type = "Item" + std::to_string(i);
-        child.framework = "win32";
-        child.text = "text" + std::to_string(i);
-        root.children.push_back(child);
-    }
-    assign_element_ids(root);
-    auto result = serialize_to_json(root, nullptr, 0, "test.exe", {"win32"});
-    auto j = json::parse(result);
-    EXPECT_EQ(j["root"]["children"].size(), 100);
-    EXPECT_EQ(j["root"]["children"][99]["id"], "e100");
-}
-
-TEST(XmlSerializer, LargeTree) {
-    Element root;
-    root.type = "Root";
-    root.framework = "win32";
-    for (int i = 0; i < 100; i++) {
-        Element child;
-        child.type = "Item";
-        child.framework = "win32";
-        root.children.push_back(child);
-    }
-    assign_element_ids(root);
-    auto result = serialize_to_xml(root, nullptr, 0, "test.exe", {"win32"});
-    // Count occurrences of "<Item"
-    size_t count = 0;
-    size_t pos = 0;
-    while ((pos = result.find("<Item", pos)) != std::string::npos) {
-        count++;
-        pos++;
-    }
-    EXPECT_EQ(count, 100);
-}
-
-TEST(XmlSerializer, MultipleFrameworksList) {
-    auto root = make_test_tree();
-    auto result = serialize_to_xml(root, nullptr, 0, "test.exe", {"win32", "comctl"});
-    EXPECT_NE(result.find("frameworks=\"win32,comctl\""), std::string::npos);
-}
-
 // ---- Architecture detection ----
 
 TEST(Architecture, NameStrings) {
@@ -476,18 +102,19 @@ static PluginFrameworkInfo make_mock_fw(const LoadedPlugin* p) {
 
 TEST(PluginGraft, GraftByTargetHwnd) {
     // Build a simple Win32 tree: root -> child (hwnd=0x1234)
-    Element root;
-    root.type = "Window";
-    root.framework = "win32";
-    root.properties["hwnd"] = "0x1234";
-
-    Element child;
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root].type = "Window";
+    tree[root].framework = "win32";
+    tree[root].properties.set("hwnd", "0x1234");
+
+    NodeId hostNode = tree.append_child(root);
+    Element& child = tree[hostNode];
     child.type = "Window";
     child.framework = "win32";
     child.className = "HostClass";
-    child.properties["hwnd"] = "0xABCD";
+    child.properties.set("hwnd", "0xABCD");
     child.bounds = {100, 200, 300, 400};
-    root.children.push_back(child);
 
     // Plugin returns JSON targeting hwnd 0xABCD
     s_mockJson = R"([{"target_hwnd":"0xABCD","type":"HostClass","children":[
@@ -496,27 +123,28 @@ TEST(PluginGraft, GraftByTargetHwnd) {
 
     auto lp = make_mock_plugin();
     auto fw = make_mock_fw(&lp);
-    bool ok = enrich_with_plugin(root, nullptr, 0, fw);
+    bool ok = enrich_with_plugin(tree, root, nullptr, 0, fw);
     EXPECT_TRUE(ok);
 
     // The child at hwnd 0xABCD should now have a plugin child
-    auto& host = root.children[0];
-    ASSERT_EQ(host.children.size(), 1);
-    EXPECT_EQ(host.children[0].type, "PluginButton");
-    EXPECT_EQ(host.children[0].framework, "mock");
-    EXPECT_EQ(host.children[0].text, "OK");
-    EXPECT_EQ(host.children[0].bounds.width, 80);
-    EXPECT_EQ(host.children[0].bounds.height, 30);
+    ASSERT_EQ(tree.child_count(hostNode), 1);
+    auto& grafted = tree[tree.first_child(hostNode)];
+    EXPECT_EQ(grafted.type, "PluginButton");
+    EXPECT_EQ(grafted.framework, "mock");
+    EXPECT_EQ(grafted.text, "OK");
+    EXPECT_EQ(grafted.bounds.width, 80);
+    EXPECT_EQ(grafted.bounds.height, 30);
     // Coordinates are host base + offset
-    EXPECT_EQ(host.children[0].bounds.x, 110);  // 100 + 10
-    EXPECT_EQ(host.children[0].bounds.y, 220);  // 200 + 20
+    EXPECT_EQ(grafted.bounds.x, 110);  // 100 + 10
+    EXPECT_EQ(grafted.bounds.y, 220);  // 200 + 20
 }
 
 TEST(PluginGraft, GraftUnderRootWhenNoMatch) {
-    Element root;
-    root.type = "Window";
-    root.framework = "win32";
-    root.bounds = {0, 0, 800, 600};
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root].type = "Window";
+    tree[root].framework = "win32";
+    tree[root].bounds = {0, 0, 800, 600};
 
     // Plugin returns JSON with a target_hwnd that doesn't exist
     s_mockJson = R"([{"target_hwnd":"0xDEAD","type":"Orphan","children":[
@@ -525,26 +153,27 @@ TEST(PluginGraft, GraftUnderRootWhenNoMatch) {
 
     auto lp = make_mock_plugin();
     auto fw = make_mock_fw(&lp);
-    bool ok = enrich_with_plugin(root, nullptr, 0, fw);
+    bool ok = enrich_with_plugin(tree, root, nullptr, 0, fw);
     EXPECT_TRUE(ok);
 
     // Should graft under root since no match
-    ASSERT_EQ(root.children.size(), 1);
-    EXPECT_EQ(root.children[0].type, "Orphan");
-    EXPECT_EQ(root.children[0].framework, "mock");
+    ASSERT_EQ(tree.child_count(root), 1);
+    EXPECT_EQ(tree[tree.first_child(root)].type, "Orphan");
+    EXPECT_EQ(tree[tree.first_child(root)].framework, "mock");
 }
 
 TEST(PluginGraft, GraftMultipleRoots) {
-    Element root;
-    root.type = "Window";
-    root.framework = "win32";
-
-    Element h1, h2;
-    h1.type = "Window"; h1.framework = "win32"; h1.properties["hwnd"] = "0x1111";
-    h1.bounds = {10, 20, 100, 100};
-    h2.type = "Window"; h2.framework = "win32"; h2.properties["hwnd"] = "0x2222";
-    h2.bounds = {200, 300, 100, 100};
-    root.children = {h1, h2};
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root].type = "Window";
+    tree[root].framework = "win32";
+
+    NodeId h1 = tree.append_child(root);
+    NodeId h2 = tree.append_child(root);
+    tree[h1].type = "Window"; tree[h1].framework = "win32"; tree[h1].properties.set("hwnd", "0x1111");
+    tree[h1].bounds = {10, 20, 100, 100};
+    tree[h2].type = "Window"; tree[h2].framework = "win32"; tree[h2].properties.set("hwnd", "0x2222");
+    tree[h2].bounds = {200, 300, 100, 100};
 
     s_mockJson = R"([
         {"target_hwnd":"0x1111","type":"Host1","children":[{"type":"A"}]},
@@ -553,20 +182,21 @@ TEST(PluginGraft, GraftMultipleRoots) {
 
     auto lp = make_mock_plugin();
     auto fw = make_mock_fw(&lp);
-    enrich_with_plugin(root, nullptr, 0, fw);
+    enrich_with_plugin(tree, root, nullptr, 0, fw);
 
-    ASSERT_EQ(root.children[0].children.size(), 1);
-    EXPECT_EQ(root.children[0].children[0].type, "A");
-    ASSERT_EQ(root.children[1].children.size(), 1);
-    EXPECT_EQ(root.children[1].children[0].type, "B");
+    ASSERT_EQ(tree.child_count(h1), 1);
+    EXPECT_EQ(tree[tree.first_child(h1)].type, "A");
+    ASSERT_EQ(tree.child_count(h2), 1);
+    EXPECT_EQ(tree[tree.first_child(h2)].type, "B");
 }
 
 TEST(PluginGraft, NestedChildren) {
-    Element root;
-    root.type = "Window";
-    root.framework = "win32";
-    root.properties["hwnd"] = "0x1000";
-    root.bounds = {0, 0, 800, 600};
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root].type = "Window";
+    tree[root].framework = "win32";
+    tree[root].properties.set("hwnd", "0x1000");
+    tree[root].bounds = {0, 0, 800, 600};
 
     s_mockJson = R"([{"target_hwnd":"0x1000","type":"Root","children":[
         {"type":"Parent","children":[
@@ -577,21 +207,22 @@ TEST(PluginGraft, NestedChildren) {
 
     auto lp = make_mock_plugin();
     auto fw = make_mock_fw(&lp);
-    enrich_with_plugin(root, nullptr, 0, fw);
-
-    ASSERT_EQ(root.children.size(), 1);
-    auto& parent = root.children[0];
-    EXPECT_EQ(parent.type, "Parent");
-    ASSERT_EQ(parent.children.size(), 2);
-    EXPECT_EQ(parent.children[0].text, "hello");
-    EXPECT_EQ(parent.children[1].text, "world");
+    enrich_with_plugin(tree, root, nullptr, 0, fw);
+
+    ASSERT_EQ(tree.child_count(root), 1);
+    NodeId parent = tree.first_child(root);
+    EXPECT_EQ(tree[parent].type, "Parent");
+    ASSERT_EQ(tree.child_count(parent), 2);
+    EXPECT_EQ(tree[tree.child_at(parent, 0)].text, "hello");
+    EXPECT_EQ(tree[tree.child_at(parent, 1)].text, "world");
 }
 
 TEST(PluginGraft, PropertiesCopied) {
-    Element root;
-    root.type = "Window";
-    root.properties["hwnd"] = "0x1000";
-    root.bounds = {0, 0, 100, 100};
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root].type = "Window";
+    tree[root].properties.set("hwnd", "0x1000");
+    tree[root].bounds = {0, 0, 100, 100};
 
     s_mockJson = R"([{"target_hwnd":"0x1000","type":"Root","children":[
         {"type":"Item","properties":{"visible":"true","role":"button"}}
@@ -599,51 +230,54 @@ TEST(PluginGraft, PropertiesCopied) {
 
     auto lp = make_mock_plugin();
     auto fw = make_mock_fw(&lp);
-    enrich_with_plugin(root, nullptr, 0, fw);
+    enrich_with_plugin(tree, root, nullptr, 0, fw);
 
-    ASSERT_EQ(root.children.size(), 1);
-    EXPECT_EQ(root.children[0].properties["visible"], "true");
-    EXPECT_EQ(root.children[0].properties["role"], "button");
+    ASSERT_EQ(tree.child_count(root), 1);
+    auto& item = tree[tree.first_child(root)];
+    EXPECT_EQ(item.properties.text("visible"), "true");
+    EXPECT_EQ(item.properties.text("role"), "button");
 }
 
 TEST(PluginGraft, EmptyJsonReturnsFailure) {
-    Element root;
-    root.type = "Window";
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root].type = "Window";
 
     s_mockJson = nullptr;  // enrich returns 0
 
     auto lp = make_mock_plugin();
     auto fw = make_mock_fw(&lp);
-    bool ok = enrich_with_plugin(root, nullptr, 0, fw);
+    bool ok = enrich_with_plugin(tree, root, nullptr, 0, fw);
     EXPECT_FALSE(ok);
-    EXPECT_TRUE(root.children.empty());
+    EXPECT_FALSE(tree.has_children(root));
 }
 
 TEST(PluginGraft, InvalidJsonReturnsFailure) {
-    Element root;
-    root.type = "Window";
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root].type = "Window";
 
     s_mockJson = "this is not json{{{";
 
     auto lp = make_mock_plugin();
     auto fw = make_mock_fw(&lp);
-    bool ok = enrich_with_plugin(root, nullptr, 0, fw);
+    bool ok = enrich_with_plugin(tree, root, nullptr, 0, fw);
     EXPECT_FALSE(ok);
-    EXPECT_TRUE(root.children.empty());
+    EXPECT_FALSE(tree.has_children(root));
 }
 
 TEST(PluginGraft, DeepHwndMatch) {
     // target_hwnd is on a deeply nested element
-    Element root;
-    root.type = "Window"; root.framework = "win32";
-    Element a, b, c;
-    a.type = "A"; a.framework = "win32";
-    b.type = "B"; b.framework = "win32";
-    c.type = "C"; c.framework = "win32"; c.properties["hwnd"] = "0xDEEP";
-    c.bounds = {50, 60, 200, 200};
-    b.children.push_back(c);
-    a.children.push_back(b);
-    root.children.push_back(a);
+    ElementTree tree;
+    NodeId root = tree.add_root();
+    tree[root].type = "Window"; tree[root].framework = "win32";
+    NodeId a = tree.append_child(root);
+    NodeId b = tree.append_child(a);
+    NodeId c = tree.append_child(b);
+    tree[a].type = "A"; tree[a].framework = "win32";
+    tree[b].type = "B"; tree[b].framework = "win32";
+    tree[c].type = "C"; tree[c].framework = "win32"; tree[c].properties.set("hwnd", "0xDEEP");
+    tree[c].bounds = {50, 60, 200, 200};
 
     s_mockJson = R"([{"target_hwnd":"0xDEEP","type":"DeepHost","children":[
         {"type":"Leaf","name":"found it"}
@@ -651,12 +285,11 @@ TEST(PluginGraft, DeepHwndMatch) {
 
     auto lp = make_mock_plugin();
     auto fw = make_mock_fw(&lp);
-    enrich_with_plugin(root, nullptr, 0, fw);
+    enrich_with_plugin(tree, root, nullptr, 0, fw);
 
     // Navigate to the deeply nested C element
-    auto& leaf = root.children[0].children[0].children[0];
-    EXPECT_EQ(leaf.type, "C");
-    ASSERT_EQ(leaf.children.size(), 1);
-    EXPECT_EQ(leaf.children[0].type, "Leaf");
-    EXPECT_EQ(leaf.children[0].text, "found it");
+    EXPECT_EQ(tree[c].type, "C");
+    ASSERT_EQ(tree.child_count(c), 1);
+    EXPECT_EQ(tree[tree.first_child(c)].type, "Leaf");
+    EXPECT_EQ(tree[tree.first_child(c)].text, "found it");
 }